@@ -58,6 +58,10 @@ static uint32_t calc_crc32(const uint8_t* data, size_t len) {
     return crc ^ 0xFFFFFFFF;
 }
 
+uint32_t adler32(const uint8_t* data, size_t size) {
+    return static_cast<uint32_t>(mz_adler32(MZ_ADLER32_INIT, data, size));
+}
+
 template<typename T>
 static T read_le(const uint8_t* p) {
     T val = 0;
@@ -74,13 +78,13 @@ static void write_le(uint8_t* p, T val) {
     }
 }
 
-static std::vector<uint8_t> deflate_compress(const std::vector<uint8_t>& input) {
+static std::vector<uint8_t> deflate_compress(const std::vector<uint8_t>& input, int level = 9) {
     if (input.empty()) return input;
     
     size_t out_len = 0;
-    // Use maximum compression level (MZ_BEST_COMPRESSION = 9)
+    // Use maximum compression level (MZ_BEST_COMPRESSION = 9) unless asked otherwise
     // TDEFL_WRITE_ZLIB_HEADER is NOT set - we want raw deflate for ZIP
-    int flags = tdefl_create_comp_flags_from_zip_params(9, -15, MZ_DEFAULT_STRATEGY);
+    int flags = tdefl_create_comp_flags_from_zip_params(level, -15, MZ_DEFAULT_STRATEGY);
     MzUniquePtr pComp(tdefl_compress_mem_to_heap(input.data(), input.size(), &out_len, flags));
     
     if (!pComp) {
@@ -422,4 +426,128 @@ std::vector<uint8_t> ZipWriter::finalize() {
     return output;
 }
 
+// ZipStreamWriter implementation
+
+ZipStreamWriter::Prepared ZipStreamWriter::prepare(std::string name, const uint8_t* data, size_t size,
+                                                   bool compress) {
+    Prepared entry;
+    entry.name = std::move(name);
+    entry.uncompressed_size = static_cast<uint32_t>(size);
+    entry.crc32 = calc_crc32(data, size);
+    entry.data.assign(data, data + size);
+    
+    if (compress && size > 0 && !should_store(entry.name)) {
+        // Default level: streamed exports favour throughput over the last few percent
+        std::vector<uint8_t> compressed = deflate_compress(entry.data, MZ_DEFAULT_LEVEL);
+        if (compressed.size() < size) {
+            entry.data = std::move(compressed);
+            entry.compression_method = 8;
+        }
+    }
+    return entry;
+}
+
+ZipStreamWriter::~ZipStreamWriter() {
+    abort();
+}
+
+bool ZipStreamWriter::open(const std::string& path) {
+    abort();
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return false;
+    
+    buffer_.resize(256 * 1024);
+    std::setvbuf(file_, buffer_.data(), _IOFBF, buffer_.size());
+    records_.clear();
+    offset_ = 0;
+    failed_ = false;
+    return true;
+}
+
+void ZipStreamWriter::put(const void* data, size_t size) {
+    if (failed_ || size == 0) return;
+    if (std::fwrite(data, 1, size, file_) != size) failed_ = true;
+    offset_ += size;
+}
+
+bool ZipStreamWriter::write(const Prepared& entry) {
+    if (!file_ || failed_) return false;
+    // Without ZIP64 records, offsets and the entry count must fit the classic fields
+    if (offset_ > 0xFFFFFFFFu || records_.size() >= 0xFFFF) {
+        failed_ = true;
+        return false;
+    }
+    
+    Record record;
+    record.name = entry.name;
+    record.crc32 = entry.crc32;
+    record.compressed_size = static_cast<uint32_t>(entry.data.size());
+    record.uncompressed_size = entry.uncompressed_size;
+    record.compression_method = entry.compression_method;
+    record.local_header_offset = static_cast<uint32_t>(offset_);
+    
+    uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+    write_le<uint32_t>(&header[0], ZIP_LOCAL_FILE_HEADER_SIG);
+    write_le<uint16_t>(&header[4], 20);
+    write_le<uint16_t>(&header[6], 0);
+    write_le<uint16_t>(&header[8], record.compression_method);
+    write_le<uint16_t>(&header[10], 0);
+    write_le<uint16_t>(&header[12], 0);
+    write_le<uint32_t>(&header[14], record.crc32);
+    write_le<uint32_t>(&header[18], record.compressed_size);
+    write_le<uint32_t>(&header[22], record.uncompressed_size);
+    write_le<uint16_t>(&header[26], static_cast<uint16_t>(record.name.size()));
+    write_le<uint16_t>(&header[28], 0);
+    
+    put(header, sizeof(header));
+    put(record.name.data(), record.name.size());
+    put(entry.data.data(), entry.data.size());
+    records_.push_back(std::move(record));
+    return !failed_;
+}
+
+bool ZipStreamWriter::finish() {
+    if (!file_) return false;
+    
+    uint64_t central_dir_offset = offset_;
+    for (const auto& record : records_) {
+        uint8_t cd_entry[ZIP_CENTRAL_DIR_ENTRY_SIZE] = {};
+        write_le<uint32_t>(&cd_entry[0], ZIP_CENTRAL_DIR_SIG);
+        write_le<uint16_t>(&cd_entry[4], 20);
+        write_le<uint16_t>(&cd_entry[6], 20);
+        write_le<uint16_t>(&cd_entry[10], record.compression_method);
+        write_le<uint32_t>(&cd_entry[16], record.crc32);
+        write_le<uint32_t>(&cd_entry[20], record.compressed_size);
+        write_le<uint32_t>(&cd_entry[24], record.uncompressed_size);
+        write_le<uint16_t>(&cd_entry[28], static_cast<uint16_t>(record.name.size()));
+        write_le<uint32_t>(&cd_entry[42], record.local_header_offset);
+        put(cd_entry, sizeof(cd_entry));
+        put(record.name.data(), record.name.size());
+    }
+    
+    uint64_t central_dir_size = offset_ - central_dir_offset;
+    if (offset_ > 0xFFFFFFFFu) failed_ = true;
+    
+    uint8_t eocd[ZIP_EOCD_SIZE] = {};
+    write_le<uint32_t>(&eocd[0], ZIP_END_CENTRAL_DIR_SIG);
+    write_le<uint16_t>(&eocd[8], static_cast<uint16_t>(records_.size()));
+    write_le<uint16_t>(&eocd[10], static_cast<uint16_t>(records_.size()));
+    write_le<uint32_t>(&eocd[12], static_cast<uint32_t>(central_dir_size));
+    write_le<uint32_t>(&eocd[16], static_cast<uint32_t>(central_dir_offset));
+    put(eocd, sizeof(eocd));
+    
+    bool ok = !failed_ && std::fclose(file_) == 0;
+    file_ = nullptr;
+    records_.clear();
+    return ok;
+}
+
+void ZipStreamWriter::abort() {
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+    records_.clear();
+}
+
 } // namespace apk
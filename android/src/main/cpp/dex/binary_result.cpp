@@ -0,0 +1,82 @@
+#include "dex/binary_result.h"
+#include <cstring>
+
+namespace dex {
+
+template<typename T>
+static uint8_t* write_le(uint8_t* p, T val) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        p[i] = static_cast<uint8_t>(static_cast<uint64_t>(val) >> (i * 8));
+    }
+    return p + sizeof(T);
+}
+
+BinaryResult::BinaryResult(std::initializer_list<std::pair<const char*, Column>> columns) {
+    for (const auto& column : columns) {
+        columns_.push_back({intern(column.first), column.second});
+    }
+}
+
+uint32_t BinaryResult::intern(std::string_view str) {
+    auto it = string_index_.find(str);
+    if (it != string_index_.end()) return it->second;
+
+    uint32_t idx = static_cast<uint32_t>(strings_.size());
+    strings_.push_back(str);
+    string_index_.emplace(str, idx);
+    return idx;
+}
+
+uint32_t BinaryResult::intern_copy(std::string str) {
+    auto it = string_index_.find(str);
+    if (it != string_index_.end()) return it->second;
+
+    owned_.push_back(std::move(str));
+    return intern(owned_.back());
+}
+
+void BinaryResult::add_meta(const char* name, int64_t value) {
+    meta_.push_back({intern(name), value});
+}
+
+size_t BinaryResult::serialized_size() const {
+    size_t size = 4 + 4;
+    for (std::string_view str : strings_) {
+        size += 4 + str.size();
+    }
+    size += 4 + meta_.size() * 12;
+    size += 4 + columns_.size() * 5;
+    size += 4 + row_count() * columns_.size() * 4;
+    return size;
+}
+
+void BinaryResult::serialize(uint8_t* out) const {
+    uint8_t* p = write_le<uint32_t>(out, kMagic);
+
+    p = write_le<uint32_t>(p, static_cast<uint32_t>(strings_.size()));
+    for (std::string_view str : strings_) {
+        p = write_le<uint32_t>(p, static_cast<uint32_t>(str.size()));
+        std::memcpy(p, str.data(), str.size());
+        p += str.size();
+    }
+
+    p = write_le<uint32_t>(p, static_cast<uint32_t>(meta_.size()));
+    for (const auto& entry : meta_) {
+        p = write_le<uint32_t>(p, entry.first);
+        p = write_le<int64_t>(p, entry.second);
+    }
+
+    p = write_le<uint32_t>(p, static_cast<uint32_t>(columns_.size()));
+    for (const auto& column : columns_) {
+        p = write_le<uint32_t>(p, column.first);
+        p = write_le<uint8_t>(p, static_cast<uint8_t>(column.second));
+    }
+
+    size_t rows = row_count();
+    p = write_le<uint32_t>(p, static_cast<uint32_t>(rows));
+    for (size_t i = 0; i < rows * columns_.size(); i++) {
+        p = write_le<uint32_t>(p, cells_[i]);
+    }
+}
+
+} // namespace dex
@@ -1,8 +1,15 @@
 #include "dex/dex_builder.h"
+#include "dex/insn_iterator.h"
+#include "dex/string_table.h"
+#include "dex/thread_pool.h"
+#include "apk/zip_utils.h"
 #include <fstream>
 #include <algorithm>
 #include <cstring>
+#include <numeric>
 #include <sstream>
+#include <tuple>
+#include <unordered_set>
 
 namespace dex {
 
@@ -13,6 +20,13 @@ static void write_le(std::vector<uint8_t>& out, T val) {
     }
 }
 
+template<typename T>
+static void write_le(uint8_t* p, T val) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        p[i] = static_cast<uint8_t>(val >> (i * 8));
+    }
+}
+
 template<typename T>
 static T read_le(const uint8_t* p) {
     T val = 0;
@@ -22,7 +36,712 @@ static T read_le(const uint8_t* p) {
     return val;
 }
 
+static bool read_uleb128(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= end) return false;
+        uint8_t b = *p++;
+        value |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static bool read_sleb128(const uint8_t*& p, const uint8_t* end, int32_t& value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= end) return false;
+        uint8_t b = *p++;
+        result |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            if (shift + 7 < 32 && (b & 0x40)) result |= ~0u << (shift + 7);
+            value = static_cast<int32_t>(result);
+            return true;
+        }
+    }
+    return false;
+}
+
+// utf16_size of a string_data_item: MUTF-8 bytes that start a code point, surrogate pairs counting twice
+static uint32_t utf16_length(const std::string& s) {
+    uint32_t length = 0;
+    for (unsigned char c : s) {
+        if ((c & 0xC0) != 0x80) length++;
+        if (c >= 0xF0) length++;
+    }
+    return length;
+}
+
+static bool skip_encoded_annotation(const uint8_t*& p, const uint8_t* end, int depth = 0);
+
+// Step over one encoded_value; false if it is malformed or runs past `end`
+static bool skip_encoded_value(const uint8_t*& p, const uint8_t* end, int depth = 0) {
+    if (p >= end || depth > 64) return false;
+    uint8_t type = *p & 0x1F;
+    uint8_t arg = *p++ >> 5;
+    switch (type) {
+        case 0x1C: {  // VALUE_ARRAY
+            uint32_t count;
+            if (!read_uleb128(p, end, count)) return false;
+            for (uint32_t i = 0; i < count; i++) {
+                if (!skip_encoded_value(p, end, depth + 1)) return false;
+            }
+            return true;
+        }
+        case 0x1D:  // VALUE_ANNOTATION
+            return skip_encoded_annotation(p, end, depth + 1);
+        case 0x1E:  // VALUE_NULL
+        case 0x1F:  // VALUE_BOOLEAN
+            return true;
+        default:
+            if (static_cast<size_t>(end - p) < arg + 1u) return false;
+            p += arg + 1;
+            return true;
+    }
+}
+
+static bool skip_encoded_annotation(const uint8_t*& p, const uint8_t* end, int depth) {
+    uint32_t type_idx, count;
+    if (!read_uleb128(p, end, type_idx) || !read_uleb128(p, end, count)) return false;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t name_idx;
+        if (!read_uleb128(p, end, name_idx) || !skip_encoded_value(p, end, depth)) return false;
+    }
+    return true;
+}
+
+static void put_uleb128(std::vector<uint8_t>& out, uint32_t value) {
+    do {
+        uint8_t b = value & 0x7F;
+        value >>= 7;
+        if (value != 0) b |= 0x80;
+        out.push_back(b);
+    } while (value != 0);
+}
+
+static void put_sleb128(std::vector<uint8_t>& out, int32_t value) {
+    bool more = true;
+    while (more) {
+        uint8_t b = value & 0x7F;
+        value >>= 7;
+        more = !((value == 0 && !(b & 0x40)) || (value == -1 && (b & 0x40)));
+        if (more) b |= 0x80;
+        out.push_back(b);
+    }
+}
+
+// Old-to-new pool indexes, for moving classes between builders or reordering the pools
+struct PoolRemap {
+    std::vector<uint32_t> strings;
+    std::vector<uint32_t> types;
+    std::vector<uint32_t> protos;
+    std::vector<uint32_t> fields;
+    std::vector<uint32_t> methods;
+};
+
+static bool remap_lookup(const std::vector<uint32_t>& table, uint32_t& idx) {
+    if (idx >= table.size()) return false;
+    idx = table[idx];
+    return true;
+}
+
+static bool remap_encoded_annotation(const uint8_t*& p, const uint8_t* end, const PoolRemap& map,
+                                     std::vector<uint8_t>& out, int depth = 0);
+
+// Copy one encoded_value with its pool indexes remapped; false if it is malformed or an index is unknown
+static bool remap_encoded_value(const uint8_t*& p, const uint8_t* end, const PoolRemap& map,
+                                std::vector<uint8_t>& out, int depth = 0) {
+    if (p >= end || depth > 64) return false;
+    uint8_t header = *p++;
+    uint8_t type = header & 0x1F;
+    uint8_t arg = header >> 5;
+    const std::vector<uint32_t>* table = nullptr;
+    switch (type) {
+        case 0x1C: {  // VALUE_ARRAY
+            uint32_t count;
+            if (!read_uleb128(p, end, count)) return false;
+            out.push_back(header);
+            put_uleb128(out, count);
+            for (uint32_t i = 0; i < count; i++) {
+                if (!remap_encoded_value(p, end, map, out, depth + 1)) return false;
+            }
+            return true;
+        }
+        case 0x1D:  // VALUE_ANNOTATION
+            out.push_back(header);
+            return remap_encoded_annotation(p, end, map, out, depth + 1);
+        case 0x1E:  // VALUE_NULL
+        case 0x1F:  // VALUE_BOOLEAN
+            out.push_back(header);
+            return true;
+        case 0x15: table = &map.protos; break;   // VALUE_METHOD_TYPE
+        case 0x17: table = &map.strings; break;  // VALUE_STRING
+        case 0x18: table = &map.types; break;    // VALUE_TYPE
+        case 0x19:                               // VALUE_FIELD
+        case 0x1B: table = &map.fields; break;   // VALUE_ENUM
+        case 0x1A: table = &map.methods; break;  // VALUE_METHOD
+        default: break;
+    }
+    if (static_cast<size_t>(end - p) < arg + 1u) return false;
+    if (!table) {
+        out.push_back(header);
+        out.insert(out.end(), p, p + arg + 1);
+        p += arg + 1;
+        return true;
+    }
+    if (arg > 3) return false;
+    uint32_t idx = 0;
+    for (uint32_t i = 0; i <= arg; i++) idx |= static_cast<uint32_t>(p[i]) << (i * 8);
+    p += arg + 1;
+    if (!remap_lookup(*table, idx)) return false;
+
+    // Indexes are zero-extended, so the new one may need a different width
+    uint32_t size = idx > 0xFFFFFF ? 4 : idx > 0xFFFF ? 3 : idx > 0xFF ? 2 : 1;
+    out.push_back(static_cast<uint8_t>(((size - 1) << 5) | type));
+    for (uint32_t i = 0; i < size; i++) out.push_back(static_cast<uint8_t>(idx >> (i * 8)));
+    return true;
+}
+
+// encoded_annotation after its header; elements are re-sorted by their new name indexes
+static bool remap_encoded_annotation(const uint8_t*& p, const uint8_t* end, const PoolRemap& map,
+                                     std::vector<uint8_t>& out, int depth) {
+    uint32_t type_idx, count;
+    if (!read_uleb128(p, end, type_idx) || !read_uleb128(p, end, count) || !remap_lookup(map.types, type_idx)) {
+        return false;
+    }
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> elements(count);
+    for (auto& element : elements) {
+        if (!read_uleb128(p, end, element.first) || !remap_lookup(map.strings, element.first) ||
+            !remap_encoded_value(p, end, map, element.second, depth)) {
+            return false;
+        }
+    }
+    std::stable_sort(elements.begin(), elements.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    put_uleb128(out, type_idx);
+    put_uleb128(out, count);
+    for (const auto& element : elements) {
+        put_uleb128(out, element.first);
+        out.insert(out.end(), element.second.begin(), element.second.end());
+    }
+    return true;
+}
+
+static bool remap_annotations(std::vector<AnnotationDef>& annotations, const PoolRemap& map) {
+    for (auto& annotation : annotations) {
+        std::vector<uint8_t> encoded;
+        const uint8_t* p = annotation.encoded.data();
+        if (!remap_lookup(map.types, annotation.type_idx) ||
+            !remap_encoded_annotation(p, p + annotation.encoded.size(), map, encoded)) {
+            return false;
+        }
+        annotation.encoded = std::move(encoded);
+    }
+    return true;
+}
+
+// Pool an instruction's index operand refers to; none for call sites and method handles
+static const std::vector<uint32_t>* operand_pool(uint8_t op, const PoolRemap& map) {
+    if (op == 0x1A || op == 0x1B) return &map.strings;
+    if (op == 0x1C || op == 0x1F || op == 0x20 || (op >= 0x22 && op <= 0x25)) return &map.types;
+    if (op >= 0x52 && op <= 0x6D) return &map.fields;
+    if ((op >= 0x6E && op <= 0x72) || (op >= 0x74 && op <= 0x78) || op == 0xFA || op == 0xFB) return &map.methods;
+    if (op == 0xFF) return &map.protos;
+    return nullptr;
+}
+
+using WideRefs = std::vector<std::pair<uint32_t, uint32_t>>;
+
+// Remap the pool indexes in `code`; operands listed in `wide_refs` take their index from there. A 16-bit
+// operand whose new index does not fit goes back into `wide_refs` until the ids are `final`. After that
+// a const-string is listed in `jumbo` as (pc, index) for widen_code, and any other operand is an error.
+static bool remap_code(std::vector<uint8_t>& code, WideRefs& wide_refs, const PoolRemap& map, bool final,
+                       WideRefs& jumbo, std::string& error) {
+    std::unordered_map<uint32_t, uint32_t> pending(wide_refs.begin(), wide_refs.end());
+    wide_refs.clear();
+    auto remap_operand = [&](const Insn& insn, uint32_t pos, const std::vector<uint32_t>& pool) {
+        auto it = pending.find(pos);
+        uint32_t idx = it != pending.end() ? it->second : read_le<uint16_t>(&code[pos]);
+        if (!remap_lookup(pool, idx)) {
+            error = "Unknown pool index in " + std::string(insn.info().name);
+            return false;
+        }
+        write_le<uint16_t>(&code[pos], static_cast<uint16_t>(idx <= 0xFFFF ? idx : 0));
+        if (idx <= 0xFFFF) return true;
+        if (!final) {
+            wide_refs.push_back({pos, idx});
+        } else if (insn.opcode == 0x1A) {
+            jumbo.push_back({insn.pc, idx});
+        } else {
+            error = std::string(insn.info().name) + " index " + std::to_string(idx) + " does not fit 16 bits";
+            return false;
+        }
+        return true;
+    };
+    
+    InsnIterator it(code.data(), static_cast<uint32_t>(code.size() / 2));
+    Insn insn;
+    while (it.next(insn)) {
+        const std::vector<uint32_t>* pool = insn.payload == PayloadKind::kNone ? operand_pool(insn.opcode, map)
+                                                                                 : nullptr;
+        if (!pool) continue;
+        uint32_t pos = insn.pc * 2 + 2;
+        OpcodeFormat format = insn.info().format;
+        if (format == OpcodeFormat::k31c) {
+            uint32_t idx = read_le<uint32_t>(&code[pos]);
+            if (!remap_lookup(*pool, idx)) {
+                error = "Unknown pool index in " + std::string(insn.info().name);
+                return false;
+            }
+            write_le<uint32_t>(&code[pos], idx);
+            continue;
+        }
+        if (!remap_operand(insn, pos, *pool)) return false;
+        if ((format == OpcodeFormat::k45cc || format == OpcodeFormat::k4rcc) &&
+            !remap_operand(insn, pos + 4, map.protos)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rewrite `code` with the const-string at each pc of `jumbo` widened to const-string/jumbo with the
+// given index. Later instructions move down: branch and switch offsets follow their targets, gotos grow
+// into goto/16 or goto/32 when they have to, and a payload that would lose its 4-byte alignment gets a
+// nop in front. `pc_map` receives the new pc of every old one, and of the end.
+static bool widen_code(std::vector<uint8_t>& code, const WideRefs& jumbo, std::vector<uint32_t>& pc_map,
+                       std::string& error) {
+    constexpr uint32_t kNone = 0xFFFFFFFF;
+    struct Slot {
+        Insn insn;
+        OpcodeFormat format;
+        uint32_t size;            // in code units once widened
+        uint32_t new_pc = 0;
+        bool pad = false;         // nop in front of a payload
+        uint32_t target = kNone;  // old pc a branch, switch or fill-array-data refers to
+        uint32_t owner = kNone;   // slot of the switch using a switch payload
+        uint32_t string_idx = kNone;
+    };
+    uint32_t units = static_cast<uint32_t>(code.size() / 2);
+    std::vector<Slot> slots;
+    std::vector<uint32_t> slot_at(units, kNone);
+    InsnIterator it(code.data(), units);
+    Insn insn;
+    uint32_t decoded = 0;
+    while (it.next(insn)) {
+        slot_at[insn.pc] = static_cast<uint32_t>(slots.size());
+        OpcodeFormat format = insn.payload == PayloadKind::kNone ? insn.info().format : OpcodeFormat::kUnknown;
+        slots.push_back({insn, format, insn.size});
+        decoded = insn.pc + insn.size;
+    }
+    if (decoded != units) {
+        error = "Cannot decode the instructions at " + std::to_string(decoded);
+        return false;
+    }
+    auto valid = [&](int64_t pc) { return pc >= 0 && pc < units && slot_at[pc] != kNone; };
+    
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        Slot& slot = slots[i];
+        const uint8_t* p = slot.insn.code;
+        int32_t offset;
+        switch (slot.format) {
+            case OpcodeFormat::k10t: offset = static_cast<int8_t>(p[1]); break;
+            case OpcodeFormat::k20t:
+            case OpcodeFormat::k21t:
+            case OpcodeFormat::k22t: offset = static_cast<int16_t>(read_le<uint16_t>(p + 2)); break;
+            case OpcodeFormat::k30t:
+            case OpcodeFormat::k31t: offset = static_cast<int32_t>(read_le<uint32_t>(p + 2)); break;
+            default: continue;
+        }
+        int64_t target = int64_t(slot.insn.pc) + offset;
+        if (!valid(target)) {
+            error = std::string(slot.insn.info().name) + " at " + std::to_string(slot.insn.pc) +
+                    " targets no instruction";
+            return false;
+        }
+        slot.target = static_cast<uint32_t>(target);
+        if (slot.insn.opcode != 0x2B && slot.insn.opcode != 0x2C) continue;  // packed-switch, sparse-switch
+        Slot& payload = slots[slot_at[target]];
+        if (payload.owner != kNone) {
+            error = "Switch payload at " + std::to_string(target) + " is shared";
+            return false;
+        }
+        payload.owner = i;
+    }
+    for (const auto& ref : jumbo) {
+        Slot& slot = slots[slot_at[ref.first]];
+        slot.size = 3;
+        slot.string_idx = ref.second;
+    }
+    
+    // Gotos only grow, so the layout settles
+    auto fits = [](int64_t value, int bits) {
+        return value >= -(int64_t(1) << (bits - 1)) && value < (int64_t(1) << (bits - 1));
+    };
+    auto new_pc = [&](uint32_t old_pc) { return slots[slot_at[old_pc]].new_pc; };
+    uint32_t end = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        end = 0;
+        for (Slot& slot : slots) {
+            slot.pad = slot.insn.payload != PayloadKind::kNone && end % 2 != 0;
+            end += slot.pad;
+            slot.new_pc = end;
+            end += slot.size;
+        }
+        for (Slot& slot : slots) {
+            if (slot.format != OpcodeFormat::k10t && slot.format != OpcodeFormat::k20t) continue;
+            int64_t offset = int64_t(new_pc(slot.target)) - slot.new_pc;
+            uint32_t size = offset != 0 && fits(offset, 8) ? 1 : offset != 0 && fits(offset, 16) ? 2 : 3;
+            if (size > slot.size) {
+                slot.size = size;
+                changed = true;
+            }
+        }
+    }
+    
+    std::vector<uint8_t> out;
+    out.reserve(static_cast<size_t>(end) * 2);
+    for (const Slot& slot : slots) {
+        if (slot.pad) out.insert(out.end(), {0x00, 0x00});  // nop
+        const uint8_t* p = slot.insn.code;
+        size_t at = out.size();
+        int32_t offset = slot.target == kNone ? 0 : static_cast<int32_t>(int64_t(new_pc(slot.target)) - slot.new_pc);
+        if (slot.string_idx != kNone) {
+            out.insert(out.end(), {0x1B, p[1]});  // const-string/jumbo vAA
+            write_le<uint32_t>(out, slot.string_idx);
+            continue;
+        }
+        switch (slot.format) {
+            case OpcodeFormat::k10t:
+            case OpcodeFormat::k20t:
+            case OpcodeFormat::k30t:
+                if (slot.size == 1) {
+                    out.insert(out.end(), {0x28, static_cast<uint8_t>(offset)});
+                } else if (slot.size == 2) {
+                    out.insert(out.end(), {0x29, 0x00});
+                    write_le<int16_t>(out, static_cast<int16_t>(offset));
+                } else {
+                    out.insert(out.end(), {0x2A, 0x00});
+                    write_le<int32_t>(out, offset);
+                }
+                continue;
+            default:
+                break;
+        }
+        out.insert(out.end(), p, p + slot.insn.size * 2);
+        if (slot.format == OpcodeFormat::k21t || slot.format == OpcodeFormat::k22t) {
+            if (!fits(offset, 16)) {
+                error = std::string(slot.insn.info().name) + " at " + std::to_string(slot.insn.pc) +
+                        " no longer reaches its target";
+                return false;
+            }
+            write_le<int16_t>(&out[at + 2], static_cast<int16_t>(offset));
+        } else if (slot.format == OpcodeFormat::k31t) {
+            write_le<int32_t>(&out[at + 2], offset);
+        } else if (slot.owner != kNone) {
+            // Switch targets are relative to the switch instruction
+            const Slot& owner = slots[slot.owner];
+            uint32_t count = read_le<uint16_t>(p + 2);
+            size_t targets = at + (slot.insn.payload == PayloadKind::kPackedSwitch ? 8 : 4 + count * 4);
+            for (uint32_t i = 0; i < count; i++) {
+                uint8_t* entry = &out[targets + i * 4];
+                int64_t target = int64_t(owner.insn.pc) + static_cast<int32_t>(read_le<uint32_t>(entry));
+                if (!valid(target)) {
+                    error = "Switch at " + std::to_string(owner.insn.pc) + " targets no instruction";
+                    return false;
+                }
+                write_le<int32_t>(entry, static_cast<int32_t>(int64_t(new_pc(target)) - owner.new_pc));
+            }
+        }
+    }
+    
+    pc_map.assign(units + 1, end);
+    for (const Slot& slot : slots) {
+        for (uint32_t u = 0; u < slot.insn.size; u++) {
+            pc_map[slot.insn.pc + u] = slot.new_pc + std::min(u, slot.size - 1);
+        }
+    }
+    code = std::move(out);
+    return true;
+}
+
+// New pc of an old address, from widen_code; addresses past the end map to the new end
+static uint32_t moved_pc(const std::vector<uint32_t>& pc_map, uint64_t addr) {
+    return pc_map[std::min<uint64_t>(addr, pc_map.size() - 1)];
+}
+
+// Remap the code of a method and its catch types and debug indexes; `final` as for remap_code
+static bool remap_method(MethodDef& method, const PoolRemap& map, bool final, std::string& error) {
+    WideRefs jumbo;
+    if (!remap_code(method.code, method.wide_refs, map, final, jumbo, error)) return false;
+    for (auto& block : method.tries) {
+        for (auto& handler : block.handlers) {
+            if (handler.type_idx != CatchHandler::kCatchAll && !remap_lookup(map.types, handler.type_idx)) {
+                error = "unknown catch type";
+                return false;
+            }
+        }
+    }
+    // Debug indexes are optional, so kNoIndex passes through
+    auto remap_optional = [](const std::vector<uint32_t>& table, uint32_t& idx) {
+        return idx == DebugEvent::kNoIndex || remap_lookup(table, idx);
+    };
+    bool debug_ok = true;
+    for (auto& name : method.debug_info.parameter_names) debug_ok &= remap_optional(map.strings, name);
+    for (auto& event : method.debug_info.events) {
+        debug_ok &= remap_optional(map.strings, event.name_idx) && remap_optional(map.types, event.type_idx) &&
+                    remap_optional(map.strings, event.signature_idx);
+    }
+    if (!debug_ok) {
+        error = "unknown index in debug info";
+        return false;
+    }
+    if (jumbo.empty()) return true;
+    
+    std::vector<uint32_t> pc_map;
+    if (!widen_code(method.code, jumbo, pc_map, error)) return false;
+    for (auto& block : method.tries) {
+        block.start_addr = moved_pc(pc_map, block.start_addr);
+        block.end_addr = moved_pc(pc_map, block.end_addr);
+        if (block.end_addr - block.start_addr > 0xFFFF) {
+            error = "try block no longer fits 16 bits";
+            return false;
+        }
+        for (auto& handler : block.handlers) handler.addr = moved_pc(pc_map, handler.addr);
+    }
+    for (auto& event : method.debug_info.events) event.addr = moved_pc(pc_map, event.addr);
+    return true;
+}
+
+// Remap every pool index a class holds outside its names, which are resolved at build time; `final`
+// as for remap_code
+static bool remap_class(ClassBuilder& cls, const PoolRemap& map, bool final, std::string& error) {
+    error.clear();
+    if (!remap_annotations(cls.annotations, map)) {
+        error = "Malformed annotation";
+        return false;
+    }
+    for (auto* fields : {&cls.static_fields, &cls.instance_fields}) {
+        for (auto& field : *fields) {
+            if (!remap_annotations(field.annotations, map)) {
+                error = "Malformed annotation on field " + field.name;
+                return false;
+            }
+            if (field.initial_value.empty()) continue;
+            std::vector<uint8_t> value;
+            const uint8_t* p = field.initial_value.data();
+            if (!remap_encoded_value(p, p + field.initial_value.size(), map, value)) {
+                error = "Malformed initial value of field " + field.name;
+                return false;
+            }
+            field.initial_value = std::move(value);
+        }
+    }
+    for (auto* methods : {&cls.direct_methods, &cls.virtual_methods}) {
+        for (auto& method : *methods) {
+            bool annotations_ok = remap_annotations(method.annotations, map);
+            for (auto& parameter : method.parameter_annotations) {
+                annotations_ok = annotations_ok && remap_annotations(parameter, map);
+            }
+            if (!annotations_ok) {
+                error = "Malformed annotation on method " + method.name;
+                return false;
+            }
+            if (method.code.empty()) continue;
+            if (!remap_method(method, map, final, error)) {
+                error = method.name + ": " + error;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Base DEX code_item with remapped instructions and catch types. Catch types are ULEB128 and may change
+// length, so the handler offsets of the try_items are recomputed. When a const-string had to be widened,
+// `pc_map` receives the moved addresses, which the try_items and handlers follow.
+static bool remap_code_item(const uint8_t* p, const uint8_t* end, const PoolRemap& map, std::vector<uint8_t>& out,
+                            std::vector<uint32_t>& pc_map, std::string& error) {
+    pc_map.clear();
+    if (end - p < 16) return false;
+    uint16_t tries_size = read_le<uint16_t>(p + 6);
+    uint32_t insns_size = read_le<uint32_t>(p + 12);
+    size_t insns_bytes = static_cast<size_t>(insns_size) * 2;
+    if (static_cast<size_t>(end - p) < 16 + insns_bytes) return false;
+    std::vector<uint8_t> insns(p + 16, p + 16 + insns_bytes);
+    WideRefs no_refs, jumbo;
+    if (!remap_code(insns, no_refs, map, true, jumbo, error)) return false;
+    if (!jumbo.empty() && !widen_code(insns, jumbo, pc_map, error)) return false;
+    auto moved = [&](uint64_t addr) { return pc_map.empty() ? static_cast<uint32_t>(addr) : moved_pc(pc_map, addr); };
+    
+    size_t header = out.size();
+    out.insert(out.end(), p, p + 16);
+    write_le<uint32_t>(&out[header + 12], static_cast<uint32_t>(insns.size() / 2));
+    out.insert(out.end(), insns.begin(), insns.end());
+    p += 16 + insns_bytes;
+    if (tries_size == 0) return true;
+    
+    size_t padding = (insns_size % 2) * 2;  // try_items are 4-aligned
+    if (static_cast<size_t>(end - p) < padding + tries_size * 8ull) return false;
+    p += padding;
+    if (insns.size() % 4 != 0) out.insert(out.end(), {0x00, 0x00});
+    size_t tries_pos = out.size();
+    out.insert(out.end(), p, p + tries_size * 8);
+    p += tries_size * 8;
+    for (uint32_t i = 0; i < tries_size && !pc_map.empty(); i++) {
+        uint8_t* item = &out[tries_pos + i * 8];
+        uint32_t start = read_le<uint32_t>(item);
+        uint32_t new_start = moved(start);
+        uint32_t new_end = moved(uint64_t(start) + read_le<uint16_t>(item + 4));
+        if (new_end - new_start > 0xFFFF) {
+            error = "try block no longer fits 16 bits";
+            return false;
+        }
+        write_le<uint32_t>(item, new_start);
+        write_le<uint16_t>(item + 4, static_cast<uint16_t>(new_end - new_start));
+    }
+    
+    const uint8_t* list = p;
+    size_t list_pos = out.size();
+    std::unordered_map<uint32_t, uint32_t> handler_offs;  // old -> new, from the start of the list
+    uint32_t handlers;
+    if (!read_uleb128(p, end, handlers)) return false;
+    put_uleb128(out, handlers);
+    for (uint32_t i = 0; i < handlers; i++) {
+        handler_offs[static_cast<uint32_t>(p - list)] = static_cast<uint32_t>(out.size() - list_pos);
+        int32_t size;
+        if (!read_sleb128(p, end, size)) return false;
+        put_sleb128(out, size);
+        uint32_t pairs = size < 0 ? 0u - static_cast<uint32_t>(size) : static_cast<uint32_t>(size);
+        for (uint32_t j = 0; j < pairs; j++) {
+            uint32_t type_idx, addr;
+            if (!read_uleb128(p, end, type_idx) || !read_uleb128(p, end, addr) ||
+                !remap_lookup(map.types, type_idx)) {
+                return false;
+            }
+            put_uleb128(out, type_idx);
+            put_uleb128(out, moved(addr));
+        }
+        if (size <= 0) {
+            uint32_t catch_all_addr;
+            if (!read_uleb128(p, end, catch_all_addr)) return false;
+            put_uleb128(out, moved(catch_all_addr));
+        }
+    }
+    for (uint32_t i = 0; i < tries_size; i++) {
+        uint8_t* handler_off = &out[tries_pos + i * 8 + 6];
+        auto it = handler_offs.find(read_le<uint16_t>(handler_off));
+        if (it == handler_offs.end() || it->second > 0xFFFF) return false;
+        write_le<uint16_t>(handler_off, static_cast<uint16_t>(it->second));
+    }
+    return true;
+}
+
+// Base DEX debug_info_item with remapped names, types and signatures. With a `pc_map` from widen_code,
+// addresses move to the new pcs of the code they describe.
+static bool remap_debug_info(const uint8_t* p, const uint8_t* end, const PoolRemap& map, std::vector<uint8_t>& out,
+                             const std::vector<uint32_t>* pc_map = nullptr) {
+    uint32_t value;
+    auto copy_leb = [&]() {  // an SLEB128 has the same length as when read as ULEB128
+        const uint8_t* start = p;
+        if (!read_uleb128(p, end, value)) return false;
+        out.insert(out.end(), start, p);
+        return true;
+    };
+    auto optional_index = [&](const std::vector<uint32_t>& table) {  // uleb128p1, 0 for none
+        if (!read_uleb128(p, end, value)) return false;
+        uint32_t idx = value - 1;
+        if (value != 0 && !remap_lookup(table, idx)) return false;
+        put_uleb128(out, value == 0 ? 0 : idx + 1);
+        return true;
+    };
+    uint32_t parameters;
+    if (!copy_leb() || !read_uleb128(p, end, parameters)) return false;
+    put_uleb128(out, parameters);
+    for (uint32_t i = 0; i < parameters; i++) {
+        if (!optional_index(map.strings)) return false;
+    }
+    // Address advances are re-encoded from the old address the events are at
+    uint32_t old_addr = 0, new_addr = 0;
+    auto advance = [&](uint32_t& diff) {
+        uint32_t target = moved_pc(*pc_map, old_addr);
+        diff = target > new_addr ? target - new_addr : 0;
+        new_addr += diff;
+    };
+    while (p < end) {
+        uint8_t op = *p++;
+        if (pc_map && op == 0x01) {  // DBG_ADVANCE_PC
+            if (!read_uleb128(p, end, value)) return false;
+            old_addr += value;
+            continue;
+        }
+        if (pc_map && op >= 0x03) {
+            // Events happen at the current address; a special opcode carries its own advance while
+            // that still fits in the byte
+            bool special = op >= 0x0A;
+            uint32_t line_part = special ? (op - 0x0A) % 15 : 0;
+            if (special) old_addr += (op - 0x0A) / 15;
+            uint32_t diff;
+            advance(diff);
+            if (diff != 0 && (!special || 0x0A + line_part + uint64_t(diff) * 15 > 0xFF)) {
+                out.push_back(0x01);  // DBG_ADVANCE_PC
+                put_uleb128(out, diff);
+                diff = 0;
+            }
+            if (special) op = static_cast<uint8_t>(0x0A + line_part + diff * 15);
+        }
+        out.push_back(op);
+        bool ok = true;
+        switch (op) {
+            case 0x00: return true;  // DBG_END_SEQUENCE
+            case 0x01:               // DBG_ADVANCE_PC
+            case 0x02:               // DBG_ADVANCE_LINE
+            case 0x05:               // DBG_END_LOCAL
+            case 0x06:               // DBG_RESTART_LOCAL
+                ok = copy_leb();
+                break;
+            case 0x03:  // DBG_START_LOCAL
+                ok = copy_leb() && optional_index(map.strings) && optional_index(map.types);
+                break;
+            case 0x04:  // DBG_START_LOCAL_EXTENDED
+                ok = copy_leb() && optional_index(map.strings) && optional_index(map.types) &&
+                     optional_index(map.strings);
+                break;
+            case 0x09:  // DBG_SET_FILE
+                ok = optional_index(map.strings);
+                break;
+            default:
+                break;
+        }
+        if (!ok) return false;
+    }
+    return false;
+}
+
 // Prototype implementation
+bool Prototype::parse(const std::string& descriptor, Prototype& proto) {
+    size_t paren_end = descriptor.find(')');
+    if (descriptor.empty() || descriptor[0] != '(' || paren_end == std::string::npos) return false;
+    
+    Prototype parsed(descriptor.substr(paren_end + 1));
+    size_t i = 1;
+    while (i < paren_end) {
+        size_t start = i;
+        while (i < paren_end && descriptor[i] == '[') i++;
+        if (i >= paren_end) return false;
+        if (descriptor[i] == 'L') {
+            size_t end = descriptor.find(';', i);
+            if (end == std::string::npos || end > paren_end) return false;
+            i = end;
+        }
+        parsed.param_types.push_back(descriptor.substr(start, i - start + 1));
+        i++;
+    }
+    proto = std::move(parsed);
+    return true;
+}
+
 std::string Prototype::to_string() const {
     std::string result = "(";
     for (const auto& p : param_types) {
@@ -76,120 +795,149 @@ DexBuilder::DexBuilder() {
 }
 
 bool DexBuilder::load(const std::vector<uint8_t>& data) {
-    if (data.size() < sizeof(DexHeader)) return false;
+    return load(std::vector<uint8_t>(data));
+}
+
+bool DexBuilder::load(std::vector<uint8_t>&& buffer) {
+    if (buffer.size() < sizeof(DexHeader)) return false;
     
     DexHeader header;
-    std::memcpy(&header, data.data(), sizeof(DexHeader));
+    std::memcpy(&header, buffer.data(), sizeof(DexHeader));
     
     if (std::memcmp(header.magic, "dex\n", 4) != 0) return false;
     
-    original_data_ = data;
-    has_original_ = true;
+    // Every id table must lie inside the file before any entry is read
+    auto table_fits = [&](uint32_t off, uint32_t count, uint32_t entry_size) {
+        return count == 0 || uint64_t(off) + uint64_t(count) * entry_size <= buffer.size();
+    };
+    if (!table_fits(header.string_ids_off, header.string_ids_size, 4) ||
+        !table_fits(header.type_ids_off, header.type_ids_size, 4) ||
+        !table_fits(header.proto_ids_off, header.proto_ids_size, 12) ||
+        !table_fits(header.field_ids_off, header.field_ids_size, 8) ||
+        !table_fits(header.method_ids_off, header.method_ids_size, 8) ||
+        !table_fits(header.class_defs_off, header.class_defs_size, 32)) {
+        return false;
+    }
+    
+    original_data_ = std::move(buffer);
+    original_header_ = header;
+    const std::vector<uint8_t>& data = original_data_;
+    const uint8_t* end = data.data() + data.size();
     
-    // Parse string pool
+    // Parse string pool; string_data is a ULEB128 UTF-16 length followed by NUL-terminated MUTF-8,
+    // kept as is so it is written back unchanged
+    strings_.reserve(header.string_ids_size);
     for (uint32_t i = 0; i < header.string_ids_size; i++) {
         uint32_t str_off = read_le<uint32_t>(&data[header.string_ids_off + i * 4]);
+        if (str_off >= data.size()) return false;
+        const uint8_t* p = &data[str_off];
+        uint32_t utf16_size;
+        if (!read_uleb128(p, end, utf16_size)) return false;
+        const void* nul = std::memchr(p, 0, end - p);
+        if (!nul) return false;
         
-        // Read ULEB128 length
-        size_t pos = str_off;
-        uint32_t len = 0;
-        int shift = 0;
-        while (pos < data.size()) {
-            uint8_t b = data[pos++];
-            len |= (b & 0x7F) << shift;
-            if ((b & 0x80) == 0) break;
-            shift += 7;
-        }
-        
-        std::string str(reinterpret_cast<const char*>(&data[pos]), len);
-        strings_.push_back(str);
-        string_map_[str] = i;
+        std::string str(reinterpret_cast<const char*>(p), static_cast<const uint8_t*>(nul) - p);
+        string_map_.emplace(str, i);
+        strings_.push_back(std::move(str));
     }
     
     // Parse type pool
+    types_.reserve(header.type_ids_size);
     for (uint32_t i = 0; i < header.type_ids_size; i++) {
         uint32_t str_idx = read_le<uint32_t>(&data[header.type_ids_off + i * 4]);
-        if (str_idx < strings_.size()) {
-            types_.push_back(strings_[str_idx]);
-            type_map_[strings_[str_idx]] = i;
-        }
+        if (str_idx >= strings_.size()) return false;
+        types_.push_back(strings_[str_idx]);
+        type_map_.emplace(strings_[str_idx], i);
     }
     
     // Parse proto pool
+    protos_.reserve(header.proto_ids_size);
     for (uint32_t i = 0; i < header.proto_ids_size; i++) {
-        size_t off = header.proto_ids_off + i * 12;
+        size_t off = header.proto_ids_off + static_cast<size_t>(i) * 12;
         ProtoId proto;
         proto.shorty_idx = read_le<uint32_t>(&data[off]);
         proto.return_type_idx = read_le<uint32_t>(&data[off + 4]);
         uint32_t params_off = read_le<uint32_t>(&data[off + 8]);
+        proto.params_off = params_off;
+        if (proto.shorty_idx >= strings_.size() || proto.return_type_idx >= types_.size()) return false;
         
-        if (params_off != 0 && params_off + 4 <= data.size()) {
+        if (params_off != 0) {
+            if (params_off + 4ull > data.size()) return false;
             uint32_t param_count = read_le<uint32_t>(&data[params_off]);
-            for (uint32_t j = 0; j < param_count && params_off + 4 + (j + 1) * 2 <= data.size(); j++) {
+            if (params_off + 4ull + param_count * 2ull > data.size()) return false;
+            for (uint32_t j = 0; j < param_count; j++) {
                 uint16_t type_idx = read_le<uint16_t>(&data[params_off + 4 + j * 2]);
+                if (type_idx >= types_.size()) return false;
                 proto.param_type_idxs.push_back(type_idx);
             }
         }
         
-        protos_.push_back(proto);
-        
         // Build proto string for map
         std::string proto_str = "(";
-        for (auto idx : proto.param_type_idxs) {
-            if (idx < types_.size()) proto_str += types_[idx];
-        }
+        for (auto idx : proto.param_type_idxs) proto_str += types_[idx];
         proto_str += ")";
-        if (proto.return_type_idx < types_.size()) {
-            proto_str += types_[proto.return_type_idx];
-        }
-        proto_map_[proto_str] = i;
+        proto_str += types_[proto.return_type_idx];
+        proto_map_.emplace(std::move(proto_str), i);
+        protos_.push_back(std::move(proto));
     }
     
     // Parse field pool
+    fields_.reserve(header.field_ids_size);
     for (uint32_t i = 0; i < header.field_ids_size; i++) {
-        size_t off = header.field_ids_off + i * 8;
+        size_t off = header.field_ids_off + static_cast<size_t>(i) * 8;
         FieldId field;
         field.class_idx = read_le<uint16_t>(&data[off]);
         field.type_idx = read_le<uint16_t>(&data[off + 2]);
         field.name_idx = read_le<uint32_t>(&data[off + 4]);
+        if (field.class_idx >= types_.size() || field.type_idx >= types_.size() || field.name_idx >= strings_.size()) {
+            return false;
+        }
         fields_.push_back(field);
-        
-        std::string field_key;
-        if (field.class_idx < types_.size()) field_key += types_[field.class_idx];
-        field_key += "->";
-        if (field.name_idx < strings_.size()) field_key += strings_[field.name_idx];
-        field_key += ":";
-        if (field.type_idx < types_.size()) field_key += types_[field.type_idx];
-        field_map_[field_key] = i;
+        field_map_.emplace(types_[field.class_idx] + "->" + strings_[field.name_idx] + ":" + types_[field.type_idx], i);
     }
     
     // Parse method pool
+    methods_.reserve(header.method_ids_size);
     for (uint32_t i = 0; i < header.method_ids_size; i++) {
-        size_t off = header.method_ids_off + i * 8;
+        size_t off = header.method_ids_off + static_cast<size_t>(i) * 8;
         MethodId method;
         method.class_idx = read_le<uint16_t>(&data[off]);
         method.proto_idx = read_le<uint16_t>(&data[off + 2]);
         method.name_idx = read_le<uint32_t>(&data[off + 4]);
+        if (method.class_idx >= types_.size() || method.proto_idx >= protos_.size() ||
+            method.name_idx >= strings_.size()) {
+            return false;
+        }
         methods_.push_back(method);
         
-        std::string method_key;
-        if (method.class_idx < types_.size()) method_key += types_[method.class_idx];
-        method_key += "->";
-        if (method.name_idx < strings_.size()) method_key += strings_[method.name_idx];
-        if (method.proto_idx < protos_.size()) {
-            const auto& proto = protos_[method.proto_idx];
-            method_key += "(";
-            for (auto idx : proto.param_type_idxs) {
-                if (idx < types_.size()) method_key += types_[idx];
-            }
-            method_key += ")";
-            if (proto.return_type_idx < types_.size()) {
-                method_key += types_[proto.return_type_idx];
-            }
+        const auto& proto = protos_[method.proto_idx];
+        std::string method_key = types_[method.class_idx] + "->" + strings_[method.name_idx] + "(";
+        for (auto idx : proto.param_type_idxs) method_key += types_[idx];
+        method_key += ")";
+        method_key += types_[proto.return_type_idx];
+        method_map_.emplace(std::move(method_key), i);
+    }
+    
+    // Parse class defs so edits can replace a class in place
+    for (uint32_t i = 0; i < header.class_defs_size; i++) {
+        size_t off = header.class_defs_off + static_cast<size_t>(i) * 32;
+        ClassDef def;
+        def.class_idx = read_le<uint32_t>(&data[off]);
+        def.access_flags = read_le<uint32_t>(&data[off + 4]);
+        def.superclass_idx = read_le<uint32_t>(&data[off + 8]);
+        def.interfaces_off = read_le<uint32_t>(&data[off + 12]);
+        def.source_file_idx = read_le<uint32_t>(&data[off + 16]);
+        def.annotations_off = read_le<uint32_t>(&data[off + 20]);
+        def.class_data_off = read_le<uint32_t>(&data[off + 24]);
+        def.static_values_off = read_le<uint32_t>(&data[off + 28]);
+        original_classes_.push_back(def);
+        if (def.class_idx < types_.size()) {
+            original_class_map_[types_[def.class_idx]] = i;
         }
-        method_map_[method_key] = i;
     }
+    removed_classes_.assign(original_classes_.size(), 0);
     
+    has_original_ = true;
     return true;
 }
 
@@ -227,104 +975,310 @@ ClassBuilder* DexBuilder::get_class(const std::string& class_name) {
     if (it != class_map_.end()) {
         return &classes_[it->second];
     }
-    return nullptr;
+    return import_class(class_name);
 }
 
-bool DexBuilder::add_method(const std::string& class_name, const MethodDef& method) {
-    ClassBuilder* cls = get_class(class_name);
-    if (!cls) {
-        cls = &make_class(class_name);
+bool DexBuilder::remove_class(const std::string& class_name) {
+    bool removed = false;
+    auto it = class_map_.find(class_name);
+    if (it != class_map_.end()) {
+        classes_.erase(classes_.begin() + it->second);
+        class_map_.clear();
+        for (size_t i = 0; i < classes_.size(); i++) class_map_[classes_[i].class_name] = i;
+        removed = true;
     }
-    cls->add_method(method);
-    return true;
+    auto base = original_class_map_.find(class_name);
+    if (base != original_class_map_.end() && !removed_classes_[base->second]) {
+        removed_classes_[base->second] = 1;
+        removed = true;
+    }
+    return removed;
 }
 
-bool DexBuilder::modify_method(const std::string& class_name, const std::string& method_name,
-                                const std::string& new_prototype, const std::vector<uint8_t>& new_code) {
-    ClassBuilder* cls = get_class(class_name);
-    if (!cls) return false;
+ClassBuilder* DexBuilder::import_class(const std::string& class_name) {
+    auto it = original_class_map_.find(class_name);
+    if (it == original_class_map_.end() || removed_classes_[it->second]) return nullptr;
+    const ClassDef& def = original_classes_[it->second];
+    const auto& data = original_data_;
     
-    // Find and modify method
-    for (auto& m : cls->direct_methods) {
-        if (m.name == method_name) {
-            // Parse new prototype
-            // Format: (params)return
-            size_t paren_end = new_prototype.find(')');
-            if (paren_end != std::string::npos) {
-                m.prototype.return_type = new_prototype.substr(paren_end + 1);
-                m.prototype.param_types.clear();
-                
-                std::string params = new_prototype.substr(1, paren_end - 1);
-                size_t i = 0;
-                while (i < params.size()) {
-                    if (params[i] == 'L') {
-                        size_t end = params.find(';', i);
-                        if (end != std::string::npos) {
-                            m.prototype.param_types.push_back(params.substr(i, end - i + 1));
-                            i = end + 1;
-                        } else break;
-                    } else if (params[i] == '[') {
-                        size_t start = i;
-                        while (i < params.size() && params[i] == '[') i++;
-                        if (i < params.size()) {
-                            if (params[i] == 'L') {
-                                size_t end = params.find(';', i);
-                                if (end != std::string::npos) {
-                                    m.prototype.param_types.push_back(params.substr(start, end - start + 1));
-                                    i = end + 1;
-                                } else break;
-                            } else {
-                                m.prototype.param_types.push_back(params.substr(start, i - start + 1));
-                                i++;
-                            }
-                        }
-                    } else {
-                        m.prototype.param_types.push_back(std::string(1, params[i]));
-                        i++;
-                    }
-                }
-            }
-            m.code = new_code;
-            return true;
+    ClassBuilder cls(class_name);
+    cls.access_flags = def.access_flags;
+    cls.super_class = def.superclass_idx < types_.size() ? types_[def.superclass_idx] : "";
+    if (def.source_file_idx < strings_.size()) cls.source_file = strings_[def.source_file_idx];
+    
+    if (def.interfaces_off != 0) {
+        if (def.interfaces_off + 4ull > data.size()) return nullptr;
+        uint32_t count = read_le<uint32_t>(&data[def.interfaces_off]);
+        if (def.interfaces_off + 4ull + count * 2ull > data.size()) return nullptr;
+        for (uint32_t i = 0; i < count; i++) {
+            uint16_t type_idx = read_le<uint16_t>(&data[def.interfaces_off + 4 + i * 2]);
+            if (type_idx >= types_.size()) return nullptr;
+            cls.interfaces.push_back(types_[type_idx]);
         }
     }
     
-    for (auto& m : cls->virtual_methods) {
-        if (m.name == method_name) {
-            // Same logic as above
-            size_t paren_end = new_prototype.find(')');
-            if (paren_end != std::string::npos) {
-                m.prototype.return_type = new_prototype.substr(paren_end + 1);
-                m.prototype.param_types.clear();
-                // ... (same parsing logic)
+    ClassMembers members;
+    if (def.class_data_off != 0 && !read_class_data(def.class_data_off, members)) return nullptr;
+    
+    auto import_fields = [&](const std::vector<EncodedField>& encoded, std::vector<FieldDef>& out) {
+        for (const auto& ef : encoded) {
+            if (ef.field_idx >= fields_.size()) return false;
+            const FieldId& id = fields_[ef.field_idx];
+            if (id.name_idx >= strings_.size() || id.type_idx >= types_.size()) return false;
+            out.push_back({strings_[id.name_idx], types_[id.type_idx], ef.access_flags});
+        }
+        return true;
+    };
+    // Methods keep pointing at their original code_item until their code is replaced
+    auto import_methods = [&](const std::vector<EncodedMethod>& encoded, std::vector<MethodDef>& out) {
+        for (const auto& em : encoded) {
+            if (em.method_idx >= methods_.size()) return false;
+            const MethodId& id = methods_[em.method_idx];
+            if (id.name_idx >= strings_.size() || id.proto_idx >= protos_.size()) return false;
+            const ProtoId& proto = protos_[id.proto_idx];
+            if (proto.return_type_idx >= types_.size()) return false;
+            
+            MethodDef m;
+            m.name = strings_[id.name_idx];
+            m.prototype.return_type = types_[proto.return_type_idx];
+            for (uint32_t type_idx : proto.param_type_idxs) {
+                if (type_idx >= types_.size()) return false;
+                m.prototype.param_types.push_back(types_[type_idx]);
             }
-            m.code = new_code;
-            return true;
+            m.access_flags = em.access_flags;
+            m.registers_size = m.ins_size = m.outs_size = 0;
+            m.code_off = em.code_off;
+            if (em.code_off != 0) {
+                if (em.code_off + 16ull > data.size()) return false;
+                m.registers_size = read_le<uint16_t>(&data[em.code_off]);
+                m.ins_size = read_le<uint16_t>(&data[em.code_off + 2]);
+                m.outs_size = read_le<uint16_t>(&data[em.code_off + 4]);
+            }
+            out.push_back(std::move(m));
         }
+        return true;
+    };
+    if (!import_fields(members.static_fields, cls.static_fields) ||
+        !import_fields(members.instance_fields, cls.instance_fields) ||
+        !import_methods(members.direct_methods, cls.direct_methods) ||
+        !import_methods(members.virtual_methods, cls.virtual_methods)) {
+        return nullptr;
     }
     
-    return false;
+    // Initial values are listed in static field order; trailing fields may be omitted
+    if (def.static_values_off != 0) {
+        if (def.static_values_off >= data.size()) return nullptr;
+        const uint8_t* p = &data[def.static_values_off];
+        const uint8_t* end = data.data() + data.size();
+        uint32_t count;
+        if (!read_uleb128(p, end, count)) return nullptr;
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t* value = p;
+            if (!skip_encoded_value(p, end)) return nullptr;
+            if (i < cls.static_fields.size()) cls.static_fields[i].initial_value.assign(value, p);
+        }
+    }
+    
+    if (def.annotations_off != 0) {
+        std::unordered_map<uint32_t, FieldDef*> fields_by_idx;
+        for (size_t i = 0; i < cls.static_fields.size(); i++) {
+            fields_by_idx[members.static_fields[i].field_idx] = &cls.static_fields[i];
+        }
+        for (size_t i = 0; i < cls.instance_fields.size(); i++) {
+            fields_by_idx[members.instance_fields[i].field_idx] = &cls.instance_fields[i];
+        }
+        std::unordered_map<uint32_t, MethodDef*> methods_by_idx;
+        for (size_t i = 0; i < cls.direct_methods.size(); i++) {
+            methods_by_idx[members.direct_methods[i].method_idx] = &cls.direct_methods[i];
+        }
+        for (size_t i = 0; i < cls.virtual_methods.size(); i++) {
+            methods_by_idx[members.virtual_methods[i].method_idx] = &cls.virtual_methods[i];
+        }
+        if (!import_annotations(def.annotations_off, cls, fields_by_idx, methods_by_idx)) return nullptr;
+    }
+    
+    classes_.push_back(std::move(cls));
+    class_map_[class_name] = classes_.size() - 1;
+    return &classes_.back();
 }
 
-uint32_t DexBuilder::get_or_add_string(const std::string& str) {
-    auto it = string_map_.find(str);
-    if (it != string_map_.end()) {
-        return it->second;
+bool DexBuilder::read_annotation_set(uint32_t set_off, std::vector<AnnotationDef>& annotations) const {
+    const auto& data = original_data_;
+    if (set_off + 4ull > data.size()) return false;
+    uint32_t count = read_le<uint32_t>(&data[set_off]);
+    if (set_off + 4ull + count * 4ull > data.size()) return false;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t item_off = read_le<uint32_t>(&data[set_off + 4 + i * 4]);
+        if (item_off + 1ull >= data.size()) return false;
+        const uint8_t* begin = &data[item_off + 1];
+        const uint8_t* p = begin;
+        const uint8_t* end = data.data() + data.size();
+        AnnotationDef annotation;
+        annotation.visibility = data[item_off];
+        if (!read_uleb128(p, end, annotation.type_idx)) return false;
+        p = begin;
+        if (!skip_encoded_annotation(p, end)) return false;
+        annotation.encoded.assign(begin, p);
+        annotations.push_back(std::move(annotation));
     }
+    return true;
+}
+
+bool DexBuilder::import_annotations(uint32_t directory_off, ClassBuilder& cls,
+                                    const std::unordered_map<uint32_t, FieldDef*>& fields,
+                                    const std::unordered_map<uint32_t, MethodDef*>& methods) const {
+    const auto& data = original_data_;
+    if (directory_off + 16ull > data.size()) return false;
+    uint32_t class_set = read_le<uint32_t>(&data[directory_off]);
+    uint32_t field_count = read_le<uint32_t>(&data[directory_off + 4]);
+    uint32_t method_count = read_le<uint32_t>(&data[directory_off + 8]);
+    uint32_t parameter_count = read_le<uint32_t>(&data[directory_off + 12]);
+    uint64_t entries = uint64_t(field_count) + method_count + parameter_count;
+    if (directory_off + 16 + entries * 8 > data.size()) return false;
+    if (class_set != 0 && !read_annotation_set(class_set, cls.annotations)) return false;
     
-    uint32_t idx = strings_.size();
-    strings_.push_back(str);
-    string_map_[str] = idx;
-    return idx;
+    // Entries for members the class does not define cannot be expressed and are dropped
+    const uint8_t* entry = &data[directory_off + 16];
+    for (uint32_t i = 0; i < field_count; i++, entry += 8) {
+        auto it = fields.find(read_le<uint32_t>(entry));
+        if (it != fields.end() && !read_annotation_set(read_le<uint32_t>(entry + 4), it->second->annotations)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < method_count; i++, entry += 8) {
+        auto it = methods.find(read_le<uint32_t>(entry));
+        if (it != methods.end() && !read_annotation_set(read_le<uint32_t>(entry + 4), it->second->annotations)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < parameter_count; i++, entry += 8) {
+        auto it = methods.find(read_le<uint32_t>(entry));
+        if (it == methods.end()) continue;
+        uint32_t list_off = read_le<uint32_t>(entry + 4);
+        if (list_off + 4ull > data.size()) return false;
+        uint32_t size = read_le<uint32_t>(&data[list_off]);
+        if (list_off + 4ull + size * 4ull > data.size()) return false;
+        auto& parameters = it->second->parameter_annotations;
+        parameters.assign(size, {});
+        for (uint32_t j = 0; j < size; j++) {
+            uint32_t set_off = read_le<uint32_t>(&data[list_off + 4 + j * 4]);
+            if (set_off != 0 && !read_annotation_set(set_off, parameters[j])) return false;
+        }
+    }
+    return true;
 }
 
-uint32_t DexBuilder::get_or_add_type(const std::string& type) {
-    auto it = type_map_.find(type);
-    if (it != type_map_.end()) {
-        return it->second;
+bool DexBuilder::read_class_data(uint32_t class_data_off, ClassMembers& members) const {
+    if (class_data_off >= original_data_.size()) return false;
+    const uint8_t* p = original_data_.data() + class_data_off;
+    const uint8_t* end = original_data_.data() + original_data_.size();
+    
+    uint32_t sizes[4];
+    for (auto& size : sizes) {
+        if (!read_uleb128(p, end, size)) return false;
     }
     
-    get_or_add_string(type);
+    auto read_fields = [&](uint32_t count, std::vector<EncodedField>& out) {
+        uint32_t idx = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t diff, flags;
+            if (!read_uleb128(p, end, diff) || !read_uleb128(p, end, flags)) return false;
+            idx += diff;
+            out.push_back({idx, flags});
+        }
+        return true;
+    };
+    auto read_methods = [&](uint32_t count, std::vector<EncodedMethod>& out) {
+        uint32_t idx = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t diff, flags, code_off;
+            if (!read_uleb128(p, end, diff) || !read_uleb128(p, end, flags) ||
+                !read_uleb128(p, end, code_off)) {
+                return false;
+            }
+            idx += diff;
+            out.push_back({idx, flags, code_off});
+        }
+        return true;
+    };
+    return read_fields(sizes[0], members.static_fields) &&
+           read_fields(sizes[1], members.instance_fields) &&
+           read_methods(sizes[2], members.direct_methods) &&
+           read_methods(sizes[3], members.virtual_methods);
+}
+
+void DexBuilder::write_class_data(std::vector<uint8_t>& out, const ClassMembers& members) {
+    write_uleb128(out, members.static_fields.size());
+    write_uleb128(out, members.instance_fields.size());
+    write_uleb128(out, members.direct_methods.size());
+    write_uleb128(out, members.virtual_methods.size());
+    
+    for (const auto* fields : {&members.static_fields, &members.instance_fields}) {
+        uint32_t prev_idx = 0;
+        for (const auto& f : *fields) {
+            write_uleb128(out, f.field_idx - prev_idx);
+            write_uleb128(out, f.access_flags);
+            prev_idx = f.field_idx;
+        }
+    }
+    for (const auto* methods : {&members.direct_methods, &members.virtual_methods}) {
+        uint32_t prev_idx = 0;
+        for (const auto& m : *methods) {
+            write_uleb128(out, m.method_idx - prev_idx);
+            write_uleb128(out, m.access_flags);
+            write_uleb128(out, m.code_off);
+            prev_idx = m.method_idx;
+        }
+    }
+}
+
+bool DexBuilder::add_method(const std::string& class_name, const MethodDef& method) {
+    ClassBuilder* cls = get_class(class_name);
+    if (!cls) {
+        cls = &make_class(class_name);
+    }
+    cls->add_method(method);
+    return true;
+}
+
+bool DexBuilder::modify_method(const std::string& class_name, const std::string& method_name,
+                                const std::string& new_prototype, const std::vector<uint8_t>& new_code) {
+    ClassBuilder* cls = get_class(class_name);
+    if (!cls) return false;
+    
+    // Find and modify method; an unparsable prototype keeps the old one
+    for (auto* methods : {&cls->direct_methods, &cls->virtual_methods}) {
+        for (auto& m : *methods) {
+            if (m.name != method_name) continue;
+            Prototype::parse(new_prototype, m.prototype);
+            m.code = new_code;
+            m.code_off = 0;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+uint32_t DexBuilder::get_or_add_string(const std::string& str) {
+    auto it = string_map_.find(str);
+    if (it != string_map_.end()) {
+        return it->second;
+    }
+    
+    uint32_t idx = strings_.size();
+    strings_.push_back(str);
+    string_map_[str] = idx;
+    return idx;
+}
+
+uint32_t DexBuilder::get_or_add_type(const std::string& type) {
+    auto it = type_map_.find(type);
+    if (it != type_map_.end()) {
+        return it->second;
+    }
+    
+    get_or_add_string(type);
     
     uint32_t idx = types_.size();
     types_.push_back(type);
@@ -441,12 +1395,64 @@ std::vector<uint8_t> DexBuilder::build_code_item(const MethodDef& method) {
     write_le<uint16_t>(out, method.registers_size);
     write_le<uint16_t>(out, method.ins_size);
     write_le<uint16_t>(out, method.outs_size);
-    write_le<uint16_t>(out, 0);  // tries_size
-    write_le<uint32_t>(out, 0);  // debug_info_off
+    write_le<uint16_t>(out, method.tries.size());
+    write_le<uint32_t>(out, 0);  // debug_info_off, filled in by the writer
     write_le<uint32_t>(out, method.code.size() / 2);  // insns_size in 16-bit units
     
     out.insert(out.end(), method.code.begin(), method.code.end());
     
+    if (!method.tries.empty()) {
+        // try_items are 4-aligned and point into the encoded_catch_handler_list that follows
+        while (out.size() % 4 != 0) out.push_back(0);
+        size_t tries_pos = out.size();
+        out.resize(tries_pos + method.tries.size() * 8);
+        
+        std::vector<uint8_t> handlers;
+        std::vector<uint32_t> handler_offs;
+        std::vector<size_t> unique;  // first try with each distinct handler list
+        for (const TryBlock& block : method.tries) {
+            size_t match = 0;
+            while (match < unique.size()) {
+                const auto& other = method.tries[unique[match]].handlers;
+                if (other.size() == block.handlers.size() &&
+                    std::equal(other.begin(), other.end(), block.handlers.begin(),
+                               [](const CatchHandler& a, const CatchHandler& b) {
+                                   return a.type_idx == b.type_idx && a.addr == b.addr;
+                               })) {
+                    break;
+                }
+                match++;
+            }
+            if (match < unique.size()) {
+                handler_offs.push_back(handler_offs[unique[match]]);
+                continue;
+            }
+            unique.push_back(handler_offs.size());
+            handler_offs.push_back(handlers.size());
+            
+            bool catch_all = !block.handlers.empty() && block.handlers.back().type_idx == CatchHandler::kCatchAll;
+            int32_t typed = static_cast<int32_t>(block.handlers.size()) - (catch_all ? 1 : 0);
+            write_sleb128(handlers, catch_all ? -typed : typed);
+            for (int32_t i = 0; i < typed; i++) {
+                write_uleb128(handlers, block.handlers[i].type_idx);
+                write_uleb128(handlers, block.handlers[i].addr);
+            }
+            if (catch_all) write_uleb128(handlers, block.handlers.back().addr);
+        }
+        
+        std::vector<uint8_t> list_size;
+        write_uleb128(list_size, unique.size());
+        for (size_t i = 0; i < method.tries.size(); i++) {
+            const TryBlock& block = method.tries[i];
+            uint8_t* item = &out[tries_pos + i * 8];
+            write_le<uint32_t>(item, block.start_addr);
+            write_le<uint16_t>(item + 4, block.end_addr - block.start_addr);
+            write_le<uint16_t>(item + 6, list_size.size() + handler_offs[i]);
+        }
+        out.insert(out.end(), list_size.begin(), list_size.end());
+        out.insert(out.end(), handlers.begin(), handlers.end());
+    }
+    
     // Align to 4 bytes
     while (out.size() % 4 != 0) {
         out.push_back(0);
@@ -455,6 +1461,66 @@ std::vector<uint8_t> DexBuilder::build_code_item(const MethodDef& method) {
     return out;
 }
 
+void DexBuilder::write_debug_info(std::vector<uint8_t>& out, const DebugInfo& debug) {
+    constexpr int kLineBase = -4, kLineRange = 15, kFirstSpecial = 0x0A;
+    auto uleb_p1 = [&](uint32_t idx) { write_uleb128(out, idx == DebugEvent::kNoIndex ? 0 : idx + 1); };
+    
+    write_uleb128(out, debug.line_start);
+    write_uleb128(out, debug.parameter_names.size());
+    for (uint32_t name : debug.parameter_names) uleb_p1(name);
+    
+    uint32_t addr = 0;
+    int64_t line = debug.line_start;
+    for (const DebugEvent& event : debug.events) {
+        uint32_t addr_diff = event.addr > addr ? event.addr - addr : 0;
+        if (event.kind == DebugEvent::Kind::kLine) {
+            // A special opcode advances both registers and emits the position entry
+            int64_t line_diff = int64_t(event.line) - line;
+            if (line_diff < kLineBase || line_diff >= kLineBase + kLineRange) {
+                out.push_back(0x02);  // DBG_ADVANCE_LINE
+                write_sleb128(out, static_cast<int32_t>(line_diff));
+                line_diff = 0;
+            }
+            if (kFirstSpecial + (line_diff - kLineBase) + uint64_t(addr_diff) * kLineRange > 0xFF) {
+                out.push_back(0x01);  // DBG_ADVANCE_PC
+                write_uleb128(out, addr_diff);
+                addr_diff = 0;
+            }
+            out.push_back(static_cast<uint8_t>(kFirstSpecial + (line_diff - kLineBase) + addr_diff * kLineRange));
+            addr = event.addr > addr ? event.addr : addr;
+            line = event.line;
+            continue;
+        }
+        if (addr_diff != 0) {
+            out.push_back(0x01);  // DBG_ADVANCE_PC
+            write_uleb128(out, addr_diff);
+            addr = event.addr;
+        }
+        switch (event.kind) {
+            case DebugEvent::Kind::kStartLocal:
+                out.push_back(event.signature_idx == DebugEvent::kNoIndex ? 0x03 : 0x04);
+                write_uleb128(out, event.reg);
+                uleb_p1(event.name_idx);
+                uleb_p1(event.type_idx);
+                if (event.signature_idx != DebugEvent::kNoIndex) uleb_p1(event.signature_idx);
+                break;
+            case DebugEvent::Kind::kEndLocal:
+            case DebugEvent::Kind::kRestartLocal:
+                out.push_back(event.kind == DebugEvent::Kind::kEndLocal ? 0x05 : 0x06);
+                write_uleb128(out, event.reg);
+                break;
+            case DebugEvent::Kind::kPrologueEnd: out.push_back(0x07); break;
+            case DebugEvent::Kind::kEpilogueBegin: out.push_back(0x08); break;
+            case DebugEvent::Kind::kSetFile:
+                out.push_back(0x09);
+                uleb_p1(event.name_idx);
+                break;
+            case DebugEvent::Kind::kLine: break;
+        }
+    }
+    out.push_back(0x00);  // DBG_END_SEQUENCE
+}
+
 std::vector<uint8_t> DexBuilder::build_class_data(const ClassBuilder& cls) {
     std::vector<uint8_t> out;
     
@@ -506,236 +1572,1405 @@ std::vector<uint8_t> DexBuilder::build_class_data(const ClassBuilder& cls) {
 }
 
 uint32_t DexBuilder::compute_checksum(const std::vector<uint8_t>& data) {
-    uint32_t s1 = 1, s2 = 0;
-    for (size_t i = 12; i < data.size(); i++) {
-        s1 = (s1 + data[i]) % 65521;
-        s2 = (s2 + s1) % 65521;
+    // Adler-32 of everything after the checksum field
+    return data.size() <= 12 ? 1 : apk::adler32(data.data() + 12, data.size() - 12);
+}
+
+// Header and map_list of a DEX without any ids or data
+static std::vector<uint8_t> empty_dex() {
+    std::vector<uint8_t> out(0x70, 0);
+    std::memcpy(out.data(), "dex\n035\0", 8);
+    write_le<uint32_t>(out, 2);
+    write_le<uint16_t>(out, 0x0000);  // header_item
+    write_le<uint16_t>(out, 0);
+    write_le<uint32_t>(out, 1);
+    write_le<uint32_t>(out, 0);
+    write_le<uint16_t>(out, 0x1000);  // map_list
+    write_le<uint16_t>(out, 0);
+    write_le<uint32_t>(out, 1);
+    write_le<uint32_t>(out, 0x70);
+    
+    DexHeader* header = reinterpret_cast<DexHeader*>(out.data());
+    header->file_size = out.size();
+    header->header_size = 0x70;
+    header->endian_tag = 0x12345678;
+    header->map_off = 0x70;
+    header->data_size = out.size() - 0x70;
+    header->data_off = 0x70;
+    return out;
+}
+
+void DexBuilder::add_class_ids() {
+    for (const auto& cls : classes_) {
+        get_or_add_type(cls.class_name);
+        if (!cls.super_class.empty()) get_or_add_type(cls.super_class);
+        for (const auto& i : cls.interfaces) get_or_add_type(i);
+        if (!cls.source_file.empty()) get_or_add_string(cls.source_file);
+        for (const auto* fields : {&cls.static_fields, &cls.instance_fields}) {
+            for (const auto& f : *fields) get_or_add_field(cls.class_name, f.name, f.type);
+        }
+        for (const auto* methods : {&cls.direct_methods, &cls.virtual_methods}) {
+            for (const auto& m : *methods) get_or_add_method(cls.class_name, m.name, m.prototype);
+        }
+    }
+}
+
+bool DexBuilder::merge(std::vector<DexBuilder>& partials, std::string& error) {
+    for (const auto& partial : partials) {
+        if (partial.has_original_) {
+            error = "Cannot merge a builder with a base DEX";
+            return false;
+        }
+    }
+    
+    // Replaying each pool in order appends new entries in first-use order, whatever the partition
+    std::vector<PoolRemap> maps(partials.size());
+    for (size_t i = 0; i < partials.size(); i++) {
+        const DexBuilder& partial = partials[i];
+        PoolRemap& map = maps[i];
+        map.strings.reserve(partial.strings_.size());
+        for (const auto& str : partial.strings_) map.strings.push_back(get_or_add_string(str));
+        map.types.reserve(partial.types_.size());
+        for (const auto& type : partial.types_) map.types.push_back(get_or_add_type(type));
+        auto prototype = [&](const ProtoId& id) {
+            Prototype proto(partial.types_[id.return_type_idx]);
+            for (uint32_t idx : id.param_type_idxs) proto.param_types.push_back(partial.types_[idx]);
+            return proto;
+        };
+        map.protos.reserve(partial.protos_.size());
+        for (const auto& id : partial.protos_) map.protos.push_back(get_or_add_proto(prototype(id)));
+        map.fields.reserve(partial.fields_.size());
+        for (const auto& id : partial.fields_) {
+            map.fields.push_back(get_or_add_field(partial.types_[id.class_idx], partial.strings_[id.name_idx],
+                                                  partial.types_[id.type_idx]));
+        }
+        map.methods.reserve(partial.methods_.size());
+        for (const auto& id : partial.methods_) {
+            map.methods.push_back(get_or_add_method(partial.types_[id.class_idx], partial.strings_[id.name_idx],
+                                                    prototype(partial.protos_[id.proto_idx])));
+        }
+    }
+    
+    std::vector<std::string> errors(partials.size());
+    ThreadPool::shared()->parallel_for(partials.size(), [&](size_t i) {
+        for (auto& cls : partials[i].classes_) {
+            if (!remap_class(cls, maps[i], false, errors[i])) {
+                errors[i] = cls.class_name + ": " + errors[i];
+                return;
+            }
+        }
+    });
+    for (const auto& message : errors) {
+        if (!message.empty()) {
+            error = message;
+            return false;
+        }
+    }
+    
+    for (auto& partial : partials) {
+        for (auto& cls : partial.classes_) {
+            std::string name = cls.class_name;
+            make_class(name) = std::move(cls);
+        }
+        partial.classes_.clear();
+        partial.class_map_.clear();
     }
-    return (s2 << 16) | s1;
+    return true;
+}
+
+bool DexBuilder::sort_pools(PoolRemap& map, std::string& error) const {
+    const DexHeader& base = original_header_;
+    // Ids are 16 bits wide in field_ids, method_ids and type_lists
+    if (types_.size() > 0x10000 || protos_.size() > 0x10000) {
+        error = "Too many " + std::string(types_.size() > 0x10000 ? "type" : "prototype") + " ids: " +
+                std::to_string(std::max(types_.size(), protos_.size()));
+        return false;
+    }
+    
+    // Output order of a pool, order[new] = old: new entries are sorted and merged into the base ones,
+    // which keep their own order. The map is the inverse, map[old] = new.
+    auto merged = [](size_t count, uint32_t base_count, auto less) {
+        uint32_t kept = std::min<uint32_t>(base_count, static_cast<uint32_t>(count));
+        std::vector<uint32_t> added(count - kept);
+        std::iota(added.begin(), added.end(), kept);
+        std::sort(added.begin(), added.end(), less);
+        std::vector<uint32_t> map(count);
+        uint32_t next = 0, i = 0;
+        for (uint32_t idx : added) {
+            while (i < kept && less(i, idx)) map[i++] = next++;
+            map[idx] = next++;
+        }
+        while (i < kept) map[i++] = next++;
+        return map;
+    };
+    
+    map.strings = merged(strings_.size(), base.string_ids_size, [&](uint32_t a, uint32_t b) {
+        return compare_utf16(strings_[a], strings_[b]) < 0;
+    });
+    
+    // Types follow their descriptor strings
+    std::vector<uint32_t> descriptors(types_.size());
+    for (uint32_t i = 0; i < types_.size(); i++) {
+        auto it = string_map_.find(types_[i]);
+        if (it == string_map_.end()) {
+            error = "No string for type " + types_[i];
+            return false;
+        }
+        descriptors[i] = map.strings[it->second];
+    }
+    map.types = merged(types_.size(), base.type_ids_size, [&](uint32_t a, uint32_t b) {
+        return descriptors[a] < descriptors[b];
+    });
+    
+    // Protos by return type, then parameter lists
+    std::vector<std::vector<uint32_t>> params(protos_.size());
+    for (uint32_t i = 0; i < protos_.size(); i++) {
+        for (uint32_t idx : protos_[i].param_type_idxs) params[i].push_back(map.types[idx]);
+    }
+    map.protos = merged(protos_.size(), base.proto_ids_size, [&](uint32_t a, uint32_t b) {
+        uint32_t x = map.types[protos_[a].return_type_idx];
+        uint32_t y = map.types[protos_[b].return_type_idx];
+        return x != y ? x < y : params[a] < params[b];
+    });
+    
+    // Fields by class, name and type; methods by class, name and prototype
+    map.fields = merged(fields_.size(), base.field_ids_size, [&](uint32_t a, uint32_t b) {
+        const FieldId& x = fields_[a];
+        const FieldId& y = fields_[b];
+        return std::make_tuple(map.types[x.class_idx], map.strings[x.name_idx], map.types[x.type_idx]) <
+               std::make_tuple(map.types[y.class_idx], map.strings[y.name_idx], map.types[y.type_idx]);
+    });
+    map.methods = merged(methods_.size(), base.method_ids_size, [&](uint32_t a, uint32_t b) {
+        const MethodId& x = methods_[a];
+        const MethodId& y = methods_[b];
+        return std::make_tuple(map.types[x.class_idx], map.strings[x.name_idx], map.protos[x.proto_idx]) <
+               std::make_tuple(map.types[y.class_idx], map.strings[y.name_idx], map.protos[y.proto_idx]);
+    });
+    return true;
+}
+
+void DexBuilder::permute_pools(const PoolRemap& map) {
+    auto permute = [](auto& pool, const std::vector<uint32_t>& to) {
+        std::remove_reference_t<decltype(pool)> moved(pool.size());
+        for (size_t i = 0; i < pool.size(); i++) moved[to[i]] = std::move(pool[i]);
+        pool = std::move(moved);
+    };
+    auto remap_keys = [](auto& index, const std::vector<uint32_t>& to) {
+        for (auto& entry : index) entry.second = to[entry.second];
+    };
+    
+    permute(strings_, map.strings);
+    remap_keys(string_map_, map.strings);
+    permute(types_, map.types);
+    remap_keys(type_map_, map.types);
+    
+    for (auto& proto : protos_) {
+        proto.shorty_idx = map.strings[proto.shorty_idx];
+        proto.return_type_idx = map.types[proto.return_type_idx];
+        for (auto& idx : proto.param_type_idxs) idx = map.types[idx];
+    }
+    permute(protos_, map.protos);
+    remap_keys(proto_map_, map.protos);
+    
+    for (auto& field : fields_) {
+        field.class_idx = static_cast<uint16_t>(map.types[field.class_idx]);
+        field.type_idx = static_cast<uint16_t>(map.types[field.type_idx]);
+        field.name_idx = map.strings[field.name_idx];
+    }
+    permute(fields_, map.fields);
+    remap_keys(field_map_, map.fields);
+    
+    for (auto& method : methods_) {
+        method.class_idx = static_cast<uint16_t>(map.types[method.class_idx]);
+        method.proto_idx = static_cast<uint16_t>(map.protos[method.proto_idx]);
+        method.name_idx = map.strings[method.name_idx];
+    }
+    permute(methods_, map.methods);
+    remap_keys(method_map_, map.methods);
 }
 
 std::vector<uint8_t> DexBuilder::build() {
-    if (has_original_ && classes_.empty()) {
-        return original_data_;
+    std::string error;
+    return build(error);
+}
+
+std::vector<uint8_t> DexBuilder::build(std::string& error) {
+    error.clear();
+    // A DEX built from scratch is written as an edit of an empty one
+    if (!has_original_ && !load(empty_dex())) {
+        error = "Cannot start an empty DEX";
+        return {};
     }
     
-    std::vector<uint8_t> out;
-    out.resize(0x70, 0);  // Header
-    std::memcpy(out.data(), "dex\n035\0", 8);
+    const DexHeader& base = original_header_;
+    bool unchanged = classes_.empty() &&
+                     std::find(removed_classes_.begin(), removed_classes_.end(), 1) == removed_classes_.end() &&
+                     strings_.size() == base.string_ids_size && types_.size() == base.type_ids_size &&
+                     protos_.size() == base.proto_ids_size && fields_.size() == base.field_ids_size &&
+                     methods_.size() == base.method_ids_size;
+    if (unchanged) {
+        std::vector<uint8_t> out = original_data_;
+        reinterpret_cast<DexHeader*>(out.data())->checksum = compute_checksum(out);
+        return out;
+    }
+    std::vector<uint8_t> out = build_incremental(error);
+    if (out.empty() && error.empty()) error = "Malformed base DEX";
+    return out;
+}
+
+std::vector<uint8_t> DexBuilder::build_incremental(std::string& error) {
+    const DexHeader& base = original_header_;
+    add_class_ids();
+    if (strings_.size() < base.string_ids_size || types_.size() < base.type_ids_size ||
+        protos_.size() < base.proto_ids_size || fields_.size() < base.field_ids_size ||
+        methods_.size() < base.method_ids_size) {
+        return {};
+    }
     
-    // === Data Section (variable-size items first) ===
-    uint32_t data_start = out.size();
+    // New ids are merged into the sorted tables, shifting the base ids after them
+    PoolRemap map;
+    if (!sort_pools(map, error)) return {};
+    auto identity = [](const std::vector<uint32_t>& table) {
+        for (uint32_t i = 0; i < table.size(); i++) {
+            if (table[i] != i) return false;
+        }
+        return true;
+    };
+    bool reordered = !identity(map.strings) || !identity(map.types) || !identity(map.protos) ||
+                     !identity(map.fields) || !identity(map.methods);
+    bool pending = false;
+    for (const auto& cls : classes_) {
+        for (const auto* methods : {&cls.direct_methods, &cls.virtual_methods}) {
+            for (const auto& m : *methods) pending = pending || !m.wide_refs.empty();
+        }
+    }
+    if (!reordered && !pending) return write_incremental(map, classes_, error);
     
-    // 1. String data
-    std::vector<uint32_t> string_data_offs;
-    for (const auto& s : strings_) {
-        string_data_offs.push_back(out.size());
-        write_uleb128(out, s.size());
-        out.insert(out.end(), s.begin(), s.end());
-        out.push_back(0);
+    // The classes are written from a copy holding output ids, so a failure leaves the builder as it was
+    // and later edits still see builder ids
+    std::vector<ClassBuilder> classes = classes_;
+    for (auto& cls : classes) {
+        if (!remap_class(cls, map, true, error)) {
+            error = cls.class_name + ": " + error;
+            return {};
+        }
     }
-    while (out.size() % 4 != 0) out.push_back(0);
+    if (!reordered) return write_incremental(map, classes, error);
     
-    // 2. Type lists for protos
-    std::vector<uint32_t> type_list_offs;
-    for (const auto& p : protos_) {
-        if (p.param_type_idxs.empty()) {
-            type_list_offs.push_back(0);
-        } else {
-            while (out.size() % 4 != 0) out.push_back(0);
-            type_list_offs.push_back(out.size());
-            write_le<uint32_t>(out, p.param_type_idxs.size());
-            for (auto idx : p.param_type_idxs) {
-                write_le<uint16_t>(out, idx);
+    // The pools are put in output order for the write, then restored so later edits still see the base
+    // DEX's ids. With an empty base every id is new, so the sorted order can stay.
+    permute_pools(map);
+    std::vector<uint8_t> out = write_incremental(map, classes, error);
+    if (base.string_ids_size || base.type_ids_size || base.proto_ids_size || base.field_ids_size ||
+        base.method_ids_size) {
+        auto invert = [](const std::vector<uint32_t>& table) {
+            std::vector<uint32_t> inverse(table.size());
+            for (uint32_t i = 0; i < table.size(); i++) inverse[table[i]] = i;
+            return inverse;
+        };
+        permute_pools({invert(map.strings), invert(map.types), invert(map.protos), invert(map.fields),
+                       invert(map.methods)});
+    } else {
+        classes_ = std::move(classes);
+    }
+    return out;
+}
+
+// ==================== Incremental rewrite ====================
+
+namespace {
+
+// map_list item type codes
+enum : uint16_t {
+    kTypeHeaderItem = 0x0000,
+    kTypeStringIdItem = 0x0001,
+    kTypeTypeIdItem = 0x0002,
+    kTypeProtoIdItem = 0x0003,
+    kTypeFieldIdItem = 0x0004,
+    kTypeMethodIdItem = 0x0005,
+    kTypeClassDefItem = 0x0006,
+    kTypeCallSiteIdItem = 0x0007,
+    kTypeMethodHandleItem = 0x0008,
+    kTypeMapList = 0x1000,
+    kTypeTypeList = 0x1001,
+    kTypeAnnotationSetRefList = 0x1002,
+    kTypeAnnotationSetItem = 0x1003,
+    kTypeClassDataItem = 0x2000,
+    kTypeCodeItem = 0x2001,
+    kTypeStringDataItem = 0x2002,
+    kTypeDebugInfoItem = 0x2003,
+    kTypeAnnotationItem = 0x2004,
+    kTypeEncodedArrayItem = 0x2005,
+    kTypeAnnotationsDirectoryItem = 0x2006,
+    kTypeHiddenapiClassDataItem = 0xF000,
+};
+
+constexpr uint32_t kNoIndex = 0xFFFFFFFF;
+
+// One output section: a verbatim slice of the base DEX, or its items re-encoded, followed by appended items
+struct Section {
+    uint16_t type = 0;
+    uint32_t count = 0;      // items in the output
+    uint32_t old_count = 0;  // items in the base DEX
+    uint32_t old_off = 0;
+    uint32_t copy_size = 0;  // bytes copied from old_off
+    std::vector<uint8_t> head;                          // re-encoded base items, in place of the copy
+    std::vector<std::pair<uint32_t, uint32_t>> items;  // base offset -> position in head
+    uint32_t new_off = 0;
+    uint32_t tail_off = 0;   // start of tail, relative to new_off
+    std::vector<uint8_t> tail;
+
+    uint32_t kept_size() const { return copy_size + static_cast<uint32_t>(head.size()); }
+    uint32_t size() const {
+        return tail.empty() ? kept_size() : tail_off + static_cast<uint32_t>(tail.size());
+    }
+};
+
+// Base DEX offset -> output offset
+class Relocations {
+public:
+    void add_range(uint32_t old_begin, uint32_t size, uint32_t new_begin) {
+        ranges_.push_back({old_begin, old_begin + size, new_begin});
+    }
+    // Items must be in ascending old offset order when looked up
+    void add_item(uint32_t old_off, uint32_t new_off) { items_.push_back({old_off, new_off}); }
+    void sort_items() { std::sort(items_.begin(), items_.end()); }
+    void clear() {
+        ranges_.clear();
+        items_.clear();
+        last_ = last_item_ = 0;
+    }
+
+    // 0 means "none" and stays 0; false for offsets that point at nothing that was kept
+    bool apply(uint32_t old_off, uint32_t& new_off) const {
+        if (old_off == 0) {
+            new_off = 0;
+            return true;
+        }
+        // Fix-ups walk items in file order, so consecutive lookups usually hit the same range
+        if (last_ < ranges_.size() && old_off >= ranges_[last_].old_begin && old_off < ranges_[last_].old_end) {
+            new_off = ranges_[last_].new_begin + (old_off - ranges_[last_].old_begin);
+            return true;
+        }
+        auto it = std::upper_bound(ranges_.begin(), ranges_.end(), old_off,
+                                   [](uint32_t off, const Range& r) { return off < r.old_begin; });
+        if (it != ranges_.begin() && old_off < (it - 1)->old_end) {
+            --it;
+            last_ = it - ranges_.begin();
+            new_off = it->new_begin + (old_off - it->old_begin);
+            return true;
+        }
+        if (last_item_ + 1 < items_.size() && items_[last_item_ + 1].first == old_off) {
+            new_off = items_[++last_item_].second;
+            return true;
+        }
+        auto item = std::lower_bound(items_.begin(), items_.end(), old_off,
+                                     [](const std::pair<uint32_t, uint32_t>& i, uint32_t off) { return i.first < off; });
+        if (item == items_.end() || item->first != old_off) return false;
+        last_item_ = item - items_.begin();
+        new_off = item->second;
+        return true;
+    }
+
+private:
+    struct Range {
+        uint32_t old_begin;
+        uint32_t old_end;
+        uint32_t new_begin;
+    };
+    std::vector<Range> ranges_;                           // copied slices, added in base DEX order
+    std::vector<std::pair<uint32_t, uint32_t>> items_;  // re-encoded items
+    mutable size_t last_ = 0;       // range of the previous lookup
+    mutable size_t last_item_ = 0;  // item of the previous lookup
+};
+
+} // namespace
+
+// Byte-aligned data items; every other section is 4-aligned
+static size_t item_alignment(uint16_t type) {
+    switch (type) {
+        case kTypeStringDataItem:
+        case kTypeClassDataItem:
+        case kTypeDebugInfoItem:
+        case kTypeAnnotationItem:
+        case kTypeEncodedArrayItem:
+            return 1;
+        default:
+            return 4;
+    }
+}
+
+static uint32_t align4(uint32_t n) {
+    return (n + 3) & ~3u;
+}
+
+// Data items holding pool indexes whose encoded size depends on their values
+static bool has_indexes(uint16_t type) {
+    return type == kTypeCodeItem || type == kTypeDebugInfoItem || type == kTypeAnnotationItem ||
+           type == kTypeEncodedArrayItem;
+}
+
+// Copy of the base DEX item of `type` at p with its pool indexes remapped; code_items go through
+// remap_code_item
+static bool remap_item(uint16_t type, const uint8_t* p, const uint8_t* end, const PoolRemap& map,
+                       std::vector<uint8_t>& out) {
+    switch (type) {
+        case kTypeDebugInfoItem:
+            return remap_debug_info(p, end, map, out);
+        case kTypeAnnotationItem:
+            if (p >= end) return false;
+            out.push_back(*p++);  // visibility
+            return remap_encoded_annotation(p, end, map, out);
+        case kTypeEncodedArrayItem: {
+            uint32_t count;
+            if (!read_uleb128(p, end, count)) return false;
+            put_uleb128(out, count);
+            for (uint32_t i = 0; i < count; i++) {
+                if (!remap_encoded_value(p, end, map, out)) return false;
             }
-            while (out.size() % 4 != 0) out.push_back(0);
+            return true;
         }
+        default:
+            return false;
     }
+}
+
+// encoded_value of the zero/null default of a field type, for gaps in static_values
+static void write_default_value(std::vector<uint8_t>& out, const std::string& type) {
+    switch (type.empty() ? 'L' : type[0]) {
+        case 'Z': out.push_back(0x1F); return;              // VALUE_BOOLEAN false
+        case 'B': out.insert(out.end(), {0x00, 0}); return;
+        case 'S': out.insert(out.end(), {0x02, 0}); return;
+        case 'C': out.insert(out.end(), {0x03, 0}); return;
+        case 'I': out.insert(out.end(), {0x04, 0}); return;
+        case 'J': out.insert(out.end(), {0x06, 0}); return;
+        case 'F': out.insert(out.end(), {0x10, 0}); return;
+        case 'D': out.insert(out.end(), {0x11, 0}); return;
+        default: out.push_back(0x1E); return;               // VALUE_NULL
+    }
+}
+
+// End offset of the data item of `type` at off, or 0 if it is truncated or malformed
+static size_t item_end(uint16_t type, const std::vector<uint8_t>& data, size_t off) {
+    if (off >= data.size()) return 0;
+    const uint8_t* begin = data.data();
+    const uint8_t* end = begin + data.size();
+    const uint8_t* p = begin + off;
+    uint64_t fixed_end;
     
-    // 3. Code items
-    std::vector<uint32_t> code_item_offs;
-    std::vector<std::pair<size_t, size_t>> class_method_indices;  // class_idx -> (start, count)
-    
-    for (size_t ci = 0; ci < classes_.size(); ci++) {
-        const auto& cls = classes_[ci];
-        size_t start = code_item_offs.size();
-        
-        for (const auto& m : cls.direct_methods) {
-            if (m.code.empty()) {
-                code_item_offs.push_back(0);
-            } else {
-                while (out.size() % 4 != 0) out.push_back(0);
-                code_item_offs.push_back(out.size());
-                auto code_data = build_code_item(m);
-                out.insert(out.end(), code_data.begin(), code_data.end());
+    switch (type) {
+        case kTypeStringDataItem: {
+            uint32_t utf16_size;
+            if (!read_uleb128(p, end, utf16_size)) return 0;
+            const void* nul = std::memchr(p, 0, end - p);
+            return nul ? static_cast<const uint8_t*>(nul) - begin + 1 : 0;
+        }
+        case kTypeTypeList:
+            if (off + 4 > data.size()) return 0;
+            fixed_end = off + 4 + uint64_t(read_le<uint32_t>(p)) * 2;
+            break;
+        case kTypeAnnotationSetRefList:
+        case kTypeAnnotationSetItem:
+            if (off + 4 > data.size()) return 0;
+            fixed_end = off + 4 + uint64_t(read_le<uint32_t>(p)) * 4;
+            break;
+        case kTypeAnnotationsDirectoryItem:
+            if (off + 16 > data.size()) return 0;
+            fixed_end = off + 16 + (uint64_t(read_le<uint32_t>(p + 4)) + read_le<uint32_t>(p + 8) +
+                                    read_le<uint32_t>(p + 12)) * 8;
+            break;
+        case kTypeCodeItem: {
+            if (off + 16 > data.size()) return 0;
+            uint16_t tries_size = read_le<uint16_t>(p + 6);
+            fixed_end = off + 16 + uint64_t(read_le<uint32_t>(p + 12)) * 2;
+            if (tries_size == 0) break;
+            
+            // try_items are 4-aligned, then an encoded_catch_handler_list
+            uint64_t handlers_off = ((fixed_end + 3) & ~uint64_t(3)) + tries_size * 8ull;
+            if (handlers_off > data.size()) return 0;
+            p = begin + handlers_off;
+            uint32_t handlers;
+            if (!read_uleb128(p, end, handlers)) return 0;
+            for (uint32_t i = 0; i < handlers; i++) {
+                int32_t size;
+                if (!read_sleb128(p, end, size)) return 0;
+                uint32_t pairs = size < 0 ? 0u - static_cast<uint32_t>(size) : static_cast<uint32_t>(size);
+                uint64_t values = uint64_t(pairs) * 2 + (size <= 0 ? 1 : 0);
+                for (uint64_t j = 0; j < values; j++) {
+                    uint32_t value;
+                    if (!read_uleb128(p, end, value)) return 0;
+                }
             }
+            return p - begin;
         }
-        for (const auto& m : cls.virtual_methods) {
-            if (m.code.empty()) {
-                code_item_offs.push_back(0);
-            } else {
-                while (out.size() % 4 != 0) out.push_back(0);
-                code_item_offs.push_back(out.size());
-                auto code_data = build_code_item(m);
-                out.insert(out.end(), code_data.begin(), code_data.end());
+        case kTypeClassDataItem: {
+            uint32_t sizes[4];
+            for (auto& size : sizes) {
+                if (!read_uleb128(p, end, size)) return 0;
+            }
+            uint64_t values = (uint64_t(sizes[0]) + sizes[1]) * 2 + (uint64_t(sizes[2]) + sizes[3]) * 3;
+            for (uint64_t i = 0; i < values; i++) {
+                uint32_t value;
+                if (!read_uleb128(p, end, value)) return 0;
             }
+            return p - begin;
         }
-        class_method_indices.push_back({start, code_item_offs.size() - start});
+        case kTypeDebugInfoItem: {
+            uint32_t value, parameters;
+            if (!read_uleb128(p, end, value) || !read_uleb128(p, end, parameters)) return 0;
+            for (uint32_t i = 0; i < parameters; i++) {
+                if (!read_uleb128(p, end, value)) return 0;
+            }
+            // Operand counts of DBG_END_SEQUENCE .. DBG_SET_FILE; special opcodes take none
+            static const uint8_t kOperands[] = {0, 1, 1, 3, 4, 1, 1, 0, 0, 1};
+            while (p < end) {
+                uint8_t op = *p++;
+                if (op == 0x00) return p - begin;
+                for (int i = 0; op < sizeof(kOperands) && i < kOperands[op]; i++) {
+                    if (!read_uleb128(p, end, value)) return 0;  // the sleb128 of ADVANCE_LINE has the same length
+                }
+            }
+            return 0;
+        }
+        case kTypeAnnotationItem:
+            p++;  // visibility
+            return skip_encoded_annotation(p, end) ? p - begin : 0;
+        case kTypeEncodedArrayItem: {
+            uint32_t count;
+            if (!read_uleb128(p, end, count)) return 0;
+            for (uint32_t i = 0; i < count; i++) {
+                if (!skip_encoded_value(p, end)) return 0;
+            }
+            return p - begin;
+        }
+        default:
+            return 0;
     }
+    return fixed_end <= data.size() ? fixed_end : 0;
+}
+
+// Visit the `count` consecutive items of a data section; returns where the last one ends, or 0 if malformed
+template<typename Visit>
+static size_t walk_items(uint16_t type, const std::vector<uint8_t>& data, size_t off, uint32_t count,
+                         Visit&& visit) {
+    size_t align = item_alignment(type);
+    for (uint32_t i = 0; i < count; i++) {
+        off = (off + align - 1) & ~(align - 1);
+        size_t next = item_end(type, data, off);
+        if (next == 0) return 0;
+        visit(off);
+        off = next;
+    }
+    return off;
+}
+
+std::vector<uint8_t> DexBuilder::write_incremental(const PoolRemap& map, const std::vector<ClassBuilder>& classes,
+                                                   std::string& error) {
+    const std::vector<uint8_t>& in = original_data_;
+    const DexHeader& base = original_header_;
+    
+    // Base ids keep their relative order, so lists sorted by index stay sorted. When some of them
+    // moved, the items holding them are re-encoded; otherwise every copied index stays valid.
+    bool reordered = false;
+    auto check_base = [&](const std::vector<uint32_t>& table, uint32_t base_count) {
+        for (uint32_t i = 0; i < base_count && i < table.size() && !reordered; i++) reordered = table[i] != i;
+    };
+    check_base(map.strings, base.string_ids_size);
+    check_base(map.types, base.type_ids_size);
+    check_base(map.protos, base.proto_ids_size);
+    check_base(map.fields, base.field_ids_size);
+    check_base(map.methods, base.method_ids_size);
+    auto sources = [](const std::vector<uint32_t>& table) {  // output index -> pool index before sorting
+        std::vector<uint32_t> source(table.size());
+        for (uint32_t i = 0; i < table.size(); i++) source[table[i]] = i;
+        return source;
+    };
+    std::vector<uint32_t> string_source = sources(map.strings);
+    std::vector<uint32_t> proto_source = sources(map.protos);
     
-    // 4. Class data items
-    std::vector<uint32_t> class_data_offs;
-    size_t code_idx = 0;
-    for (size_t ci = 0; ci < classes_.size(); ci++) {
-        const auto& cls = classes_[ci];
-        if (cls.static_fields.empty() && cls.instance_fields.empty() &&
-            cls.direct_methods.empty() && cls.virtual_methods.empty()) {
-            class_data_offs.push_back(0);
+    // Edited classes replace their class_def in place, deleted ones are dropped and the rest are appended
+    std::vector<int32_t> replaced_by(original_classes_.size(), -1);
+    std::unordered_set<uint32_t> dropped_class_data;
+    std::vector<size_t> added;
+    for (size_t i = 0; i < classes.size(); i++) {
+        auto it = original_class_map_.find(classes[i].class_name);
+        if (it == original_class_map_.end()) {
+            added.push_back(i);
             continue;
         }
+        replaced_by[it->second] = static_cast<int32_t>(i);
+    }
+    uint32_t kept_classes = 0;
+    for (size_t i = 0; i < original_classes_.size(); i++) {
+        bool kept = replaced_by[i] < 0 && !removed_classes_[i];
+        if (!kept && original_classes_[i].class_data_off != 0) {
+            dropped_class_data.insert(original_classes_[i].class_data_off);
+        }
+        if (kept || replaced_by[i] >= 0) kept_classes++;
+    }
+    
+    // A class_def must come after those of its superclass and interfaces
+    std::vector<size_t> appended;
+    std::unordered_set<std::string> pending;
+    for (size_t i : added) pending.insert(classes[i].class_name);
+    while (!added.empty()) {
+        size_t remaining = added.size();
+        for (auto it = added.begin(); it != added.end();) {
+            const ClassBuilder& cls = classes[*it];
+            bool ready = !pending.count(cls.super_class);
+            for (const auto& i : cls.interfaces) ready = ready && !pending.count(i);
+            if (!ready) {
+                ++it;
+                continue;
+            }
+            appended.push_back(*it);
+            pending.erase(cls.class_name);
+            it = added.erase(it);
+        }
+        if (added.size() == remaining) {  // inheritance cycle: keep declaration order
+            appended.insert(appended.end(), added.begin(), added.end());
+            break;
+        }
+    }
+    
+    // Items appended to each data section; links fill in offsets between appended items
+    // once the layout is known
+    struct Appended {
+        std::vector<uint8_t> data;
+        uint32_t count = 0;
+    };
+    struct Link {
+        uint16_t from;  // section holding the offset
+        uint32_t pos;   // position of the offset in that section's appended data
+        uint16_t to;
+        uint32_t rel;   // position of the target in that section's appended data
+    };
+    std::unordered_map<uint16_t, Appended> tails;
+    std::vector<Link> links;
+    
+    // string_data of new strings
+    Appended& string_data = tails[kTypeStringDataItem];
+    std::vector<uint32_t> string_data_rel(strings_.size(), kNoIndex);
+    for (size_t i = 0; i < strings_.size(); i++) {
+        if (string_source[i] < base.string_ids_size) continue;
+        string_data_rel[i] = string_data.data.size();
+        write_uleb128(string_data.data, utf16_length(strings_[i]));
+        string_data.data.insert(string_data.data.end(), strings_[i].begin(), strings_[i].end());
+        string_data.data.push_back(0);
+        string_data.count++;
+    }
+    
+    // type_lists of new protos and edited interfaces, shared with identical base DEX lists
+    struct ListRef {
+        uint32_t off = 0;        // base DEX offset, or offset into type_lists when appended
+        bool appended = false;
+    };
+    Appended& type_lists = tails[kTypeTypeList];
+    std::unordered_map<std::string, ListRef> list_index;
+    bool base_lists_indexed = false;
+    auto intern_list = [&](const std::vector<uint32_t>& type_idxs) -> ListRef {
+        if (type_idxs.empty()) return {};
+        std::vector<uint8_t> list;
+        write_le<uint32_t>(list, type_idxs.size());
+        for (uint32_t idx : type_idxs) write_le<uint16_t>(list, idx);
         
-        class_data_offs.push_back(out.size());
+        if (!base_lists_indexed) {
+            base_lists_indexed = true;
+            // Keyed by the output type ids, which the type_list fix-up below writes into the copies
+            auto index_base_list = [&](uint32_t off) {
+                if (off == 0 || off + 4ull > in.size()) return;
+                uint32_t size = read_le<uint32_t>(&in[off]);
+                if (off + 4 + uint64_t(size) * 2 > in.size()) return;
+                std::string key(reinterpret_cast<const char*>(&in[off]), 4);
+                for (uint32_t i = 0; i < size; i++) {
+                    uint32_t idx = read_le<uint16_t>(&in[off + 4 + i * 2]);
+                    if (!remap_lookup(map.types, idx)) return;
+                    key.push_back(static_cast<char>(idx & 0xFF));
+                    key.push_back(static_cast<char>(idx >> 8));
+                }
+                list_index.emplace(std::move(key), ListRef{off, false});
+            };
+            for (const auto& proto : protos_) index_base_list(proto.params_off);
+            for (const auto& def : original_classes_) index_base_list(def.interfaces_off);
+        }
+        std::string key(list.begin(), list.end());
+        auto it = list_index.find(key);
+        if (it != list_index.end()) return it->second;
         
-        write_uleb128(out, cls.static_fields.size());
-        write_uleb128(out, cls.instance_fields.size());
-        write_uleb128(out, cls.direct_methods.size());
-        write_uleb128(out, cls.virtual_methods.size());
+        while (type_lists.data.size() % 4 != 0) type_lists.data.push_back(0);
+        ListRef ref{static_cast<uint32_t>(type_lists.data.size()), true};
+        type_lists.data.insert(type_lists.data.end(), list.begin(), list.end());
+        type_lists.count++;
+        list_index.emplace(std::move(key), ref);
+        return ref;
+    };
+    std::vector<ListRef> proto_lists(protos_.size());
+    for (size_t i = 0; i < protos_.size(); i++) {
+        if (proto_source[i] >= base.proto_ids_size) proto_lists[i] = intern_list(protos_[i].param_type_idxs);
+    }
+    std::vector<ListRef> interface_lists;
+    for (const auto& cls : classes) {
+        std::vector<uint32_t> type_idxs;
+        for (const auto& i : cls.interfaces) type_idxs.push_back(type_map_[i]);
+        interface_lists.push_back(intern_list(type_idxs));
+    }
+    
+    // code_items of methods whose code was replaced; untouched methods keep their base code_item
+    Appended& code_items = tails[kTypeCodeItem];
+    Appended& debug_infos = tails[kTypeDebugInfoItem];
+    std::vector<std::vector<uint32_t>> code_rel(classes.size());
+    for (size_t ci = 0; ci < classes.size(); ci++) {
+        for (const auto* methods : {&classes[ci].direct_methods, &classes[ci].virtual_methods}) {
+            for (const auto& m : *methods) {
+                if (m.code.empty()) {
+                    code_rel[ci].push_back(kNoIndex);
+                    continue;
+                }
+                uint32_t rel = code_items.data.size();
+                code_rel[ci].push_back(rel);
+                auto code_data = build_code_item(m);
+                code_items.data.insert(code_items.data.end(), code_data.begin(), code_data.end());
+                code_items.count++;
+                
+                const DebugInfo& debug = m.debug_info;
+                if (debug.events.empty() && debug.parameter_names.empty()) continue;
+                links.push_back({kTypeCodeItem, rel + 8, kTypeDebugInfoItem,
+                                 static_cast<uint32_t>(debug_infos.data.size())});
+                write_debug_info(debug_infos.data, debug);
+                debug_infos.count++;
+            }
+        }
+    }
+    
+    // Annotations and static values of edited classes
+    Appended& annotation_items = tails[kTypeAnnotationItem];
+    Appended& annotation_sets = tails[kTypeAnnotationSetItem];
+    Appended& ref_lists = tails[kTypeAnnotationSetRefList];
+    Appended& directories = tails[kTypeAnnotationsDirectoryItem];
+    Appended& encoded_arrays = tails[kTypeEncodedArrayItem];
+    auto add_set = [&](const std::vector<AnnotationDef>& annotations) {
+        std::vector<const AnnotationDef*> sorted;
+        for (const auto& annotation : annotations) sorted.push_back(&annotation);
+        std::stable_sort(sorted.begin(), sorted.end(), [](const AnnotationDef* a, const AnnotationDef* b) {
+            return a->type_idx < b->type_idx;
+        });
+        uint32_t rel = annotation_sets.data.size();
+        write_le<uint32_t>(annotation_sets.data, sorted.size());
+        for (const AnnotationDef* annotation : sorted) {
+            links.push_back({kTypeAnnotationSetItem, static_cast<uint32_t>(annotation_sets.data.size()),
+                             kTypeAnnotationItem, static_cast<uint32_t>(annotation_items.data.size())});
+            write_le<uint32_t>(annotation_sets.data, 0);
+            annotation_items.data.push_back(annotation->visibility);
+            annotation_items.data.insert(annotation_items.data.end(), annotation->encoded.begin(),
+                                         annotation->encoded.end());
+            annotation_items.count++;
+        }
+        annotation_sets.count++;
+        return rel;
+    };
+    
+    std::vector<uint32_t> directory_rel(classes.size(), kNoIndex);
+    std::vector<uint32_t> static_values_rel(classes.size(), kNoIndex);
+    for (size_t ci = 0; ci < classes.size(); ci++) {
+        const ClassBuilder& cls = classes[ci];
         
-        // Fields
-        uint32_t prev_idx = 0;
+        // Directory entries ascend by member index; parameter annotations go through a ref list
+        using Entry = std::pair<uint32_t, uint32_t>;  // member index, appended set or ref list
+        std::vector<Entry> field_sets, method_sets, parameter_lists;
+        for (const auto* fields : {&cls.static_fields, &cls.instance_fields}) {
+            for (const auto& f : *fields) {
+                if (f.annotations.empty()) continue;
+                field_sets.push_back({field_map_[cls.class_name + "->" + f.name + ":" + f.type],
+                                      add_set(f.annotations)});
+            }
+        }
+        for (const auto* methods : {&cls.direct_methods, &cls.virtual_methods}) {
+            for (const auto& m : *methods) {
+                uint32_t method_idx = method_map_[cls.class_name + "->" + m.name + m.prototype.to_string()];
+                if (!m.annotations.empty()) method_sets.push_back({method_idx, add_set(m.annotations)});
+                
+                bool annotated = false;
+                for (const auto& set : m.parameter_annotations) annotated = annotated || !set.empty();
+                if (!annotated) continue;
+                uint32_t list = ref_lists.data.size();
+                write_le<uint32_t>(ref_lists.data, m.parameter_annotations.size());
+                for (const auto& set : m.parameter_annotations) {
+                    uint32_t pos = ref_lists.data.size();
+                    write_le<uint32_t>(ref_lists.data, 0);
+                    if (set.empty()) continue;
+                    links.push_back({kTypeAnnotationSetRefList, pos, kTypeAnnotationSetItem, add_set(set)});
+                }
+                ref_lists.count++;
+                parameter_lists.push_back({method_idx, list});
+            }
+        }
+        if (!cls.annotations.empty() || !field_sets.empty() || !method_sets.empty() || !parameter_lists.empty()) {
+            std::sort(field_sets.begin(), field_sets.end());
+            std::sort(method_sets.begin(), method_sets.end());
+            std::sort(parameter_lists.begin(), parameter_lists.end());
+            
+            auto& dir = directories.data;
+            directory_rel[ci] = dir.size();
+            if (!cls.annotations.empty()) {
+                links.push_back({kTypeAnnotationsDirectoryItem, static_cast<uint32_t>(dir.size()),
+                                 kTypeAnnotationSetItem, add_set(cls.annotations)});
+            }
+            write_le<uint32_t>(dir, 0);
+            write_le<uint32_t>(dir, field_sets.size());
+            write_le<uint32_t>(dir, method_sets.size());
+            write_le<uint32_t>(dir, parameter_lists.size());
+            for (const auto* entries : {&field_sets, &method_sets, &parameter_lists}) {
+                uint16_t target = entries == &parameter_lists ? kTypeAnnotationSetRefList : kTypeAnnotationSetItem;
+                for (const Entry& entry : *entries) {
+                    write_le<uint32_t>(dir, entry.first);
+                    links.push_back({kTypeAnnotationsDirectoryItem, static_cast<uint32_t>(dir.size()), target,
+                                     entry.second});
+                    write_le<uint32_t>(dir, 0);
+                }
+            }
+            directories.count++;
+        }
+        
+        // Initial values follow the static fields in class_data order, up to the last one that has a value
+        std::vector<std::pair<uint32_t, const FieldDef*>> statics;
         for (const auto& f : cls.static_fields) {
-            uint32_t idx = field_map_[cls.class_name + "->" + f.name + ":" + f.type];
-            write_uleb128(out, idx - prev_idx);
-            write_uleb128(out, f.access_flags);
-            prev_idx = idx;
+            statics.push_back({field_map_[cls.class_name + "->" + f.name + ":" + f.type], &f});
         }
-        prev_idx = 0;
-        for (const auto& f : cls.instance_fields) {
-            uint32_t idx = field_map_[cls.class_name + "->" + f.name + ":" + f.type];
-            write_uleb128(out, idx - prev_idx);
-            write_uleb128(out, f.access_flags);
-            prev_idx = idx;
+        std::sort(statics.begin(), statics.end());
+        size_t value_count = statics.size();
+        while (value_count > 0 && statics[value_count - 1].second->initial_value.empty()) value_count--;
+        if (value_count == 0) continue;
+        static_values_rel[ci] = encoded_arrays.data.size();
+        write_uleb128(encoded_arrays.data, value_count);
+        for (size_t i = 0; i < value_count; i++) {
+            const FieldDef& f = *statics[i].second;
+            if (f.initial_value.empty()) {
+                write_default_value(encoded_arrays.data, f.type);
+            } else {
+                encoded_arrays.data.insert(encoded_arrays.data.end(), f.initial_value.begin(), f.initial_value.end());
+            }
         }
+        encoded_arrays.count++;
+    }
+    
+    // Sections of the base DEX, in file order
+    if (base.map_off + 4ull > in.size()) return {};
+    uint32_t map_size = read_le<uint32_t>(&in[base.map_off]);
+    if (base.map_off + 4 + uint64_t(map_size) * 12 > in.size()) return {};
+    std::vector<Section> sections;
+    for (uint32_t i = 0; i < map_size; i++) {
+        const uint8_t* item = &in[base.map_off + 4 + i * 12];
+        Section s;
+        s.type = read_le<uint16_t>(item);
+        s.count = s.old_count = read_le<uint32_t>(item + 4);
+        s.old_off = read_le<uint32_t>(item + 8);
+        sections.push_back(std::move(s));
+    }
+    std::sort(sections.begin(), sections.end(),
+              [](const Section& a, const Section& b) { return a.old_off < b.old_off; });
+    
+    std::vector<uint32_t> class_data_items;  // base class_data_items that are kept
+    std::vector<uint32_t> code_item_offs;    // base code_items, for the debug_info_off fix-up
+    std::unordered_map<uint32_t, uint32_t> widened_debug;  // widened base code_item -> its appended debug info
+    std::vector<uint32_t> pc_map;
+    uint32_t file_end = std::min<size_t>(base.file_size, in.size());
+    for (size_t i = 0; i < sections.size(); i++) {
+        Section& s = sections[i];
+        uint32_t next = i + 1 < sections.size() ? sections[i + 1].old_off : file_end;
+        if (next < s.old_off) return {};
         
-        // Methods with code offsets
-        prev_idx = 0;
-        for (const auto& m : cls.direct_methods) {
-            uint32_t idx = method_map_[cls.class_name + "->" + m.name + m.prototype.to_string()];
-            write_uleb128(out, idx - prev_idx);
-            write_uleb128(out, m.access_flags);
-            write_uleb128(out, code_item_offs[code_idx++]);
-            prev_idx = idx;
+        size_t end = 0;
+        if (reordered && has_indexes(s.type)) {
+            size_t align = item_alignment(s.type);
+            bool remapped = true;
+            uint32_t failed = 0;
+            end = walk_items(s.type, in, s.old_off, s.count, [&](size_t item) {
+                while (s.head.size() % align != 0) s.head.push_back(0);
+                s.items.push_back({static_cast<uint32_t>(item), static_cast<uint32_t>(s.head.size())});
+                if (s.type == kTypeCodeItem) code_item_offs.push_back(item);
+                if (!remapped) return;
+                failed = static_cast<uint32_t>(item);
+                const uint8_t* data_end = in.data() + in.size();
+                if (s.type != kTypeCodeItem) {
+                    remapped = remap_item(s.type, &in[item], data_end, map, s.head);
+                    return;
+                }
+                remapped = remap_code_item(&in[item], data_end, map, s.head, pc_map, error);
+                
+                // A widened code_item gets its own copy of its debug info, which other methods may share
+                uint32_t debug_off = read_le<uint32_t>(&in[item + 8]);
+                if (!remapped || pc_map.empty() || debug_off == 0) return;
+                widened_debug.emplace(static_cast<uint32_t>(item), static_cast<uint32_t>(debug_infos.data.size()));
+                remapped = debug_off < in.size() &&
+                           remap_debug_info(&in[debug_off], data_end, map, debug_infos.data, &pc_map);
+                debug_infos.count++;
+            });
+            if (end == 0) return {};
+            if (!remapped) {
+                std::ostringstream where;
+                where << "Item 0x" << std::hex << failed << " of map type 0x" << s.type;
+                error = where.str() + (error.empty() ? " is malformed" : ": " + error);
+                return {};
+            }
+            continue;
         }
-        prev_idx = 0;
-        for (const auto& m : cls.virtual_methods) {
-            uint32_t idx = method_map_[cls.class_name + "->" + m.name + m.prototype.to_string()];
-            write_uleb128(out, idx - prev_idx);
-            write_uleb128(out, m.access_flags);
-            write_uleb128(out, code_item_offs[code_idx++]);
-            prev_idx = idx;
+        auto tail = tails.find(s.type);
+        switch (s.type) {
+            case kTypeHeaderItem: s.copy_size = base.header_size; break;
+            case kTypeCallSiteIdItem: s.copy_size = s.count * 4; break;
+            case kTypeMethodHandleItem: s.copy_size = s.count * 8; break;
+            case kTypeStringIdItem:
+            case kTypeTypeIdItem:
+            case kTypeProtoIdItem:
+            case kTypeFieldIdItem:
+            case kTypeMethodIdItem:
+            case kTypeClassDefItem: break;  // rewritten as a whole below
+            case kTypeMapList: break;
+            case kTypeCodeItem:
+                end = walk_items(s.type, in, s.old_off, s.count, [&](size_t item) {
+                    code_item_offs.push_back(item);
+                });
+                if (end == 0) return {};
+                s.copy_size = end - s.old_off;
+                break;
+            case kTypeClassDataItem:
+                end = walk_items(s.type, in, s.old_off, s.count, [&](size_t item) {
+                    if (!dropped_class_data.count(item)) class_data_items.push_back(item);
+                });
+                if (end == 0) return {};
+                // Starting from the base size usually lets the layout below settle in one pass
+                s.tail.resize(end - s.old_off);
+                break;
+            case kTypeHiddenapiClassDataItem:
+                // Indexed by class_def and member order, both of which edits change
+                s.count = 0;
+                break;
+            default:
+                if (tail == tails.end() || tail->second.count == 0) {
+                    s.copy_size = next - s.old_off;
+                    break;
+                }
+                // Appended items must follow the last item directly, not its trailing padding
+                end = walk_items(s.type, in, s.old_off, s.count, [](size_t) {});
+                if (end == 0) return {};
+                s.copy_size = end - s.old_off;
+                break;
         }
+        if (s.old_off + uint64_t(s.copy_size) > in.size()) return {};
     }
-    while (out.size() % 4 != 0) out.push_back(0);
     
-    // === Fixed-size sections ===
+    // Sections the base DEX did not need: ids before the data, data before the map_list
+    auto find_section = [&](uint16_t type) -> Section* {
+        for (auto& s : sections) {
+            if (s.type == type) return &s;
+        }
+        return nullptr;
+    };
+    auto ensure_section = [&](uint16_t type) {
+        if (find_section(type)) return;
+        auto pos = std::find_if(sections.begin(), sections.end(), [&](const Section& s) {
+            return type < kTypeMapList ? s.type > type : s.type == kTypeMapList;
+        });
+        Section s;
+        s.type = type;
+        sections.insert(pos, std::move(s));
+    };
+    if (strings_.size() > base.string_ids_size) {
+        ensure_section(kTypeStringIdItem);
+        ensure_section(kTypeStringDataItem);
+    }
+    if (types_.size() > base.type_ids_size) ensure_section(kTypeTypeIdItem);
+    if (protos_.size() > base.proto_ids_size) ensure_section(kTypeProtoIdItem);
+    if (fields_.size() > base.field_ids_size) ensure_section(kTypeFieldIdItem);
+    if (methods_.size() > base.method_ids_size) ensure_section(kTypeMethodIdItem);
+    if (!appended.empty()) ensure_section(kTypeClassDefItem);
+    for (uint16_t type : {kTypeTypeList, kTypeAnnotationSetRefList, kTypeAnnotationSetItem, kTypeCodeItem,
+                          kTypeDebugInfoItem, kTypeAnnotationItem, kTypeEncodedArrayItem,
+                          kTypeAnnotationsDirectoryItem}) {
+        if (tails[type].count) ensure_section(type);
+    }
     
-    // String IDs
-    uint32_t string_ids_off = out.size();
-    for (uint32_t off : string_data_offs) {
-        write_le<uint32_t>(out, off);
+    uint32_t class_data_count = class_data_items.size();
+    for (const auto& cls : classes) {
+        if (!cls.static_fields.empty() || !cls.instance_fields.empty() ||
+            !cls.direct_methods.empty() || !cls.virtual_methods.empty()) {
+            class_data_count++;
+        }
     }
+    if (class_data_count) ensure_section(kTypeClassDataItem);
+    if (!find_section(kTypeHeaderItem) || !find_section(kTypeMapList)) return {};
     
-    // Type IDs
-    uint32_t type_ids_off = out.size();
-    for (const auto& t : types_) {
-        auto it = string_map_.find(t);
-        write_le<uint32_t>(out, it != string_map_.end() ? it->second : 0);
+    // Appended items and final counts
+    uint32_t map_entries = 0;
+    for (auto& s : sections) {
+        switch (s.type) {
+            // Id tables are written from the pools, which are in output order
+            case kTypeStringIdItem:
+                s.count = strings_.size();
+                s.tail.resize(s.count * 4);
+                break;
+            case kTypeTypeIdItem:
+                s.count = types_.size();
+                for (const auto& type : types_) write_le<uint32_t>(s.tail, string_map_[type]);
+                break;
+            case kTypeProtoIdItem:
+                s.count = protos_.size();
+                s.tail.resize(s.count * 12);
+                break;
+            case kTypeFieldIdItem:
+                s.count = fields_.size();
+                for (size_t i = 0; i < fields_.size(); i++) {
+                    write_le<uint16_t>(s.tail, fields_[i].class_idx);
+                    write_le<uint16_t>(s.tail, fields_[i].type_idx);
+                    write_le<uint32_t>(s.tail, fields_[i].name_idx);
+                }
+                break;
+            case kTypeMethodIdItem:
+                s.count = methods_.size();
+                for (size_t i = 0; i < methods_.size(); i++) {
+                    write_le<uint16_t>(s.tail, methods_[i].class_idx);
+                    write_le<uint16_t>(s.tail, methods_[i].proto_idx);
+                    write_le<uint32_t>(s.tail, methods_[i].name_idx);
+                }
+                break;
+            case kTypeClassDefItem:
+                s.count = kept_classes + appended.size();
+                s.tail.resize(s.count * 32);
+                break;
+            case kTypeClassDataItem:
+                s.count = class_data_count;
+                break;
+            default: {
+                auto tail = tails.find(s.type);
+                if (tail == tails.end() || tail->second.count == 0) break;
+                s.count = s.old_count + tail->second.count;
+                s.tail_off = item_alignment(s.type) == 4 ? align4(s.kept_size()) : s.kept_size();
+                s.tail = std::move(tail->second.data);
+                break;
+            }
+        }
+        if (s.count) map_entries++;
+    }
+    sections.erase(std::remove_if(sections.begin(), sections.end(),
+                                  [](const Section& s) { return s.count == 0; }),
+                   sections.end());
+    Section* map_section = find_section(kTypeMapList);
+    map_section->tail.resize(4 + map_entries * 12);
+    
+    // Lay sections out back to back; class_data_items hold code offsets as ULEB128, so their
+    // size depends on where the code lands and the layout is repeated until it settles
+    Section* code_section = find_section(kTypeCodeItem);
+    Section* class_data_section = find_section(kTypeClassDataItem);
+    Relocations relocations;
+    std::vector<uint32_t> class_data_offs(classes.size(), 0);
+    uint32_t file_size = 0;
+    for (int pass = 0;; pass++) {
+        if (pass == 8) return {};
+        relocations.clear();
+        uint64_t cursor = 0;
+        for (auto& s : sections) {
+            s.new_off = align4(static_cast<uint32_t>(cursor));
+            if (s.copy_size) relocations.add_range(s.old_off, s.copy_size, s.new_off);
+            for (const auto& item : s.items) relocations.add_item(item.first, s.new_off + item.second);
+            cursor = uint64_t(s.new_off) + s.size();
+            if (cursor > 0xFFFFFFF0ull) return {};
+        }
+        file_size = static_cast<uint32_t>(cursor);
+        if (!class_data_section) break;
+        
+        // Kept items only change in their member indexes and code_off values; transcode them in place.
+        // Base ids keep their relative order, so each member list still ascends.
+        std::vector<uint8_t> content;
+        content.reserve(class_data_section->tail.size());
+        std::vector<std::pair<uint32_t, uint32_t>> kept_items;
+        for (uint32_t item : class_data_items) {
+            kept_items.push_back({item, class_data_section->new_off + static_cast<uint32_t>(content.size())});
+            const uint8_t* p = &in[item];
+            const uint8_t* end = in.data() + in.size();
+            uint32_t sizes[4];
+            for (auto& size : sizes) {
+                if (!read_uleb128(p, end, size)) return {};
+                write_uleb128(content, size);
+            }
+            for (int list = 0; list < 4; list++) {
+                const std::vector<uint32_t>& table = list < 2 ? map.fields : map.methods;
+                uint32_t idx = 0, prev = 0;
+                for (uint32_t i = 0; i < sizes[list]; i++) {
+                    uint32_t diff, flags;
+                    if (!read_uleb128(p, end, diff) || !read_uleb128(p, end, flags)) return {};
+                    idx += diff;
+                    uint32_t new_idx = idx;
+                    if (!remap_lookup(table, new_idx) || (i > 0 && new_idx <= prev)) return {};
+                    write_uleb128(content, i == 0 ? new_idx : new_idx - prev);
+                    write_uleb128(content, flags);
+                    prev = new_idx;
+                    if (list < 2) continue;
+                    uint32_t code_off;
+                    if (!read_uleb128(p, end, code_off) || !relocations.apply(code_off, code_off)) return {};
+                    write_uleb128(content, code_off);
+                }
+            }
+        }
+        for (const auto& item : kept_items) relocations.add_item(item.first, item.second);
+        relocations.sort_items();
+        
+        uint32_t new_code_off = code_section ? code_section->new_off + code_section->tail_off : 0;
+        for (size_t ci = 0; ci < classes.size(); ci++) {
+            const ClassBuilder& cls = classes[ci];
+            ClassMembers members;
+            auto field_idx = [&](const FieldDef& f) { return field_map_[cls.class_name + "->" + f.name + ":" + f.type]; };
+            for (const auto& f : cls.static_fields) members.static_fields.push_back({field_idx(f), f.access_flags});
+            for (const auto& f : cls.instance_fields) members.instance_fields.push_back({field_idx(f), f.access_flags});
+            size_t k = 0;
+            for (auto* methods : {&cls.direct_methods, &cls.virtual_methods}) {
+                auto& out = methods == &cls.direct_methods ? members.direct_methods : members.virtual_methods;
+                for (const auto& m : *methods) {
+                    uint32_t code_off = 0;
+                    uint32_t rel = code_rel[ci][k++];
+                    if (rel != kNoIndex) {
+                        code_off = new_code_off + rel;
+                    } else if (!relocations.apply(m.code_off, code_off)) {
+                        return {};
+                    }
+                    out.push_back({method_map_[cls.class_name + "->" + m.name + m.prototype.to_string()],
+                                   m.access_flags, code_off});
+                }
+            }
+            if (members.static_fields.empty() && members.instance_fields.empty() &&
+                members.direct_methods.empty() && members.virtual_methods.empty()) {
+                class_data_offs[ci] = 0;
+                continue;
+            }
+            // Members are diff-encoded, so each list must ascend by index
+            auto by_field = [](const EncodedField& a, const EncodedField& b) {
+                return a.field_idx < b.field_idx;
+            };
+            auto by_method = [](const EncodedMethod& a, const EncodedMethod& b) {
+                return a.method_idx < b.method_idx;
+            };
+            std::sort(members.static_fields.begin(), members.static_fields.end(), by_field);
+            std::sort(members.instance_fields.begin(), members.instance_fields.end(), by_field);
+            std::sort(members.direct_methods.begin(), members.direct_methods.end(), by_method);
+            std::sort(members.virtual_methods.begin(), members.virtual_methods.end(), by_method);
+            class_data_offs[ci] = class_data_section->new_off + content.size();
+            write_class_data(content, members);
+        }
+        
+        bool settled = content.size() == class_data_section->tail.size();
+        class_data_section->tail = std::move(content);
+        if (settled) break;
+    }
+    
+    std::vector<uint8_t> out;
+    out.reserve(file_size);
+    for (const auto& s : sections) {
+        out.resize(s.new_off, 0);
+        out.insert(out.end(), in.begin() + s.old_off, in.begin() + s.old_off + s.copy_size);
+        out.insert(out.end(), s.head.begin(), s.head.end());
+        if (s.tail.empty()) continue;
+        out.resize(s.new_off + s.tail_off, 0);
+        out.insert(out.end(), s.tail.begin(), s.tail.end());
+    }
+    
+    // Fix up offsets stored inside copied items, and fill in appended ids that point into the data
+    bool ok = true;
+    auto relocate_at = [&](size_t pos) {
+        uint32_t off;
+        if (!relocations.apply(read_le<uint32_t>(&out[pos]), off)) {
+            ok = false;
+            return;
+        }
+        write_le<uint32_t>(&out[pos], off);
+    };
+    // Base id stored at pos, for items copied while the ids moved
+    auto remap_at = [&](size_t pos, const std::vector<uint32_t>& table) {
+        uint32_t idx = read_le<uint32_t>(&out[pos]);
+        if (!reordered || idx == kNoIndex) return;
+        ok = ok && remap_lookup(table, idx);
+        write_le<uint32_t>(&out[pos], idx);
+    };
+    // Output offset of an appended item, `rel` bytes into the appended data of its section
+    auto appended_at = [&](uint16_t type, uint32_t rel) {
+        const Section* s = find_section(type);
+        return s->new_off + s->tail_off + rel;
+    };
+    auto resolve_list = [&](const ListRef& ref) {
+        if (!ref.appended) {
+            uint32_t off = 0;
+            ok = ok && relocations.apply(ref.off, off);
+            return off;
+        }
+        return appended_at(kTypeTypeList, ref.off);
+    };
+    auto write_class_def = [&](uint8_t* p, size_t ci) {
+        const ClassBuilder& cls = classes[ci];
+        write_le<uint32_t>(p, type_map_[cls.class_name]);
+        write_le<uint32_t>(p + 4, cls.access_flags);
+        write_le<uint32_t>(p + 8, cls.super_class.empty() ? kNoIndex : type_map_[cls.super_class]);
+        write_le<uint32_t>(p + 12, resolve_list(interface_lists[ci]));
+        write_le<uint32_t>(p + 16, cls.source_file.empty() ? kNoIndex : string_map_[cls.source_file]);
+        write_le<uint32_t>(p + 20, directory_rel[ci] == kNoIndex
+                                       ? 0 : appended_at(kTypeAnnotationsDirectoryItem, directory_rel[ci]));
+        write_le<uint32_t>(p + 24, class_data_offs[ci]);
+        write_le<uint32_t>(p + 28, static_values_rel[ci] == kNoIndex
+                                       ? 0 : appended_at(kTypeEncodedArrayItem, static_values_rel[ci]));
+    };
+    
+    for (const auto& s : sections) {
+        auto moved = [&](size_t item) { return s.new_off + (item - s.old_off); };
+        switch (s.type) {
+            case kTypeStringIdItem:
+                for (uint32_t i = 0; i < s.count; i++) {
+                    uint32_t pos = s.new_off + i * 4;
+                    if (string_data_rel[i] != kNoIndex) {
+                        write_le<uint32_t>(&out[pos], appended_at(kTypeStringDataItem, string_data_rel[i]));
+                        continue;
+                    }
+                    std::memcpy(&out[pos], &in[base.string_ids_off + string_source[i] * 4ull], 4);
+                    relocate_at(pos);
+                }
+                break;
+            case kTypeProtoIdItem:
+                for (uint32_t i = 0; i < s.count; i++) {
+                    uint8_t* p = &out[s.new_off + i * 12];
+                    write_le<uint32_t>(p, protos_[i].shorty_idx);
+                    write_le<uint32_t>(p + 4, protos_[i].return_type_idx);
+                    if (proto_source[i] >= base.proto_ids_size) {
+                        write_le<uint32_t>(p + 8, resolve_list(proto_lists[i]));
+                        continue;
+                    }
+                    write_le<uint32_t>(p + 8, protos_[i].params_off);
+                    relocate_at(s.new_off + i * 12 + 8);
+                }
+                break;
+            case kTypeClassDefItem: {
+                size_t pos = s.new_off;
+                for (uint32_t i = 0; i < original_classes_.size(); i++) {
+                    if (replaced_by[i] >= 0) {
+                        write_class_def(&out[pos], replaced_by[i]);
+                    } else if (removed_classes_[i]) {
+                        continue;
+                    } else {
+                        std::memcpy(&out[pos], &in[base.class_defs_off + i * 32], 32);
+                        remap_at(pos, map.types);           // class_idx
+                        remap_at(pos + 8, map.types);       // superclass_idx
+                        remap_at(pos + 16, map.strings);    // source_file_idx
+                        relocate_at(pos + 12);
+                        relocate_at(pos + 20);
+                        relocate_at(pos + 24);
+                        relocate_at(pos + 28);
+                    }
+                    pos += 32;
+                }
+                for (size_t ci : appended) {
+                    write_class_def(&out[pos], ci);
+                    pos += 32;
+                }
+                break;
+            }
+            case kTypeCallSiteIdItem:
+                for (uint32_t i = 0; i < s.old_count; i++) relocate_at(s.new_off + i * 4);
+                break;
+            case kTypeMethodHandleItem:
+                for (uint32_t i = 0; i < s.old_count && reordered; i++) {
+                    // Types 0x00-0x03 are field accessors, the rest invoke methods
+                    uint32_t pos = s.new_off + i * 8;
+                    uint32_t idx = read_le<uint16_t>(&out[pos + 4]);
+                    ok = ok && remap_lookup(read_le<uint16_t>(&out[pos]) <= 0x03 ? map.fields : map.methods, idx);
+                    if (ok && idx > 0xFFFF) {
+                        error = "Method handle " + std::to_string(i) + " member index " + std::to_string(idx) +
+                                " does not fit 16 bits";
+                        return {};
+                    }
+                    write_le<uint16_t>(&out[pos + 4], static_cast<uint16_t>(idx));
+                }
+                break;
+            case kTypeCodeItem:
+                for (uint32_t item : code_item_offs) {
+                    uint32_t pos = 0;
+                    ok = ok && relocations.apply(item, pos);
+                    if (!ok) break;
+                    auto widened = widened_debug.find(item);
+                    if (widened == widened_debug.end()) {
+                        relocate_at(pos + 8);  // debug_info_off
+                    } else {
+                        write_le<uint32_t>(&out[pos + 8], appended_at(kTypeDebugInfoItem, widened->second));
+                    }
+                }
+                break;
+            case kTypeTypeList:
+                if (!reordered) break;
+                walk_items(s.type, in, s.old_off, s.old_count, [&](size_t item) {
+                    uint32_t entries = read_le<uint32_t>(&in[item]);
+                    for (uint32_t i = 0; i < entries; i++) {
+                        uint32_t pos = moved(item) + 4 + i * 2;
+                        uint32_t idx = read_le<uint16_t>(&out[pos]);
+                        ok = ok && remap_lookup(map.types, idx);
+                        write_le<uint16_t>(&out[pos], static_cast<uint16_t>(idx));
+                    }
+                });
+                break;
+            case kTypeAnnotationSetRefList:
+            case kTypeAnnotationSetItem:
+                walk_items(s.type, in, s.old_off, s.old_count, [&](size_t item) {
+                    uint32_t entries = read_le<uint32_t>(&in[item]);
+                    for (uint32_t i = 0; i < entries; i++) relocate_at(moved(item) + 4 + i * 4);
+                });
+                break;
+            case kTypeAnnotationsDirectoryItem:
+                walk_items(s.type, in, s.old_off, s.old_count, [&](size_t item) {
+                    relocate_at(moved(item));  // class_annotations_off
+                    uint32_t fields = read_le<uint32_t>(&in[item + 4]);
+                    uint64_t entries = uint64_t(fields) + read_le<uint32_t>(&in[item + 8]) +
+                                       read_le<uint32_t>(&in[item + 12]);
+                    for (uint64_t i = 0; i < entries; i++) {
+                        if (reordered) remap_at(moved(item) + 16 + i * 8, i < fields ? map.fields : map.methods);
+                        relocate_at(moved(item) + 16 + i * 8 + 4);
+                    }
+                });
+                break;
+        }
+    }
+    for (const Link& link : links) {
+        write_le<uint32_t>(&out[appended_at(link.from, link.pos)], appended_at(link.to, link.rel));
+    }
+    if (!ok) return {};
+    
+    uint8_t* map = &out[map_section->new_off];
+    write_le<uint32_t>(map, map_entries);
+    map += 4;
+    for (const auto& s : sections) {
+        write_le<uint16_t>(map, s.type);
+        write_le<uint16_t>(map + 2, 0);
+        write_le<uint32_t>(map + 4, s.count);
+        write_le<uint32_t>(map + 8, s.new_off);
+        map += 12;
     }
     
-    // Proto IDs with type_list offsets
-    uint32_t proto_ids_off = out.size();
-    for (size_t i = 0; i < protos_.size(); i++) {
-        write_le<uint32_t>(out, protos_[i].shorty_idx);
-        write_le<uint32_t>(out, protos_[i].return_type_idx);
-        write_le<uint32_t>(out, type_list_offs[i]);
-    }
-    
-    // Field IDs
-    uint32_t field_ids_off = out.size();
-    for (const auto& f : fields_) {
-        write_le<uint16_t>(out, f.class_idx);
-        write_le<uint16_t>(out, f.type_idx);
-        write_le<uint32_t>(out, f.name_idx);
-    }
-    
-    // Method IDs
-    uint32_t method_ids_off = out.size();
-    for (const auto& m : methods_) {
-        write_le<uint16_t>(out, m.class_idx);
-        write_le<uint16_t>(out, m.proto_idx);
-        write_le<uint32_t>(out, m.name_idx);
-    }
-    
-    // Class defs
-    uint32_t class_defs_off = out.size();
-    for (size_t i = 0; i < classes_.size(); i++) {
-        const auto& cls = classes_[i];
-        auto it = type_map_.find(cls.class_name);
-        write_le<uint32_t>(out, it != type_map_.end() ? it->second : 0);
-        write_le<uint32_t>(out, cls.access_flags);
-        auto super_it = type_map_.find(cls.super_class);
-        write_le<uint32_t>(out, super_it != type_map_.end() ? super_it->second : 0xFFFFFFFF);
-        write_le<uint32_t>(out, 0);  // interfaces_off
-        write_le<uint32_t>(out, 0xFFFFFFFF);  // source_file_idx
-        write_le<uint32_t>(out, 0);  // annotations_off
-        write_le<uint32_t>(out, class_data_offs[i]);
-        write_le<uint32_t>(out, 0);  // static_values_off
-    }
-    
-    // Map list
-    uint32_t map_off = out.size();
-    uint32_t map_count = 0;
-    std::vector<std::tuple<uint16_t, uint32_t, uint32_t>> map_items;
-    
-    map_items.push_back({0x0000, 1, 0});  // header
-    if (!strings_.empty()) map_items.push_back({0x0001, (uint32_t)strings_.size(), string_ids_off});
-    if (!types_.empty()) map_items.push_back({0x0002, (uint32_t)types_.size(), type_ids_off});
-    if (!protos_.empty()) map_items.push_back({0x0003, (uint32_t)protos_.size(), proto_ids_off});
-    if (!fields_.empty()) map_items.push_back({0x0004, (uint32_t)fields_.size(), field_ids_off});
-    if (!methods_.empty()) map_items.push_back({0x0005, (uint32_t)methods_.size(), method_ids_off});
-    if (!classes_.empty()) map_items.push_back({0x0006, (uint32_t)classes_.size(), class_defs_off});
-    map_items.push_back({0x1000, 1, map_off});  // map_list itself
-    
-    write_le<uint32_t>(out, map_items.size());
-    for (const auto& item : map_items) {
-        write_le<uint16_t>(out, std::get<0>(item));
-        write_le<uint16_t>(out, 0);  // unused
-        write_le<uint32_t>(out, std::get<1>(item));
-        write_le<uint32_t>(out, std::get<2>(item));
-    }
-    
-    // Update header
     DexHeader* header = reinterpret_cast<DexHeader*>(out.data());
-    header->file_size = out.size();
-    header->header_size = 0x70;
-    header->endian_tag = 0x12345678;
-    header->map_off = map_off;
-    header->string_ids_size = strings_.size();
-    header->string_ids_off = strings_.empty() ? 0 : string_ids_off;
-    header->type_ids_size = types_.size();
-    header->type_ids_off = types_.empty() ? 0 : type_ids_off;
-    header->proto_ids_size = protos_.size();
-    header->proto_ids_off = protos_.empty() ? 0 : proto_ids_off;
-    header->field_ids_size = fields_.size();
-    header->field_ids_off = fields_.empty() ? 0 : field_ids_off;
-    header->method_ids_size = methods_.size();
-    header->method_ids_off = methods_.empty() ? 0 : method_ids_off;
-    header->class_defs_size = classes_.size();
-    header->class_defs_off = classes_.empty() ? 0 : class_defs_off;
-    header->data_size = out.size() - data_start;
-    header->data_off = data_start;
-    
-    // Compute checksum
+    auto set_ids = [&](uint16_t type, uint32_t& size, uint32_t& off) {
+        const Section* s = find_section(type);
+        size = s ? s->count : 0;
+        off = s ? s->new_off : 0;
+    };
+    set_ids(kTypeStringIdItem, header->string_ids_size, header->string_ids_off);
+    set_ids(kTypeTypeIdItem, header->type_ids_size, header->type_ids_off);
+    set_ids(kTypeProtoIdItem, header->proto_ids_size, header->proto_ids_off);
+    set_ids(kTypeFieldIdItem, header->field_ids_size, header->field_ids_off);
+    set_ids(kTypeMethodIdItem, header->method_ids_size, header->method_ids_off);
+    set_ids(kTypeClassDefItem, header->class_defs_size, header->class_defs_off);
+    header->file_size = file_size;
+    header->link_size = 0;
+    header->link_off = 0;
+    header->map_off = map_section->new_off;
+    header->data_off = map_section->new_off;
+    for (const auto& s : sections) {
+        if (s.type >= kTypeMapList) {
+            header->data_off = s.new_off;
+            break;
+        }
+    }
+    header->data_size = file_size - header->data_off;
     header->checksum = compute_checksum(out);
     
     return out;
@@ -1,7 +1,9 @@
 #include "dex/dex_parser.h"
-#include <fstream>
+#include "dex/insn_iterator.h"
+#include "dex/thread_pool.h"
 #include <sstream>
 #include <cstring>
+#include <algorithm>
 
 namespace dex {
 
@@ -15,22 +17,34 @@ static T read_le(const uint8_t* p) {
 }
 
 bool DexParser::parse(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file) return false;
+    auto mapped = std::make_unique<MappedFile>();
+    if (!mapped->open(path)) return false;
 
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    owned_.clear();
+    data_ = ByteView{mapped->data(), mapped->size()};
+    mapped_ = std::move(mapped);
+    return parse_all();
+}
 
-    data_.resize(size);
-    file.read(reinterpret_cast<char*>(data_.data()), size);
-    file.close();
+bool DexParser::parse(const std::vector<uint8_t>& data) {
+    return parse(std::vector<uint8_t>(data));
+}
 
-    return parse_header() && parse_strings() && parse_types() && parse_classes();
+bool DexParser::parse(std::vector<uint8_t>&& data) {
+    mapped_.reset();
+    owned_ = std::move(data);
+    data_ = ByteView{owned_.data(), owned_.size()};
+    return parse_all();
 }
 
-bool DexParser::parse(const std::vector<uint8_t>& data) {
-    data_ = data;
+bool DexParser::parse_view(const uint8_t* data, size_t size) {
+    mapped_.reset();
+    owned_.clear();
+    data_ = ByteView{data, size};
+    return parse_all();
+}
+
+bool DexParser::parse_all() {
     return parse_header() && parse_strings() && parse_types() && parse_classes();
 }
 
@@ -51,14 +65,8 @@ bool DexParser::parse_strings() {
         return false;
     }
 
-    string_ids_.resize(header_.string_ids_size);
-    strings_.resize(header_.string_ids_size);
-
-    for (uint32_t i = 0; i < header_.string_ids_size; i++) {
-        string_ids_[i] = read_le<uint32_t>(&data_[header_.string_ids_off + i * 4]);
-        strings_[i] = read_string_at(string_ids_[i]);
-    }
-
+    // Entries are decoded on demand
+    string_table_.reset(data_, header_.string_ids_off, header_.string_ids_size);
     return true;
 }
 
@@ -68,19 +76,24 @@ bool DexParser::parse_types() {
     }
 
     type_ids_.resize(header_.type_ids_size);
-    types_.resize(header_.type_ids_size);
 
     for (uint32_t i = 0; i < header_.type_ids_size; i++) {
-        uint32_t string_idx = read_le<uint32_t>(&data_[header_.type_ids_off + i * 4]);
-        type_ids_[i] = string_idx;
-        if (string_idx < strings_.size()) {
-            types_[i] = strings_[string_idx];
-        }
+        type_ids_[i] = read_le<uint32_t>(&data_[header_.type_ids_off + i * 4]);
     }
 
     return true;
 }
 
+const std::vector<std::string>& DexParser::types() const {
+    std::call_once(types_once_, [this]() {
+        types_.resize(type_ids_.size());
+        for (size_t i = 0; i < type_ids_.size(); i++) {
+            types_[i] = string_table_.get(type_ids_[i]);
+        }
+    });
+    return types_;
+}
+
 bool DexParser::parse_classes() {
     if (header_.class_defs_off + header_.class_defs_size * 32 > data_.size()) {
         return false;
@@ -105,17 +118,6 @@ bool DexParser::parse_classes() {
     return true;
 }
 
-std::string DexParser::read_string_at(uint32_t offset) const {
-    if (offset >= data_.size()) return "";
-
-    size_t pos = offset;
-    uint32_t len = read_uleb128(pos);
-    
-    if (pos + len > data_.size()) return "";
-
-    return std::string(reinterpret_cast<const char*>(&data_[pos]), len);
-}
-
 uint32_t DexParser::read_uleb128(size_t& offset) const {
     uint32_t result = 0;
     int shift = 0;
@@ -130,13 +132,115 @@ uint32_t DexParser::read_uleb128(size_t& offset) const {
     return result;
 }
 
+int32_t DexParser::read_sleb128(size_t& offset) const {
+    uint32_t result = 0;
+    int shift = 0;
+    uint8_t b = 0;
+    
+    while (offset < data_.size()) {
+        b = data_[offset++];
+        result |= (b & 0x7F) << shift;
+        shift += 7;
+        if ((b & 0x80) == 0) break;
+    }
+    if (shift < 32 && (b & 0x40)) result |= ~0u << shift;
+    
+    return static_cast<int32_t>(result);
+}
+
 std::string DexParser::get_class_name(uint32_t idx) const {
-    if (idx < types_.size()) {
-        return types_[idx];
+    if (idx < type_ids_.size()) {
+        return string_table_.get(type_ids_[idx]);
     }
     return "";
 }
 
+std::string_view DexParser::type_descriptor(uint32_t type_idx) const {
+    if (type_idx >= type_ids_.size()) return {};
+    return string_table_.raw(type_ids_[type_idx]);
+}
+
+bool DexParser::method_id(uint32_t method_idx, MemberId& out) const {
+    size_t offset = header_.method_ids_off + static_cast<size_t>(method_idx) * 8;
+    if (method_idx >= header_.method_ids_size || offset + 8 > data_.size()) return false;
+
+    out.class_idx = read_le<uint16_t>(&data_[offset]);
+    out.type_idx = read_le<uint16_t>(&data_[offset + 2]);
+    out.name_idx = read_le<uint32_t>(&data_[offset + 4]);
+    return true;
+}
+
+bool DexParser::field_id(uint32_t field_idx, MemberId& out) const {
+    size_t offset = header_.field_ids_off + static_cast<size_t>(field_idx) * 8;
+    if (field_idx >= header_.field_ids_size || offset + 8 > data_.size()) return false;
+
+    out.class_idx = read_le<uint16_t>(&data_[offset]);
+    out.type_idx = read_le<uint16_t>(&data_[offset + 2]);
+    out.name_idx = read_le<uint32_t>(&data_[offset + 4]);
+    return true;
+}
+
+bool DexParser::proto_id(uint32_t proto_idx, ProtoId& out) const {
+    // proto_id: shorty_idx(4), return_type_idx(4), parameters_off(4)
+    size_t offset = header_.proto_ids_off + static_cast<size_t>(proto_idx) * 12;
+    if (proto_idx >= header_.proto_ids_size || offset + 12 > data_.size()) return false;
+
+    out.return_type_idx = read_le<uint32_t>(&data_[offset + 4]);
+    out.params = nullptr;
+    out.param_count = 0;
+
+    uint32_t params_off = read_le<uint32_t>(&data_[offset + 8]);
+    if (params_off != 0 && static_cast<size_t>(params_off) + 4 <= data_.size()) {
+        uint32_t count = read_le<uint32_t>(&data_[params_off]);
+        size_t available = (data_.size() - params_off - 4) / 2;
+        out.params = &data_[params_off + 4];
+        out.param_count = count < available ? count : static_cast<uint32_t>(available);
+    }
+    return true;
+}
+
+MethodInfo DexParser::get_method(uint32_t method_idx) const {
+    MethodInfo info;
+    info.access_flags = 0;
+    info.code_off = 0;
+
+    size_t offset = header_.method_ids_off + static_cast<size_t>(method_idx) * 8;
+    if (method_idx >= header_.method_ids_size || offset + 8 > data_.size()) return info;
+
+    uint16_t class_idx = read_le<uint16_t>(&data_[offset]);
+    uint16_t proto_idx = read_le<uint16_t>(&data_[offset + 2]);
+    uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
+
+    info.class_name = get_class_name(class_idx);
+    info.method_name = string_table_.get(name_idx);
+    info.prototype = get_proto_string(proto_idx);
+    if (const EncodedMethod* def = encoded_method(method_idx)) {
+        info.access_flags = def->access_flags;
+        info.code_off = def->code_off;
+    }
+    return info;
+}
+
+FieldInfo DexParser::get_field(uint32_t field_idx) const {
+    FieldInfo info;
+    info.access_flags = 0;
+
+    size_t offset = header_.field_ids_off + static_cast<size_t>(field_idx) * 8;
+    if (field_idx >= header_.field_ids_size || offset + 8 > data_.size()) return info;
+
+    uint16_t class_idx = read_le<uint16_t>(&data_[offset]);
+    uint16_t type_idx = read_le<uint16_t>(&data_[offset + 2]);
+    uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
+
+    info.class_name = get_class_name(class_idx);
+    info.type_name = get_class_name(type_idx);
+    info.field_name = string_table_.get(name_idx);
+    if (const EncodedField* def = encoded_field(field_idx)) {
+        info.access_flags = def->access_flags;
+    }
+    return info;
+}
+
 std::vector<MethodInfo> DexParser::get_methods() const {
     std::vector<MethodInfo> methods;
     
@@ -144,24 +248,10 @@ std::vector<MethodInfo> DexParser::get_methods() const {
         return methods;
     }
 
+    methods.reserve(header_.method_ids_size);
     for (uint32_t i = 0; i < header_.method_ids_size; i++) {
-        size_t offset = header_.method_ids_off + i * 8;
-        if (offset + 8 > data_.size()) break;
-
-        uint16_t class_idx = read_le<uint16_t>(&data_[offset]);
-        uint16_t proto_idx = read_le<uint16_t>(&data_[offset + 2]);
-        uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
-
-        MethodInfo info;
-        info.class_name = get_class_name(class_idx);
-        if (name_idx < strings_.size()) {
-            info.method_name = strings_[name_idx];
-        }
-        info.prototype = get_proto_string(proto_idx);
-        info.access_flags = 0;
-        info.code_off = 0;
-        
-        methods.push_back(info);
+        if (header_.method_ids_off + static_cast<size_t>(i) * 8 + 8 > data_.size()) break;
+        methods.push_back(get_method(i));
     }
 
     return methods;
@@ -174,23 +264,10 @@ std::vector<FieldInfo> DexParser::get_fields() const {
         return fields;
     }
 
+    fields.reserve(header_.field_ids_size);
     for (uint32_t i = 0; i < header_.field_ids_size; i++) {
-        size_t offset = header_.field_ids_off + i * 8;
-        if (offset + 8 > data_.size()) break;
-
-        uint16_t class_idx = read_le<uint16_t>(&data_[offset]);
-        uint16_t type_idx = read_le<uint16_t>(&data_[offset + 2]);
-        uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
-
-        FieldInfo info;
-        info.class_name = get_class_name(class_idx);
-        info.type_name = get_class_name(type_idx);
-        if (name_idx < strings_.size()) {
-            info.field_name = strings_[name_idx];
-        }
-        info.access_flags = 0;
-        
-        fields.push_back(info);
+        if (header_.field_ids_off + static_cast<size_t>(i) * 8 + 8 > data_.size()) break;
+        fields.push_back(get_field(i));
     }
 
     return fields;
@@ -198,17 +275,437 @@ std::vector<FieldInfo> DexParser::get_fields() const {
 
 std::vector<std::string> DexParser::get_class_methods(const std::string& class_name) const {
     std::vector<std::string> result;
-    auto methods = get_methods();
     
-    for (const auto& m : methods) {
-        if (m.class_name == class_name) {
-            result.push_back(m.method_name);
-        }
+    for (uint32_t method_idx : class_method_ids(class_name)) {
+        size_t offset = header_.method_ids_off + static_cast<size_t>(method_idx) * 8;
+        result.push_back(string_table_.get(read_le<uint32_t>(&data_[offset + 4])));
     }
     
     return result;
 }
 
+// ==================== Lookup indexes ====================
+
+void DexParser::build_class_index() const {
+    std::call_once(class_index_once_, [this]() {
+        type_index_.reserve(type_ids_.size());
+        for (uint32_t i = 0; i < type_ids_.size(); i++) {
+            type_index_.emplace(string_table_.get(type_ids_[i]), i);
+        }
+
+        class_def_by_type_.assign(type_ids_.size(), -1);
+        for (size_t i = 0; i < classes_.size(); i++) {
+            uint32_t type_idx = classes_[i].class_idx;
+            if (type_idx < class_def_by_type_.size() && class_def_by_type_[type_idx] < 0) {
+                class_def_by_type_[type_idx] = static_cast<int32_t>(i);
+            }
+        }
+    });
+}
+
+// Group ids by their owning type (first ushort of each 8-byte id item) with a counting sort
+static void build_owner_lists(const ByteView& data, uint32_t ids_off, uint32_t ids_size,
+                              size_t type_count, std::vector<uint32_t>& offsets,
+                              std::vector<uint32_t>& ids) {
+    offsets.assign(type_count + 1, 0);
+    uint32_t count = 0;
+    for (; count < ids_size; count++) {
+        size_t offset = ids_off + static_cast<size_t>(count) * 8;
+        if (offset + 8 > data.size()) break;
+        uint16_t owner = read_le<uint16_t>(&data[offset]);
+        if (owner < type_count) offsets[owner + 1]++;
+    }
+    for (size_t t = 0; t < type_count; t++) {
+        offsets[t + 1] += offsets[t];
+    }
+
+    ids.resize(offsets[type_count]);
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t owner = read_le<uint16_t>(&data[ids_off + static_cast<size_t>(i) * 8]);
+        if (owner < type_count) ids[cursor[owner]++] = i;
+    }
+}
+
+void DexParser::build_member_index() const {
+    std::call_once(member_index_once_, [this]() {
+        size_t type_count = type_ids_.size();
+        build_owner_lists(data_, header_.method_ids_off, header_.method_ids_size, type_count,
+                          method_offsets_, method_ids_by_type_);
+        build_owner_lists(data_, header_.field_ids_off, header_.field_ids_size, type_count,
+                          field_offsets_, field_ids_by_type_);
+
+        protos_.resize(header_.proto_ids_size);
+        for (uint32_t i = 0; i < header_.proto_ids_size; i++) {
+            protos_[i] = get_proto_string(i);
+        }
+
+        method_index_.reserve(method_ids_by_type_.size());
+        for (uint32_t method_idx : method_ids_by_type_) {
+            size_t offset = header_.method_ids_off + static_cast<size_t>(method_idx) * 8;
+            uint16_t class_idx = read_le<uint16_t>(&data_[offset]);
+            uint16_t proto_idx = read_le<uint16_t>(&data_[offset + 2]);
+            uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
+            std::string_view proto = proto_idx < protos_.size() ? std::string_view(protos_[proto_idx])
+                                                                : std::string_view();
+            method_index_.emplace(MethodKey{class_idx, string_table_.get(name_idx), proto}, method_idx);
+        }
+    });
+}
+
+int DexParser::find_type(const std::string& descriptor) const {
+    build_class_index();
+    auto it = type_index_.find(descriptor);
+    return it != type_index_.end() ? static_cast<int>(it->second) : -1;
+}
+
+int DexParser::find_class_def(const std::string& descriptor) const {
+    int type_idx = find_type(descriptor);
+    return type_idx >= 0 ? class_def_by_type_[type_idx] : -1;
+}
+
+int DexParser::find_string(const std::string& value) const {
+    // The pool is sorted by UTF-16 code units; the raw entries are compared without decoding them
+    uint32_t lo = 0, hi = string_table_.size();
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = compare_utf16(string_table_.raw(mid), value);
+        if (cmp == 0) return static_cast<int>(mid);
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    return -1;
+}
+
+IdRange DexParser::class_method_ids(const std::string& class_name) const {
+    int type_idx = find_type(class_name);
+    if (type_idx < 0) return {};
+    build_member_index();
+    const uint32_t* base = method_ids_by_type_.data();
+    return {base + method_offsets_[type_idx], base + method_offsets_[type_idx + 1]};
+}
+
+IdRange DexParser::class_field_ids(const std::string& class_name) const {
+    int type_idx = find_type(class_name);
+    if (type_idx < 0) return {};
+    build_member_index();
+    const uint32_t* base = field_ids_by_type_.data();
+    return {base + field_offsets_[type_idx], base + field_offsets_[type_idx + 1]};
+}
+
+void DexParser::decode_class_data() const {
+    std::call_once(class_data_once_, [this]() {
+        // Entry boundaries per class, turned into spans once the flat arrays stop growing
+        struct Bounds {
+            size_t fields_begin, static_end, fields_end;
+            size_t methods_begin, direct_end, methods_end;
+        };
+        std::vector<Bounds> bounds(classes_.size());
+
+        for (size_t c = 0; c < classes_.size(); c++) {
+            Bounds& b = bounds[c];
+            b.fields_begin = b.static_end = b.fields_end = encoded_fields_.size();
+            b.methods_begin = b.direct_end = b.methods_end = encoded_methods_.size();
+
+            size_t offset = classes_[c].class_data_off;
+            if (offset == 0 || offset >= data_.size()) continue;
+
+            uint32_t sizes[4];
+            for (uint32_t& size : sizes) size = read_uleb128(offset);
+
+            // Every field entry takes at least 2 bytes and every method entry 3
+            size_t remaining = data_.size() - offset;
+            if (static_cast<size_t>(sizes[0]) + sizes[1] > remaining / 2 ||
+                static_cast<size_t>(sizes[2]) + sizes[3] > remaining / 3) {
+                continue;
+            }
+
+            // The index diff restarts at the first entry of each list
+            for (int list = 0; list < 2; list++) {
+                uint32_t field_idx = 0;
+                for (uint32_t i = 0; i < sizes[list]; i++) {
+                    field_idx += read_uleb128(offset);
+                    uint32_t access_flags = read_uleb128(offset);
+                    encoded_fields_.push_back({field_idx, access_flags});
+                }
+                if (list == 0) b.static_end = encoded_fields_.size();
+            }
+            b.fields_end = encoded_fields_.size();
+
+            for (int list = 2; list < 4; list++) {
+                uint32_t method_idx = 0;
+                for (uint32_t i = 0; i < sizes[list]; i++) {
+                    method_idx += read_uleb128(offset);
+                    uint32_t access_flags = read_uleb128(offset);
+                    uint32_t code_off = read_uleb128(offset);
+                    encoded_methods_.push_back({method_idx, access_flags, code_off});
+                }
+                if (list == 2) b.direct_end = encoded_methods_.size();
+            }
+            b.methods_end = encoded_methods_.size();
+        }
+
+        const EncodedField* fields = encoded_fields_.data();
+        const EncodedMethod* methods = encoded_methods_.data();
+        class_data_.resize(classes_.size());
+        for (size_t c = 0; c < classes_.size(); c++) {
+            const Bounds& b = bounds[c];
+            ClassData& cd = class_data_[c];
+            cd.static_fields = {fields + b.fields_begin, fields + b.static_end};
+            cd.instance_fields = {fields + b.static_end, fields + b.fields_end};
+            cd.direct_methods = {methods + b.methods_begin, methods + b.direct_end};
+            cd.virtual_methods = {methods + b.direct_end, methods + b.methods_end};
+        }
+
+        // The first definition wins if a malformed DEX defines a member twice
+        field_defs_.assign(header_.field_ids_size, kNotDefined);
+        for (size_t i = 0; i < encoded_fields_.size(); i++) {
+            uint32_t idx = encoded_fields_[i].field_idx;
+            if (idx < field_defs_.size() && field_defs_[idx] == kNotDefined) {
+                field_defs_[idx] = static_cast<uint32_t>(i);
+            }
+        }
+        method_defs_.assign(header_.method_ids_size, kNotDefined);
+        for (size_t i = 0; i < encoded_methods_.size(); i++) {
+            uint32_t idx = encoded_methods_[i].method_idx;
+            if (idx < method_defs_.size() && method_defs_[idx] == kNotDefined) {
+                method_defs_[idx] = static_cast<uint32_t>(i);
+            }
+        }
+    });
+}
+
+const ClassData& DexParser::class_data(uint32_t class_def_idx) const {
+    static const ClassData kEmpty;
+    decode_class_data();
+    return class_def_idx < class_data_.size() ? class_data_[class_def_idx] : kEmpty;
+}
+
+const EncodedMethod* DexParser::encoded_method(uint32_t method_idx) const {
+    decode_class_data();
+    if (method_idx >= method_defs_.size() || method_defs_[method_idx] == kNotDefined) return nullptr;
+    return &encoded_methods_[method_defs_[method_idx]];
+}
+
+const EncodedField* DexParser::encoded_field(uint32_t field_idx) const {
+    decode_class_data();
+    if (field_idx >= field_defs_.size() || field_defs_[field_idx] == kNotDefined) return nullptr;
+    return &encoded_fields_[field_defs_[field_idx]];
+}
+
+bool DexParser::read_code_item(uint32_t code_off, CodeItem& code) const {
+    if (code_off == 0 || static_cast<size_t>(code_off) + 16 > data_.size()) return false;
+
+    code.registers_size = read_le<uint16_t>(&data_[code_off]);
+    code.ins_size = read_le<uint16_t>(&data_[code_off + 2]);
+    code.outs_size = read_le<uint16_t>(&data_[code_off + 4]);
+    code.tries_size = read_le<uint16_t>(&data_[code_off + 6]);
+    code.debug_info_off = read_le<uint32_t>(&data_[code_off + 8]);
+    code.insns_size = read_le<uint32_t>(&data_[code_off + 12]);
+    code.code_off = code_off;
+
+    size_t insns_off = static_cast<size_t>(code_off) + 16;
+    size_t insns_bytes = static_cast<size_t>(code.insns_size) * 2;
+    if (insns_off + insns_bytes > data_.size()) return false;
+
+    code.insns.assign(data_.begin() + insns_off, data_.begin() + insns_off + insns_bytes);
+    return true;
+}
+
+bool DexParser::read_tries(const CodeItem& code, std::vector<TryBlock>& tries) const {
+    tries.clear();
+    if (code.tries_size == 0) return true;
+
+    // try_items follow the instructions, 4-byte aligned
+    size_t tries_off = static_cast<size_t>(code.code_off) + 16 + static_cast<size_t>(code.insns_size) * 2;
+    if (code.insns_size & 1) tries_off += 2;
+    size_t handlers_off = tries_off + static_cast<size_t>(code.tries_size) * 8;
+    if (handlers_off > data_.size()) return false;
+
+    tries.resize(code.tries_size);
+    for (uint32_t i = 0; i < code.tries_size; i++) {
+        const uint8_t* item = &data_[tries_off + i * 8];
+        TryBlock& block = tries[i];
+        block.start_addr = read_le<uint32_t>(item);
+        block.end_addr = block.start_addr + read_le<uint16_t>(item + 4);
+
+        size_t offset = handlers_off + read_le<uint16_t>(item + 6);
+        if (offset >= data_.size()) return false;
+        int32_t size = read_sleb128(offset);
+        uint32_t count = static_cast<uint32_t>(size < 0 ? -static_cast<int64_t>(size) : size);
+        if (count > data_.size() - offset) return false;
+
+        block.handlers.resize(count);
+        for (CatchHandler& handler : block.handlers) {
+            handler.type_idx = read_uleb128(offset);
+            handler.addr = read_uleb128(offset);
+        }
+        if (size <= 0) block.handlers.push_back({CatchHandler::kCatchAll, read_uleb128(offset)});
+    }
+    return true;
+}
+
+bool DexParser::read_debug_info(uint32_t debug_info_off, DebugInfo& info) const {
+    info = DebugInfo();
+    if (debug_info_off == 0 || debug_info_off >= data_.size()) return false;
+
+    size_t offset = debug_info_off;
+    // uleb128p1: 0 encodes NO_INDEX
+    auto read_index = [&]() { return read_uleb128(offset) - 1; };
+
+    uint32_t line = read_uleb128(offset);
+    info.line_start = line;
+    uint32_t params = read_uleb128(offset);
+    if (params > data_.size() - offset) return false;
+    info.parameter_names.resize(params);
+    for (uint32_t& name : info.parameter_names) name = read_index();
+
+    uint32_t addr = 0;
+    std::vector<uint32_t> last_start;  // register -> index of its latest start event in info.events
+    while (offset < data_.size()) {
+        uint8_t op = data_[offset++];
+        DebugEvent event;
+        event.addr = addr;
+
+        switch (op) {
+            case 0x00:  // DBG_END_SEQUENCE
+                return true;
+            case 0x01:  // DBG_ADVANCE_PC
+                addr += read_uleb128(offset);
+                continue;
+            case 0x02:  // DBG_ADVANCE_LINE
+                line += read_sleb128(offset);
+                continue;
+            case 0x03:    // DBG_START_LOCAL
+            case 0x04: {  // DBG_START_LOCAL_EXTENDED
+                event.kind = DebugEvent::Kind::kStartLocal;
+                event.reg = read_uleb128(offset);
+                event.name_idx = read_index();
+                event.type_idx = read_index();
+                if (op == 0x04) event.signature_idx = read_index();
+                if (event.reg > 0xFFFF) return false;
+                if (event.reg >= last_start.size()) last_start.resize(event.reg + 1, DebugEvent::kNoIndex);
+                last_start[event.reg] = static_cast<uint32_t>(info.events.size());
+                break;
+            }
+            case 0x05:    // DBG_END_LOCAL
+            case 0x06: {  // DBG_RESTART_LOCAL
+                event.kind = op == 0x05 ? DebugEvent::Kind::kEndLocal : DebugEvent::Kind::kRestartLocal;
+                event.reg = read_uleb128(offset);
+                if (event.reg < last_start.size() && last_start[event.reg] != DebugEvent::kNoIndex) {
+                    const DebugEvent& start = info.events[last_start[event.reg]];
+                    event.name_idx = start.name_idx;
+                    event.type_idx = start.type_idx;
+                    event.signature_idx = start.signature_idx;
+                }
+                break;
+            }
+            case 0x07:  // DBG_SET_PROLOGUE_END
+                event.kind = DebugEvent::Kind::kPrologueEnd;
+                break;
+            case 0x08:  // DBG_SET_EPILOGUE_BEGIN
+                event.kind = DebugEvent::Kind::kEpilogueBegin;
+                break;
+            case 0x09:  // DBG_SET_FILE
+                event.kind = DebugEvent::Kind::kSetFile;
+                event.name_idx = read_index();
+                break;
+            default: {  // special opcode: advance both, then emit a position entry
+                uint32_t adjusted = op - 0x0a;
+                line += static_cast<int32_t>(adjusted % 15) - 4;
+                addr += adjusted / 15;
+                event.kind = DebugEvent::Kind::kLine;
+                event.addr = addr;
+                event.line = line;
+                break;
+            }
+        }
+        info.events.push_back(event);
+    }
+    return false;
+}
+
+bool DexParser::read_annotations_directory(uint32_t annotations_off, AnnotationsDirectory& dir) const {
+    dir = AnnotationsDirectory();
+    if (annotations_off == 0 || annotations_off > data_.size() || data_.size() - annotations_off < 16) {
+        return false;
+    }
+    const uint8_t* p = &data_[annotations_off];
+    dir.class_annotations_off = read_le<uint32_t>(p);
+    uint32_t counts[3] = {read_le<uint32_t>(p + 4), read_le<uint32_t>(p + 8), read_le<uint32_t>(p + 12)};
+    if ((uint64_t(counts[0]) + counts[1] + counts[2]) * 8 > data_.size() - annotations_off - 16) return false;
+
+    p += 16;
+    for (int i = 0; i < 3; i++) {
+        auto& entries = i == 0 ? dir.fields : i == 1 ? dir.methods : dir.parameters;
+        entries.resize(counts[i]);
+        for (auto& entry : entries) {
+            entry = {read_le<uint32_t>(p), read_le<uint32_t>(p + 4)};
+            p += 8;
+        }
+    }
+    return true;
+}
+
+bool DexParser::read_offset_list(uint32_t off, std::vector<uint32_t>& offsets) const {
+    offsets.clear();
+    if (off > data_.size() || data_.size() - off < 4) return false;
+    uint32_t size = read_le<uint32_t>(&data_[off]);
+    if (uint64_t(size) * 4 > data_.size() - off - 4) return false;
+    offsets.resize(size);
+    for (uint32_t i = 0; i < size; i++) offsets[i] = read_le<uint32_t>(&data_[off + 4 + i * 4]);
+    return true;
+}
+
+int DexParser::find_method(const std::string& class_name, const std::string& name,
+                           const std::string& proto) const {
+    int type_idx = find_type(class_name);
+    if (type_idx < 0) return -1;
+    build_member_index();
+
+    if (!proto.empty()) {
+        auto it = method_index_.find(MethodKey{static_cast<uint32_t>(type_idx), name, proto});
+        return it != method_index_.end() ? static_cast<int>(it->second) : -1;
+    }
+
+    for (uint32_t method_idx : class_method_ids(class_name)) {
+        size_t offset = header_.method_ids_off + static_cast<size_t>(method_idx) * 8;
+        if (string_table_.get(read_le<uint32_t>(&data_[offset + 4])) == name) {
+            return static_cast<int>(method_idx);
+        }
+    }
+    return -1;
+}
+
+std::vector<uint32_t> DexParser::find_methods(const std::string& class_name, const std::string& name) const {
+    std::vector<uint32_t> ids;
+    size_t paren = name.find('(');
+    if (paren != std::string::npos) {
+        int method_idx = find_method(class_name, name.substr(0, paren), name.substr(paren));
+        if (method_idx >= 0) ids.push_back(static_cast<uint32_t>(method_idx));
+        return ids;
+    }
+    // method_ids are sorted by class, name and proto, so overloads are adjacent
+    for (uint32_t method_idx : class_method_ids(class_name)) {
+        size_t offset = header_.method_ids_off + static_cast<size_t>(method_idx) * 8;
+        if (string_table_.get(read_le<uint32_t>(&data_[offset + 4])) == name) {
+            ids.push_back(method_idx);
+        } else if (!ids.empty()) {
+            break;
+        }
+    }
+    return ids;
+}
+
+int DexParser::find_field(const std::string& class_name, const std::string& name) const {
+    for (uint32_t field_idx : class_field_ids(class_name)) {
+        size_t offset = header_.field_ids_off + static_cast<size_t>(field_idx) * 8;
+        if (string_table_.get(read_le<uint32_t>(&data_[offset + 4])) == name) {
+            return static_cast<int>(field_idx);
+        }
+    }
+    return -1;
+}
+
 std::string DexParser::get_info() const {
     std::stringstream ss;
     
@@ -226,131 +723,48 @@ std::string DexParser::get_info() const {
 }
 
 bool DexParser::get_method_code(const std::string& class_name, const std::string& method_name, CodeItem& code) const {
-    // Find the class
-    for (const auto& cls : classes_) {
-        std::string cls_name = get_class_name(cls.class_idx);
-        if (cls_name != class_name) continue;
-        
-        if (cls.class_data_off == 0) continue;
-        
-        // Parse class_data_item
-        size_t offset = cls.class_data_off;
-        uint32_t static_fields_size = read_uleb128(offset);
-        uint32_t instance_fields_size = read_uleb128(offset);
-        uint32_t direct_methods_size = read_uleb128(offset);
-        uint32_t virtual_methods_size = read_uleb128(offset);
-        
-        // Skip fields
-        for (uint32_t i = 0; i < static_fields_size + instance_fields_size; i++) {
-            read_uleb128(offset); // field_idx_diff
-            read_uleb128(offset); // access_flags
-        }
+    int class_def_idx = find_class_def(class_name);
+    if (class_def_idx < 0) return false;
+    
+    for (const EncodedMethod& method : class_data(class_def_idx).methods()) {
+        MemberId id;
+        if (!method_id(method.method_idx, id) || id.name_idx >= string_table_.size()) continue;
+        if (string_table_.get(id.name_idx) != method_name) continue;
         
-        // Parse methods
-        uint32_t method_idx = 0;
-        for (uint32_t i = 0; i < direct_methods_size + virtual_methods_size; i++) {
-            uint32_t method_idx_diff = read_uleb128(offset);
-            method_idx += method_idx_diff;
-            uint32_t access_flags = read_uleb128(offset);
-            uint32_t code_off = read_uleb128(offset);
-            
-            // Get method name from method_ids
-            if (method_idx < header_.method_ids_size) {
-                size_t mid_off = header_.method_ids_off + method_idx * 8;
-                if (mid_off + 8 <= data_.size()) {
-                    uint32_t name_idx = read_le<uint32_t>(&data_[mid_off + 4]);
-                    if (name_idx < strings_.size() && strings_[name_idx] == method_name) {
-                        // Found the method
-                        if (code_off == 0) return false; // No code (abstract/native)
-                        
-                        // Parse code_item
-                        if (code_off + 16 > data_.size()) return false;
-                        
-                        code.registers_size = read_le<uint16_t>(&data_[code_off]);
-                        code.ins_size = read_le<uint16_t>(&data_[code_off + 2]);
-                        code.outs_size = read_le<uint16_t>(&data_[code_off + 4]);
-                        code.tries_size = read_le<uint16_t>(&data_[code_off + 6]);
-                        code.debug_info_off = read_le<uint32_t>(&data_[code_off + 8]);
-                        code.insns_size = read_le<uint32_t>(&data_[code_off + 12]);
-                        
-                        size_t insns_off = code_off + 16;
-                        size_t insns_bytes = code.insns_size * 2;
-                        
-                        if (insns_off + insns_bytes > data_.size()) return false;
-                        
-                        code.insns.assign(data_.begin() + insns_off, 
-                                         data_.begin() + insns_off + insns_bytes);
-                        code.code_off = code_off;
-                        return true;
-                    }
-                }
-            }
-        }
+        // No code for abstract/native methods
+        return read_code_item(method.code_off, code);
     }
     return false;
 }
 
+bool DexParser::get_method_code(const std::string& class_name, const std::string& method_name,
+                                const std::string& proto, CodeItem& code) const {
+    if (proto.empty()) return get_method_code(class_name, method_name, code);
+    
+    int method_idx = find_method(class_name, method_name, proto);
+    return method_idx >= 0 && get_method_code(static_cast<uint32_t>(method_idx), code);
+}
+
+bool DexParser::get_method_code(uint32_t method_idx, CodeItem& code) const {
+    const EncodedMethod* method = encoded_method(method_idx);
+    return method && read_code_item(method->code_off, code);
+}
+
 std::unordered_map<std::string, CodeItem> DexParser::get_all_method_codes() const {
     std::unordered_map<std::string, CodeItem> result;
     
-    for (const auto& cls : classes_) {
-        std::string cls_name = get_class_name(cls.class_idx);
-        if (cls_name.empty() || cls.class_data_off == 0) continue;
+    for (uint32_t c = 0; c < classes_.size(); c++) {
+        std::string cls_name = get_class_name(classes_[c].class_idx);
+        if (cls_name.empty()) continue;
         
-        // Parse class_data_item
-        size_t offset = cls.class_data_off;
-        uint32_t static_fields_size = read_uleb128(offset);
-        uint32_t instance_fields_size = read_uleb128(offset);
-        uint32_t direct_methods_size = read_uleb128(offset);
-        uint32_t virtual_methods_size = read_uleb128(offset);
-        
-        // Skip fields
-        for (uint32_t i = 0; i < static_fields_size + instance_fields_size; i++) {
-            read_uleb128(offset);
-            read_uleb128(offset);
-        }
-        
-        // Parse all methods
-        uint32_t method_idx = 0;
-        for (uint32_t i = 0; i < direct_methods_size + virtual_methods_size; i++) {
-            uint32_t method_idx_diff = read_uleb128(offset);
-            method_idx += method_idx_diff;
-            read_uleb128(offset); // access_flags
-            uint32_t code_off = read_uleb128(offset);
-            
-            if (code_off == 0) continue; // No code
-            if (method_idx >= header_.method_ids_size) continue;
-            
-            size_t mid_off = header_.method_ids_off + method_idx * 8;
-            if (mid_off + 8 > data_.size()) continue;
-            
-            uint32_t name_idx = read_le<uint32_t>(&data_[mid_off + 4]);
-            if (name_idx >= strings_.size()) continue;
-            
-            std::string method_name = strings_[name_idx];
-            std::string key = cls_name + "|" + method_name;
-            
-            // Parse code_item
-            if (code_off + 16 > data_.size()) continue;
+        for (const EncodedMethod& method : class_data(c).methods()) {
+            MemberId id;
+            if (method.code_off == 0) continue;
+            if (!method_id(method.method_idx, id) || id.name_idx >= string_table_.size()) continue;
             
             CodeItem code;
-            code.registers_size = read_le<uint16_t>(&data_[code_off]);
-            code.ins_size = read_le<uint16_t>(&data_[code_off + 2]);
-            code.outs_size = read_le<uint16_t>(&data_[code_off + 4]);
-            code.tries_size = read_le<uint16_t>(&data_[code_off + 6]);
-            code.debug_info_off = read_le<uint32_t>(&data_[code_off + 8]);
-            code.insns_size = read_le<uint32_t>(&data_[code_off + 12]);
-            code.code_off = code_off;
-            
-            size_t insns_off = code_off + 16;
-            size_t insns_bytes = code.insns_size * 2;
-            
-            if (insns_off + insns_bytes > data_.size()) continue;
-            
-            code.insns.assign(data_.begin() + insns_off, 
-                             data_.begin() + insns_off + insns_bytes);
-            
-            result[key] = std::move(code);
+            if (!read_code_item(method.code_off, code)) continue;
+            result[cls_name + "|" + string_table_.get(id.name_idx)] = std::move(code);
         }
     }
     
@@ -393,8 +807,8 @@ std::string DexParser::get_full_method_signature(uint32_t method_idx) const {
     uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
     
     std::string sig = get_class_name(class_idx) + "->";
-    if (name_idx < strings_.size()) {
-        sig += strings_[name_idx];
+    if (name_idx < string_table_.size()) {
+        sig += string_table_.get(name_idx);
     }
     sig += get_proto_string(proto_idx);
     
@@ -411,209 +825,98 @@ std::vector<std::string> DexParser::get_method_signatures() const {
     return sigs;
 }
 
+std::string DexParser::get_full_field_signature(uint32_t field_idx) const {
+    MemberId id;
+    if (!field_id(field_idx, id)) return "";
+    
+    std::string sig = get_class_name(id.class_idx) + "->";
+    if (id.name_idx < string_table_.size()) {
+        sig += string_table_.get(id.name_idx);
+    }
+    sig += ":" + get_class_name(id.type_idx);
+    return sig;
+}
+
 std::vector<std::string> DexParser::get_field_signatures() const {
     std::vector<std::string> sigs;
     
     for (uint32_t i = 0; i < header_.field_ids_size; i++) {
         size_t offset = header_.field_ids_off + i * 8;
         if (offset + 8 > data_.size()) break;
-        
-        uint16_t class_idx = read_le<uint16_t>(&data_[offset]);
-        uint16_t type_idx = read_le<uint16_t>(&data_[offset + 2]);
-        uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
-        
-        std::string sig = get_class_name(class_idx) + "->";
-        if (name_idx < strings_.size()) {
-            sig += strings_[name_idx];
-        }
-        sig += ":" + get_class_name(type_idx);
-        sigs.push_back(sig);
+        sigs.push_back(get_full_field_signature(i));
     }
     
     return sigs;
 }
 
+// invoke-*: 0x6e-0x72, invoke-*/range: 0x74-0x78, invoke-polymorphic(/range): 0xfa-0xfb
+static bool is_invoke(uint8_t opcode) {
+    return (opcode >= 0x6e && opcode <= 0x72) || (opcode >= 0x74 && opcode <= 0x78) ||
+           opcode == 0xfa || opcode == 0xfb;
+}
+
+// iget/iput: 0x52-0x5f, sget/sput: 0x60-0x6d
+static bool is_field_access(uint8_t opcode) {
+    return opcode >= 0x52 && opcode <= 0x6d;
+}
+
 std::vector<DexParser::XRef> DexParser::find_method_xrefs(const std::string& class_name, const std::string& method_name) const {
-    std::vector<XRef> results;
-    
-    // Find the target method index
-    int target_method_idx = -1;
-    for (uint32_t i = 0; i < header_.method_ids_size; i++) {
-        size_t offset = header_.method_ids_off + i * 8;
-        if (offset + 8 > data_.size()) break;
-        
-        uint16_t cls_idx = read_le<uint16_t>(&data_[offset]);
-        uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
-        
-        if (get_class_name(cls_idx) == class_name && 
-            name_idx < strings_.size() && strings_[name_idx] == method_name) {
-            target_method_idx = i;
-            break;
-        }
-    }
-    
-    if (target_method_idx < 0) return results;
-    
-    // Scan all methods for invoke instructions
-    for (const auto& cls : classes_) {
-        std::string caller_class = get_class_name(cls.class_idx);
-        if (caller_class.empty() || cls.class_data_off == 0) continue;
-        
-        size_t offset = cls.class_data_off;
-        uint32_t static_fields = read_uleb128(offset);
-        uint32_t instance_fields = read_uleb128(offset);
-        uint32_t direct_methods = read_uleb128(offset);
-        uint32_t virtual_methods = read_uleb128(offset);
-        
-        // Skip fields
-        for (uint32_t i = 0; i < static_fields + instance_fields; i++) {
-            read_uleb128(offset);
-            read_uleb128(offset);
-        }
-        
-        // Scan methods
-        uint32_t method_idx = 0;
-        for (uint32_t i = 0; i < direct_methods + virtual_methods; i++) {
-            method_idx += read_uleb128(offset);
-            read_uleb128(offset); // access_flags
-            uint32_t code_off = read_uleb128(offset);
-            
-            if (code_off == 0) continue;
-            if (code_off + 16 > data_.size()) continue;
-            
-            uint32_t insns_size = read_le<uint32_t>(&data_[code_off + 12]);
-            size_t insns_off = code_off + 16;
-            
-            // Get caller method name
-            std::string caller_method;
-            if (method_idx < header_.method_ids_size) {
-                size_t mid_off = header_.method_ids_off + method_idx * 8;
-                if (mid_off + 8 <= data_.size()) {
-                    uint32_t name_idx = read_le<uint32_t>(&data_[mid_off + 4]);
-                    if (name_idx < strings_.size()) {
-                        caller_method = strings_[name_idx];
-                    }
-                }
-            }
-            
-            // Scan bytecode for invoke instructions
-            for (size_t pos = 0; pos < insns_size * 2;) {
-                if (insns_off + pos >= data_.size()) break;
-                
-                uint8_t opcode = data_[insns_off + pos];
-                
-                // invoke-* opcodes: 0x6e-0x72 (invoke-virtual to invoke-interface)
-                // invoke-*/range: 0x74-0x78
-                if ((opcode >= 0x6e && opcode <= 0x72) || (opcode >= 0x74 && opcode <= 0x78)) {
-                    if (insns_off + pos + 3 <= data_.size()) {
-                        uint16_t ref_idx = read_le<uint16_t>(&data_[insns_off + pos + 2]);
-                        if (ref_idx == target_method_idx) {
-                            XRef xref;
-                            xref.caller_class = caller_class;
-                            xref.caller_method = caller_method;
-                            xref.offset = static_cast<uint32_t>(pos / 2);
-                            results.push_back(xref);
-                        }
-                    }
-                    pos += 6; // invoke instructions are 3 units (6 bytes)
-                } else {
-                    // Simple instruction size estimation
-                    pos += 2;
-                    if (opcode == 0x00 && pos > 2) break; // nop might indicate padding
-                }
-            }
-        }
-    }
-    
-    return results;
+    std::vector<uint32_t> targets = find_methods(class_name, method_name);
+    if (targets.empty()) return {};
+    return scan_xrefs(is_invoke, targets);
 }
 
 std::vector<DexParser::XRef> DexParser::find_field_xrefs(const std::string& class_name, const std::string& field_name) const {
-    std::vector<XRef> results;
-    
-    // Find the target field index
-    int target_field_idx = -1;
-    for (uint32_t i = 0; i < header_.field_ids_size; i++) {
-        size_t offset = header_.field_ids_off + i * 8;
-        if (offset + 8 > data_.size()) break;
-        
-        uint16_t cls_idx = read_le<uint16_t>(&data_[offset]);
-        uint32_t name_idx = read_le<uint32_t>(&data_[offset + 4]);
-        
-        if (get_class_name(cls_idx) == class_name && 
-            name_idx < strings_.size() && strings_[name_idx] == field_name) {
-            target_field_idx = i;
-            break;
-        }
-    }
-    
-    if (target_field_idx < 0) return results;
+    int target_field_idx = find_field(class_name, field_name);
+    if (target_field_idx < 0) return {};
+    return scan_xrefs(is_field_access, {static_cast<uint32_t>(target_field_idx)});
+}
+
+std::vector<DexParser::XRef> DexParser::scan_xrefs(bool (*matches)(uint8_t),
+                                                   const std::vector<uint32_t>& targets) const {
+    // Classes are scanned in parallel chunks; chunk results are concatenated in class order
+    decode_class_data();
+    size_t chunks = chunk_count(classes_.size(), 64);
+    std::vector<std::vector<XRef>> partial(chunks);
     
-    // Scan all methods for field access instructions
-    for (const auto& cls : classes_) {
-        std::string caller_class = get_class_name(cls.class_idx);
-        if (caller_class.empty() || cls.class_data_off == 0) continue;
-        
-        size_t offset = cls.class_data_off;
-        uint32_t static_fields = read_uleb128(offset);
-        uint32_t instance_fields = read_uleb128(offset);
-        uint32_t direct_methods = read_uleb128(offset);
-        uint32_t virtual_methods = read_uleb128(offset);
-        
-        for (uint32_t i = 0; i < static_fields + instance_fields; i++) {
-            read_uleb128(offset);
-            read_uleb128(offset);
-        }
+    parallel_chunks(classes_.size(), chunks, [&](size_t chunk, size_t begin, size_t end) {
+        std::vector<XRef>& results = partial[chunk];
         
-        uint32_t method_idx = 0;
-        for (uint32_t i = 0; i < direct_methods + virtual_methods; i++) {
-            method_idx += read_uleb128(offset);
-            read_uleb128(offset);
-            uint32_t code_off = read_uleb128(offset);
+        for (size_t c = begin; c < end; c++) {
+            const ClassDef& cls = classes_[c];
+            std::string caller_class = get_class_name(cls.class_idx);
+            if (caller_class.empty()) continue;
             
-            if (code_off == 0) continue;
-            if (code_off + 16 > data_.size()) continue;
-            
-            uint32_t insns_size = read_le<uint32_t>(&data_[code_off + 12]);
-            size_t insns_off = code_off + 16;
-            
-            std::string caller_method;
-            if (method_idx < header_.method_ids_size) {
-                size_t mid_off = header_.method_ids_off + method_idx * 8;
-                if (mid_off + 8 <= data_.size()) {
-                    uint32_t name_idx = read_le<uint32_t>(&data_[mid_off + 4]);
-                    if (name_idx < strings_.size()) {
-                        caller_method = strings_[name_idx];
-                    }
-                }
-            }
-            
-            for (size_t pos = 0; pos < insns_size * 2;) {
-                if (insns_off + pos >= data_.size()) break;
+            for (const EncodedMethod& method : class_data(static_cast<uint32_t>(c)).methods()) {
+                uint32_t method_idx = method.method_idx;
+                uint32_t code_off = method.code_off;
+                if (code_off == 0) continue;
+                if (static_cast<size_t>(code_off) + 16 > data_.size()) continue;
                 
-                uint8_t opcode = data_[insns_off + pos];
+                uint32_t insns_size = read_le<uint32_t>(&data_[code_off + 12]);
+                size_t insns_off = static_cast<size_t>(code_off) + 16;
+                if (insns_off + static_cast<size_t>(insns_size) * 2 > data_.size()) continue;
                 
-                // iget/iput: 0x52-0x5f, sget/sput: 0x60-0x6d
-                if ((opcode >= 0x52 && opcode <= 0x5f) || (opcode >= 0x60 && opcode <= 0x6d)) {
-                    if (insns_off + pos + 3 <= data_.size()) {
-                        uint16_t ref_idx = read_le<uint16_t>(&data_[insns_off + pos + 2]);
-                        if (ref_idx == target_field_idx) {
-                            XRef xref;
-                            xref.caller_class = caller_class;
-                            xref.caller_method = caller_method;
-                            xref.offset = static_cast<uint32_t>(pos / 2);
-                            results.push_back(xref);
-                        }
-                    }
-                    pos += 4; // field instructions are 2 units (4 bytes)
-                } else {
-                    pos += 2;
-                    if (opcode == 0x00 && pos > 2) break;
+                InsnIterator it(&data_[insns_off], insns_size);
+                Insn insn;
+                while (it.next(insn)) {
+                    if (insn.payload != PayloadKind::kNone || !matches(insn.opcode)) continue;
+                    if (std::find(targets.begin(), targets.end(), insn.ref_index()) == targets.end()) continue;
+                    
+                    XRef xref;
+                    xref.caller_class = caller_class;
+                    xref.caller_method = get_method(method_idx).method_name;
+                    xref.offset = insn.pc;
+                    results.push_back(xref);
                 }
             }
         }
-    }
+    });
     
+    std::vector<XRef> results;
+    for (auto& part : partial) {
+        results.insert(results.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+    }
     return results;
 }
 
@@ -0,0 +1,777 @@
+#include "dex/dex_regex.h"
+#include <algorithm>
+#include <memory>
+
+namespace dex {
+
+static const uint32_t kMaxCodePoint = 0x10FFFF;
+
+static uint32_t ascii_lower(uint32_t c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static bool is_continuation(uint8_t b) {
+    return (b & 0xC0) == 0x80;
+}
+
+// Decode one code point of (M)UTF-8; a malformed byte stands for itself
+static uint32_t decode_code_point(const uint8_t* p, size_t size, size_t& pos) {
+    uint8_t b = p[pos++];
+    if (b < 0x80) return b;
+    if ((b & 0xE0) == 0xC0 && pos < size && is_continuation(p[pos])) {
+        return (static_cast<uint32_t>(b & 0x1F) << 6) | (p[pos++] & 0x3F);
+    }
+    if ((b & 0xF0) == 0xE0 && pos + 1 < size && is_continuation(p[pos]) && is_continuation(p[pos + 1])) {
+        uint32_t cp = (static_cast<uint32_t>(b & 0x0F) << 12) |
+                      (static_cast<uint32_t>(p[pos] & 0x3F) << 6) | (p[pos + 1] & 0x3F);
+        pos += 2;
+        return cp;
+    }
+    if ((b & 0xF8) == 0xF0 && pos + 2 < size && is_continuation(p[pos]) &&
+        is_continuation(p[pos + 1]) && is_continuation(p[pos + 2])) {
+        uint32_t cp = (static_cast<uint32_t>(b & 0x07) << 18) | (static_cast<uint32_t>(p[pos] & 0x3F) << 12) |
+                      (static_cast<uint32_t>(p[pos + 1] & 0x3F) << 6) | (p[pos + 2] & 0x3F);
+        pos += 3;
+        return cp;
+    }
+    return b;
+}
+
+// Encode a code point the way DEX string_data stores it (MUTF-8)
+static void append_mutf8(std::string& out, uint32_t cp) {
+    if (cp > 0xFFFF) {
+        cp -= 0x10000;
+        append_mutf8(out, 0xD800 + (cp >> 10));
+        append_mutf8(out, 0xDC00 + (cp & 0x3FF));
+    } else if (cp != 0 && cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+static bool is_line_terminator(uint32_t cp) {
+    return cp == '\n' || cp == '\r' || cp == 0x85 || cp == 0x2028 || cp == 0x2029;
+}
+
+static bool is_word(uint32_t cp) {
+    return (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') || (cp >= '0' && cp <= '9') || cp == '_';
+}
+
+bool Regex::CharClass::contains(uint32_t cp) const {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), cp,
+                               [](uint32_t c, const std::pair<uint32_t, uint32_t>& r) { return c < r.first; });
+    bool found = it != ranges.begin() && cp <= std::prev(it)->second;
+    return found != negated;
+}
+
+// ==================== Parser ====================
+
+struct Regex::Node {
+    enum class Kind { kEmpty, kChar, kAny, kClass, kConcat, kAlt, kRepeat, kBol, kEol, kEnd,
+                      kWordBoundary, kNotWordBoundary };
+
+    explicit Node(Kind k) : kind(k) {}
+
+    Kind kind;
+    uint32_t value = 0;    // kChar: code point, kClass: index into classes_
+    int min = 0;           // kRepeat bounds; max < 0 means unbounded
+    int max = 0;
+    std::vector<std::unique_ptr<Node>> children;
+};
+
+class Regex::Parser {
+public:
+    using NodePtr = std::unique_ptr<Node>;
+
+    Parser(Regex& regex, std::string_view pattern, std::string& error)
+        : regex_(regex), error_(error) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(pattern.data());
+        size_t pos = 0;
+        while (pos < pattern.size()) {
+            cps_.push_back(decode_code_point(p, pattern.size(), pos));
+        }
+    }
+
+    NodePtr parse() {
+        NodePtr root = parse_alt();
+        if (!root) return nullptr;
+        if (pos_ < cps_.size()) return fail("Unmatched closing ')'");
+        return root;
+    }
+
+private:
+    Regex& regex_;
+    std::string& error_;
+    std::vector<uint32_t> cps_;
+    size_t pos_ = 0;
+
+    NodePtr fail(const std::string& message) {
+        error_ = message + " near index " + std::to_string(pos_);
+        return nullptr;
+    }
+
+    bool at_end() const { return pos_ >= cps_.size(); }
+    uint32_t peek(size_t ahead = 0) const { return pos_ + ahead < cps_.size() ? cps_[pos_ + ahead] : 0; }
+    bool has(size_t ahead) const { return pos_ + ahead < cps_.size(); }
+
+    static NodePtr make(Node::Kind kind) { return NodePtr(new Node(kind)); }
+
+    NodePtr make_char(uint32_t cp) const {
+        NodePtr node = make(Node::Kind::kChar);
+        node->value = regex_.case_sensitive_ ? cp : ascii_lower(cp);
+        return node;
+    }
+
+    NodePtr make_class(CharClass cls) {
+        std::sort(cls.ranges.begin(), cls.ranges.end());
+        if (!regex_.case_sensitive_) {
+            // Input is lowercased before matching, so uppercase ranges also admit their lowercase forms
+            size_t n = cls.ranges.size();
+            for (size_t i = 0; i < n; i++) {
+                uint32_t lo = std::max<uint32_t>(cls.ranges[i].first, 'A');
+                uint32_t hi = std::min<uint32_t>(cls.ranges[i].second, 'Z');
+                if (lo <= hi) cls.ranges.push_back({lo + ('a' - 'A'), hi + ('a' - 'A')});
+            }
+            std::sort(cls.ranges.begin(), cls.ranges.end());
+        }
+        std::vector<std::pair<uint32_t, uint32_t>> merged;
+        for (const auto& r : cls.ranges) {
+            if (!merged.empty() && r.first <= merged.back().second + 1) {
+                merged.back().second = std::max(merged.back().second, r.second);
+            } else {
+                merged.push_back(r);
+            }
+        }
+        cls.ranges = std::move(merged);
+
+        NodePtr node = make(Node::Kind::kClass);
+        node->value = static_cast<uint32_t>(regex_.classes_.size());
+        regex_.classes_.push_back(std::move(cls));
+        return node;
+    }
+
+    NodePtr parse_alt() {
+        NodePtr first = parse_concat();
+        if (!first) return nullptr;
+        if (at_end() || peek() != '|') return first;
+
+        NodePtr alt = make(Node::Kind::kAlt);
+        alt->children.push_back(std::move(first));
+        while (!at_end() && peek() == '|') {
+            pos_++;
+            NodePtr next = parse_concat();
+            if (!next) return nullptr;
+            alt->children.push_back(std::move(next));
+        }
+        return alt;
+    }
+
+    NodePtr parse_concat() {
+        NodePtr concat = make(Node::Kind::kConcat);
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            NodePtr item = parse_repeat();
+            if (!item) return nullptr;
+            concat->children.push_back(std::move(item));
+        }
+        if (concat->children.size() == 1) return std::move(concat->children.front());
+        return concat;
+    }
+
+    bool parse_number(int& value) {
+        if (at_end() || peek() < '0' || peek() > '9') return false;
+        value = 0;
+        while (!at_end() && peek() >= '0' && peek() <= '9') {
+            value = value * 10 + static_cast<int>(peek() - '0');
+            if (value > kMaxRepeat) return false;
+            pos_++;
+        }
+        return true;
+    }
+
+    NodePtr parse_repeat() {
+        NodePtr atom = parse_atom();
+        if (!atom || at_end()) return atom;
+
+        int min, max;
+        uint32_t c = peek();
+        if (c == '*') {
+            min = 0; max = -1; pos_++;
+        } else if (c == '+') {
+            min = 1; max = -1; pos_++;
+        } else if (c == '?') {
+            min = 0; max = 1; pos_++;
+        } else if (c == '{') {
+            pos_++;
+            if (!parse_number(min)) return fail("Illegal repetition");
+            max = min;
+            if (!at_end() && peek() == ',') {
+                pos_++;
+                max = -1;
+                if (!at_end() && peek() != '}' && !parse_number(max)) return fail("Illegal repetition");
+            }
+            if (at_end() || peek() != '}') return fail("Unclosed counted closure");
+            pos_++;
+            if (max >= 0 && max < min) return fail("Illegal repetition range");
+        } else {
+            return atom;
+        }
+
+        // Lazy quantifiers only change which match is reported, not whether one exists
+        if (!at_end() && peek() == '?') pos_++;
+        else if (!at_end() && peek() == '+') return fail("Possessive quantifiers are not supported");
+        if (!at_end() && (peek() == '*' || peek() == '+' || peek() == '?' || peek() == '{')) {
+            return fail("Dangling meta character");
+        }
+
+        NodePtr repeat = make(Node::Kind::kRepeat);
+        repeat->min = min;
+        repeat->max = max;
+        repeat->children.push_back(std::move(atom));
+        return repeat;
+    }
+
+    NodePtr parse_atom() {
+        uint32_t c = peek();
+        switch (c) {
+            case '(': {
+                pos_++;
+                if (!at_end() && peek() == '?') {
+                    if (peek(1) == ':') {
+                        pos_ += 2;
+                    } else if (peek(1) == '<' && has(2) && is_word(peek(2)) && !(peek(2) >= '0' && peek(2) <= '9')) {
+                        // Named group; names are not used since nothing is captured
+                        pos_ += 2;
+                        while (!at_end() && is_word(peek())) pos_++;
+                        if (at_end() || peek() != '>') return fail("Named capturing group is missing trailing '>'");
+                        pos_++;
+                    } else {
+                        return fail("Lookaround and inline flags are not supported");
+                    }
+                }
+                NodePtr inner = parse_alt();
+                if (!inner) return nullptr;
+                if (at_end() || peek() != ')') return fail("Unclosed group");
+                pos_++;
+                return inner;
+            }
+            case '.':
+                pos_++;
+                return make(Node::Kind::kAny);
+            case '^':
+                pos_++;
+                return make(Node::Kind::kBol);
+            case '$':
+                pos_++;
+                return make(Node::Kind::kEol);
+            case '[':
+                pos_++;
+                return parse_class();
+            case '\\':
+                pos_++;
+                return parse_escape();
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                return fail("Dangling meta character");
+            default:
+                pos_++;
+                return make_char(c);
+        }
+    }
+
+    static void add_builtin(CharClass& cls, uint32_t kind) {
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        switch (ascii_lower(kind)) {
+            case 'd': ranges = {{'0', '9'}}; break;
+            case 'w': ranges = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}}; break;
+            case 's': ranges = {{'\t', '\r'}, {' ', ' '}}; break;
+        }
+        if (kind >= 'A' && kind <= 'Z') {
+            // Complement of the sorted ranges
+            std::vector<std::pair<uint32_t, uint32_t>> complement;
+            uint32_t next = 0;
+            for (const auto& r : ranges) {
+                if (r.first > next) complement.push_back({next, r.first - 1});
+                next = r.second + 1;
+            }
+            complement.push_back({next, kMaxCodePoint});
+            ranges = std::move(complement);
+        }
+        cls.ranges.insert(cls.ranges.end(), ranges.begin(), ranges.end());
+    }
+
+    static bool is_builtin(uint32_t c) {
+        return c == 'd' || c == 'D' || c == 'w' || c == 'W' || c == 's' || c == 'S';
+    }
+
+    bool parse_hex(size_t digits, uint32_t& value) {
+        value = 0;
+        for (size_t i = 0; i < digits; i++) {
+            if (at_end()) return false;
+            uint32_t c = peek();
+            uint32_t d;
+            if (c >= '0' && c <= '9') d = c - '0';
+            else if (ascii_lower(c) >= 'a' && ascii_lower(c) <= 'f') d = ascii_lower(c) - 'a' + 10;
+            else return false;
+            value = value * 16 + d;
+            pos_++;
+        }
+        return true;
+    }
+
+    // Escapes that denote a single code point; returns false (with error_ set) otherwise
+    bool parse_escaped_char(uint32_t c, uint32_t& cp) {
+        switch (c) {
+            case 't': cp = '\t'; return true;
+            case 'n': cp = '\n'; return true;
+            case 'r': cp = '\r'; return true;
+            case 'f': cp = '\f'; return true;
+            case 'a': cp = 0x07; return true;
+            case 'e': cp = 0x1B; return true;
+            case '0': {
+                cp = 0;
+                for (int i = 0; i < 3 && !at_end() && peek() >= '0' && peek() <= '7'; i++) {
+                    if (cp * 8 + (peek() - '0') > 0xFF) break;
+                    cp = cp * 8 + (peek() - '0');
+                    pos_++;
+                }
+                return true;
+            }
+            case 'x':
+                if (!at_end() && peek() == '{') {
+                    pos_++;
+                    cp = 0;
+                    size_t digits = 0;
+                    uint32_t d;
+                    while (!at_end() && peek() != '}' && parse_hex(1, d)) {
+                        cp = cp * 16 + d;
+                        if (++digits > 6 || cp > kMaxCodePoint) break;
+                    }
+                    if (digits == 0 || digits > 6 || cp > kMaxCodePoint || at_end() || peek() != '}') {
+                        fail("Illegal hexadecimal escape sequence");
+                        return false;
+                    }
+                    pos_++;
+                    return true;
+                }
+                if (!parse_hex(2, cp)) {
+                    fail("Illegal hexadecimal escape sequence");
+                    return false;
+                }
+                return true;
+            case 'u':
+                if (!parse_hex(4, cp)) {
+                    fail("Illegal Unicode escape sequence");
+                    return false;
+                }
+                return true;
+        }
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '1' && c <= '9')) {
+            fail(c >= '1' && c <= '9' ? "Backreferences are not supported" : "Unsupported escape sequence");
+            return false;
+        }
+        cp = c;
+        return true;
+    }
+
+    NodePtr parse_escape() {
+        if (at_end()) return fail("Unexpected internal error");
+        uint32_t c = peek();
+        pos_++;
+
+        if (is_builtin(c)) {
+            CharClass cls;
+            add_builtin(cls, c);
+            return make_class(std::move(cls));
+        }
+        switch (c) {
+            case 'b': return make(Node::Kind::kWordBoundary);
+            case 'B': return make(Node::Kind::kNotWordBoundary);
+            case 'A': return make(Node::Kind::kBol);
+            case 'Z': return make(Node::Kind::kEol);
+            case 'z': return make(Node::Kind::kEnd);
+            case 'Q': {
+                NodePtr quoted = make(Node::Kind::kConcat);
+                while (!at_end() && !(peek() == '\\' && peek(1) == 'E')) {
+                    quoted->children.push_back(make_char(peek()));
+                    pos_++;
+                }
+                if (!at_end()) pos_ += 2;
+                return quoted;
+            }
+        }
+
+        uint32_t cp;
+        if (!parse_escaped_char(c, cp)) return nullptr;
+        return make_char(cp);
+    }
+
+    NodePtr parse_class() {
+        CharClass cls;
+        if (!at_end() && peek() == '^') {
+            cls.negated = true;
+            pos_++;
+        }
+
+        bool first = true;
+        while (true) {
+            if (at_end()) return fail("Unclosed character class");
+            uint32_t c = peek();
+            if (c == ']' && !first) {
+                pos_++;
+                break;
+            }
+            first = false;
+            if (c == '[') return fail("Nested character classes are not supported");
+            if (c == '&' && peek(1) == '&') return fail("Character class intersections are not supported");
+
+            uint32_t lo;
+            pos_++;
+            if (c == '\\') {
+                if (at_end()) return fail("Unclosed character class");
+                uint32_t e = peek();
+                pos_++;
+                if (is_builtin(e)) {
+                    add_builtin(cls, e);
+                    continue;
+                }
+                if (e == 'Q' || e == 'b' || e == 'B') return fail("Unsupported escape in character class");
+                if (!parse_escaped_char(e, lo)) return nullptr;
+            } else {
+                lo = c;
+            }
+
+            uint32_t hi = lo;
+            if (!at_end() && peek() == '-' && has(1) && peek(1) != ']') {
+                pos_++;
+                uint32_t h = peek();
+                pos_++;
+                if (h == '\\') {
+                    if (at_end()) return fail("Unclosed character class");
+                    uint32_t e = peek();
+                    pos_++;
+                    if (is_builtin(e)) return fail("Illegal character range");
+                    if (!parse_escaped_char(e, hi)) return nullptr;
+                } else if (h == '[') {
+                    return fail("Nested character classes are not supported");
+                } else {
+                    hi = h;
+                }
+                if (hi < lo) return fail("Illegal character range");
+            }
+            cls.ranges.push_back({lo, hi});
+        }
+        return make_class(std::move(cls));
+    }
+};
+
+// ==================== Literal extraction ====================
+
+// The text a node always matches, if it is a fixed string
+bool Regex::exact_literal(const Node& node, std::string& out) {
+    using Kind = Node::Kind;
+    switch (node.kind) {
+        case Kind::kEmpty:
+            return true;
+        case Kind::kChar:
+            append_mutf8(out, node.value);
+            return true;
+        case Kind::kConcat:
+            for (const auto& child : node.children) {
+                if (!exact_literal(*child, out)) return false;
+            }
+            return true;
+        case Kind::kRepeat: {
+            if (node.min != node.max) return false;
+            std::string once;
+            if (!exact_literal(*node.children.front(), once)) return false;
+            for (int i = 0; i < node.min; i++) out += once;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Longest fixed string that every match of the node contains
+std::string Regex::required_literal(const Node& node) {
+    using Kind = Node::Kind;
+    std::string exact;
+    if (exact_literal(node, exact)) return exact;
+
+    if (node.kind == Kind::kRepeat) {
+        return node.min > 0 ? required_literal(*node.children.front()) : std::string();
+    }
+    if (node.kind != Kind::kConcat) return std::string();
+
+    std::string best, run;
+    for (const auto& child : node.children) {
+        std::string part;
+        if (exact_literal(*child, part)) {
+            run += part;
+            continue;
+        }
+        if (run.size() > best.size()) best = run;
+        run.clear();
+        std::string inner = required_literal(*child);
+        if (inner.size() > best.size()) best = std::move(inner);
+    }
+    if (run.size() > best.size()) best = std::move(run);
+    return best;
+}
+
+// ==================== Compiler ====================
+
+bool Regex::emit(const Node& node, std::string& error) {
+    auto push = [this](Op op, uint32_t arg = 0) {
+        Inst inst;
+        inst.op = op;
+        inst.arg = arg;
+        program_.push_back(inst);
+        return static_cast<uint32_t>(program_.size() - 1);
+    };
+    auto pc = [this]() { return static_cast<uint32_t>(program_.size()); };
+
+    if (program_.size() > kMaxProgramSize) {
+        error = "Pattern is too complex";
+        return false;
+    }
+
+    switch (node.kind) {
+        case Node::Kind::kEmpty:
+            break;
+        case Node::Kind::kChar:
+            push(Op::kChar, node.value);
+            break;
+        case Node::Kind::kAny:
+            push(Op::kAny);
+            break;
+        case Node::Kind::kClass:
+            push(Op::kClass, node.value);
+            break;
+        case Node::Kind::kBol:
+            push(Op::kBol);
+            break;
+        case Node::Kind::kEol:
+            push(Op::kEol);
+            break;
+        case Node::Kind::kEnd:
+            push(Op::kEol, 1);
+            break;
+        case Node::Kind::kWordBoundary:
+            push(Op::kWordBoundary);
+            break;
+        case Node::Kind::kNotWordBoundary:
+            push(Op::kNotWordBoundary);
+            break;
+        case Node::Kind::kConcat:
+            for (const auto& child : node.children) {
+                if (!emit(*child, error)) return false;
+            }
+            break;
+        case Node::Kind::kAlt: {
+            std::vector<uint32_t> exits;
+            for (size_t i = 0; i + 1 < node.children.size(); i++) {
+                uint32_t split = push(Op::kSplit);
+                program_[split].x = pc();
+                if (!emit(*node.children[i], error)) return false;
+                exits.push_back(push(Op::kJmp));
+                program_[split].y = pc();
+            }
+            if (!emit(*node.children.back(), error)) return false;
+            for (uint32_t jmp : exits) program_[jmp].x = pc();
+            break;
+        }
+        case Node::Kind::kRepeat: {
+            const Node& child = *node.children.front();
+            for (int i = 0; i < node.min; i++) {
+                if (!emit(child, error)) return false;
+            }
+            if (node.max < 0) {
+                uint32_t split = push(Op::kSplit);
+                program_[split].x = pc();
+                if (!emit(child, error)) return false;
+                program_[push(Op::kJmp)].x = split;
+                program_[split].y = pc();
+            } else {
+                std::vector<uint32_t> splits;
+                for (int i = node.min; i < node.max; i++) {
+                    uint32_t split = push(Op::kSplit);
+                    program_[split].x = pc();
+                    splits.push_back(split);
+                    if (!emit(child, error)) return false;
+                }
+                for (uint32_t split : splits) program_[split].y = pc();
+            }
+            break;
+        }
+    }
+
+    if (program_.size() > kMaxProgramSize) {
+        error = "Pattern is too complex";
+        return false;
+    }
+    return true;
+}
+
+bool Regex::compile(std::string_view pattern, bool case_sensitive, std::string& error) {
+    program_.clear();
+    classes_.clear();
+    required_literal_.clear();
+    is_literal_ = false;
+    anchored_start_ = false;
+    case_sensitive_ = case_sensitive;
+
+    if (pattern.size() > kMaxPatternSize) {
+        error = "Pattern is too long";
+        return false;
+    }
+
+    std::unique_ptr<Node> root = Parser(*this, pattern, error).parse();
+    if (!root) return false;
+
+    if (!emit(*root, error)) {
+        program_.clear();
+        return false;
+    }
+    program_.push_back(Inst{Op::kMatch});
+
+    // Emitting first bounds the pattern's expanded size, and so the literal's
+    std::string exact;
+    is_literal_ = exact_literal(*root, exact);
+    required_literal_ = is_literal_ ? std::move(exact) : required_literal(*root);
+
+    const Node* first = root.get();
+    while (first->kind == Node::Kind::kConcat && !first->children.empty()) {
+        first = first->children.front().get();
+    }
+    anchored_start_ = first->kind == Node::Kind::kBol;
+    return true;
+}
+
+// ==================== Pike VM ====================
+
+bool Regex::step(const Inst& inst, uint32_t cp) const {
+    switch (inst.op) {
+        case Op::kChar: return cp == inst.arg;
+        case Op::kAny: return !is_line_terminator(cp);
+        case Op::kClass: return classes_[inst.arg].contains(cp);
+        default: return false;
+    }
+}
+
+namespace {
+
+// Set of program counters with O(1) insert/clear, kept in insertion order
+struct ThreadList {
+    std::vector<uint32_t> dense;
+    std::vector<uint32_t> sparse;
+    size_t count = 0;
+
+    void reset(size_t program_size) {
+        if (sparse.size() < program_size) {
+            sparse.resize(program_size);
+            dense.resize(program_size);
+        }
+        count = 0;
+    }
+    bool contains(uint32_t pc) const { return sparse[pc] < count && dense[sparse[pc]] == pc; }
+    void insert(uint32_t pc) {
+        sparse[pc] = static_cast<uint32_t>(count);
+        dense[count++] = pc;
+    }
+};
+
+// Scratch buffers reused across searches on the same thread
+struct VmScratch {
+    std::vector<uint32_t> text;
+    std::vector<uint32_t> stack;
+    ThreadList lists[2];
+};
+
+} // namespace
+
+bool Regex::search(std::string_view text) const {
+    if (program_.empty()) return false;
+
+    thread_local VmScratch scratch;
+    std::vector<uint32_t>& cps = scratch.text;
+    cps.clear();
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+    for (size_t pos = 0; pos < text.size();) {
+        uint32_t cp = decode_code_point(p, text.size(), pos);
+        cps.push_back(case_sensitive_ ? cp : ascii_lower(cp));
+    }
+
+    const size_t n = cps.size();
+    ThreadList* current = &scratch.lists[0];
+    ThreadList* next = &scratch.lists[1];
+    current->reset(program_.size());
+    next->reset(program_.size());
+    std::vector<uint32_t>& stack = scratch.stack;
+
+    // Follow non-consuming instructions from pc at position i; true if Match is reachable
+    auto add_thread = [&](ThreadList& list, uint32_t start, size_t i) {
+        stack.clear();
+        stack.push_back(start);
+        while (!stack.empty()) {
+            uint32_t pc = stack.back();
+            stack.pop_back();
+            if (list.contains(pc)) continue;
+            list.insert(pc);
+
+            const Inst& inst = program_[pc];
+            switch (inst.op) {
+                case Op::kMatch:
+                    return true;
+                case Op::kJmp:
+                    stack.push_back(inst.x);
+                    break;
+                case Op::kSplit:
+                    stack.push_back(inst.y);
+                    stack.push_back(inst.x);
+                    break;
+                case Op::kBol:
+                    if (i == 0) stack.push_back(pc + 1);
+                    break;
+                case Op::kEol:
+                    // $ also matches before a final line terminator; \z only at the very end
+                    if (i == n || (inst.arg == 0 && i + 1 == n && is_line_terminator(cps[i]))) {
+                        stack.push_back(pc + 1);
+                    }
+                    break;
+                case Op::kWordBoundary:
+                case Op::kNotWordBoundary: {
+                    bool before = i > 0 && is_word(cps[i - 1]);
+                    bool after = i < n && is_word(cps[i]);
+                    if ((before != after) == (inst.op == Op::kWordBoundary)) stack.push_back(pc + 1);
+                    break;
+                }
+                default:
+                    break;  // consuming instruction, runs in step()
+            }
+        }
+        return false;
+    };
+
+    for (size_t i = 0;; i++) {
+        if ((!anchored_start_ || i == 0) && add_thread(*current, 0, i)) return true;
+        if (i == n || current->count == 0) return false;
+
+        next->count = 0;
+        for (size_t t = 0; t < current->count; t++) {
+            uint32_t pc = current->dense[t];
+            if (step(program_[pc], cps[i]) && add_thread(*next, pc + 1, i + 1)) return true;
+        }
+        std::swap(current, next);
+    }
+}
+
+} // namespace dex
@@ -0,0 +1,128 @@
+#include "dex/dex_search.h"
+#include "dex/dex_parser.h"
+#include "dex/thread_pool.h"
+#include "dex/substring_matcher.h"
+#include "dex/dex_regex.h"
+#include "dex/trigram_index.h"
+#include <atomic>
+
+namespace dex {
+
+template<typename T>
+static T read_le(const uint8_t* p) {
+    T val = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        val |= static_cast<T>(p[i]) << (i * 8);
+    }
+    return val;
+}
+
+bool parse_search_target(const std::string& name, SearchTarget& target) {
+    if (name == "string") target = SearchTarget::kString;
+    else if (name == "class") target = SearchTarget::kClass;
+    else if (name == "method") target = SearchTarget::kMethod;
+    else if (name == "field") target = SearchTarget::kField;
+    else return false;
+    return true;
+}
+
+size_t search_pool_size(const DexParser& parser, SearchTarget target) {
+    const DexHeader& header = parser.header();
+    switch (target) {
+        case SearchTarget::kString: return header.string_ids_size;
+        case SearchTarget::kClass: return parser.classes().size();
+        case SearchTarget::kMethod: return header.method_ids_size;
+        case SearchTarget::kField: return header.field_ids_size;
+    }
+    return 0;
+}
+
+std::string_view search_text(const DexParser& parser, SearchTarget target, size_t i) {
+    const DexHeader& header = parser.header();
+    const ByteView& data = parser.data();
+    const StringTable& strings = parser.string_table();
+
+    switch (target) {
+        case SearchTarget::kString:
+            return strings.raw(static_cast<uint32_t>(i));
+        case SearchTarget::kClass: {
+            uint32_t type_idx = parser.classes()[i].class_idx;
+            if (type_idx >= header.type_ids_size) return {};
+            return strings.raw(read_le<uint32_t>(&data[header.type_ids_off + type_idx * 4]));
+        }
+        case SearchTarget::kMethod: {
+            size_t offset = header.method_ids_off + i * 8;
+            if (offset + 8 > data.size()) return {};
+            return strings.raw(read_le<uint32_t>(&data[offset + 4]));
+        }
+        case SearchTarget::kField: {
+            size_t offset = header.field_ids_off + i * 8;
+            if (offset + 8 > data.size()) return {};
+            return strings.raw(read_le<uint32_t>(&data[offset + 4]));
+        }
+    }
+    return {};
+}
+
+bool search_dex(const DexParser& parser, const SearchOptions& options, std::vector<uint32_t>& results,
+                std::string& error, const TrigramIndex* index) {
+    results.clear();
+
+    Regex regex;
+    if (options.regex && !regex.compile(options.query, options.case_sensitive, error)) return false;
+
+    size_t count = search_pool_size(parser, options.target);
+    if (count == 0 || options.max_results == 0) return true;
+
+    // Substring queries match the literal directly; regex candidates must contain its required literal
+    const std::string& literal = options.regex ? regex.required_literal() : options.query;
+    bool run_regex = options.regex && !regex.is_literal();
+    SubstringMatcher matcher(literal, options.case_sensitive);
+    // Raw string data lives inside the DEX image, so the matcher may load up to its end
+    const char* limit = reinterpret_cast<const char*>(parser.data().end());
+
+    auto matches = [&](size_t i) {
+        std::string_view text = search_text(parser, options.target, i);
+        return matcher.match(text, limit) && (!run_regex || regex.search(text));
+    };
+
+    // Posting-list candidates are ascending, so verifying them in order keeps pool order
+    std::vector<uint32_t> candidates;
+    if (index && index->candidates(literal, candidates)) {
+        for (uint32_t idx : candidates) {
+            if (idx >= count || !matches(idx)) continue;
+            results.push_back(idx);
+            if (results.size() >= options.max_results) break;
+        }
+        return true;
+    }
+
+    size_t chunks = chunk_count(count, 1024);
+    std::vector<std::vector<uint32_t>> partial(chunks);
+    // Lowest chunk known to have filled the quota; later chunks can stop early
+    std::atomic<size_t> full_chunk{chunks};
+
+    parallel_chunks(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        std::vector<uint32_t>& hits = partial[chunk];
+        for (size_t i = begin; i < end; i++) {
+            if (hits.size() >= options.max_results) break;
+            if ((i & 0xFF) == 0 && full_chunk.load(std::memory_order_relaxed) < chunk) break;
+
+            if (matches(i)) hits.push_back(static_cast<uint32_t>(i));
+        }
+        if (hits.size() >= options.max_results) {
+            size_t current = full_chunk.load(std::memory_order_relaxed);
+            while (chunk < current && !full_chunk.compare_exchange_weak(current, chunk)) {}
+        }
+    });
+
+    for (const auto& hits : partial) {
+        for (uint32_t idx : hits) {
+            if (results.size() >= options.max_results) return true;
+            results.push_back(idx);
+        }
+    }
+    return true;
+}
+
+} // namespace dex
@@ -0,0 +1,278 @@
+#include "dex/dex_session.h"
+#include <sstream>
+#include <algorithm>
+
+namespace dex {
+
+// Nothing is resolved until first use, so opening a session stays cheap
+DexSession::DexSession()
+    : symbols_(std::make_shared<DexSymbolResolver>(parser_)), disasm_(symbols_) {}
+
+bool DexSession::open(std::vector<uint8_t>&& data) {
+    return parser_.parse(std::move(data));
+}
+
+bool DexSession::open_file(const std::string& path) {
+    return parser_.parse(path);
+}
+
+bool DexSession::open_view(const uint8_t* data, size_t size, std::shared_ptr<const void> keepalive) {
+    keepalive_ = std::move(keepalive);
+    return parser_.parse_view(data, size);
+}
+
+const XrefIndex& DexSession::xref_index() const {
+    std::call_once(xref_once_, [this]() {
+        xref_index_.build(parser_);
+    });
+    return xref_index_;
+}
+
+std::vector<DexParser::XRef> DexSession::xrefs(XrefKind kind, int idx) const {
+    std::vector<DexParser::XRef> result;
+    if (idx < 0) return result;
+
+    XrefRange sites = xref_index().sites(kind, static_cast<uint32_t>(idx));
+    result.reserve(sites.size());
+    for (const XrefSite& site : sites) {
+        MethodInfo caller = parser_.get_method(site.method_idx);
+        DexParser::XRef xref;
+        xref.caller_class = std::move(caller.class_name);
+        xref.caller_method = std::move(caller.method_name);
+        xref.offset = site.pc;
+        result.push_back(std::move(xref));
+    }
+    return result;
+}
+
+bool DexSession::search(const SearchOptions& options, std::vector<uint32_t>& results, std::string& error) const {
+    if (!search_index_enabled_ || options.query.size() < TrigramIndex::kGram) {
+        return search_dex(parser_, options, results, error);
+    }
+
+    int target = static_cast<int>(options.target);
+    std::call_once(search_index_once_[target], [this, &options, target]() {
+        search_index_[target].build(parser_, options.target);
+    });
+    return search_dex(parser_, options, results, error, &search_index_[target]);
+}
+
+const PackageTree& DexSession::package_tree() const {
+    std::call_once(package_tree_once_, [this]() {
+        package_tree_.build(parser_);
+    });
+    return package_tree_;
+}
+
+std::shared_ptr<const DebugInfo> DexSession::debug_info(uint32_t debug_info_off) const {
+    if (debug_info_off == 0) return nullptr;
+    {
+        std::lock_guard<std::mutex> lock(debug_info_mutex_);
+        auto it = debug_info_.find(debug_info_off);
+        if (it != debug_info_.end()) return it->second;
+    }
+
+    // Decoded outside the lock; if two threads race, the first result is kept
+    std::shared_ptr<const DebugInfo> decoded;
+    auto info = std::make_shared<DebugInfo>();
+    if (parser_.read_debug_info(debug_info_off, *info)) decoded = std::move(info);
+
+    std::lock_guard<std::mutex> lock(debug_info_mutex_);
+    return debug_info_.emplace(debug_info_off, std::move(decoded)).first->second;
+}
+
+void DexSession::method_header_smali(SmaliWriter& out, uint32_t method_idx, uint32_t access_flags,
+                                     const CodeItem* code, const DebugInfo* debug, uint32_t annotations,
+                                     uint32_t parameters) const {
+    const SmaliDisassembler& disasm = disassembler();
+    std::vector<uint32_t> parameter_sets;
+    if (parameters != 0) parser_.read_offset_list(parameters, parameter_sets);
+
+    MemberId id;
+    ProtoId proto;
+    if ((debug || !parameter_sets.empty()) && parser_.method_id(method_idx, id) &&
+        parser_.proto_id(id.type_idx, proto)) {
+        disasm.write_parameters_smali(out, debug, proto, code ? code->registers_size : 0, code ? code->ins_size : 0,
+                                      (access_flags & 0x0008) != 0, &parser_, &parameter_sets);
+    }
+    if (annotations != 0) disasm.write_annotation_set(out, parser_, annotations, 4);
+}
+
+void DexSession::code_smali(SmaliWriter& out, uint32_t method_idx, uint32_t access_flags, const CodeItem& code,
+                            bool with_debug, uint32_t annotations, uint32_t parameters) const {
+    const SmaliDisassembler& disasm = disassembler();
+    std::vector<TryBlock> tries;
+    if (!parser_.read_tries(code, tries)) tries.clear();
+    std::shared_ptr<const DebugInfo> debug = with_debug ? debug_info(code.debug_info_off) : nullptr;
+
+    out.append("    .registers ").decimal(static_cast<uint32_t>(code.registers_size)).append('\n');
+    method_header_smali(out, method_idx, access_flags, &code, debug.get(), annotations, parameters);
+    disasm.write_method_smali(out, code.insns.data(), code.insns.size(), tries, debug.get());
+}
+
+bool DexSession::class_smali(const std::string& class_name, std::string& out, bool with_debug) const {
+    int class_def_idx = parser_.find_class_def(class_name);
+    return class_def_idx >= 0 && class_smali(static_cast<uint32_t>(class_def_idx), out, with_debug);
+}
+
+bool DexSession::class_smali(uint32_t class_def_idx, std::string& out, bool with_debug) const {
+    if (class_def_idx >= parser_.classes().size()) return false;
+
+    using AccessKind = SmaliDisassembler::AccessKind;
+    const ClassDef& cls = parser_.classes()[class_def_idx];
+    const ClassData& data = parser_.class_data(class_def_idx);
+    const SmaliDisassembler& disasm = disassembler();
+
+    // Rendered straight into the caller's buffer, reusing its capacity
+    out.clear();
+    SmaliWriter smali(out);
+
+    // Member names and types straight from the id tables: "name:I", "name(I)V"
+    auto append_field = [&](uint32_t field_idx) {
+        MemberId id;
+        if (!parser_.field_id(field_idx, id)) return;
+        smali.append(parser_.get_string(id.name_idx)).append(':').append(parser_.type_descriptor(id.type_idx));
+    };
+    auto append_method = [&](uint32_t method_idx) {
+        MemberId id;
+        ProtoId proto;
+        if (!parser_.method_id(method_idx, id)) return;
+        smali.append(parser_.get_string(id.name_idx)).append('(');
+        if (!parser_.proto_id(id.type_idx, proto)) {
+            smali.append(")V");
+            return;
+        }
+        for (uint32_t i = 0; i < proto.param_count; i++) smali.append(parser_.type_descriptor(proto.param(i)));
+        smali.append(')').append(parser_.type_descriptor(proto.return_type_idx));
+    };
+
+    // Keywords followed by a separating space, or nothing when no flag is set
+    auto flags = [&](uint32_t access_flags, AccessKind kind) {
+        std::string keywords = SmaliDisassembler::access_flags_string(access_flags, kind);
+        if (!keywords.empty()) smali.append(keywords).append(' ');
+    };
+
+    smali.append(".class ");
+    flags(cls.access_flags, AccessKind::kClass);
+    smali.append(parser_.type_descriptor(cls.class_idx)).append('\n');
+    std::string_view super_name = parser_.type_descriptor(cls.superclass_idx);
+    if (!super_name.empty()) {
+        smali.append(".super ").append(super_name).append('\n');
+    }
+    if (cls.source_file_idx < parser_.string_table().size()) {
+        smali.append(".source ").string_literal(parser_.get_string(cls.source_file_idx)).append('\n');
+    }
+    smali.append('\n');
+
+    std::vector<uint32_t> interfaces;
+    if (cls.interfaces_off != 0 && cls.interfaces_off < parser_.data().size() - 4) {
+        const uint8_t* list = parser_.data().begin() + cls.interfaces_off;
+        uint32_t size = list[0] | (list[1] << 8) | (list[2] << 16) | (uint32_t(list[3]) << 24);
+        if (uint64_t(size) * 2 <= parser_.data().size() - cls.interfaces_off - 4) {
+            for (uint32_t i = 0; i < size; i++) {
+                smali.append(".implements ").append(parser_.type_descriptor(list[4 + i * 2] | (list[5 + i * 2] << 8)))
+                     .append('\n');
+            }
+            if (size != 0) smali.append('\n');
+        }
+    }
+
+    // Member annotations by index; lists in the directory ascend, so they are binary searched
+    AnnotationsDirectory annotations;
+    parser_.read_annotations_directory(cls.annotations_off, annotations);
+    auto find = [](const std::vector<std::pair<uint32_t, uint32_t>>& entries, uint32_t idx) -> uint32_t {
+        auto it = std::lower_bound(entries.begin(), entries.end(), std::make_pair(idx, 0u));
+        return it != entries.end() && it->first == idx ? it->second : 0;
+    };
+    if (annotations.class_annotations_off != 0) {
+        disasm.write_annotation_set(smali, parser_, annotations.class_annotations_off, 0);
+        smali.append('\n');
+    }
+
+    // Initial values of the static fields, in class_data order
+    const uint8_t* value = nullptr;
+    const uint8_t* values_end = parser_.data().end();
+    uint32_t value_count = 0;
+    if (cls.static_values_off != 0 && cls.static_values_off < parser_.data().size()) {
+        value = parser_.data().begin() + cls.static_values_off;
+        uint32_t shift = 0;
+        for (uint8_t b = 0x80; (b & 0x80) && value < values_end && shift < 35; shift += 7) {
+            b = *value++;
+            value_count |= static_cast<uint32_t>(b & 0x7f) << shift;
+        }
+    }
+
+    for (const EncodedField& field : data.fields()) {
+        smali.append(".field ");
+        flags(field.access_flags, AccessKind::kField);
+        append_field(field.field_idx);
+        if (value && value_count > 0 && (field.access_flags & 0x0008)) {
+            value_count--;
+            smali.append(" = ");
+            if (!disasm.write_encoded_value(smali, value, values_end, 0)) value = nullptr;
+        }
+        smali.append('\n');
+        uint32_t set_off = find(annotations.fields, field.field_idx);
+        if (set_off != 0) {
+            disasm.write_annotation_set(smali, parser_, set_off, 4);
+            smali.append(".end field\n");
+        }
+    }
+    if (!data.fields().empty()) smali.append('\n');
+
+    CodeItem code;
+    for (const EncodedMethod& method : data.methods()) {
+        smali.append(".method ");
+        flags(method.access_flags, AccessKind::kMethod);
+        append_method(method.method_idx);
+        smali.append('\n');
+
+        uint32_t method_annotations = find(annotations.methods, method.method_idx);
+        uint32_t parameters = find(annotations.parameters, method.method_idx);
+        if (parser_.read_code_item(method.code_off, code)) {
+            code_smali(smali, method.method_idx, method.access_flags, code, with_debug, method_annotations,
+                       parameters);
+        } else {
+            method_header_smali(smali, method.method_idx, method.access_flags, nullptr, nullptr,
+                                method_annotations, parameters);
+        }
+        smali.append(".end method\n\n");
+    }
+
+    return true;
+}
+
+// SessionRegistry implementation
+
+SessionRegistry& SessionRegistry::instance() {
+    static SessionRegistry registry;
+    return registry;
+}
+
+int64_t SessionRegistry::add(std::shared_ptr<DexSession> session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t handle = next_handle_++;
+    sessions_[handle] = std::move(session);
+    return handle;
+}
+
+std::shared_ptr<DexSession> SessionRegistry::get(int64_t handle) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(handle);
+    if (it != sessions_.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+bool SessionRegistry::remove(int64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sessions_.erase(handle) > 0;
+}
+
+size_t SessionRegistry::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sessions_.size();
+}
+
+} // namespace dex
@@ -0,0 +1,72 @@
+#include "dex/insn_iterator.h"
+
+namespace dex {
+
+template<typename T>
+static T read_le(const uint8_t* p) {
+    T val = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        val |= static_cast<T>(p[i]) << (i * 8);
+    }
+    return val;
+}
+
+uint32_t Insn::ref_index() const {
+    switch (info().format) {
+        case OpcodeFormat::k21c:
+        case OpcodeFormat::k35c:
+        case OpcodeFormat::k3rc:
+        case OpcodeFormat::k45cc:
+        case OpcodeFormat::k4rcc:
+        case OpcodeFormat::k22c:
+            return read_le<uint16_t>(code + 2);
+        case OpcodeFormat::k31c:
+            return read_le<uint32_t>(code + 2);
+        default:
+            return 0;
+    }
+}
+
+bool InsnIterator::next(Insn& insn) {
+    if (pc_ >= units_) return false;
+
+    const uint8_t* code = insns_ + static_cast<size_t>(pc_) * 2;
+    uint32_t remaining = units_ - pc_;
+    uint8_t op = code[0];
+
+    insn.code = code;
+    insn.pc = pc_;
+    insn.opcode = op;
+    insn.payload = PayloadKind::kNone;
+    insn.size = SmaliDisassembler::get_opcode_info(op).size;
+
+    if (op == 0x00 && code[1] >= 0x01 && code[1] <= 0x03) {
+        if (remaining < 4) return false;
+        uint16_t count = read_le<uint16_t>(code + 2);
+        switch (code[1]) {
+            case 0x01:  // packed-switch-payload: ident, size, first_key(2), targets(size*2)
+                insn.payload = PayloadKind::kPackedSwitch;
+                insn.size = 4 + count * 2u;
+                break;
+            case 0x02:  // sparse-switch-payload: ident, size, keys(size*2), targets(size*2)
+                insn.payload = PayloadKind::kSparseSwitch;
+                insn.size = 2 + count * 4u;
+                break;
+            case 0x03: {  // fill-array-data-payload: ident, element_width, size(2), data
+                uint32_t elements = read_le<uint32_t>(code + 4);
+                uint64_t data_units = (static_cast<uint64_t>(elements) * count + 1) / 2;
+                if (data_units > remaining) return false;
+                insn.payload = PayloadKind::kFillArrayData;
+                insn.size = 4 + static_cast<uint32_t>(data_units);
+                break;
+            }
+        }
+    }
+
+    if (insn.size == 0 || insn.size > remaining) return false;
+
+    pc_ += insn.size;
+    return true;
+}
+
+} // namespace dex
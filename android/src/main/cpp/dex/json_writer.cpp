@@ -0,0 +1,133 @@
+#include "dex/json_writer.h"
+#include <charconv>
+
+namespace dex {
+
+void JsonWriter::separate() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (depth_ > 0 && depth_ <= kMaxDepth) {
+        if (has_items_[depth_ - 1]) out_ += ',';
+        has_items_[depth_ - 1] = true;
+    }
+}
+
+void JsonWriter::open(char bracket) {
+    separate();
+    out_ += bracket;
+    if (depth_ < kMaxDepth) has_items_[depth_] = false;
+    depth_++;
+}
+
+void JsonWriter::close(char bracket) {
+    if (depth_ > 0) depth_--;
+    out_ += bracket;
+}
+
+JsonWriter& JsonWriter::begin_object() {
+    open('{');
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+    close('}');
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+    open('[');
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+    close(']');
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+    separate();
+    out_ += '"';
+    out_.append(name.data(), name.size());
+    out_ += "\":";
+    after_key_ = true;
+    return *this;
+}
+
+void JsonWriter::escape(std::string_view str) {
+    static const char kHex[] = "0123456789abcdef";
+
+    // Copy unescaped runs in bulk
+    size_t run = 0;
+    for (size_t i = 0; i < str.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out_.append(str.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\n': out_ += "\\n"; break;
+            case '\r': out_ += "\\r"; break;
+            case '\t': out_ += "\\t"; break;
+            case '\b': out_ += "\\b"; break;
+            case '\f': out_ += "\\f"; break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+                out_.append(esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+    out_.append(str.data() + run, str.size() - run);
+}
+
+JsonWriter& JsonWriter::value(std::string_view str) {
+    separate();
+    out_ += '"';
+    escape(str);
+    out_ += '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(int64_t number) {
+    separate();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), number);
+    out_.append(buf, res.ptr - buf);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t number) {
+    separate();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), number);
+    out_.append(buf, res.ptr - buf);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag) {
+    separate();
+    out_ += flag ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_string() {
+    separate();
+    out_ += '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::append(std::string_view piece) {
+    escape(piece);
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_string() {
+    out_ += '"';
+    return *this;
+}
+
+} // namespace dex
@@ -0,0 +1,106 @@
+#include "dex/package_tree.h"
+#include "dex/dex_parser.h"
+#include <algorithm>
+
+namespace dex {
+
+void PackageTree::build(const DexParser& parser) {
+    struct Item {
+        std::string_view path;  // descriptor without the leading 'L' and trailing ';'
+        uint32_t class_def;
+    };
+    struct Group {
+        std::string_view name;
+        size_t begin;
+        size_t end;
+    };
+    struct Pending {
+        uint32_t node;
+        size_t begin;
+        size_t end;
+        size_t depth;  // offset of the node's relative path inside each item path
+    };
+
+    const auto& classes = parser.classes();
+    std::vector<Item> items;
+    items.reserve(classes.size());
+    for (size_t i = 0; i < classes.size(); i++) {
+        std::string_view desc = parser.type_descriptor(classes[i].class_idx);
+        if (desc.size() >= 2 && desc.front() == 'L' && desc.back() == ';') {
+            desc = desc.substr(1, desc.size() - 2);
+        }
+        items.push_back({desc, static_cast<uint32_t>(i)});
+    }
+    // Paths sharing a package prefix are contiguous once sorted
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.path < b.path; });
+
+    nodes_.assign(1, Node{});
+    nodes_[0].total_classes = static_cast<uint32_t>(items.size());
+    classes_.clear();
+    classes_.reserve(items.size());
+
+    // Breadth-first, so every node's children are appended next to each other
+    std::vector<Pending> queue{{0, 0, items.size(), 0}};
+    std::vector<Group> groups;
+    for (size_t head = 0; head < queue.size(); head++) {
+        Pending p = queue[head];
+        groups.clear();
+
+        uint32_t first_class = static_cast<uint32_t>(classes_.size());
+        for (size_t i = p.begin; i < p.end;) {
+            std::string_view rest = items[i].path.substr(p.depth);
+            size_t slash = rest.find('/');
+            if (slash == std::string_view::npos) {
+                classes_.push_back(items[i].class_def);
+                i++;
+                continue;
+            }
+
+            std::string_view prefix = rest.substr(0, slash + 1);
+            size_t j = i + 1;
+            while (j < p.end && items[j].path.substr(p.depth, prefix.size()) == prefix) j++;
+            groups.push_back({rest.substr(0, slash), i, j});
+            i = j;
+        }
+
+        // '/' sorts after characters like '$' and '-', so group order may differ from name order
+        std::sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) { return a.name < b.name; });
+
+        Node& node = nodes_[p.node];
+        node.first_class = first_class;
+        node.class_count = static_cast<uint32_t>(classes_.size()) - first_class;
+        node.first_child = static_cast<uint32_t>(nodes_.size());
+        node.child_count = static_cast<uint32_t>(groups.size());
+
+        for (const Group& group : groups) {
+            Node child;
+            child.name = group.name;
+            child.total_classes = static_cast<uint32_t>(group.end - group.begin);
+            queue.push_back({static_cast<uint32_t>(nodes_.size()), group.begin, group.end,
+                             p.depth + group.name.size() + 1});
+            nodes_.push_back(child);
+        }
+    }
+}
+
+const PackageTree::Node* PackageTree::find(std::string_view path) const {
+    const Node* node = &nodes_.front();
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t sep = path.find_first_of("/.", pos);
+        if (sep == std::string_view::npos) sep = path.size();
+        std::string_view segment = path.substr(pos, sep - pos);
+        pos = sep + 1;
+        if (segment.empty()) continue;
+
+        const Node* begin = children_begin(*node);
+        const Node* end = children_end(*node);
+        const Node* it = std::lower_bound(begin, end, segment,
+                                          [](const Node& n, std::string_view name) { return n.name < name; });
+        if (it == end || it->name != segment) return nullptr;
+        node = it;
+    }
+    return node;
+}
+
+} // namespace dex
@@ -0,0 +1,97 @@
+#include "dex/result_cursor.h"
+#include "dex/dex_search.h"
+#include <algorithm>
+#include <limits>
+
+namespace dex {
+
+bool parse_cursor_target(const std::string& name, CursorTarget& target) {
+    if (name == "class") target = CursorTarget::kClass;
+    else if (name == "string") target = CursorTarget::kString;
+    else return false;
+    return true;
+}
+
+static SearchTarget search_target(CursorTarget target) {
+    return target == CursorTarget::kClass ? SearchTarget::kClass : SearchTarget::kString;
+}
+
+std::shared_ptr<ResultCursor> ResultCursor::open(std::vector<std::shared_ptr<const DexSession>> sessions,
+                                                 CursorTarget target, const std::string& filter) {
+    auto cursor = std::make_shared<ResultCursor>();
+    cursor->sessions_ = std::move(sessions);
+    cursor->target_ = target;
+
+    SearchOptions options;
+    options.query = filter;
+    options.target = search_target(target);
+    options.case_sensitive = true;
+    options.max_results = std::numeric_limits<size_t>::max();
+
+    std::vector<uint32_t> hits;
+    std::string error;
+    for (size_t source = 0; source < cursor->sessions_.size(); source++) {
+        if (!cursor->sessions_[source]->search(options, hits, error)) continue;
+        for (uint32_t idx : hits) {
+            cursor->entries_.push_back({static_cast<uint32_t>(source), idx});
+        }
+    }
+
+    // The string pool of a single DEX is already sorted; class_defs are in superclass-first order
+    if (target == CursorTarget::kClass || cursor->sessions_.size() > 1) {
+        std::vector<std::pair<std::string_view, Entry>> keyed;
+        keyed.reserve(cursor->entries_.size());
+        for (const Entry& entry : cursor->entries_) {
+            keyed.emplace_back(cursor->text(entry), entry);
+        }
+        std::stable_sort(keyed.begin(), keyed.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (size_t i = 0; i < keyed.size(); i++) {
+            cursor->entries_[i] = keyed[i].second;
+        }
+    }
+    return cursor;
+}
+
+const ResultCursor::Entry* ResultCursor::page(size_t offset, size_t limit, size_t& count) const {
+    if (offset >= entries_.size()) {
+        count = 0;
+        return nullptr;
+    }
+    count = std::min(limit, entries_.size() - offset);
+    return entries_.data() + offset;
+}
+
+std::string_view ResultCursor::text(const Entry& entry) const {
+    return search_text(sessions_[entry.source]->parser(), search_target(target_), entry.idx);
+}
+
+// CursorRegistry implementation
+
+CursorRegistry& CursorRegistry::instance() {
+    static CursorRegistry registry;
+    return registry;
+}
+
+int64_t CursorRegistry::add(std::shared_ptr<const ResultCursor> cursor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t handle = next_handle_++;
+    cursors_[handle] = std::move(cursor);
+    return handle;
+}
+
+std::shared_ptr<const ResultCursor> CursorRegistry::get(int64_t handle) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cursors_.find(handle);
+    if (it != cursors_.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+bool CursorRegistry::remove(int64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cursors_.erase(handle) > 0;
+}
+
+} // namespace dex
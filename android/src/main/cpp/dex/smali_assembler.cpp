@@ -0,0 +1,1077 @@
+#include "dex/smali_assembler.h"
+#include "dex/smali_disasm.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <unordered_map>
+
+namespace dex {
+
+template<typename T>
+static void write_le(uint8_t* p, T val) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        p[i] = static_cast<uint8_t>(val >> (i * 8));
+    }
+}
+
+static std::string_view trim(std::string_view s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return {};
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+static bool starts_with(std::string_view s, std::string_view prefix) {
+    return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Drop the ".0000:" offset prefix of the plain disassembly listing
+static std::string_view strip_offset_prefix(std::string_view line) {
+    size_t colon = line.find(':');
+    if (line.empty() || line[0] != '.' || colon == std::string_view::npos || colon > 8 || colon < 2) return line;
+    for (size_t i = 1; i < colon; i++) {
+        if (!std::isxdigit(static_cast<unsigned char>(line[i]))) return line;
+    }
+    return trim(line.substr(colon + 1));
+}
+
+// Operands separated by commas outside quotes and braces
+static void split_operands(std::string_view operands, std::vector<std::string_view>& parts) {
+    parts.clear();
+    bool in_quote = false;
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < operands.size(); i++) {
+        char c = operands[i];
+        if (in_quote) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                in_quote = false;
+            }
+            continue;
+        }
+        if (c == '"') in_quote = true;
+        if (c == '{') depth++;
+        if (c == '}') depth--;
+        if (c == ',' && depth == 0) {
+            parts.push_back(trim(operands.substr(start, i - start)));
+            start = i + 1;
+        }
+    }
+    std::string_view last = trim(operands.substr(start));
+    if (!last.empty() || !parts.empty()) parts.push_back(last);
+}
+
+// One UTF-16 unit as Modified UTF-8: NUL takes two bytes and surrogates are encoded separately
+static void append_mutf8(std::string& out, uint32_t unit) {
+    if (unit != 0 && unit < 0x80) {
+        out += static_cast<char>(unit);
+    } else if (unit < 0x800) {
+        out += static_cast<char>(0xC0 | (unit >> 6));
+        out += static_cast<char>(0x80 | (unit & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (unit >> 12));
+        out += static_cast<char>(0x80 | ((unit >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (unit & 0x3F));
+    }
+}
+
+std::string_view SmaliAssembler::strip_comment(std::string_view line) {
+    bool in_quote = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (in_quote) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                in_quote = false;
+            }
+            continue;
+        }
+        if (c == '"') {
+            in_quote = true;
+        } else if (c == '\'' && i + 2 < line.size()) {
+            // Character literal such as '#' or '\''
+            size_t close = line.find('\'', i + (line[i + 1] == '\\' ? 3 : 2));
+            if (close != std::string_view::npos) i = close;
+        } else if (c == '#') {
+            std::string_view rest = line.substr(i);
+            if (!starts_with(rest, "#int ") && !starts_with(rest, "#long ")) return trim(line.substr(0, i));
+        } else if (c == '/' && i + 1 < line.size() && line[i + 1] == '/') {
+            return trim(line.substr(0, i));
+        }
+    }
+    return trim(line);
+}
+
+bool SmaliAssembler::parse_string_literal(std::string_view text, std::string& value, size_t* end) {
+    value.clear();
+    if (text.empty() || text[0] != '"') return false;
+    for (size_t i = 1; i < text.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == '"') {
+            if (end) *end = i + 1;
+            return true;
+        }
+        if (c >= 0xF0 && i + 3 < text.size()) {
+            // 4-byte UTF-8 from an editor becomes a surrogate pair
+            uint32_t cp = ((c & 0x07) << 18) | ((text[i + 1] & 0x3F) << 12) | ((text[i + 2] & 0x3F) << 6) |
+                          (text[i + 3] & 0x3F);
+            cp -= 0x10000;
+            append_mutf8(value, 0xD800 + (cp >> 10));
+            append_mutf8(value, 0xDC00 + (cp & 0x3FF));
+            i += 3;
+            continue;
+        }
+        if (c != '\\') {
+            value += static_cast<char>(c);
+            continue;
+        }
+        if (++i >= text.size()) return false;
+        uint32_t unit;
+        switch (text[i]) {
+            case 'n': unit = '\n'; break;
+            case 'r': unit = '\r'; break;
+            case 't': unit = '\t'; break;
+            case 'b': unit = '\b'; break;
+            case 'f': unit = '\f'; break;
+            case '0': unit = 0; break;
+            case '"': unit = '"'; break;
+            case '\'': unit = '\''; break;
+            case '\\': unit = '\\'; break;
+            case 'u': {
+                if (i + 4 >= text.size()) return false;
+                auto res = std::from_chars(text.data() + i + 1, text.data() + i + 5, unit, 16);
+                if (res.ptr != text.data() + i + 5) return false;
+                i += 4;
+                break;
+            }
+            default: return false;
+        }
+        append_mutf8(value, unit);
+    }
+    return false;
+}
+
+bool SmaliAssembler::parse_literal(std::string_view text, int64_t& value) {
+    text = trim(text);
+    if (starts_with(text, "#int ")) text = trim(text.substr(5));
+    if (starts_with(text, "#long ")) text = trim(text.substr(6));
+    // None of the suffixes is a hex digit
+    if (!text.empty() && std::strchr("tTsSlL", text.back())) text.remove_suffix(1);
+    bool negative = false;
+    if (!text.empty() && (text[0] == '-' || text[0] == '+')) {
+        negative = text[0] == '-';
+        text.remove_prefix(1);
+    }
+    int base = 10;
+    if (starts_with(text, "0x") || starts_with(text, "0X")) {
+        base = 16;
+        text.remove_prefix(2);
+    }
+    if (text.empty()) return false;
+    uint64_t magnitude;
+    auto res = std::from_chars(text.data(), text.data() + text.size(), magnitude, base);
+    if (res.ec != std::errc() || res.ptr != text.data() + text.size()) return false;
+    value = static_cast<int64_t>(negative ? 0 - magnitude : magnitude);
+    return true;
+}
+
+static bool is_wide(const std::string& type) {
+    return type == "J" || type == "D";
+}
+
+uint32_t SmaliAssembler::ins_size(const MethodDef& method) {
+    uint32_t size = (method.access_flags & ACC_STATIC) ? 0 : 1;
+    for (const auto& type : method.prototype.param_types) size += is_wide(type) ? 2 : 1;
+    return size;
+}
+
+int SmaliAssembler::parameter_index(const MethodDef& method, uint32_t p) {
+    uint32_t reg = (method.access_flags & ACC_STATIC) ? 0 : 1;
+    const auto& params = method.prototype.param_types;
+    for (size_t i = 0; i < params.size(); i++) {
+        if (reg == p) return static_cast<int>(i);
+        reg += is_wide(params[i]) ? 2 : 1;
+    }
+    return -1;
+}
+
+// "Lfoo/Bar;", "[I", "V"; arrays of void are rejected
+static bool valid_type(std::string_view type) {
+    size_t i = 0;
+    while (i < type.size() && type[i] == '[') i++;
+    if (i >= type.size()) return false;
+    if (type[i] == 'L') return type.size() > i + 2 && type.back() == ';' && type.find(';') == type.size() - 1;
+    return i + 1 == type.size() && std::strchr(i == 0 ? "VZBSCIJFD" : "ZBSCIJFD", type[i]) != nullptr;
+}
+
+bool SmaliAssembler::resolve(RefKind kind, std::string_view token, uint32_t& idx, std::string& error) {
+    // Explicit pool index: string@12, type@3, method_handle@0, ...
+    size_t at = token.find('@');
+    if (at != std::string_view::npos && token[0] != '"' && token.find_first_of(";(") == std::string_view::npos) {
+        std::string_view digits = token.substr(at + 1);
+        auto res = std::from_chars(digits.data(), digits.data() + digits.size(), idx);
+        if (res.ec == std::errc() && res.ptr == digits.data() + digits.size()) return true;
+        error = "Invalid index: " + std::string(token);
+        return false;
+    }
+
+    switch (kind) {
+        case RefKind::kString: {
+            std::string value;
+            size_t end = 0;
+            if (!parse_string_literal(token, value, &end) || end != token.size()) {
+                error = "Invalid string literal: " + std::string(token);
+                return false;
+            }
+            idx = builder_.get_or_add_string(value);
+            return true;
+        }
+        case RefKind::kType: {
+            if (!valid_type(token)) {
+                error = "Invalid type: " + std::string(token);
+                return false;
+            }
+            std::string type(token);
+            idx = builder_.get_or_add_type(type);
+            return true;
+        }
+        case RefKind::kField: {
+            size_t arrow = token.find("->");
+            size_t colon = arrow == std::string_view::npos ? arrow : token.find(':', arrow);
+            if (colon == std::string_view::npos || !valid_type(token.substr(0, arrow)) ||
+                !valid_type(token.substr(colon + 1)) || colon == arrow + 2) {
+                error = "Invalid field reference: " + std::string(token);
+                return false;
+            }
+            idx = builder_.get_or_add_field(std::string(token.substr(0, arrow)),
+                                            std::string(token.substr(arrow + 2, colon - arrow - 2)),
+                                            std::string(token.substr(colon + 1)));
+            return true;
+        }
+        case RefKind::kMethod: {
+            size_t arrow = token.find("->");
+            size_t paren = arrow == std::string_view::npos ? arrow : token.find('(', arrow);
+            Prototype proto;
+            if (paren == std::string_view::npos || paren == arrow + 2 || !valid_type(token.substr(0, arrow)) ||
+                !Prototype::parse(std::string(token.substr(paren)), proto)) {
+                error = "Invalid method reference: " + std::string(token);
+                return false;
+            }
+            idx = builder_.get_or_add_method(std::string(token.substr(0, arrow)),
+                                             std::string(token.substr(arrow + 2, paren - arrow - 2)), proto);
+            return true;
+        }
+        case RefKind::kProto: {
+            Prototype proto;
+            if (!Prototype::parse(std::string(token), proto)) {
+                error = "Invalid prototype: " + std::string(token);
+                return false;
+            }
+            idx = builder_.get_or_add_proto(proto);
+            return true;
+        }
+        default:
+            error = "Expected an index reference: " + std::string(token);
+            return false;
+    }
+}
+
+// Per-method assembly state: frame size and label addresses in code units
+struct SmaliAssembler::MethodState {
+    uint32_t registers = 0;
+    uint32_t ins = 0;
+    bool has_registers = false;
+    std::unordered_map<std::string_view, uint32_t> labels;  // without the leading ':'
+};
+
+bool SmaliAssembler::parse_register(std::string_view token, const MethodState* state, uint32_t limit,
+                                    uint32_t& num, std::string& error) const {
+    if (token.size() < 2 || (token[0] != 'v' && token[0] != 'p')) {
+        error = "Invalid register: " + std::string(token);
+        return false;
+    }
+    auto res = std::from_chars(token.data() + 1, token.data() + token.size(), num);
+    if (res.ec != std::errc() || res.ptr != token.data() + token.size()) {
+        error = "Invalid register: " + std::string(token);
+        return false;
+    }
+    if (token[0] == 'p') {
+        // Parameters occupy the last `ins` registers of the frame
+        if (!state || !state->has_registers) {
+            error = "Parameter register without .registers: " + std::string(token);
+            return false;
+        }
+        num += state->registers - state->ins;
+    }
+    if (state && state->has_registers && num >= state->registers) {
+        error = "Register out of range: " + std::string(token);
+        return false;
+    }
+    if (num >= limit) {
+        error = "Register does not fit the instruction format: " + std::string(token);
+        return false;
+    }
+    return true;
+}
+
+static bool fits_signed(int64_t value, int bits) {
+    return value >= -(int64_t(1) << (bits - 1)) && value < (int64_t(1) << (bits - 1));
+}
+
+bool SmaliAssembler::encode_insn(std::string_view line, const MethodState* state, uint32_t pc,
+                                 std::vector<uint8_t>& insn, uint32_t& outs,
+                                 std::vector<std::pair<uint32_t, uint32_t>>* wide_refs, std::string& error) {
+    size_t space = line.find_first_of(" \t");
+    std::string_view name = line.substr(0, space);
+    std::string_view operands = space == std::string_view::npos ? std::string_view() : trim(line.substr(space));
+
+    int op = SmaliDisassembler::get_opcode_by_name(name);
+    if (op < 0) {
+        error = "Unknown opcode: " + std::string(name);
+        return false;
+    }
+    const OpcodeInfo& info = SmaliDisassembler::get_opcode_info(static_cast<uint8_t>(op));
+    insn.assign(info.size * 2, 0);
+    insn[0] = static_cast<uint8_t>(op);
+
+    std::vector<std::string_view> parts;
+    split_operands(operands, parts);
+
+    size_t expected;
+    switch (info.format) {
+        case OpcodeFormat::k10x: expected = 0; break;
+        case OpcodeFormat::k11x:
+        case OpcodeFormat::k10t:
+        case OpcodeFormat::k20t:
+        case OpcodeFormat::k30t: expected = 1; break;
+        case OpcodeFormat::k23x:
+        case OpcodeFormat::k22b:
+        case OpcodeFormat::k22t:
+        case OpcodeFormat::k22s:
+        case OpcodeFormat::k22c:
+        case OpcodeFormat::k45cc:
+        case OpcodeFormat::k4rcc: expected = 3; break;
+        case OpcodeFormat::kUnknown:
+        case OpcodeFormat::kPackedSwitch:
+        case OpcodeFormat::kSparseSwitch:
+        case OpcodeFormat::kFillArrayData:
+            error = "Unsupported instruction: " + std::string(name);
+            return false;
+        default: expected = 2; break;
+    }
+    if (parts.size() != expected) {
+        error = "Expected " + std::to_string(expected) + " operands for " + std::string(name);
+        return false;
+    }
+
+    uint32_t a = 0, b = 0, c = 0, idx = 0;
+    int64_t lit = 0;
+    auto reg = [&](size_t i, uint32_t limit, uint32_t& num) {
+        return parse_register(parts[i], state, limit, num, error);
+    };
+    auto literal = [&](size_t i, int bits) {
+        if (!parse_literal(parts[i], lit)) {
+            error = "Invalid literal: " + std::string(parts[i]);
+            return false;
+        }
+        if (bits < 64 && !fits_signed(lit, bits)) {
+            error = "Literal out of range: " + std::string(parts[i]);
+            return false;
+        }
+        return true;
+    };
+    // Label or relative offset, as a signed distance in code units
+    auto target = [&](size_t i, int bits) {
+        std::string_view token = parts[i];
+        if (!token.empty() && token[0] == ':') {
+            auto it = state ? state->labels.find(token.substr(1)) : decltype(state->labels.end()){};
+            if (!state || it == state->labels.end()) {
+                error = "Unknown label: " + std::string(token);
+                return false;
+            }
+            lit = static_cast<int64_t>(it->second) - pc;
+        } else if (!parse_literal(token, lit)) {
+            error = "Invalid branch target: " + std::string(token);
+            return false;
+        }
+        if (!fits_signed(lit, bits)) {
+            error = "Branch target out of range: " + std::string(token);
+            return false;
+        }
+        return true;
+    };
+    // Index operand stored at byte `at` of the instruction. Pool indexes are provisional until build()
+    // sorts the ids, so one that does not fit yet waits in `wide_refs` and the operand holds 0.
+    auto ref = [&](size_t i, RefKind kind, uint32_t limit, uint32_t at) {
+        if (!resolve(kind, parts[i], idx, error)) return false;
+        if (idx <= limit) return true;
+        if (wide_refs && kind != RefKind::kCallSite && kind != RefKind::kMethodHandle) {
+            wide_refs->push_back({pc * 2 + at, idx});
+            idx = 0;
+            return true;
+        }
+        error = "Index does not fit the instruction format: " + std::string(parts[i]);
+        return false;
+    };
+    auto is_invoke = [](int opcode) {
+        return (opcode >= 0x6e && opcode <= 0x72) || (opcode >= 0x74 && opcode <= 0x78) || opcode >= 0xfa;
+    };
+
+    switch (info.format) {
+        case OpcodeFormat::k10x:
+            break;
+
+        case OpcodeFormat::k12x:
+            if (!reg(0, 16, a) || !reg(1, 16, b)) return false;
+            insn[1] = static_cast<uint8_t>((b << 4) | a);
+            break;
+
+        case OpcodeFormat::k11n:
+            if (!reg(0, 16, a) || !literal(1, 4)) return false;
+            insn[1] = static_cast<uint8_t>(((lit & 0xF) << 4) | a);
+            break;
+
+        case OpcodeFormat::k11x:
+            if (!reg(0, 256, a)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            break;
+
+        case OpcodeFormat::k10t:
+            if (!target(0, 8)) return false;
+            insn[1] = static_cast<uint8_t>(lit);
+            break;
+
+        case OpcodeFormat::k20t:
+            if (!target(0, 16)) return false;
+            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
+            break;
+
+        case OpcodeFormat::k30t:
+            if (!target(0, 32)) return false;
+            write_le<int32_t>(&insn[2], static_cast<int32_t>(lit));
+            break;
+
+        case OpcodeFormat::k22x:
+            if (!reg(0, 256, a) || !reg(1, 65536, b)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(b));
+            break;
+
+        case OpcodeFormat::k32x:
+            if (!reg(0, 65536, a) || !reg(1, 65536, b)) return false;
+            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(a));
+            write_le<uint16_t>(&insn[4], static_cast<uint16_t>(b));
+            break;
+
+        case OpcodeFormat::k21t:
+            if (!reg(0, 256, a) || !target(1, 16)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
+            break;
+
+        case OpcodeFormat::k31t:
+            if (!reg(0, 256, a) || !target(1, 32)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<int32_t>(&insn[2], static_cast<int32_t>(lit));
+            break;
+
+        case OpcodeFormat::k21s:
+            if (!reg(0, 256, a) || !literal(1, 16)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
+            break;
+
+        case OpcodeFormat::k21h: {
+            // The literal is the full value; only its top 16 bits are encoded
+            int shift = op == 0x15 ? 16 : 48;
+            if (!reg(0, 256, a) || !literal(1, op == 0x15 ? 32 : 64)) return false;
+            if ((static_cast<uint64_t>(lit) & ((uint64_t(1) << shift) - 1)) != 0) {
+                error = "Literal has low bits set: " + std::string(parts[1]);
+                return false;
+            }
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit >> shift));
+            break;
+        }
+
+        case OpcodeFormat::k31i:
+            if (!reg(0, 256, a) || !literal(1, 64)) return false;
+            if (!fits_signed(lit, 32) && (lit < 0 || lit > 0xFFFFFFFFll)) {
+                error = "Literal out of range: " + std::string(parts[1]);
+                return false;
+            }
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<int32_t>(&insn[2], static_cast<int32_t>(lit));
+            break;
+
+        case OpcodeFormat::k51l:
+            if (!reg(0, 256, a) || !literal(1, 64)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<int64_t>(&insn[2], lit);
+            break;
+
+        case OpcodeFormat::k21c: {
+            RefKind kind = op == 0x1a ? RefKind::kString
+                         : op == 0xfe ? RefKind::kMethodHandle
+                         : op == 0xff ? RefKind::kProto
+                         : (op >= 0x60 && op <= 0x6d) ? RefKind::kField
+                         : RefKind::kType;
+            if (!reg(0, 256, a) || !ref(1, kind, 0xFFFF, 2)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(idx));
+            break;
+        }
+
+        case OpcodeFormat::k31c:
+            if (!reg(0, 256, a) || !ref(1, RefKind::kString, 0xFFFFFFFF, 2)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            write_le<uint32_t>(&insn[2], idx);
+            break;
+
+        case OpcodeFormat::k23x:
+            if (!reg(0, 256, a) || !reg(1, 256, b) || !reg(2, 256, c)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            insn[2] = static_cast<uint8_t>(b);
+            insn[3] = static_cast<uint8_t>(c);
+            break;
+
+        case OpcodeFormat::k22b:
+            if (!reg(0, 256, a) || !reg(1, 256, b) || !literal(2, 8)) return false;
+            insn[1] = static_cast<uint8_t>(a);
+            insn[2] = static_cast<uint8_t>(b);
+            insn[3] = static_cast<uint8_t>(lit);
+            break;
+
+        case OpcodeFormat::k22t:
+            if (!reg(0, 16, a) || !reg(1, 16, b) || !target(2, 16)) return false;
+            insn[1] = static_cast<uint8_t>((b << 4) | a);
+            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
+            break;
+
+        case OpcodeFormat::k22s:
+            if (!reg(0, 16, a) || !reg(1, 16, b) || !literal(2, 16)) return false;
+            insn[1] = static_cast<uint8_t>((b << 4) | a);
+            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
+            break;
+
+        case OpcodeFormat::k22c: {
+            RefKind kind = op == 0x20 || op == 0x23 ? RefKind::kType : RefKind::kField;
+            if (!reg(0, 16, a) || !reg(1, 16, b) || !ref(2, kind, 0xFFFF, 2)) return false;
+            insn[1] = static_cast<uint8_t>((b << 4) | a);
+            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(idx));
+            break;
+        }
+
+        case OpcodeFormat::k35c:
+        case OpcodeFormat::k45cc: {
+            // A|G|op BBBB F|E|D|C [HHHH]
+            std::string_view list = parts[0];
+            if (list.size() < 2 || list.front() != '{' || list.back() != '}') {
+                error = "Expected a register list: " + std::string(list);
+                return false;
+            }
+            std::vector<std::string_view> regs;
+            split_operands(list.substr(1, list.size() - 2), regs);
+            if (regs.size() > 5) {
+                error = "More than 5 registers: " + std::string(list);
+                return false;
+            }
+            uint32_t nums[5] = {};
+            for (size_t i = 0; i < regs.size(); i++) {
+                if (!parse_register(regs[i], state, 16, nums[i], error)) return false;
+            }
+            RefKind kind = op == 0x24 ? RefKind::kType : op == 0xfc ? RefKind::kCallSite : RefKind::kMethod;
+            if (!ref(1, kind, 0xFFFF, 2)) return false;
+            insn[1] = static_cast<uint8_t>((regs.size() << 4) | nums[4]);
+            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(idx));
+            insn[4] = static_cast<uint8_t>(nums[0] | (nums[1] << 4));
+            insn[5] = static_cast<uint8_t>(nums[2] | (nums[3] << 4));
+            if (info.format == OpcodeFormat::k45cc) {
+                if (!ref(2, RefKind::kProto, 0xFFFF, 6)) return false;
+                write_le<uint16_t>(&insn[6], static_cast<uint16_t>(idx));
+            }
+            if (is_invoke(op)) outs = std::max<uint32_t>(outs, static_cast<uint32_t>(regs.size()));
+            break;
+        }
+
+        case OpcodeFormat::k3rc:
+        case OpcodeFormat::k4rcc: {
+            // AA|op BBBB CCCC [HHHH], with the registers vCCCC .. vCCCC+AA-1
+            std::string_view range = parts[0];
+            if (range.size() < 2 || range.front() != '{' || range.back() != '}') {
+                error = "Expected a register range: " + std::string(range);
+                return false;
+            }
+            range = trim(range.substr(1, range.size() - 2));
+            uint32_t first = 0, count = 0;
+            if (!range.empty()) {
+                size_t dots = range.find("..");
+                uint32_t last;
+                if (!parse_register(trim(range.substr(0, dots)), state, 65536, first, error)) return false;
+                last = first;
+                if (dots != std::string_view::npos &&
+                    !parse_register(trim(range.substr(dots + 2)), state, 65536, last, error)) {
+                    return false;
+                }
+                if (last + 1 < first || last + 1 - first > 255) {
+                    error = "Invalid register range: " + std::string(parts[0]);
+                    return false;
+                }
+                count = last + 1 - first;
+            }
+            RefKind kind = op == 0x25 ? RefKind::kType : op == 0xfd ? RefKind::kCallSite : RefKind::kMethod;
+            if (!ref(1, kind, 0xFFFF, 2)) return false;
+            insn[1] = static_cast<uint8_t>(count);
+            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(idx));
+            write_le<uint16_t>(&insn[4], static_cast<uint16_t>(first));
+            if (info.format == OpcodeFormat::k4rcc) {
+                if (!ref(2, RefKind::kProto, 0xFFFF, 6)) return false;
+                write_le<uint16_t>(&insn[6], static_cast<uint16_t>(idx));
+            }
+            if (is_invoke(op)) outs = std::max(outs, count);
+            break;
+        }
+
+        default:
+            error = "Unsupported instruction format for assembly: " + std::string(name);
+            return false;
+    }
+    return true;
+}
+
+bool SmaliAssembler::assemble_insn(const std::string& line, std::vector<uint8_t>& bytecode, std::string& error) {
+    std::string_view text = strip_offset_prefix(strip_comment(line));
+    if (text.empty() || text[0] == '.' || text[0] == ':') return true;  // directives and labels carry no code
+
+    std::vector<uint8_t> insn;
+    uint32_t outs = 0;
+    if (!encode_insn(text, nullptr, 0, insn, outs, nullptr, error)) return false;
+    bytecode.insert(bytecode.end(), insn.begin(), insn.end());
+    return true;
+}
+
+bool SmaliAssembler::assemble(const std::string& smali_code, std::vector<uint8_t>& bytecode, std::string& error) {
+    std::vector<SmaliLine> lines;
+    std::string_view text(smali_code);
+    uint32_t number = 1;
+    for (size_t start = 0; start <= text.size(); number++) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) end = text.size();
+        lines.push_back({text.substr(start, end - start), number});
+        start = end + 1;
+    }
+
+    MethodDef method;
+    method.access_flags = ACC_STATIC;
+    if (!assemble_lines(lines, method, false, error)) return false;
+    if (!method.wide_refs.empty()) {
+        // Bare bytecode has nowhere to keep an index for later
+        error = "Index does not fit the instruction format at pc " + std::to_string(method.wide_refs[0].first / 2);
+        return false;
+    }
+    bytecode = std::move(method.code);
+    return true;
+}
+
+bool SmaliAssembler::assemble_method(const std::vector<SmaliLine>& lines, MethodDef& method, std::string& error) {
+    return assemble_lines(lines, method, true, error);
+}
+
+bool SmaliAssembler::assemble_lines(const std::vector<SmaliLine>& lines, MethodDef& method, bool with_prototype,
+                                    std::string& error) {
+    enum class Kind { kInsn, kPayload, kCatch, kDebug, kParam };
+    struct Statement {
+        Kind kind;
+        uint32_t pc;
+        size_t first;  // line index; payloads run to their .end directive at `last`
+        size_t last;
+    };
+
+    MethodState state;
+    state.ins = with_prototype ? ins_size(method) : 0;
+    std::vector<Statement> statements;
+    std::vector<std::string_view> pending;  // labels waiting for the next instruction
+    uint32_t pc = 0;
+    size_t line = 0;
+    auto fail = [&](const std::string& message) {
+        uint32_t number = line < lines.size() ? lines[line].number : (lines.empty() ? 0 : lines.back().number);
+        error = "Line " + std::to_string(number) + ": " + message;
+        return false;
+    };
+    auto place = [&]() {
+        for (std::string_view label : pending) {
+            if (!state.labels.emplace(label, pc).second) return fail("Duplicate label :" + std::string(label));
+        }
+        pending.clear();
+        return true;
+    };
+    auto text_of = [&](size_t i) { return strip_offset_prefix(strip_comment(lines[i].text)); };
+
+    // Pass 1: addresses of instructions, payloads and labels
+    for (; line < lines.size(); line++) {
+        std::string_view text = text_of(line);
+        if (text.empty()) continue;
+        if (text[0] == ':') {
+            pending.push_back(text.substr(1));
+            continue;
+        }
+        if (text[0] != '.') {
+            int op = SmaliDisassembler::get_opcode_by_name(text.substr(0, text.find_first_of(" \t")));
+            if (op < 0) return fail("Unknown opcode: " + std::string(text.substr(0, text.find_first_of(" \t"))));
+            if (!place()) return false;
+            statements.push_back({Kind::kInsn, pc, line, line});
+            pc += SmaliDisassembler::get_opcode_info(static_cast<uint8_t>(op)).size;
+            continue;
+        }
+
+        std::string_view directive = text.substr(0, text.find_first_of(" \t"));
+        std::string_view args = trim(text.substr(directive.size()));
+        if (directive == ".registers" || directive == ".locals") {
+            int64_t count;
+            if (!parse_literal(args, count) || count < 0) return fail("Invalid register count: " + std::string(args));
+            uint64_t registers = static_cast<uint64_t>(count) + (directive == ".locals" ? state.ins : 0);
+            if (registers > 0xFFFF) return fail("Too many registers");
+            if (registers < state.ins) return fail("Fewer registers than parameter registers");
+            state.registers = static_cast<uint32_t>(registers);
+            state.has_registers = true;
+        } else if (directive == ".packed-switch" || directive == ".sparse-switch" || directive == ".array-data") {
+            std::string end_directive = ".end " + std::string(directive.substr(1));
+            size_t last = line + 1;
+            uint64_t entries = 0;
+            for (; last < lines.size(); last++) {
+                std::string_view entry = text_of(last);
+                if (entry == end_directive) break;
+                if (!entry.empty()) entries++;
+            }
+            if (last == lines.size()) return fail("Missing " + end_directive);
+            uint64_t units;
+            if (directive == ".packed-switch") {
+                units = 4 + entries * 2;
+            } else if (directive == ".sparse-switch") {
+                units = 2 + entries * 4;
+            } else {
+                int64_t width;
+                if (!parse_literal(args, width) || (width != 1 && width != 2 && width != 4 && width != 8)) {
+                    return fail("Invalid element width: " + std::string(args));
+                }
+                units = 4 + (entries * width + 1) / 2;
+            }
+            if (pc & 1) pc++;  // payloads are 4-byte aligned; the gap stays a nop
+            if (!place()) return false;
+            statements.push_back({Kind::kPayload, pc, line, last});
+            pc += static_cast<uint32_t>(units);
+            line = last;
+        } else if (directive == ".catch" || directive == ".catchall") {
+            statements.push_back({Kind::kCatch, pc, line, line});
+        } else if (directive == ".line" || directive == ".local" || directive == ".restart" ||
+                   directive == ".prologue" || directive == ".epilogue" || directive == ".source" ||
+                   (directive == ".end" && starts_with(args, "local"))) {
+            statements.push_back({Kind::kDebug, pc, line, line});
+        } else if (directive == ".param" || directive == ".parameter") {
+            statements.push_back({Kind::kParam, pc, line, line});
+        } else if (directive == ".annotation") {
+            // Annotations are the class parser's business; skip the block
+            while (line < lines.size() && text_of(line) != ".end annotation") line++;
+            if (line == lines.size()) return fail("Missing .end annotation");
+        } else if (directive == ".end") {
+            if (args != "method" && args != "param" && args != "parameter") {
+                return fail("Unexpected .end " + std::string(args));
+            }
+        } else if (directive != ".method") {
+            return fail("Unknown directive: " + std::string(directive));
+        }
+    }
+    if (!place()) return false;
+    if (pc > 0 && !state.has_registers && with_prototype) return fail("Missing .registers or .locals");
+
+    // Switch payloads are relative to the first switch that references them
+    std::unordered_map<uint32_t, uint32_t> payload_base;
+    for (const Statement& st : statements) {
+        if (st.kind != Kind::kInsn) continue;
+        std::string_view text = text_of(st.first);
+        if (!starts_with(text, "packed-switch") && !starts_with(text, "sparse-switch")) continue;
+        std::string_view label = trim(text.substr(text.rfind(',') + 1));
+        if (label.empty() || label[0] != ':') continue;
+        auto it = state.labels.find(label.substr(1));
+        if (it != state.labels.end()) payload_base.emplace(it->second, st.pc);
+    }
+
+    // Pass 2: encode, resolving labels
+    method.code.assign(static_cast<size_t>(pc) * 2, 0);
+    method.wide_refs.clear();
+    method.tries.clear();
+    method.debug_info = DebugInfo();
+    uint32_t outs = 0;
+    std::vector<uint8_t> insn;
+    struct CatchRange {
+        uint32_t start, end, type_idx, handler;
+    };
+    std::vector<CatchRange> catches;
+    DebugInfo& debug = method.debug_info;
+    uint32_t next_parameter = 0;
+    auto label_pc = [&](std::string_view token, uint32_t& out) {
+        token = trim(token);
+        auto it = token.empty() || token[0] != ':' ? state.labels.end() : state.labels.find(token.substr(1));
+        if (it == state.labels.end()) return fail("Unknown label: " + std::string(token));
+        out = it->second;
+        return true;
+    };
+    auto string_index = [&](std::string_view token, uint32_t& idx) {
+        if (token == "null") {
+            idx = DebugEvent::kNoIndex;
+            return true;
+        }
+        std::string message;
+        if (!resolve(RefKind::kString, token, idx, message)) return fail(message);
+        return true;
+    };
+    auto debug_register = [&](std::string_view token, uint32_t& num) {
+        std::string message;
+        if (!parse_register(trim(token), &state, 65536, num, message)) return fail(message);
+        return true;
+    };
+
+    for (const Statement& st : statements) {
+        line = st.first;
+        std::string_view text = text_of(st.first);
+        std::string_view directive = text.substr(0, text.find_first_of(" \t"));
+        std::string_view args = trim(text.substr(directive.size()));
+
+        switch (st.kind) {
+            case Kind::kInsn: {
+                std::string message;
+                if (!encode_insn(text, &state, st.pc, insn, outs, &method.wide_refs, message)) return fail(message);
+                std::copy(insn.begin(), insn.end(), method.code.begin() + st.pc * 2);
+                break;
+            }
+
+            case Kind::kPayload: {
+                uint8_t* p = &method.code[st.pc * 2];
+                std::vector<std::string_view> entries;
+                for (size_t i = st.first + 1; i < st.last; i++) {
+                    std::string_view entry = text_of(i);
+                    if (!entry.empty()) entries.push_back(entry);
+                }
+                if (directive == ".array-data") {
+                    int64_t width = 0;
+                    parse_literal(args, width);
+                    write_le<uint16_t>(p, 0x0300);
+                    write_le<uint16_t>(p + 2, static_cast<uint16_t>(width));
+                    write_le<uint32_t>(p + 4, static_cast<uint32_t>(entries.size()));
+                    for (size_t i = 0; i < entries.size(); i++) {
+                        line = st.first + 1 + i;
+                        int64_t value;
+                        if (!parse_literal(entries[i], value)) return fail("Invalid array element: " +
+                                                                           std::string(entries[i]));
+                        for (int64_t k = 0; k < width; k++) p[8 + i * width + k] = static_cast<uint8_t>(value >> (k * 8));
+                    }
+                    break;
+                }
+
+                auto base = payload_base.find(st.pc);
+                if (base == payload_base.end()) return fail("Payload is not referenced by a switch");
+                bool packed = directive == ".packed-switch";
+                write_le<uint16_t>(p, packed ? 0x0100 : 0x0200);
+                write_le<uint16_t>(p + 2, static_cast<uint16_t>(entries.size()));
+                if (packed) {
+                    int64_t first_key;
+                    if (!parse_literal(args, first_key)) return fail("Invalid first key: " + std::string(args));
+                    write_le<int32_t>(p + 4, static_cast<int32_t>(first_key));
+                    for (size_t i = 0; i < entries.size(); i++) {
+                        uint32_t target;
+                        if (!label_pc(entries[i], target)) return false;
+                        write_le<int32_t>(p + 8 + i * 4, static_cast<int32_t>(target - base->second));
+                    }
+                    break;
+                }
+                // Sparse keys must ascend
+                std::vector<std::pair<int32_t, int32_t>> cases;
+                for (std::string_view entry : entries) {
+                    size_t arrow = entry.find("->");
+                    int64_t key;
+                    uint32_t target;
+                    if (arrow == std::string_view::npos || !parse_literal(entry.substr(0, arrow), key)) {
+                        return fail("Invalid sparse-switch entry: " + std::string(entry));
+                    }
+                    if (!label_pc(entry.substr(arrow + 2), target)) return false;
+                    cases.push_back({static_cast<int32_t>(key), static_cast<int32_t>(target - base->second)});
+                }
+                std::sort(cases.begin(), cases.end());
+                for (size_t i = 0; i < cases.size(); i++) {
+                    write_le<int32_t>(p + 4 + i * 4, cases[i].first);
+                    write_le<int32_t>(p + 4 + (cases.size() + i) * 4, cases[i].second);
+                }
+                break;
+            }
+
+            case Kind::kCatch: {
+                // .catch Ljava/lang/Exception; {:try_start_0 .. :try_end_0} :catch_0
+                size_t open = args.find('{');
+                size_t close = args.find('}');
+                size_t dots = args.find("..");
+                if (open == std::string_view::npos || close < open || dots > close) {
+                    return fail("Invalid " + std::string(directive));
+                }
+                CatchRange range;
+                range.type_idx = CatchHandler::kCatchAll;
+                if (directive == ".catch") {
+                    std::string message;
+                    if (!resolve(RefKind::kType, trim(args.substr(0, open)), range.type_idx, message)) {
+                        return fail(message);
+                    }
+                }
+                if (!label_pc(args.substr(open + 1, dots - open - 1), range.start) ||
+                    !label_pc(args.substr(dots + 2, close - dots - 2), range.end) ||
+                    !label_pc(args.substr(close + 1), range.handler)) {
+                    return false;
+                }
+                if (range.start >= range.end) return fail("Empty try range");
+                catches.push_back(range);
+                break;
+            }
+
+            case Kind::kDebug: {
+                DebugEvent event;
+                event.addr = st.pc;
+                if (directive == ".line") {
+                    int64_t number;
+                    if (!parse_literal(args, number) || number < 0) return fail("Invalid line: " + std::string(args));
+                    event.kind = DebugEvent::Kind::kLine;
+                    event.line = static_cast<uint32_t>(number);
+                } else if (directive == ".prologue") {
+                    event.kind = DebugEvent::Kind::kPrologueEnd;
+                } else if (directive == ".epilogue") {
+                    event.kind = DebugEvent::Kind::kEpilogueBegin;
+                } else if (directive == ".source") {
+                    event.kind = DebugEvent::Kind::kSetFile;
+                    if (!string_index(args, event.name_idx)) return false;
+                } else if (directive == ".local") {
+                    // .local v0, "name":Type[, "signature"]
+                    size_t comma = args.find(',');
+                    if (!debug_register(args.substr(0, comma), event.reg)) return false;
+                    event.kind = DebugEvent::Kind::kStartLocal;
+                    if (comma != std::string_view::npos) {
+                        std::string_view rest = trim(args.substr(comma + 1));
+                        size_t name_end = 4;  // "null"
+                        std::string name;
+                        if (!rest.empty() && rest[0] == '"' && !parse_string_literal(rest, name, &name_end)) {
+                            return fail("Invalid local name: " + std::string(rest));
+                        }
+                        if (!string_index(rest.substr(0, name_end), event.name_idx)) return false;
+                        rest = rest.substr(std::min(name_end, rest.size()));
+                        if (rest.empty() || rest[0] != ':') return fail("Expected :Type after the local name");
+                        size_t sig = rest.find(',');
+                        std::string_view type = trim(rest.substr(1, sig == std::string_view::npos ? sig : sig - 1));
+                        std::string message;
+                        if (type != "V" && !resolve(RefKind::kType, type, event.type_idx, message)) return fail(message);
+                        if (sig != std::string_view::npos && !string_index(trim(rest.substr(sig + 1)),
+                                                                           event.signature_idx)) {
+                            return false;
+                        }
+                    }
+                } else {
+                    // .end local v0 / .restart local v0
+                    std::string_view reg = trim(args.substr(5));
+                    if (!debug_register(reg, event.reg)) return false;
+                    event.kind = directive == ".end" ? DebugEvent::Kind::kEndLocal : DebugEvent::Kind::kRestartLocal;
+                }
+                debug.events.push_back(event);
+                break;
+            }
+
+            case Kind::kParam: {
+                // .param p1, "name" / .param v3, "name" / .parameter "name"
+                uint32_t index = next_parameter;
+                std::string_view name = args;
+                if (directive == ".param") {
+                    size_t comma = args.find(',');
+                    std::string_view token = trim(args.substr(0, comma));
+                    uint32_t num;
+                    if (!debug_register(token, num)) return false;
+                    int parameter = parameter_index(method, num - (state.registers - state.ins));
+                    if (num < state.registers - state.ins || parameter < 0) {
+                        return fail("Not a parameter register: " + std::string(token));
+                    }
+                    index = static_cast<uint32_t>(parameter);
+                    name = comma == std::string_view::npos ? std::string_view() : trim(args.substr(comma + 1));
+                }
+                next_parameter = index + 1;
+                if (name.empty()) break;
+                if (index >= method.prototype.param_types.size()) return fail("Too many .parameter directives");
+                debug.parameter_names.resize(method.prototype.param_types.size(), DebugEvent::kNoIndex);
+                if (!string_index(name, debug.parameter_names[index])) return false;
+                break;
+            }
+        }
+    }
+
+    // Overlapping .catch ranges become disjoint try blocks; each keeps the first handler of every type
+    // in declaration order, with the catch-all last
+    if (!catches.empty()) {
+        std::vector<uint32_t> points;
+        for (const CatchRange& range : catches) {
+            points.push_back(range.start);
+            points.push_back(range.end);
+        }
+        std::sort(points.begin(), points.end());
+        points.erase(std::unique(points.begin(), points.end()), points.end());
+        for (size_t i = 0; i + 1 < points.size(); i++) {
+            uint32_t start = points[i], end = points[i + 1];
+            std::vector<CatchHandler> handlers;
+            uint32_t catch_all = CatchHandler::kCatchAll;
+            for (const CatchRange& range : catches) {
+                if (range.start > start || range.end < end) continue;
+                if (range.type_idx == CatchHandler::kCatchAll) {
+                    if (catch_all == CatchHandler::kCatchAll) catch_all = range.handler;
+                    continue;
+                }
+                bool seen = std::any_of(handlers.begin(), handlers.end(),
+                                        [&](const CatchHandler& h) { return h.type_idx == range.type_idx; });
+                if (!seen) handlers.push_back({range.type_idx, range.handler});
+            }
+            if (catch_all != CatchHandler::kCatchAll) handlers.push_back({CatchHandler::kCatchAll, catch_all});
+            if (handlers.empty()) continue;
+
+            // try_item lengths are 16-bit
+            while (start < end) {
+                TryBlock* last = method.tries.empty() ? nullptr : &method.tries.back();
+                bool same = last && last->end_addr == start && last->handlers.size() == handlers.size() &&
+                            std::equal(handlers.begin(), handlers.end(), last->handlers.begin(),
+                                       [](const CatchHandler& a, const CatchHandler& b) {
+                                           return a.type_idx == b.type_idx && a.addr == b.addr;
+                                       });
+                if (same && last->end_addr - last->start_addr < 0xFFFF) {
+                    uint32_t grow = std::min<uint32_t>(end - start, 0xFFFF - (last->end_addr - last->start_addr));
+                    last->end_addr += grow;
+                    start += grow;
+                    continue;
+                }
+                uint32_t length = std::min<uint32_t>(end - start, 0xFFFF);
+                method.tries.push_back({start, start + length, handlers});
+                start += length;
+            }
+        }
+    }
+
+    bool named = std::any_of(debug.parameter_names.begin(), debug.parameter_names.end(),
+                             [](uint32_t idx) { return idx != DebugEvent::kNoIndex; });
+    if (!named) debug.parameter_names.clear();
+    for (const DebugEvent& event : debug.events) {
+        if (event.kind == DebugEvent::Kind::kLine) {
+            debug.line_start = event.line;
+            break;
+        }
+    }
+
+    method.registers_size = static_cast<uint16_t>(state.registers);
+    method.ins_size = static_cast<uint16_t>(state.ins);
+    method.outs_size = static_cast<uint16_t>(outs);
+    method.code_off = 0;
+    return true;
+}
+
+} // namespace dex
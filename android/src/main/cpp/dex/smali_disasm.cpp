@@ -1,8 +1,16 @@
 #include "dex/smali_disasm.h"
+#include "dex/insn_iterator.h"
+#include "dex/dex_parser.h"
+#include "dex/smali_writer.h"
 #include <sstream>
+#include <charconv>
 #include <iomanip>
 #include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <algorithm>
+#include <unordered_map>
 
 namespace dex {
 
@@ -258,12 +266,12 @@ const OpcodeInfo SmaliDisassembler::opcodes_[256] = {
     {"unused-f7", OpcodeFormat::k10x, 1},              // 0xf7
     {"unused-f8", OpcodeFormat::k10x, 1},              // 0xf8
     {"unused-f9", OpcodeFormat::k10x, 1},              // 0xf9
-    {"unused-fa", OpcodeFormat::k10x, 1},              // 0xfa
-    {"unused-fb", OpcodeFormat::k10x, 1},              // 0xfb
-    {"unused-fc", OpcodeFormat::k10x, 1},              // 0xfc
-    {"unused-fd", OpcodeFormat::k10x, 1},              // 0xfd
-    {"unused-fe", OpcodeFormat::k10x, 1},              // 0xfe
-    {"unused-ff", OpcodeFormat::k10x, 1},              // 0xff
+    {"invoke-polymorphic", OpcodeFormat::k45cc, 4},    // 0xfa
+    {"invoke-polymorphic/range", OpcodeFormat::k4rcc, 4}, // 0xfb
+    {"invoke-custom", OpcodeFormat::k35c, 3},          // 0xfc
+    {"invoke-custom/range", OpcodeFormat::k3rc, 3},    // 0xfd
+    {"const-method-handle", OpcodeFormat::k21c, 2},    // 0xfe
+    {"const-method-type", OpcodeFormat::k21c, 2},      // 0xff
 };
 
 template<typename T>
@@ -279,945 +287,917 @@ const OpcodeInfo& SmaliDisassembler::get_opcode_info(uint8_t opcode) {
     return opcodes_[opcode];
 }
 
-std::string SmaliDisassembler::resolve_string(uint32_t idx) const {
-    if (idx < strings_.size()) {
-        return "\"" + strings_[idx] + "\"";
+// Reference operands are resolved through the symbols; unresolved indices render as kind@idx
+void SmaliDisassembler::write_string(uint32_t idx, SmaliWriter& out) const {
+    if (const std::string* value = symbol(SymbolKind::kString, idx)) {
+        out.string_literal(*value);
+    } else {
+        out.append("string@").decimal(idx);
     }
-    return "string@" + std::to_string(idx);
 }
 
-std::string SmaliDisassembler::resolve_type(uint32_t idx) const {
-    if (idx < types_.size()) {
-        return types_[idx];
+void SmaliDisassembler::write_type(uint32_t idx, SmaliWriter& out) const {
+    if (const std::string* type = symbol(SymbolKind::kType, idx)) {
+        out.append(*type);
+    } else {
+        out.append("type@").decimal(idx);
     }
-    return "type@" + std::to_string(idx);
 }
 
-std::string SmaliDisassembler::resolve_method(uint32_t idx) const {
-    if (idx < methods_.size()) {
-        return methods_[idx];
+void SmaliDisassembler::write_method(uint32_t idx, SmaliWriter& out) const {
+    if (const std::string* method = symbol(SymbolKind::kMethod, idx)) {
+        out.append(*method);
+    } else {
+        out.append("method@").decimal(idx);
     }
-    return "method@" + std::to_string(idx);
 }
 
-std::string SmaliDisassembler::resolve_field(uint32_t idx) const {
-    if (idx < fields_.size()) {
-        return fields_[idx];
+void SmaliDisassembler::write_field(uint32_t idx, SmaliWriter& out) const {
+    if (const std::string* field = symbol(SymbolKind::kField, idx)) {
+        out.append(*field);
+    } else {
+        out.append("field@").decimal(idx);
     }
-    return "field@" + std::to_string(idx);
 }
 
-DisassembledInsn SmaliDisassembler::disassemble_insn(const uint8_t* code, size_t code_size, uint32_t offset) {
-    DisassembledInsn insn;
-    insn.offset = offset;
-    
-    if (code_size < 2) {
-        insn.opcode = "invalid";
-        return insn;
+// Relative branch offset (in code units) of a 10t/20t/30t/21t/22t/31t instruction
+static bool branch_offset(const uint8_t* code, int32_t& offset) {
+    switch (SmaliDisassembler::get_opcode_info(code[0]).format) {
+        case OpcodeFormat::k10t:
+            offset = static_cast<int8_t>(code[1]);
+            return true;
+        case OpcodeFormat::k20t:
+        case OpcodeFormat::k21t:
+        case OpcodeFormat::k22t:
+            offset = read_le<int16_t>(code + 2);
+            return true;
+        case OpcodeFormat::k30t:
+        case OpcodeFormat::k31t:
+            offset = read_le<int32_t>(code + 2);
+            return true;
+        default:
+            return false;
     }
-    
+}
+
+void SmaliDisassembler::write_operands(const uint8_t* code, SmaliWriter& out) const {
     uint8_t op = code[0];
     const OpcodeInfo& info = opcodes_[op];
-    insn.opcode = info.name;
-    
-    // Store raw bytes
-    size_t byte_size = info.size * 2;
-    for (size_t i = 0; i < byte_size && i < code_size; i += 2) {
-        insn.raw_bytes.push_back(read_le<uint16_t>(&code[i]));
-    }
-    
-    std::ostringstream oss;
     
     switch (info.format) {
         case OpcodeFormat::k10x:
-            // No operands
+        case OpcodeFormat::k10t:
+        case OpcodeFormat::k20t:
+        case OpcodeFormat::k30t:
+            // No operands before the branch target
             break;
             
-        case OpcodeFormat::k12x: {
+        case OpcodeFormat::k12x:
             // k12x format: B|A|op, A is low 4 bits, B is high 4 bits
-            uint8_t vA = code[1] & 0xF;
-            uint8_t vB = (code[1] >> 4) & 0xF;
-            oss << "v" << (int)vA << ", v" << (int)vB;
+            out.reg(code[1] & 0xF).append(", ").reg((code[1] >> 4) & 0xF);
             break;
-        }
         
         case OpcodeFormat::k11n: {
-            uint8_t vA = code[1] & 0xF;
             int8_t B = (code[1] >> 4);
             if (B & 0x8) B |= 0xF0; // Sign extend
-            oss << "v" << (int)vA << ", #int " << (int)B;
-            break;
-        }
-        
-        case OpcodeFormat::k11x: {
-            uint8_t vAA = code[1];
-            oss << "v" << (int)vAA;
-            break;
-        }
-        
-        case OpcodeFormat::k10t: {
-            int8_t AA = static_cast<int8_t>(code[1]);
-            oss << std::showpos << (int)AA << std::noshowpos;
-            insn.comment = "goto " + std::to_string(offset / 2 + AA);
+            out.reg(code[1] & 0xF).append(", #int ").decimal(static_cast<int>(B));
             break;
         }
         
-        case OpcodeFormat::k20t: {
-            int16_t AAAA = read_le<int16_t>(&code[2]);
-            oss << std::showpos << (int)AAAA << std::noshowpos;
-            insn.comment = "goto " + std::to_string(offset / 2 + AAAA);
+        case OpcodeFormat::k11x:
+            out.reg(code[1]);
             break;
-        }
         
-        case OpcodeFormat::k22x: {
-            uint8_t vAA = code[1];
-            uint16_t vBBBB = read_le<uint16_t>(&code[2]);
-            oss << "v" << (int)vAA << ", v" << (int)vBBBB;
+        case OpcodeFormat::k22x:
+            out.reg(code[1]).append(", ").reg(read_le<uint16_t>(&code[2]));
             break;
-        }
         
-        case OpcodeFormat::k21t: {
-            uint8_t vAA = code[1];
-            int16_t BBBB = read_le<int16_t>(&code[2]);
-            oss << "v" << (int)vAA << ", " << std::showpos << (int)BBBB << std::noshowpos;
-            insn.comment = "target " + std::to_string(offset / 2 + BBBB);
+        case OpcodeFormat::k21t:
+        case OpcodeFormat::k31t:
+            out.reg(code[1]).append(", ");
             break;
-        }
         
-        case OpcodeFormat::k21s: {
-            uint8_t vAA = code[1];
-            int16_t BBBB = read_le<int16_t>(&code[2]);
-            oss << "v" << (int)vAA << ", #int " << (int)BBBB;
+        case OpcodeFormat::k21s:
+            out.reg(code[1]).append(", #int ").decimal(static_cast<int>(read_le<int16_t>(&code[2])));
             break;
-        }
         
         case OpcodeFormat::k21h: {
-            uint8_t vAA = code[1];
             int16_t BBBB = read_le<int16_t>(&code[2]);
+            out.reg(code[1]);
             if (op == 0x15) { // const/high16
-                oss << "v" << (int)vAA << ", #int " << ((int)BBBB << 16);
+                out.append(", #int ").decimal(static_cast<int64_t>(static_cast<int32_t>(BBBB * 65536)));
             } else { // const-wide/high16
-                oss << "v" << (int)vAA << ", #long " << ((int64_t)BBBB << 48);
+                out.append(", #long ").decimal(static_cast<int64_t>(static_cast<uint64_t>(static_cast<int64_t>(BBBB)) << 48));
             }
             break;
         }
         
         case OpcodeFormat::k21c: {
-            uint8_t vAA = code[1];
             uint16_t BBBB = read_le<uint16_t>(&code[2]);
-            oss << "v" << (int)vAA << ", ";
+            out.reg(code[1]).append(", ");
             if (op == 0x1a) { // const-string
-                oss << resolve_string(BBBB);
+                write_string(BBBB, out);
             } else if (op == 0x1c || op == 0x1f || op == 0x22) { // const-class, check-cast, new-instance
-                oss << resolve_type(BBBB);
+                write_type(BBBB, out);
             } else if (op >= 0x60 && op <= 0x6d) { // sget/sput
-                oss << resolve_field(BBBB);
+                write_field(BBBB, out);
+            } else if (op == 0xfe) { // const-method-handle
+                out.append("method_handle@").decimal(static_cast<uint32_t>(BBBB));
+            } else if (op == 0xff) { // const-method-type
+                out.append("proto@").decimal(static_cast<uint32_t>(BBBB));
             } else {
-                oss << "ref@" << BBBB;
+                out.append("ref@").decimal(static_cast<uint32_t>(BBBB));
             }
             break;
         }
         
-        case OpcodeFormat::k23x: {
-            uint8_t vAA = code[1];
-            uint8_t vBB = code[2];
-            uint8_t vCC = code[3];
-            oss << "v" << (int)vAA << ", v" << (int)vBB << ", v" << (int)vCC;
+        case OpcodeFormat::k23x:
+            out.reg(code[1]).append(", ").reg(code[2]).append(", ").reg(code[3]);
             break;
-        }
         
-        case OpcodeFormat::k22b: {
-            uint8_t vAA = code[1];
-            uint8_t vBB = code[2];
-            int8_t CC = static_cast<int8_t>(code[3]);
-            oss << "v" << (int)vAA << ", v" << (int)vBB << ", #int " << (int)CC;
+        case OpcodeFormat::k22b:
+            out.reg(code[1]).append(", ").reg(code[2]).append(", #int ")
+               .decimal(static_cast<int>(static_cast<int8_t>(code[3])));
             break;
-        }
         
-        case OpcodeFormat::k22t: {
-            uint8_t vA = code[1] & 0xF;
-            uint8_t vB = (code[1] >> 4) & 0xF;
-            int16_t CCCC = read_le<int16_t>(&code[2]);
-            oss << "v" << (int)vA << ", v" << (int)vB << ", " << std::showpos << (int)CCCC << std::noshowpos;
-            insn.comment = "target " + std::to_string(offset / 2 + CCCC);
+        case OpcodeFormat::k22t:
+            out.reg(code[1] & 0xF).append(", ").reg((code[1] >> 4) & 0xF).append(", ");
             break;
-        }
         
-        case OpcodeFormat::k22s: {
-            uint8_t vA = code[1] & 0xF;
-            uint8_t vB = (code[1] >> 4) & 0xF;
-            int16_t CCCC = read_le<int16_t>(&code[2]);
-            oss << "v" << (int)vA << ", v" << (int)vB << ", #int " << (int)CCCC;
+        case OpcodeFormat::k22s:
+            out.reg(code[1] & 0xF).append(", ").reg((code[1] >> 4) & 0xF).append(", #int ")
+               .decimal(static_cast<int>(read_le<int16_t>(&code[2])));
             break;
-        }
         
         case OpcodeFormat::k22c: {
-            uint8_t vA = code[1] & 0xF;
-            uint8_t vB = (code[1] >> 4) & 0xF;
             uint16_t CCCC = read_le<uint16_t>(&code[2]);
-            oss << "v" << (int)vA << ", v" << (int)vB << ", ";
+            out.reg(code[1] & 0xF).append(", ").reg((code[1] >> 4) & 0xF).append(", ");
             if (op == 0x20 || op == 0x23) { // instance-of, new-array
-                oss << resolve_type(CCCC);
+                write_type(CCCC, out);
             } else { // iget/iput
-                oss << resolve_field(CCCC);
+                write_field(CCCC, out);
             }
             break;
         }
         
-        case OpcodeFormat::k32x: {
-            uint16_t vAAAA = read_le<uint16_t>(&code[2]);
-            uint16_t vBBBB = read_le<uint16_t>(&code[4]);
-            oss << "v" << (int)vAAAA << ", v" << (int)vBBBB;
-            break;
-        }
-        
-        case OpcodeFormat::k30t: {
-            int32_t AAAAAAAA = read_le<int32_t>(&code[2]);
-            oss << std::showpos << AAAAAAAA << std::noshowpos;
-            insn.comment = "goto " + std::to_string(offset / 2 + AAAAAAAA);
-            break;
-        }
-        
-        case OpcodeFormat::k31t: {
-            uint8_t vAA = code[1];
-            int32_t BBBBBBBB = read_le<int32_t>(&code[2]);
-            oss << "v" << (int)vAA << ", " << std::showpos << BBBBBBBB << std::noshowpos;
+        case OpcodeFormat::k32x:
+            out.reg(read_le<uint16_t>(&code[2])).append(", ").reg(read_le<uint16_t>(&code[4]));
             break;
-        }
         
-        case OpcodeFormat::k31i: {
-            uint8_t vAA = code[1];
-            int32_t BBBBBBBB = read_le<int32_t>(&code[2]);
-            oss << "v" << (int)vAA << ", #int " << BBBBBBBB;
+        case OpcodeFormat::k31i:
+            out.reg(code[1]).append(", #int ").decimal(static_cast<int64_t>(read_le<int32_t>(&code[2])));
             break;
-        }
         
-        case OpcodeFormat::k31c: {
-            uint8_t vAA = code[1];
-            uint32_t BBBBBBBB = read_le<uint32_t>(&code[2]);
-            oss << "v" << (int)vAA << ", " << resolve_string(BBBBBBBB);
+        case OpcodeFormat::k31c:
+            out.reg(code[1]).append(", ");
+            write_string(read_le<uint32_t>(&code[2]), out);
             break;
-        }
         
-        case OpcodeFormat::k35c: {
-            // k35c format: A|G|op BBBB F|E|D|C
-            // A = register count (high 4 bits of code[1])
-            // G = 5th register if A=5 (low 4 bits of code[1])
-            // C = low 4 bits of code[4]
-            // D = high 4 bits of code[4]
-            // E = low 4 bits of code[5]
-            // F = high 4 bits of code[5]
+        case OpcodeFormat::k35c:
+        case OpcodeFormat::k45cc: {
+            // A|G|op BBBB F|E|D|C: A = register count, G = 5th register, C..F in code[4..5]
             uint8_t A = (code[1] >> 4) & 0xF;
-            uint8_t G = code[1] & 0xF;
+            uint8_t regs[] = {
+                static_cast<uint8_t>(code[4] & 0xF), static_cast<uint8_t>((code[4] >> 4) & 0xF),
+                static_cast<uint8_t>(code[5] & 0xF), static_cast<uint8_t>((code[5] >> 4) & 0xF),
+                static_cast<uint8_t>(code[1] & 0xF)
+            };
             uint16_t BBBB = read_le<uint16_t>(&code[2]);
-            uint8_t C = code[4] & 0xF;
-            uint8_t D = (code[4] >> 4) & 0xF;
-            uint8_t E = code[5] & 0xF;
-            uint8_t F = (code[5] >> 4) & 0xF;
             
-            oss << "{";
-            uint8_t regs[] = {C, D, E, F, G};
+            out.append('{');
             for (int i = 0; i < A && i < 5; i++) {
-                if (i > 0) oss << ", ";
-                oss << "v" << (int)regs[i];
+                if (i > 0) out.append(", ");
+                out.reg(regs[i]);
             }
-            oss << "}, ";
+            out.append("}, ");
             
-            if (op >= 0x6e && op <= 0x72) { // invoke-*
-                oss << resolve_method(BBBB);
+            if (info.format == OpcodeFormat::k45cc) { // invoke-polymorphic
+                write_method(BBBB, out);
+                out.append(", proto@").decimal(static_cast<uint32_t>(read_le<uint16_t>(&code[6])));
+            } else if (op >= 0x6e && op <= 0x72) { // invoke-*
+                write_method(BBBB, out);
+            } else if (op == 0xfc) { // invoke-custom
+                out.append("call_site@").decimal(static_cast<uint32_t>(BBBB));
             } else {
-                oss << resolve_type(BBBB);
+                write_type(BBBB, out);
             }
             break;
         }
         
-        case OpcodeFormat::k3rc: {
+        case OpcodeFormat::k3rc:
+        case OpcodeFormat::k4rcc: {
             uint8_t AA = code[1];
             uint16_t BBBB = read_le<uint16_t>(&code[2]);
             uint16_t CCCC = read_le<uint16_t>(&code[4]);
             
-            oss << "{v" << CCCC << " .. v" << (CCCC + AA - 1) << "}, ";
-            if (op >= 0x74 && op <= 0x78) { // invoke-*/range
-                oss << resolve_method(BBBB);
+            out.append('{').reg(CCCC).append(" .. ").reg(static_cast<uint32_t>(CCCC) + AA - 1).append("}, ");
+            if (info.format == OpcodeFormat::k4rcc) { // invoke-polymorphic/range
+                write_method(BBBB, out);
+                out.append(", proto@").decimal(static_cast<uint32_t>(read_le<uint16_t>(&code[6])));
+            } else if (op >= 0x74 && op <= 0x78) { // invoke-*/range
+                write_method(BBBB, out);
+            } else if (op == 0xfd) { // invoke-custom/range
+                out.append("call_site@").decimal(static_cast<uint32_t>(BBBB));
             } else {
-                oss << resolve_type(BBBB);
+                write_type(BBBB, out);
             }
             break;
         }
         
-        case OpcodeFormat::k51l: {
-            uint8_t vAA = code[1];
-            int64_t BBBBBBBBBBBBBBBB = read_le<int64_t>(&code[2]);
-            oss << "v" << (int)vAA << ", #long " << BBBBBBBBBBBBBBBB;
+        case OpcodeFormat::k51l:
+            out.reg(code[1]).append(", #long ").decimal(read_le<int64_t>(&code[2]));
             break;
-        }
         
         default:
-            oss << "?";
+            out.append('?');
             break;
     }
+}
+
+DisassembledInsn SmaliDisassembler::disassemble_insn(const uint8_t* code, size_t code_size, uint32_t offset) const {
+    DisassembledInsn insn;
+    insn.offset = offset;
     
-    insn.operands = oss.str();
+    if (code_size < 2) {
+        insn.opcode = "invalid";
+        return insn;
+    }
+    
+    const OpcodeInfo& info = opcodes_[code[0]];
+    insn.opcode = info.name;
+    
+    // Store raw bytes
+    size_t byte_size = info.size * 2;
+    for (size_t i = 0; i < byte_size && i + 1 < code_size; i += 2) {
+        insn.raw_bytes.push_back(read_le<uint16_t>(&code[i]));
+    }
+    if (code_size < byte_size) {
+        insn.operands = "?";
+        return insn;
+    }
+    
+    SmaliWriter out(insn.operands);
+    write_operands(code, out);
+    int32_t target;
+    if (branch_offset(code, target)) {
+        if (target >= 0) out.append('+');
+        out.decimal(target);
+        bool is_goto = info.format == OpcodeFormat::k10t || info.format == OpcodeFormat::k20t ||
+                       info.format == OpcodeFormat::k30t;
+        if (info.format != OpcodeFormat::k31t) {
+            insn.comment = (is_goto ? "goto " : "target ") + std::to_string(static_cast<int64_t>(offset / 2) + target);
+        }
+    }
     return insn;
 }
 
-std::vector<DisassembledInsn> SmaliDisassembler::disassemble_method(const uint8_t* code, size_t code_size) {
+std::vector<DisassembledInsn> SmaliDisassembler::disassemble_method(const uint8_t* code, size_t code_size) const {
     std::vector<DisassembledInsn> result;
     
-    size_t offset = 0;
-    while (offset < code_size) {
-        DisassembledInsn insn = disassemble_insn(code + offset, code_size - offset, offset);
+    InsnIterator it(code, static_cast<uint32_t>(code_size / 2));
+    Insn insn;
+    while (it.next(insn)) {
+        size_t offset = static_cast<size_t>(insn.pc) * 2;
         
-        uint8_t op = code[offset];
-        size_t insn_size = opcodes_[op].size * 2;
-        
-        result.push_back(insn);
-        offset += insn_size;
+        if (insn.payload != PayloadKind::kNone) {
+            // Data payloads are not executable; keep them as a single annotated nop
+            DisassembledInsn data;
+            data.offset = static_cast<uint32_t>(offset);
+            data.opcode = "nop";
+            data.comment = insn.payload == PayloadKind::kPackedSwitch ? "packed-switch-payload"
+                         : insn.payload == PayloadKind::kSparseSwitch ? "sparse-switch-payload"
+                         : "fill-array-data-payload";
+            result.push_back(data);
+            continue;
+        }
         
-        if (insn_size == 0) break; // Safety
+        result.push_back(disassemble_insn(code + offset, code_size - offset, offset));
     }
     
     return result;
 }
 
-std::string SmaliDisassembler::to_smali(const std::vector<DisassembledInsn>& insns) {
-    std::ostringstream oss;
+std::string SmaliDisassembler::to_smali(const std::vector<DisassembledInsn>& insns) const {
+    std::string text;
+    SmaliWriter out(text);
     
     for (const auto& insn : insns) {
-        oss << "    " << insn.opcode;
+        out.append("    ").append(insn.opcode);
         if (!insn.operands.empty()) {
-            oss << " " << insn.operands;
+            out.append(' ').append(insn.operands);
         }
         if (!insn.comment.empty()) {
-            oss << " # " << insn.comment;
+            out.append(" # ").append(insn.comment);
         }
-        oss << "\n";
+        out.append('\n');
     }
     
-    return oss.str();
+    return text;
 }
 
-int SmaliDisassembler::get_opcode_by_name(const std::string& name) {
-    for (int i = 0; i < 256; i++) {
-        if (opcodes_[i].name == name) {
-            return i;
-        }
-    }
-    return -1;
-}
+namespace {
 
-// SmaliAssembler implementation
+// Label kinds, in the order they are printed when several share an address
+enum class LabelKind : uint8_t {
+    kTryEnd, kCatch, kCatchAll, kCond, kGoto, kPswitch, kSswitch, kTryStart,
+    kPswitchData, kSswitchData, kArray, kCount
+};
 
-template<typename T>
-static void write_le(uint8_t* p, T val) {
-    for (size_t i = 0; i < sizeof(T); i++) {
-        p[i] = static_cast<uint8_t>(val >> (i * 8));
-    }
-}
+const char* const kLabelPrefixes[] = {
+    ":try_end_", ":catch_", ":catchall_", ":cond_", ":goto_", ":pswitch_", ":sswitch_", ":try_start_",
+    ":pswitch_data_", ":sswitch_data_", ":array_"
+};
 
-int SmaliAssembler::find_string(const std::string& str) const {
-    for (size_t i = 0; i < strings_.size(); i++) {
-        if (strings_[i] == str) return static_cast<int>(i);
-    }
-    return -1;
-}
+struct Label {
+    uint32_t pc;
+    LabelKind kind;
+    uint32_t number;
 
-int SmaliAssembler::find_type(const std::string& type) const {
-    for (size_t i = 0; i < types_.size(); i++) {
-        if (types_[i] == type) return static_cast<int>(i);
-    }
-    return -1;
-}
+    bool operator<(const Label& o) const { return pc != o.pc ? pc < o.pc : kind < o.kind; }
+    bool operator==(const Label& o) const { return pc == o.pc && kind == o.kind; }
+};
 
-int SmaliAssembler::find_method(const std::string& method) const {
-    // First try exact match
-    for (size_t i = 0; i < methods_.size(); i++) {
-        if (methods_[i] == method) return static_cast<int>(i);
+// Labels of one method in a sorted vector; each kind is numbered in address order like baksmali
+class LabelTable {
+public:
+    void add(uint32_t pc, LabelKind kind) { labels_.push_back({pc, kind, 0}); }
+
+    void finish() {
+        std::sort(labels_.begin(), labels_.end());
+        labels_.erase(std::unique(labels_.begin(), labels_.end()), labels_.end());
+        uint32_t next[static_cast<size_t>(LabelKind::kCount)] = {};
+        for (Label& label : labels_) label.number = next[static_cast<size_t>(label.kind)]++;
     }
-    // Then try substring match (for cases like partial method signatures)
-    for (size_t i = 0; i < methods_.size(); i++) {
-        if (methods_[i].find(method) != std::string::npos) return static_cast<int>(i);
+
+    void write(SmaliWriter& out, uint32_t pc, LabelKind kind) const {
+        auto it = std::lower_bound(labels_.begin(), labels_.end(), Label{pc, kind, 0});
+        if (it == labels_.end() || it->pc != pc || it->kind != kind) {
+            out.append('?');
+        } else {
+            write(out, *it);
+        }
     }
-    return -1;
-}
 
-int SmaliAssembler::find_field(const std::string& field) const {
-    // First try exact match
-    for (size_t i = 0; i < fields_.size(); i++) {
-        if (fields_[i] == field) return static_cast<int>(i);
+    static void write(SmaliWriter& out, const Label& label) {
+        char buf[8];
+        auto res = std::to_chars(buf, buf + sizeof(buf), label.number, 16);
+        out.append(kLabelPrefixes[static_cast<size_t>(label.kind)]).append(std::string_view(buf, res.ptr - buf));
     }
-    // Then try substring match (for cases like partial field references)
-    for (size_t i = 0; i < fields_.size(); i++) {
-        if (fields_[i].find(field) != std::string::npos) return static_cast<int>(i);
+
+    const std::vector<Label>& labels() const { return labels_; }
+
+private:
+    std::vector<Label> labels_;
+};
+
+// Switch payload and the address of the switch instruction its targets are relative to
+struct PayloadBase {
+    uint32_t payload_pc;
+    uint32_t switch_pc;
+    bool packed;
+
+    bool operator<(const PayloadBase& o) const { return payload_pc < o.payload_pc; }
+};
+
+// Target address and label kind of a branch, switch or fill-array-data instruction
+bool branch_target(const Insn& insn, uint32_t& target, LabelKind& kind) {
+    int32_t offset;
+    if (!branch_offset(insn.code, offset)) return false;
+    target = insn.pc + offset;
+    switch (insn.info().format) {
+        case OpcodeFormat::k10t:
+        case OpcodeFormat::k20t:
+        case OpcodeFormat::k30t:
+            kind = LabelKind::kGoto;
+            break;
+        case OpcodeFormat::k31t:
+            kind = insn.opcode == 0x2b ? LabelKind::kPswitchData
+                 : insn.opcode == 0x2c ? LabelKind::kSswitchData
+                 : LabelKind::kArray;
+            break;
+        default:
+            kind = LabelKind::kCond;
+            break;
     }
-    return -1;
+    return true;
 }
 
-bool SmaliAssembler::parse_register(const std::string& reg, int& num) {
-    if (reg.empty() || reg[0] != 'v') return false;
-    try {
-        num = std::stoi(reg.substr(1));
-        return true;
-    } catch (...) {
-        return false;
-    }
+// Switch payload at `pc` if it is well-formed and fits in the method
+bool switch_payload(const uint8_t* code, uint32_t units, uint32_t pc, bool packed,
+                    uint32_t& count, const uint8_t*& targets) {
+    if (pc >= units || units - pc < 2) return false;
+    const uint8_t* p = code + static_cast<size_t>(pc) * 2;
+    if (read_le<uint16_t>(p) != (packed ? 0x0100 : 0x0200)) return false;
+    count = read_le<uint16_t>(p + 2);
+    uint64_t payload_units = packed ? 4 + count * 2ull : 2 + count * 4ull;
+    if (payload_units > units - pc) return false;
+    targets = p + (packed ? 8 : 4 + count * 4ull);
+    return true;
 }
 
-bool SmaliAssembler::parse_int(const std::string& str, int64_t& val) {
-    try {
-        if (str.find("0x") == 0 || str.find("0X") == 0) {
-            val = std::stoll(str, nullptr, 16);
-        } else {
-            val = std::stoll(str);
-        }
-        return true;
-    } catch (...) {
-        return false;
-    }
+} // namespace
+
+std::string SmaliDisassembler::disassemble_method_smali(const uint8_t* code, size_t code_size,
+                                                        const std::vector<TryBlock>& tries,
+                                                        const DebugInfo* debug) const {
+    std::string text;
+    SmaliWriter out(text);
+    write_method_smali(out, code, code_size, tries, debug);
+    return text;
 }
 
-bool SmaliAssembler::assemble_insn(const std::string& line, std::vector<uint8_t>& bytecode, std::string& error) {
-    // Parse line: ".XXXX: opcode operands // comment"
-    std::string trimmed = line;
-    
-    // Remove leading whitespace
-    size_t start = trimmed.find_first_not_of(" \t");
-    if (start == std::string::npos) return true; // Empty line
-    trimmed = trimmed.substr(start);
-    
-    // Skip directives and offset labels
-    if (trimmed[0] == '.') {
-        size_t colon = trimmed.find(':');
-        if (colon != std::string::npos && colon < 8) {
-            // Offset label like .0000: - extract instruction after it
-            trimmed = trimmed.substr(colon + 1);
-            start = trimmed.find_first_not_of(" \t");
-            if (start == std::string::npos) return true;
-            trimmed = trimmed.substr(start);
-        } else {
-            // Skip other directives like .method, .registers, .end, .line, etc
-            return true;
-        }
-    }
-    
-    // Remove comment (only outside quotes)
-    bool in_str = false;
-    size_t comment_pos = std::string::npos;
-    for (size_t i = 0; i < trimmed.size(); i++) {
-        if (trimmed[i] == '"') in_str = !in_str;
-        if (!in_str && i + 1 < trimmed.size() && trimmed[i] == '/' && trimmed[i+1] == '/') {
-            comment_pos = i;
-            break;
+void SmaliDisassembler::write_method_smali(SmaliWriter& out, const uint8_t* code, size_t code_size,
+                                           const std::vector<TryBlock>& tries, const DebugInfo* debug) const {
+    uint32_t units = static_cast<uint32_t>(code_size / 2);
+    LabelTable labels;
+    std::vector<PayloadBase> bases;
+
+    // Pass 1: collect every address that needs a label
+    InsnIterator it(code, units);
+    Insn insn;
+    while (it.next(insn)) {
+        uint32_t target;
+        LabelKind kind;
+        if (insn.payload != PayloadKind::kNone || !branch_target(insn, target, kind)) continue;
+        labels.add(target, kind);
+        if (kind == LabelKind::kPswitchData || kind == LabelKind::kSswitchData) {
+            bases.push_back({target, insn.pc, kind == LabelKind::kPswitchData});
         }
     }
-    if (comment_pos != std::string::npos) {
-        trimmed = trimmed.substr(0, comment_pos);
-    }
-    
-    // Remove \r characters (Windows line endings)
-    trimmed.erase(std::remove(trimmed.begin(), trimmed.end(), '\r'), trimmed.end());
-    
-    // Trim trailing whitespace
-    size_t end = trimmed.find_last_not_of(" \t\n");
-    if (end != std::string::npos) {
-        trimmed = trimmed.substr(0, end + 1);
-    }
-    
-    if (trimmed.empty()) return true;
-    
-    // Split opcode and operands
-    size_t space = trimmed.find(' ');
-    std::string opcode_name = (space != std::string::npos) ? trimmed.substr(0, space) : trimmed;
-    std::string operands = (space != std::string::npos) ? trimmed.substr(space + 1) : "";
-    
-    // Trim operands
-    start = operands.find_first_not_of(" \t");
-    if (start != std::string::npos) {
-        operands = operands.substr(start);
-    }
-    
-    // Find opcode
-    int op = SmaliDisassembler::get_opcode_by_name(opcode_name);
-    if (op < 0) {
-        error = "Unknown opcode: " + opcode_name;
-        return false;
-    }
-    
-    const OpcodeInfo& info = SmaliDisassembler::get_opcode_info(static_cast<uint8_t>(op));
-    size_t insn_size = info.size * 2;
-    
-    std::vector<uint8_t> insn(insn_size, 0);
-    insn[0] = static_cast<uint8_t>(op);
-    
-    // Parse operands based on format
-    std::vector<std::string> parts;
-    std::string current;
-    bool in_brace = false;
-    bool in_quote = false;
-    for (char c : operands) {
-        if (c == '"' && !in_brace) in_quote = !in_quote;
-        if (c == '{' && !in_quote) in_brace = true;
-        if (c == '}' && !in_quote) in_brace = false;
-        if (c == ',' && !in_brace && !in_quote) {
-            size_t s = current.find_first_not_of(" \t");
-            size_t e = current.find_last_not_of(" \t");
-            if (s != std::string::npos && e != std::string::npos) {
-                parts.push_back(current.substr(s, e - s + 1));
-            }
-            current.clear();
-        } else {
-            current += c;
+
+    // A payload shared by several switches is rendered relative to the first one
+    std::stable_sort(bases.begin(), bases.end());
+    bases.erase(std::unique(bases.begin(), bases.end(),
+                            [](const PayloadBase& a, const PayloadBase& b) { return a.payload_pc == b.payload_pc; }),
+                bases.end());
+    for (const PayloadBase& base : bases) {
+        uint32_t count;
+        const uint8_t* targets;
+        if (!switch_payload(code, units, base.payload_pc, base.packed, count, targets)) continue;
+        for (uint32_t i = 0; i < count; i++) {
+            labels.add(base.switch_pc + read_le<int32_t>(targets + i * 4),
+                       base.packed ? LabelKind::kPswitch : LabelKind::kSswitch);
         }
     }
-    if (!current.empty()) {
-        size_t s = current.find_first_not_of(" \t");
-        size_t e = current.find_last_not_of(" \t");
-        if (s != std::string::npos && e != std::string::npos) {
-            parts.push_back(current.substr(s, e - s + 1));
+
+    for (const TryBlock& block : tries) {
+        labels.add(block.start_addr, LabelKind::kTryStart);
+        labels.add(block.end_addr, LabelKind::kTryEnd);
+        for (const CatchHandler& handler : block.handlers) {
+            labels.add(handler.addr, handler.type_idx == CatchHandler::kCatchAll ? LabelKind::kCatchAll
+                                                                                 : LabelKind::kCatch);
         }
     }
-    
-    switch (info.format) {
-        case OpcodeFormat::k10x:
-            // No operands
-            break;
-            
-        case OpcodeFormat::k12x: {
-            // k12x format: B|A|op, A is low 4 bits, B is high 4 bits
-            if (parts.size() < 2) { error = "Expected 2 registers"; return false; }
-            int vA, vB;
-            if (!parse_register(parts[0], vA) || !parse_register(parts[1], vB)) {
-                error = "Invalid registers"; return false;
-            }
-            insn[1] = static_cast<uint8_t>((vB << 4) | (vA & 0xF));
-            break;
-        }
-        
-        case OpcodeFormat::k11n: {
-            if (parts.size() < 2) { error = "Expected register and literal"; return false; }
-            int vA;
-            int64_t lit;
-            if (!parse_register(parts[0], vA)) { error = "Invalid register"; return false; }
-            std::string lit_str = parts[1];
-            if (lit_str.find("#int") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#int") + 5);
+    labels.finish();
+
+    // Try blocks in end order, so their .catch directives follow the matching :try_end
+    std::vector<uint32_t> ends(tries.size());
+    for (uint32_t i = 0; i < ends.size(); i++) ends[i] = i;
+    std::sort(ends.begin(), ends.end(),
+              [&](uint32_t a, uint32_t b) { return tries[a].end_addr < tries[b].end_addr; });
+
+    // Pass 2: render, emitting labels as their address is reached
+    const std::vector<Label>& all = labels.labels();
+    size_t next_label = 0;
+    size_t next_end = 0;
+    size_t next_event = 0;
+    auto emit_labels = [&](uint32_t pc) {
+        while (next_end < ends.size() && tries[ends[next_end]].end_addr <= pc) {
+            const TryBlock& block = tries[ends[next_end++]];
+            out.append("    ");
+            labels.write(out, block.end_addr, LabelKind::kTryEnd);
+            out.append('\n');
+            for (const CatchHandler& handler : block.handlers) {
+                bool catch_all = handler.type_idx == CatchHandler::kCatchAll;
+                if (catch_all) {
+                    out.append("    .catchall {");
+                } else {
+                    out.append("    .catch ");
+                    write_type(handler.type_idx, out);
+                    out.append(" {");
+                }
+                labels.write(out, block.start_addr, LabelKind::kTryStart);
+                out.append(" .. ");
+                labels.write(out, block.end_addr, LabelKind::kTryEnd);
+                out.append("} ");
+                labels.write(out, handler.addr, catch_all ? LabelKind::kCatchAll : LabelKind::kCatch);
+                out.append('\n');
             }
-            if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-            insn[1] = static_cast<uint8_t>(((lit & 0xF) << 4) | (vA & 0xF));
-            break;
         }
-        
-        case OpcodeFormat::k11x: {
-            if (parts.size() < 1) { error = "Expected register"; return false; }
-            int vAA;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            break;
+        for (; next_label < all.size() && all[next_label].pc <= pc; next_label++) {
+            if (all[next_label].kind == LabelKind::kTryEnd) continue;
+            out.append("    ");
+            LabelTable::write(out, all[next_label]);
+            out.append('\n');
         }
-        
-        case OpcodeFormat::k21s: {
-            if (parts.size() < 2) { error = "Expected register and literal"; return false; }
-            int vAA;
-            int64_t lit;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            std::string lit_str = parts[1];
-            if (lit_str.find("#int") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#int") + 5);
-            }
-            if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
-            break;
+        for (; debug && next_event < debug->events.size() && debug->events[next_event].addr <= pc; next_event++) {
+            write_debug_event(debug->events[next_event], out);
         }
-        
-        case OpcodeFormat::k21c: {
-            if (parts.size() < 2) { error = "Expected register and reference"; return false; }
-            int vAA;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            
-            std::string ref = parts[1];
-            int idx = -1;
-            
-            if (ref[0] == '"') {
-                // String literal
-                std::string str = ref.substr(1, ref.length() - 2);
-                idx = find_string(str);
-                if (idx < 0) { error = "String not found: " + str; return false; }
-            } else if (ref.find("->") != std::string::npos) {
-                // Field reference (Lclass;->name:type)
-                idx = find_field(ref);
-                if (idx < 0) { error = "Field not found: " + ref; return false; }
-            } else if (ref.find("field@") == 0) {
-                idx = std::stoi(ref.substr(6));
-            } else if (ref[0] == 'L' || ref.find("type@") == 0) {
-                idx = find_type(ref);
-                if (idx < 0) { error = "Type not found: " + ref; return false; }
-            } else {
-                idx = find_field(ref);
-                if (idx < 0) { error = "Reference not found: " + ref; return false; }
+    };
+
+    InsnIterator render(code, units);
+    while (render.next(insn)) {
+        emit_labels(insn.pc);
+        const uint8_t* p = insn.code;
+
+        if (insn.payload == PayloadKind::kFillArrayData) {
+            uint16_t width = read_le<uint16_t>(p + 2);
+            uint32_t count = read_le<uint32_t>(p + 4);
+            const char* suffix = width == 1 ? "t" : width == 2 ? "s" : width == 8 ? "L" : "";
+            out.append("    .array-data ").decimal(static_cast<uint32_t>(width)).append('\n');
+            for (uint32_t i = 0; i < count && (width == 1 || width == 2 || width == 4 || width == 8); i++) {
+                const uint8_t* element = p + 8 + static_cast<size_t>(i) * width;
+                int64_t value = width == 1 ? static_cast<int8_t>(element[0])
+                              : width == 2 ? read_le<int16_t>(element)
+                              : width == 4 ? read_le<int32_t>(element)
+                              : read_le<int64_t>(element);
+                out.append("        ").hex(value, suffix).append('\n');
             }
-            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(idx));
-            break;
+            out.append("    .end array-data\n");
+            continue;
         }
-        
-        case OpcodeFormat::k22c: {
-            // vA, vB, type@CCCC or field@CCCC
-            if (parts.size() < 3) { error = "Expected 2 registers and reference"; return false; }
-            int vA, vB;
-            if (!parse_register(parts[0], vA) || !parse_register(parts[1], vB)) {
-                error = "Invalid registers"; return false;
-            }
-            insn[1] = static_cast<uint8_t>((vB << 4) | (vA & 0xF));
-            
-            std::string ref = parts[2];
-            int idx = find_field(ref);
-            if (idx < 0) {
-                idx = find_type(ref);
+
+        if (insn.payload != PayloadKind::kNone) {
+            bool packed = insn.payload == PayloadKind::kPackedSwitch;
+            std::string_view directive = packed ? "packed-switch" : "sparse-switch";
+            auto base = std::lower_bound(bases.begin(), bases.end(), PayloadBase{insn.pc, 0, packed});
+            uint32_t count;
+            const uint8_t* targets;
+            if (base == bases.end() || base->payload_pc != insn.pc || base->packed != packed ||
+                !switch_payload(code, units, insn.pc, packed, count, targets)) {
+                // Not referenced by any switch, so there are no labels to point at
+                out.append("    nop # unreferenced ").append(directive).append("-payload\n");
+                continue;
             }
-            if (idx < 0) { error = "Reference not found: " + ref; return false; }
-            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(idx));
-            break;
-        }
-        
-        case OpcodeFormat::k23x: {
-            // vAA, vBB, vCC
-            if (parts.size() < 3) { error = "Expected 3 registers"; return false; }
-            int vAA, vBB, vCC;
-            if (!parse_register(parts[0], vAA) || !parse_register(parts[1], vBB) || !parse_register(parts[2], vCC)) {
-                error = "Invalid registers"; return false;
+
+            out.append("    .").append(directive);
+            if (packed) out.append(' ').hex(read_le<int32_t>(p + 4));
+            out.append('\n');
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t target = base->switch_pc + read_le<int32_t>(targets + i * 4);
+                out.append("        ");
+                if (!packed) out.hex(read_le<int32_t>(p + 4 + i * 4)).append(" -> ");
+                labels.write(out, target, packed ? LabelKind::kPswitch : LabelKind::kSswitch);
+                out.append('\n');
             }
-            insn[1] = static_cast<uint8_t>(vAA);
-            insn[2] = static_cast<uint8_t>(vBB);
-            insn[3] = static_cast<uint8_t>(vCC);
-            break;
+            out.append("    .end ").append(directive).append('\n');
+            continue;
         }
-        
-        case OpcodeFormat::k10t: {
-            // +AA (goto)
-            int64_t offset_val;
-            std::string offset_str = parts.size() > 0 ? parts[0] : "0";
-            if (!parse_int(offset_str, offset_val)) { error = "Invalid offset"; return false; }
-            insn[1] = static_cast<uint8_t>(static_cast<int8_t>(offset_val));
-            break;
+
+        const OpcodeInfo& info = insn.info();
+        out.append("    ").append(info.name);
+        if (info.format != OpcodeFormat::k10x) out.append(' ');
+        write_operands(p, out);
+        uint32_t target;
+        LabelKind kind;
+        if (branch_target(insn, target, kind)) labels.write(out, target, kind);
+        out.append('\n');
+    }
+    emit_labels(UINT32_MAX);
+}
+
+void SmaliDisassembler::write_debug_event(const DebugEvent& event, SmaliWriter& out) const {
+    // "name":Type, with null for an absent name or type
+    auto local = [&]() {
+        if (event.name_idx == DebugEvent::kNoIndex) {
+            out.append("null");
+        } else {
+            write_string(event.name_idx, out);
         }
-        
-        case OpcodeFormat::k20t: {
-            // +AAAA (goto/16)
-            int64_t offset_val;
-            std::string offset_str = parts.size() > 0 ? parts[0] : "0";
-            if (!parse_int(offset_str, offset_val)) { error = "Invalid offset"; return false; }
-            write_le<int16_t>(&insn[2], static_cast<int16_t>(offset_val));
-            break;
+        out.append(':');
+        if (event.type_idx == DebugEvent::kNoIndex) {
+            out.append('V');
+        } else {
+            write_type(event.type_idx, out);
         }
-        
-        case OpcodeFormat::k21t: {
-            // vAA, +BBBB (if-*z)
-            if (parts.size() < 2) { error = "Expected register and offset"; return false; }
-            int vAA;
-            int64_t offset_val;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            if (!parse_int(parts[1], offset_val)) { error = "Invalid offset"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<int16_t>(&insn[2], static_cast<int16_t>(offset_val));
+    };
+
+    switch (event.kind) {
+        case DebugEvent::Kind::kLine:
+            out.append("    .line ").decimal(event.line).append('\n');
             break;
-        }
-        
-        case OpcodeFormat::k21h: {
-            // vAA, #+BBBB0000 (const/high16, const-wide/high16)
-            if (parts.size() < 2) { error = "Expected register and literal"; return false; }
-            int vAA;
-            int64_t lit;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            std::string lit_str = parts[1];
-            if (lit_str.find("#int") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#int") + 5);
-                if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-                lit = lit >> 16; // Extract high 16 bits
-            } else if (lit_str.find("#long") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#long") + 6);
-                if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-                lit = lit >> 48; // Extract high 16 bits
-            } else {
-                if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
+        case DebugEvent::Kind::kStartLocal:
+            out.append("    .local ").reg(event.reg).append(", ");
+            local();
+            if (event.signature_idx != DebugEvent::kNoIndex) {
+                out.append(", ");
+                write_string(event.signature_idx, out);
             }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
+            out.append('\n');
             break;
-        }
-        
-        case OpcodeFormat::k22b: {
-            // vAA, vBB, #+CC
-            if (parts.size() < 3) { error = "Expected 2 registers and literal"; return false; }
-            int vAA, vBB;
-            int64_t lit;
-            if (!parse_register(parts[0], vAA) || !parse_register(parts[1], vBB)) {
-                error = "Invalid registers"; return false;
+        case DebugEvent::Kind::kEndLocal:
+        case DebugEvent::Kind::kRestartLocal:
+            out.append(event.kind == DebugEvent::Kind::kEndLocal ? "    .end local " : "    .restart local ")
+               .reg(event.reg);
+            if (event.name_idx != DebugEvent::kNoIndex || event.type_idx != DebugEvent::kNoIndex) {
+                out.append("    # ");
+                local();
             }
-            std::string lit_str = parts[2];
-            if (lit_str.find("#int") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#int") + 5);
-            }
-            if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            insn[2] = static_cast<uint8_t>(vBB);
-            insn[3] = static_cast<uint8_t>(static_cast<int8_t>(lit));
+            out.append('\n');
             break;
-        }
-        
-        case OpcodeFormat::k22t: {
-            // vA, vB, +CCCC (if-*)
-            if (parts.size() < 3) { error = "Expected 2 registers and offset"; return false; }
-            int vA, vB;
-            int64_t offset_val;
-            if (!parse_register(parts[0], vA) || !parse_register(parts[1], vB)) {
-                error = "Invalid registers"; return false;
-            }
-            if (!parse_int(parts[2], offset_val)) { error = "Invalid offset"; return false; }
-            insn[1] = static_cast<uint8_t>((vB << 4) | (vA & 0xF));
-            write_le<int16_t>(&insn[2], static_cast<int16_t>(offset_val));
+        case DebugEvent::Kind::kPrologueEnd:
+            out.append("    .prologue\n");
             break;
-        }
-        
-        case OpcodeFormat::k22s: {
-            // vA, vB, #+CCCC
-            if (parts.size() < 3) { error = "Expected 2 registers and literal"; return false; }
-            int vA, vB;
-            int64_t lit;
-            if (!parse_register(parts[0], vA) || !parse_register(parts[1], vB)) {
-                error = "Invalid registers"; return false;
-            }
-            std::string lit_str = parts[2];
-            if (lit_str.find("#int") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#int") + 5);
-            }
-            if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-            insn[1] = static_cast<uint8_t>((vB << 4) | (vA & 0xF));
-            write_le<int16_t>(&insn[2], static_cast<int16_t>(lit));
+        case DebugEvent::Kind::kEpilogueBegin:
+            out.append("    .epilogue\n");
             break;
-        }
-        
-        case OpcodeFormat::k22x: {
-            // vAA, vBBBB
-            if (parts.size() < 2) { error = "Expected 2 registers"; return false; }
-            int vAA, vBBBB;
-            if (!parse_register(parts[0], vAA) || !parse_register(parts[1], vBBBB)) {
-                error = "Invalid registers"; return false;
+        case DebugEvent::Kind::kSetFile:
+            if (event.name_idx != DebugEvent::kNoIndex) {
+                out.append("    .source ");
+                write_string(event.name_idx, out);
+                out.append('\n');
             }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(vBBBB));
             break;
-        }
-        
-        case OpcodeFormat::k32x: {
-            // vAAAA, vBBBB
-            if (parts.size() < 2) { error = "Expected 2 registers"; return false; }
-            int vAAAA, vBBBB;
-            if (!parse_register(parts[0], vAAAA) || !parse_register(parts[1], vBBBB)) {
-                error = "Invalid registers"; return false;
+    }
+}
+
+void SmaliDisassembler::write_parameters_smali(SmaliWriter& out, const DebugInfo* debug, const ProtoId& proto,
+                                               uint16_t registers_size, uint16_t ins_size, bool is_static,
+                                               const DexParser* dex,
+                                               const std::vector<uint32_t>* parameter_sets) const {
+    // Without code there is no frame, so parameters are numbered from p0
+    bool has_frame = registers_size != 0 || ins_size != 0;
+    uint32_t reg = (has_frame ? static_cast<uint32_t>(registers_size) - ins_size : 0) + (is_static ? 0 : 1);
+    for (uint32_t i = 0; i < proto.param_count; i++) {
+        uint32_t type_idx = proto.param(i);
+        bool named = debug && i < debug->parameter_names.size() &&
+                     debug->parameter_names[i] != DebugEvent::kNoIndex;
+        uint32_t set_off = dex && parameter_sets && i < parameter_sets->size() ? (*parameter_sets)[i] : 0;
+        if (named || set_off != 0) {
+            out.append("    .param ");
+            if (has_frame) {
+                out.reg(reg);
+            } else {
+                out.append('p').decimal(reg);
+            }
+            if (named) {
+                out.append(", ");
+                write_string(debug->parameter_names[i], out);
+            }
+            out.append("    # ");
+            write_type(type_idx, out);
+            out.append('\n');
+            if (set_off != 0) {
+                write_annotation_set(out, *dex, set_off, 8);
+                out.append("    .end param\n");
             }
-            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(vAAAA));
-            write_le<uint16_t>(&insn[4], static_cast<uint16_t>(vBBBB));
-            break;
         }
-        
-        case OpcodeFormat::k30t: {
-            // +AAAAAAAA (goto/32)
-            int64_t offset_val;
-            std::string offset_str = parts.size() > 0 ? parts[0] : "0";
-            if (!parse_int(offset_str, offset_val)) { error = "Invalid offset"; return false; }
-            write_le<int32_t>(&insn[2], static_cast<int32_t>(offset_val));
+        // long and double parameters take a register pair
+        const std::string* type = symbol(SymbolKind::kType, type_idx);
+        bool wide = type && (*type == "J" || *type == "D");
+        reg += wide ? 2 : 1;
+    }
+}
+
+static bool read_uleb128(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= end) return false;
+        uint8_t b = *p++;
+        value |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static void indent_to(SmaliWriter& out, int indent) {
+    out.buffer().append(static_cast<size_t>(indent), ' ');
+}
+
+// Shortest decimal that reads back as the same value, as baksmali prints float and double literals
+static void write_floating(SmaliWriter& out, double value, bool is_float) {
+    std::string_view suffix = is_float ? "f" : "";
+    if (std::isnan(value)) {
+        out.append("NaN").append(suffix);
+        return;
+    }
+    if (std::isinf(value)) {
+        out.append(value < 0 ? "-Infinity" : "Infinity").append(suffix);
+        return;
+    }
+    char buf[32];
+    int len = 0;
+    for (int precision = is_float ? 6 : 15; precision <= (is_float ? 9 : 17); precision++) {
+        len = std::snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        if (is_float ? std::strtof(buf, nullptr) == static_cast<float>(value) : std::strtod(buf, nullptr) == value) {
             break;
         }
-        
-        case OpcodeFormat::k31t: {
-            // vAA, +BBBBBBBB (fill-array-data, packed-switch, sparse-switch)
-            if (parts.size() < 2) { error = "Expected register and offset"; return false; }
-            int vAA;
-            int64_t offset_val;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            if (!parse_int(parts[1], offset_val)) { error = "Invalid offset"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<int32_t>(&insn[2], static_cast<int32_t>(offset_val));
-            break;
+    }
+    std::string_view text(buf, len);
+    out.append(text);
+    if (text.find_first_of(".en") == std::string_view::npos) out.append(".0");
+    out.append(suffix);
+}
+
+bool SmaliDisassembler::write_encoded_value(SmaliWriter& out, const uint8_t*& p, const uint8_t* end,
+                                            int indent) const {
+    if (p >= end) return false;
+    uint8_t type = *p & 0x1f;
+    uint32_t arg = *p++ >> 5;
+    if (type == 0x1c) {  // VALUE_ARRAY
+        uint32_t size;
+        if (!read_uleb128(p, end, size)) return false;
+        if (size == 0) {
+            out.append("{}");
+            return true;
         }
-        
-        case OpcodeFormat::k31i: {
-            // vAA, #+BBBBBBBB (const)
-            if (parts.size() < 2) { error = "Expected register and literal"; return false; }
-            int vAA;
-            int64_t lit;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            std::string lit_str = parts[1];
-            if (lit_str.find("#int") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#int") + 5);
-            }
-            if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<int32_t>(&insn[2], static_cast<int32_t>(lit));
-            break;
+        out.append("{\n");
+        for (uint32_t i = 0; i < size; i++) {
+            indent_to(out, indent + 4);
+            if (!write_encoded_value(out, p, end, indent + 4)) return false;
+            out.append(i + 1 < size ? ",\n" : "\n");
         }
-        
-        case OpcodeFormat::k31c: {
-            // vAA, string@BBBBBBBB (const-string/jumbo)
-            if (parts.size() < 2) { error = "Expected register and string"; return false; }
-            int vAA;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            
-            std::string ref = parts[1];
-            int idx = -1;
-            if (ref[0] == '"') {
-                std::string str = ref.substr(1, ref.length() - 2);
-                idx = find_string(str);
-                if (idx < 0) { error = "String not found: " + str; return false; }
-            } else if (ref.find("string@") == 0) {
-                idx = std::stoi(ref.substr(7));
+        indent_to(out, indent);
+        out.append('}');
+        return true;
+    }
+    if (type == 0x1d) {  // VALUE_ANNOTATION
+        uint32_t type_idx;
+        if (!read_uleb128(p, end, type_idx)) return false;
+        out.append(".subannotation ");
+        write_type(type_idx, out);
+        out.append('\n');
+        if (!write_annotation_elements(out, p, end, indent + 4)) return false;
+        indent_to(out, indent);
+        out.append(".end subannotation");
+        return true;
+    }
+    if (type == 0x1e) {  // VALUE_NULL
+        out.append("null");
+        return true;
+    }
+    if (type == 0x1f) {  // VALUE_BOOLEAN
+        out.append(arg ? "true" : "false");
+        return true;
+    }
+
+    // Fixed-width values: arg + 1 little-endian bytes, no wider than the type itself
+    uint32_t size = arg + 1;
+    uint32_t max_size = type == 0x00 ? 1 : type == 0x02 || type == 0x03 ? 2 : type == 0x06 || type == 0x11 ? 8 : 4;
+    if (size > max_size || static_cast<size_t>(end - p) < size) return false;
+    uint64_t raw = 0;
+    for (uint32_t i = 0; i < size; i++) raw |= static_cast<uint64_t>(p[i]) << (i * 8);
+    p += size;
+    // Sign-extended for integers; floating point values are zero-extended to the right
+    int64_t value = size == 8 ? static_cast<int64_t>(raw)
+                              : static_cast<int64_t>(raw << (64 - size * 8)) >> (64 - size * 8);
+    uint32_t idx = static_cast<uint32_t>(raw);
+    switch (type) {
+        case 0x00: out.hex(value, "t"); break;  // VALUE_BYTE
+        case 0x02: out.hex(value, "s"); break;  // VALUE_SHORT
+        case 0x03: {                            // VALUE_CHAR
+            uint32_t c = static_cast<uint32_t>(raw);
+            if (c >= 0x20 && c < 0x7f && c != '\'' && c != '\\') {
+                out.append('\'').append(static_cast<char>(c)).append('\'');
             } else {
-                idx = find_string(ref);
-                if (idx < 0) { error = "String not found: " + ref; return false; }
+                char buf[12];
+                std::snprintf(buf, sizeof(buf), "'\\u%04x'", c & 0xFFFF);
+                out.append(buf);
             }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<uint32_t>(&insn[2], static_cast<uint32_t>(idx));
             break;
         }
-        
-        case OpcodeFormat::k3rc: {
-            // {vCCCC .. vNNNN}, method@BBBB (invoke-*/range)
-            if (parts.size() < 2) { error = "Expected register range and method"; return false; }
-            
-            std::string range_str = parts[0];
-            if (range_str[0] == '{') range_str = range_str.substr(1);
-            if (range_str.back() == '}') range_str = range_str.substr(0, range_str.length() - 1);
-            
-            // Parse "vCCCC .. vNNNN" or just "vCCCC"
-            int vStart = 0, vEnd = 0;
-            size_t dotdot = range_str.find("..");
-            if (dotdot != std::string::npos) {
-                std::string start_str = range_str.substr(0, dotdot);
-                std::string end_str = range_str.substr(dotdot + 2);
-                size_t s = start_str.find_first_not_of(" \t");
-                size_t e = start_str.find_last_not_of(" \t");
-                if (s != std::string::npos) start_str = start_str.substr(s, e - s + 1);
-                s = end_str.find_first_not_of(" \t");
-                e = end_str.find_last_not_of(" \t");
-                if (s != std::string::npos) end_str = end_str.substr(s, e - s + 1);
-                
-                if (!parse_register(start_str, vStart) || !parse_register(end_str, vEnd)) {
-                    error = "Invalid register range"; return false;
-                }
-            } else {
-                size_t s = range_str.find_first_not_of(" \t");
-                size_t e = range_str.find_last_not_of(" \t");
-                if (s != std::string::npos) range_str = range_str.substr(s, e - s + 1);
-                if (!parse_register(range_str, vStart)) {
-                    error = "Invalid register"; return false;
-                }
-                vEnd = vStart;
-            }
-            
-            int count = vEnd - vStart + 1;
-            
-            std::string method_ref = parts[1];
-            int method_idx = find_method(method_ref);
-            if (method_idx < 0) { error = "Method not found: " + method_ref; return false; }
-            
-            insn[1] = static_cast<uint8_t>(count);
-            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(method_idx));
-            write_le<uint16_t>(&insn[4], static_cast<uint16_t>(vStart));
+        case 0x04: out.hex(value); break;       // VALUE_INT
+        case 0x06: out.hex(value, "L"); break;  // VALUE_LONG
+        case 0x10: {                            // VALUE_FLOAT
+            uint32_t bits = static_cast<uint32_t>(raw << (32 - size * 8));
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            write_floating(out, f, true);
             break;
         }
-        
-        case OpcodeFormat::k51l: {
-            // vAA, #+BBBBBBBBBBBBBBBB (const-wide)
-            if (parts.size() < 2) { error = "Expected register and literal"; return false; }
-            int vAA;
-            int64_t lit;
-            if (!parse_register(parts[0], vAA)) { error = "Invalid register"; return false; }
-            std::string lit_str = parts[1];
-            if (lit_str.find("#long") != std::string::npos) {
-                lit_str = lit_str.substr(lit_str.find("#long") + 6);
-            }
-            if (!parse_int(lit_str, lit)) { error = "Invalid literal"; return false; }
-            insn[1] = static_cast<uint8_t>(vAA);
-            write_le<int64_t>(&insn[2], lit);
+        case 0x11: {                            // VALUE_DOUBLE
+            uint64_t bits = raw << (64 - size * 8);
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            write_floating(out, d, false);
             break;
         }
-        
-        case OpcodeFormat::k35c: {
-            // {vC, vD, vE, vF, vG}, method@BBBB or type@BBBB
-            // Format: A|G|op BBBB F|E|D|C
-            if (parts.size() < 2) { error = "Expected registers and method/type"; return false; }
-            
-            std::string regs_str = parts[0];
-            if (regs_str[0] == '{') regs_str = regs_str.substr(1);
-            if (regs_str.back() == '}') regs_str = regs_str.substr(0, regs_str.length() - 1);
-            
-            std::vector<int> regs;
-            std::stringstream ss(regs_str);
-            std::string reg;
-            while (std::getline(ss, reg, ',')) {
-                size_t s = reg.find_first_not_of(" \t");
-                size_t e = reg.find_last_not_of(" \t");
-                if (s != std::string::npos) {
-                    int r;
-                    if (parse_register(reg.substr(s, e - s + 1), r)) {
-                        regs.push_back(r);
-                    }
-                }
-            }
-            
-            std::string ref = parts[1];
-            int idx = -1;
-            if (op >= 0x6e && op <= 0x72) { // invoke-*
-                idx = find_method(ref);
-                if (idx < 0) { error = "Method not found: " + ref; return false; }
-            } else { // filled-new-array
-                idx = find_type(ref);
-                if (idx < 0) { error = "Type not found: " + ref; return false; }
-            }
-            
-            // Encode: A|G in code[1], where A = count, G = 5th register (if any)
-            uint8_t A = static_cast<uint8_t>(regs.size());
-            uint8_t G = (regs.size() > 4) ? static_cast<uint8_t>(regs[4] & 0xF) : 0;
-            insn[1] = static_cast<uint8_t>((A << 4) | G);
-            
-            write_le<uint16_t>(&insn[2], static_cast<uint16_t>(idx));
-            
-            // Encode D|C in code[4], F|E in code[5]
-            uint8_t C = (regs.size() > 0) ? static_cast<uint8_t>(regs[0] & 0xF) : 0;
-            uint8_t D = (regs.size() > 1) ? static_cast<uint8_t>(regs[1] & 0xF) : 0;
-            uint8_t E = (regs.size() > 2) ? static_cast<uint8_t>(regs[2] & 0xF) : 0;
-            uint8_t F = (regs.size() > 3) ? static_cast<uint8_t>(regs[3] & 0xF) : 0;
-            insn[4] = static_cast<uint8_t>(C | (D << 4));
-            insn[5] = static_cast<uint8_t>(E | (F << 4));
+        case 0x15: out.append("proto@").decimal(idx); break;          // VALUE_METHOD_TYPE
+        case 0x16: out.append("method-handle@").decimal(idx); break;  // VALUE_METHOD_HANDLE
+        case 0x17: write_string(idx, out); break;
+        case 0x18: write_type(idx, out); break;
+        case 0x19: write_field(idx, out); break;
+        case 0x1a: write_method(idx, out); break;
+        case 0x1b:                                                   // VALUE_ENUM
+            out.append(".enum ");
+            write_field(idx, out);
             break;
-        }
-        
         default:
-            error = "Unsupported instruction format for assembly: " + opcode_name;
             return false;
     }
-    
-    bytecode.insert(bytecode.end(), insn.begin(), insn.end());
     return true;
 }
 
-bool SmaliAssembler::assemble(const std::string& smali_code, std::vector<uint8_t>& bytecode, std::string& error) {
-    bytecode.clear();
-    
-    std::istringstream iss(smali_code);
-    std::string line;
-    int line_num = 0;
-    
-    while (std::getline(iss, line)) {
-        line_num++;
-        if (!assemble_insn(line, bytecode, error)) {
-            error = "Line " + std::to_string(line_num) + ": " + error;
-            return false;
+bool SmaliDisassembler::write_annotation_elements(SmaliWriter& out, const uint8_t*& p, const uint8_t* end,
+                                                  int indent) const {
+    uint32_t size;
+    if (!read_uleb128(p, end, size)) return false;
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t name_idx;
+        if (!read_uleb128(p, end, name_idx)) return false;
+        indent_to(out, indent);
+        if (const std::string* name = symbol(SymbolKind::kString, name_idx)) {
+            out.append(*name);
+        } else {
+            out.append("string@").decimal(name_idx);
         }
+        out.append(" = ");
+        if (!write_encoded_value(out, p, end, indent)) return false;
+        out.append('\n');
     }
-    
     return true;
 }
 
+void SmaliDisassembler::write_annotation_set(SmaliWriter& out, const DexParser& dex, uint32_t set_off,
+                                             int indent) const {
+    static const char* const kVisibilities[] = {"build", "runtime", "system"};
+    std::vector<uint32_t> annotations;
+    if (!dex.read_offset_list(set_off, annotations)) return;
+
+    const uint8_t* end = dex.data().end();
+    for (uint32_t off : annotations) {
+        if (off >= dex.data().size()) continue;
+        const uint8_t* p = dex.data().begin() + off;
+        uint8_t visibility = *p++;
+        uint32_t type_idx;
+        if (!read_uleb128(p, end, type_idx)) continue;
+
+        // Rendered into a scratch buffer first, so a malformed annotation leaves no partial block
+        std::string block;
+        SmaliWriter item(block);
+        indent_to(item, indent);
+        item.append(".annotation ").append(visibility < 3 ? kVisibilities[visibility] : "runtime").append(' ');
+        write_type(type_idx, item);
+        item.append('\n');
+        if (!write_annotation_elements(item, p, end, indent + 4)) continue;
+        indent_to(item, indent);
+        item.append(".end annotation\n");
+        out.append(block);
+    }
+}
+
+namespace {
+
+struct AccessFlagName {
+    uint32_t bit;
+    const char* name;
+    bool cls, field, method;
+};
+
+const AccessFlagName kAccessFlags[] = {
+    {0x1, "public", true, true, true},
+    {0x2, "private", true, true, true},
+    {0x4, "protected", true, true, true},
+    {0x8, "static", true, true, true},
+    {0x10, "final", true, true, true},
+    {0x20, "synchronized", false, false, true},
+    {0x40, "volatile", false, true, false},
+    {0x40, "bridge", false, false, true},
+    {0x80, "transient", false, true, false},
+    {0x80, "varargs", false, false, true},
+    {0x100, "native", false, false, true},
+    {0x200, "interface", true, false, false},
+    {0x400, "abstract", true, false, true},
+    {0x800, "strictfp", false, false, true},
+    {0x1000, "synthetic", true, true, true},
+    {0x2000, "annotation", true, false, false},
+    {0x4000, "enum", true, true, false},
+    {0x10000, "constructor", false, false, true},
+    {0x20000, "declared-synchronized", false, false, true},
+};
+
+} // namespace
+
+std::string SmaliDisassembler::access_flags_string(uint32_t flags, AccessKind kind) {
+    std::string result;
+    for (const AccessFlagName& flag : kAccessFlags) {
+        bool applies = kind == AccessKind::kClass ? flag.cls : kind == AccessKind::kField ? flag.field : flag.method;
+        if (!applies || (flags & flag.bit) == 0) continue;
+        if (!result.empty()) result += ' ';
+        result += flag.name;
+    }
+    return result;
+}
+
+bool SmaliDisassembler::access_flag_by_name(std::string_view name, uint32_t& flag) {
+    for (const AccessFlagName& entry : kAccessFlags) {
+        if (name == entry.name) {
+            flag = entry.bit;
+            return true;
+        }
+    }
+    return false;
+}
+
+int SmaliDisassembler::get_opcode_by_name(std::string_view name) {
+    // Built once; the first opcode wins for names the table repeats
+    static const std::unordered_map<std::string_view, int> by_name = []() {
+        std::unordered_map<std::string_view, int> map;
+        for (int i = 0; i < 256; i++) map.emplace(opcodes_[i].name, i);
+        return map;
+    }();
+    auto it = by_name.find(name);
+    return it != by_name.end() ? it->second : -1;
+}
+
 } // namespace dex
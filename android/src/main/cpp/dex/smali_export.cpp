@@ -0,0 +1,157 @@
+#include "dex/smali_export.h"
+#include "dex/dex_session.h"
+#include "dex/thread_pool.h"
+#include "apk/zip_utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include <sys/stat.h>
+
+namespace dex {
+
+// "Lcom/example/Foo;" -> "com/example/Foo.smali"; empty for descriptors that could escape the output
+static std::string smali_path(std::string_view descriptor) {
+    if (descriptor.size() < 3 || descriptor.front() != 'L' || descriptor.back() != ';') return {};
+    std::string_view path = descriptor.substr(1, descriptor.size() - 2);
+
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        size_t slash = path.find('/', pos);
+        if (slash == std::string_view::npos) slash = path.size();
+        std::string_view segment = path.substr(pos, slash - pos);
+        if (segment.empty() || segment == "." || segment == "..") return {};
+        pos = slash + 1;
+    }
+    return std::string(path) + ".smali";
+}
+
+// Create every missing parent directory of `path`; `created` caches directories known to exist
+static bool make_parent_dirs(const std::string& path, std::unordered_set<std::string>& created,
+                             std::mutex& mutex) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos || slash == 0) return true;
+    std::string dir = path.substr(0, slash);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (created.count(dir)) return true;
+    for (size_t pos = 1; pos <= dir.size(); pos++) {
+        if (pos != dir.size() && dir[pos] != '/') continue;
+        std::string prefix = dir.substr(0, pos);
+        if (created.count(prefix)) continue;
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        created.insert(prefix);
+    }
+    return true;
+}
+
+static bool write_file(const std::string& path, const std::string& content) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    char buffer[64 * 1024];
+    std::setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+    bool ok = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+bool export_smali(const DexSession& session, const std::string& output, bool zip,
+                  const ExportProgress& progress, ExportStats& stats, std::string& error) {
+    const DexParser& parser = session.parser();
+    size_t total = parser.classes().size();
+    stats = ExportStats();
+
+    std::string root = output;
+    while (root.size() > 1 && root.back() == '/') root.pop_back();
+
+    apk::ZipStreamWriter writer;
+    std::unordered_set<std::string> created_dirs;
+    std::mutex dirs_mutex;
+    if (zip) {
+        if (!make_parent_dirs(root, created_dirs, dirs_mutex) || !writer.open(root)) {
+            error = "Cannot create " + root;
+            return false;
+        }
+    } else if (!make_parent_dirs(root + "/", created_dirs, dirs_mutex)) {
+        error = "Cannot create " + root;
+        return false;
+    }
+
+    // Batches bound memory to a few hundred rendered classes and give progress/cancel points
+    size_t batch_size = std::max<size_t>(256, ThreadPool::shared()->size() * 32);
+    std::vector<std::string> paths(batch_size);
+    std::vector<apk::ZipStreamWriter::Prepared> entries(zip ? batch_size : 0);
+    std::vector<uint8_t> written(batch_size);
+
+    for (size_t begin = 0; begin < total; begin += batch_size) {
+        size_t count = std::min(batch_size, total - begin);
+        std::atomic<size_t> bytes{0};
+        std::atomic<bool> failed{false};
+        std::mutex error_mutex;
+
+        parallel_chunks(count, chunk_count(count, 8), [&](size_t, size_t chunk_begin, size_t chunk_end) {
+            std::string smali;
+            for (size_t i = chunk_begin; i < chunk_end; i++) {
+                written[i] = 0;
+                if (failed.load(std::memory_order_relaxed)) return;
+
+                uint32_t class_def_idx = static_cast<uint32_t>(begin + i);
+                paths[i] = smali_path(parser.type_descriptor(parser.classes()[class_def_idx].class_idx));
+                if (paths[i].empty() || !session.class_smali(class_def_idx, smali, true)) continue;
+                bytes += smali.size();
+
+                if (zip) {
+                    entries[i] = apk::ZipStreamWriter::prepare(
+                        paths[i], reinterpret_cast<const uint8_t*>(smali.data()), smali.size());
+                } else {
+                    std::string path = root + "/" + paths[i];
+                    if (!make_parent_dirs(path, created_dirs, dirs_mutex) || !write_file(path, smali)) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!failed.exchange(true)) error = "Cannot write " + path;
+                        return;
+                    }
+                }
+                written[i] = 1;
+            }
+        });
+        if (failed) return false;
+
+        // ZIP entries go out in class_def order regardless of which thread rendered them
+        for (size_t i = 0; i < count; i++) {
+            if (!written[i]) {
+                stats.skipped++;
+                continue;
+            }
+            if (zip && !writer.write(entries[i])) {
+                error = "Cannot write " + root;
+                writer.abort();
+                std::remove(root.c_str());
+                return false;
+            }
+            if (zip) entries[i] = apk::ZipStreamWriter::Prepared();
+            stats.classes++;
+        }
+        stats.bytes += bytes;
+
+        if (progress && !progress(begin + count, total)) {
+            stats.cancelled = true;
+            break;
+        }
+    }
+
+    if (zip) {
+        if (stats.cancelled) {
+            writer.abort();
+            std::remove(root.c_str());
+        } else if (!writer.finish()) {
+            error = "Cannot write " + root;
+            std::remove(root.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace dex
@@ -0,0 +1,629 @@
+#include "dex/smali_parser.h"
+#include "dex/smali_disasm.h"
+#include "dex/thread_pool.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace dex {
+
+static std::string_view trim(std::string_view s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos) return {};
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+static bool starts_with(std::string_view s, std::string_view prefix) {
+    return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+static void split_words(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    size_t pos = 0;
+    while (true) {
+        pos = text.find_first_not_of(" \t", pos);
+        if (pos == std::string_view::npos) break;
+        size_t end = text.find_first_of(" \t", pos);
+        if (end == std::string_view::npos) end = text.size();
+        words.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+}
+
+static void write_uleb128(std::vector<uint8_t>& out, uint32_t value) {
+    do {
+        uint8_t b = value & 0x7f;
+        value >>= 7;
+        if (value != 0) b |= 0x80;
+        out.push_back(b);
+    } while (value != 0);
+}
+
+// encoded_value: header byte, then the low `size` bytes of `bits`
+static void put_value(std::vector<uint8_t>& out, uint8_t type, uint64_t bits, uint32_t size) {
+    out.push_back(static_cast<uint8_t>(((size - 1) << 5) | type));
+    for (uint32_t i = 0; i < size; i++) out.push_back(static_cast<uint8_t>(bits >> (i * 8)));
+}
+
+// Integers are sign-extended from the fewest bytes that hold them
+static void put_signed(std::vector<uint8_t>& out, uint8_t type, int64_t value) {
+    uint32_t size = 1;
+    while (size < 8 && (value < -(int64_t(1) << (size * 8 - 1)) || value >= (int64_t(1) << (size * 8 - 1)))) size++;
+    put_value(out, type, static_cast<uint64_t>(value), size);
+}
+
+// Chars and pool indexes are zero-extended
+static void put_unsigned(std::vector<uint8_t>& out, uint8_t type, uint64_t value) {
+    uint32_t size = 1;
+    while (size < 8 && (value >> (size * 8)) != 0) size++;
+    put_value(out, type, value, size);
+}
+
+// Floating point values are zero-extended to the right, so only the high non-zero bytes are kept
+static void put_floating(std::vector<uint8_t>& out, uint8_t type, uint64_t bits, uint32_t width) {
+    while (width > 1 && (bits & 0xff) == 0) {
+        bits >>= 8;
+        width--;
+    }
+    put_value(out, type, bits, width);
+}
+
+static void put_float(std::vector<uint8_t>& out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_floating(out, 0x10, bits, 4);
+}
+
+static void put_double(std::vector<uint8_t>& out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_floating(out, 0x11, bits, 8);
+}
+
+// Text cursor for values and annotations, which may span lines
+struct SmaliParser::Cursor {
+    const char* pos;
+    const char* end;
+
+    // Spaces on this line only
+    void skip_blank() {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) pos++;
+    }
+    // Whitespace, line breaks and '#' comments
+    void skip_space() {
+        while (pos < end) {
+            if (*pos == '#') {
+                while (pos < end && *pos != '\n') pos++;
+            } else if (std::strchr(" \t\r\n", *pos)) {
+                pos++;
+            } else {
+                break;
+            }
+        }
+    }
+    bool consume(char c) {
+        skip_space();
+        if (pos < end && *pos == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+    bool at(std::string_view text) {
+        skip_space();
+        return static_cast<size_t>(end - pos) >= text.size() && std::string_view(pos, text.size()) == text;
+    }
+    std::string_view rest() const { return std::string_view(pos, end - pos); }
+    // Run up to whitespace, a separator or a comment
+    std::string_view token() {
+        skip_space();
+        const char* start = pos;
+        while (pos < end && !std::strchr(" \t\r\n,{}=#", *pos)) pos++;
+        return std::string_view(start, pos - start);
+    }
+};
+
+uint32_t SmaliParser::line_number(const char* at) const {
+    size_t offset = std::min(static_cast<size_t>(at - source_.data()), source_.size());
+    return 1 + static_cast<uint32_t>(std::count(source_.begin(), source_.begin() + offset, '\n'));
+}
+
+bool SmaliParser::fail(const char* at, const std::string& message, std::string& error) const {
+    error = "Line " + std::to_string(line_number(at)) + ": " + message;
+    return false;
+}
+
+bool SmaliParser::parse(std::string_view smali, std::string& error) {
+    source_ = smali;
+    lines_.clear();
+    class_name_.clear();
+    uint32_t number = 1;
+    for (size_t start = 0; start <= smali.size(); number++) {
+        size_t end = smali.find('\n', start);
+        if (end == std::string_view::npos) end = smali.size();
+        lines_.push_back({smali.substr(start, end - start), number});
+        start = end + 1;
+    }
+
+    // Built aside and moved into the builder once the whole class parsed
+    ClassBuilder cls("");
+    cls.super_class.clear();
+    std::vector<std::string_view> words;
+    for (size_t line = 0; line < lines_.size(); line++) {
+        std::string_view text = SmaliAssembler::strip_comment(lines_[line].text);
+        if (text.empty()) continue;
+        const char* at = lines_[line].text.data();
+        split_words(text, words);
+        std::string_view directive = words[0];
+
+        if (class_name_.empty() && directive != ".class") return fail(at, "Expected .class", error);
+        if (directive == ".class") {
+            if (!class_name_.empty()) return fail(at, "Duplicate .class", error);
+            std::string_view descriptor = words.back();
+            if (words.size() < 2 || descriptor.size() < 3 || descriptor.front() != 'L' || descriptor.back() != ';') {
+                return fail(at, "Invalid class descriptor", error);
+            }
+            uint32_t flags = 0;
+            for (size_t i = 1; i + 1 < words.size(); i++) {
+                uint32_t flag;
+                if (!SmaliDisassembler::access_flag_by_name(words[i], flag)) {
+                    return fail(at, "Unknown access flag: " + std::string(words[i]), error);
+                }
+                flags |= flag;
+            }
+            class_name_ = std::string(descriptor);
+            cls.class_name = class_name_;
+            cls.access_flags = flags;
+        } else if (directive == ".super") {
+            if (words.size() != 2) return fail(at, "Invalid .super", error);
+            cls.super_class = std::string(words[1]);
+        } else if (directive == ".implements") {
+            if (words.size() != 2) return fail(at, "Invalid .implements", error);
+            cls.interfaces.emplace_back(words[1]);
+        } else if (directive == ".source") {
+            if (!SmaliAssembler::parse_string_literal(trim(text.substr(7)), cls.source_file)) {
+                return fail(at, "Invalid .source", error);
+            }
+        } else if (directive == ".annotation") {
+            AnnotationDef annotation;
+            if (!parse_annotation(line, annotation, error)) return false;
+            cls.annotations.push_back(std::move(annotation));
+        } else if (directive == ".field") {
+            if (!parse_field(line, cls, error)) return false;
+        } else if (directive == ".method") {
+            if (!parse_method(line, cls, error)) return false;
+        } else {
+            return fail(at, "Unexpected " + std::string(directive), error);
+        }
+    }
+    if (class_name_.empty()) return fail(source_.data() + source_.size(), "Missing .class", error);
+
+    builder_.make_class(class_name_) = std::move(cls);
+    return true;
+}
+
+bool SmaliParser::parse_field(size_t& line, ClassBuilder& cls, std::string& error) {
+    // .field <flags> name:Type [= value]
+    Cursor cursor{lines_[line].text.data(), source_.data() + source_.size()};
+    const char* at = cursor.pos;
+    cursor.token();
+    FieldDef field{};
+    while (true) {
+        cursor.skip_blank();
+        std::string_view word = cursor.token();
+        if (word.empty()) return fail(at, "Expected name:Type", error);
+        size_t colon = word.find(':');
+        if (colon != std::string_view::npos) {
+            field.name = std::string(word.substr(0, colon));
+            field.type = std::string(word.substr(colon + 1));
+            break;
+        }
+        uint32_t flag;
+        if (!SmaliDisassembler::access_flag_by_name(word, flag)) {
+            return fail(at, "Unknown access flag: " + std::string(word), error);
+        }
+        field.access_flags |= flag;
+    }
+    if (field.name.empty() || field.type.empty()) return fail(at, "Expected name:Type", error);
+
+    cursor.skip_blank();
+    if (cursor.pos < cursor.end && *cursor.pos == '=') {
+        cursor.pos++;
+        if (!(field.access_flags & ACC_STATIC)) return fail(at, "Only static fields have initial values", error);
+        if (!parse_value(cursor, field.type, field.initial_value, error)) return false;
+        while (line + 1 < lines_.size() && lines_[line + 1].text.data() <= cursor.pos) line++;
+    }
+
+    // Annotations closed by .end field belong to the field; without it they are class annotations, as in smali
+    size_t next = line + 1;
+    for (; next < lines_.size(); next++) {
+        std::string_view text = SmaliAssembler::strip_comment(lines_[next].text);
+        if (text.empty()) continue;
+        if (!starts_with(text, ".annotation")) break;
+        while (next < lines_.size() && SmaliAssembler::strip_comment(lines_[next].text) != ".end annotation") next++;
+    }
+    if (next < lines_.size() && SmaliAssembler::strip_comment(lines_[next].text) == ".end field") {
+        for (line++; line < next; line++) {
+            if (SmaliAssembler::strip_comment(lines_[line].text).empty()) continue;
+            AnnotationDef annotation;
+            if (!parse_annotation(line, annotation, error)) return false;
+            field.annotations.push_back(std::move(annotation));
+        }
+    }
+
+    auto& fields = (field.access_flags & ACC_STATIC) ? cls.static_fields : cls.instance_fields;
+    fields.push_back(std::move(field));
+    return true;
+}
+
+bool SmaliParser::parse_method(size_t& line, ClassBuilder& cls, std::string& error) {
+    // .method <flags> name(params)Return
+    const char* at = lines_[line].text.data();
+    std::vector<std::string_view> words;
+    split_words(SmaliAssembler::strip_comment(lines_[line].text), words);
+    MethodDef method{};
+    std::string_view signature = words.back();
+    size_t paren = signature.find('(');
+    if (words.size() < 2 || paren == std::string_view::npos || paren == 0 ||
+        !Prototype::parse(std::string(signature.substr(paren)), method.prototype)) {
+        return fail(at, "Invalid method signature", error);
+    }
+    method.name = std::string(signature.substr(0, paren));
+    for (size_t i = 1; i + 1 < words.size(); i++) {
+        uint32_t flag;
+        if (!SmaliDisassembler::access_flag_by_name(words[i], flag)) {
+            return fail(at, "Unknown access flag: " + std::string(words[i]), error);
+        }
+        method.access_flags |= flag;
+    }
+    if (method.name == "<init>" || method.name == "<clinit>") method.access_flags |= ACC_CONSTRUCTOR;
+
+    size_t first = line + 1;
+    size_t last = first;
+    while (last < lines_.size() && SmaliAssembler::strip_comment(lines_[last].text) != ".end method") last++;
+    if (last == lines_.size()) return fail(at, "Missing .end method", error);
+
+    // Method and parameter annotations; a .param owns the annotations up to its .end param
+    uint32_t registers = 0;
+    uint32_t ins = SmaliAssembler::ins_size(method);
+    int next_parameter = 0;
+    int parameter = -1;
+    bool has_code = false;
+    for (size_t i = first; i < last; i++) {
+        std::string_view text = SmaliAssembler::strip_comment(lines_[i].text);
+        if (text.empty() || text[0] == ':') continue;
+        std::string_view directive = text.substr(0, text.find_first_of(" \t"));
+        std::string_view args = trim(text.substr(directive.size()));
+        if (directive == ".registers" || directive == ".locals") {
+            int64_t count = 0;
+            SmaliAssembler::parse_literal(args, count);
+            registers = static_cast<uint32_t>(count) + (directive == ".locals" ? ins : 0);
+        } else if (directive == ".param" || directive == ".parameter") {
+            int index = next_parameter;
+            if (directive == ".param") {
+                std::string_view reg = trim(args.substr(0, args.find(',')));
+                uint32_t num = 0;
+                auto res = std::from_chars(reg.data() + std::min<size_t>(1, reg.size()), reg.data() + reg.size(), num);
+                if (reg.empty() || (reg[0] != 'p' && reg[0] != 'v') || res.ptr != reg.data() + reg.size()) {
+                    return fail(lines_[i].text.data(), "Invalid register: " + std::string(reg), error);
+                }
+                if (reg[0] == 'v') num -= registers - ins;
+                index = SmaliAssembler::parameter_index(method, num);
+                if (index < 0) return fail(lines_[i].text.data(), "Not a parameter register: " + std::string(reg), error);
+            }
+            next_parameter = index + 1;
+
+            // Only a .param closed by .end param (after its annotations) opens a block
+            parameter = -1;
+            for (size_t j = i + 1; j < last; j++) {
+                std::string_view next = SmaliAssembler::strip_comment(lines_[j].text);
+                if (next.empty()) continue;
+                if (starts_with(next, ".annotation")) {
+                    while (j < last && SmaliAssembler::strip_comment(lines_[j].text) != ".end annotation") j++;
+                    continue;
+                }
+                if (next == ".end param" || next == ".end parameter") parameter = index;
+                break;
+            }
+        } else if (directive == ".end" && (args == "param" || args == "parameter")) {
+            parameter = -1;
+        } else if (directive == ".annotation") {
+            AnnotationDef annotation;
+            if (!parse_annotation(i, annotation, error)) return false;
+            if (parameter < 0) {
+                method.annotations.push_back(std::move(annotation));
+            } else {
+                if (method.parameter_annotations.size() <= static_cast<size_t>(parameter)) {
+                    method.parameter_annotations.resize(parameter + 1);
+                }
+                method.parameter_annotations[parameter].push_back(std::move(annotation));
+            }
+        } else if (directive[0] != '.') {
+            has_code = true;
+        }
+    }
+
+    if (method.access_flags & (ACC_ABSTRACT | ACC_NATIVE)) {
+        if (has_code) return fail(at, "Abstract and native methods have no code", error);
+    } else {
+        std::vector<SmaliLine> body(lines_.begin() + first, lines_.begin() + last);
+        if (!assembler_.assemble_method(body, method, error)) return false;
+        if (method.code.empty()) return fail(at, "Method " + method.name + " has no code", error);
+    }
+    method.code_off = 0;
+
+    cls.add_method(method);
+    line = last;
+    return true;
+}
+
+bool SmaliParser::parse_annotation(size_t& line, AnnotationDef& annotation, std::string& error) {
+    // .annotation <visibility> Ltype; <elements> .end annotation
+    Cursor cursor{lines_[line].text.data(), source_.data() + source_.size()};
+    const char* at = cursor.pos;
+    cursor.token();
+    std::string_view visibility = cursor.token();
+    if (visibility == "build") {
+        annotation.visibility = VISIBILITY_BUILD;
+    } else if (visibility == "runtime") {
+        annotation.visibility = VISIBILITY_RUNTIME;
+    } else if (visibility == "system") {
+        annotation.visibility = VISIBILITY_SYSTEM;
+    } else {
+        return fail(at, "Unknown annotation visibility: " + std::string(visibility), error);
+    }
+    std::string_view type = cursor.token();
+    if (type.size() < 3 || type.front() != 'L' || type.back() != ';') return fail(at, "Invalid annotation type", error);
+
+    annotation.type_idx = builder_.get_or_add_type(std::string(type));
+    annotation.encoded.clear();
+    write_uleb128(annotation.encoded, annotation.type_idx);
+    if (!parse_annotation_elements(cursor, ".end annotation", annotation.encoded, error)) return false;
+    while (line + 1 < lines_.size() && lines_[line + 1].text.data() <= cursor.pos) line++;
+    return true;
+}
+
+bool SmaliParser::parse_annotation_elements(Cursor& cursor, std::string_view end_directive,
+                                            std::vector<uint8_t>& out, std::string& error) {
+    // Elements are sorted by name string index
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> elements;
+    while (!cursor.at(end_directive)) {
+        const char* at = cursor.pos;
+        std::string_view name = cursor.token();
+        if (name.empty() || name[0] == '.') {
+            return fail(at, cursor.pos >= cursor.end ? "Missing " + std::string(end_directive)
+                                                     : "Expected an element name", error);
+        }
+        if (!cursor.consume('=')) return fail(at, "Expected '=' after " + std::string(name), error);
+        std::vector<uint8_t> value;
+        if (!parse_value(cursor, {}, value, error)) return false;
+        elements.emplace_back(builder_.get_or_add_string(std::string(name)), std::move(value));
+    }
+    cursor.pos += end_directive.size();
+
+    std::stable_sort(elements.begin(), elements.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    write_uleb128(out, static_cast<uint32_t>(elements.size()));
+    for (const auto& element : elements) {
+        write_uleb128(out, element.first);
+        out.insert(out.end(), element.second.begin(), element.second.end());
+    }
+    return true;
+}
+
+bool SmaliParser::parse_value(Cursor& cursor, std::string_view type, std::vector<uint8_t>& out,
+                              std::string& error) {
+    cursor.skip_space();
+    const char* at = cursor.pos;
+    if (cursor.pos >= cursor.end) return fail(at, "Expected a value", error);
+
+    if (*cursor.pos == '{') {
+        cursor.pos++;
+        std::string_view component = !type.empty() && type[0] == '[' ? type.substr(1) : std::string_view();
+        std::vector<uint8_t> values;
+        uint32_t count = 0;
+        while (!cursor.consume('}')) {
+            if (cursor.pos >= cursor.end) return fail(at, "Unterminated array", error);
+            if (!parse_value(cursor, component, values, error)) return false;
+            count++;
+            if (!cursor.consume(',') && !cursor.at("}")) return fail(cursor.pos, "Expected ',' or '}'", error);
+        }
+        out.push_back(0x1c);
+        write_uleb128(out, count);
+        out.insert(out.end(), values.begin(), values.end());
+        return true;
+    }
+
+    if (*cursor.pos == '"') {
+        std::string value;
+        size_t end = 0;
+        if (!SmaliAssembler::parse_string_literal(cursor.rest(), value, &end)) return fail(at, "Invalid string", error);
+        cursor.pos += end;
+        put_unsigned(out, 0x17, builder_.get_or_add_string(value));
+        return true;
+    }
+
+    if (*cursor.pos == '\'') {
+        // 'c', '\n' or '\uXXXX'; other characters are UTF-8 in the source
+        std::string_view rest = cursor.rest();
+        size_t close = rest.find('\'', rest.size() > 1 && rest[1] == '\\' ? 3 : 2);
+        if (close == std::string_view::npos) return fail(at, "Invalid char literal", error);
+        std::string quoted = "\"" + std::string(rest.substr(1, close - 1)) + "\"";
+        std::string value;
+        if (rest[1] == '"') quoted = "\"\\\"\"";
+        if (!SmaliAssembler::parse_string_literal(quoted, value) || value.empty()) {
+            return fail(at, "Invalid char literal", error);
+        }
+        // Decode the single MUTF-8 character back to its UTF-16 unit
+        uint32_t c = static_cast<uint8_t>(value[0]);
+        if (c >= 0xE0 && value.size() >= 3) {
+            c = ((c & 0x0F) << 12) | ((value[1] & 0x3F) << 6) | (value[2] & 0x3F);
+        } else if (c >= 0xC0 && value.size() >= 2) {
+            c = ((c & 0x1F) << 6) | (value[1] & 0x3F);
+        }
+        cursor.pos += close + 1;
+        put_unsigned(out, 0x03, c & 0xFFFF);
+        return true;
+    }
+
+    if (cursor.at(".subannotation")) {
+        cursor.pos += 14;
+        std::string_view annotation_type = cursor.token();
+        if (annotation_type.size() < 3 || annotation_type.front() != 'L') {
+            return fail(at, "Invalid subannotation type", error);
+        }
+        out.push_back(0x1d);
+        write_uleb128(out, builder_.get_or_add_type(std::string(annotation_type)));
+        return parse_annotation_elements(cursor, ".end subannotation", out, error);
+    }
+
+    std::string_view token = cursor.token();
+    if (token == ".enum") {
+        token = cursor.token();
+        type = {};
+        size_t arrow = token.find("->");
+        size_t colon = token.find(':', arrow == std::string_view::npos ? 0 : arrow);
+        if (arrow == std::string_view::npos || colon == std::string_view::npos) {
+            return fail(at, "Invalid enum value: " + std::string(token), error);
+        }
+        put_unsigned(out, 0x1b, builder_.get_or_add_field(std::string(token.substr(0, arrow)),
+                                                          std::string(token.substr(arrow + 2, colon - arrow - 2)),
+                                                          std::string(token.substr(colon + 1))));
+        return true;
+    }
+    if (token == "null") {
+        out.push_back(0x1e);
+        return true;
+    }
+    if (token == "true" || token == "false") {
+        out.push_back(static_cast<uint8_t>(((token == "true" ? 1 : 0) << 5) | 0x1f));
+        return true;
+    }
+
+    // Explicit pool indexes, as rendered for entries the disassembler could not resolve
+    size_t at_sign = token.find('@');
+    if (at_sign != std::string_view::npos) {
+        static const std::pair<std::string_view, uint8_t> kIndexKinds[] = {
+            {"proto", 0x15}, {"method-handle", 0x16}, {"method_handle", 0x16}, {"string", 0x17},
+            {"type", 0x18},  {"field", 0x19},         {"method", 0x1a},
+        };
+        std::string_view kind = token.substr(0, at_sign);
+        std::string_view digits = token.substr(at_sign + 1);
+        uint32_t idx;
+        auto res = std::from_chars(digits.data(), digits.data() + digits.size(), idx);
+        for (const auto& entry : kIndexKinds) {
+            if (entry.first == kind && res.ec == std::errc() && res.ptr == digits.data() + digits.size()) {
+                put_unsigned(out, entry.second, idx);
+                return true;
+            }
+        }
+        return fail(at, "Invalid index value: " + std::string(token), error);
+    }
+
+    if (token[0] == '(') {
+        Prototype proto;
+        if (!Prototype::parse(std::string(token), proto)) return fail(at, "Invalid prototype: " + std::string(token), error);
+        put_unsigned(out, 0x15, builder_.get_or_add_proto(proto));
+        return true;
+    }
+
+    // Type, field or method reference
+    bool reference = token[0] == 'L' || token[0] == '[' || (token.size() == 1 && std::strchr("VZBSCIJFD", token[0]));
+    if (reference) {
+        size_t arrow = token.find("->");
+        if (arrow == std::string_view::npos) {
+            put_unsigned(out, 0x18, builder_.get_or_add_type(std::string(token)));
+            return true;
+        }
+        std::string owner(token.substr(0, arrow));
+        std::string_view member = token.substr(arrow + 2);
+        size_t paren = member.find('(');
+        if (paren != std::string_view::npos) {
+            Prototype proto;
+            if (paren == 0 || !Prototype::parse(std::string(member.substr(paren)), proto)) {
+                return fail(at, "Invalid method reference: " + std::string(token), error);
+            }
+            put_unsigned(out, 0x1a, builder_.get_or_add_method(owner, std::string(member.substr(0, paren)), proto));
+            return true;
+        }
+        size_t colon = member.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            return fail(at, "Invalid field reference: " + std::string(token), error);
+        }
+        put_unsigned(out, 0x19, builder_.get_or_add_field(owner, std::string(member.substr(0, colon)),
+                                                          std::string(member.substr(colon + 1))));
+        return true;
+    }
+
+    // Numbers: an integer suffix (t, s, L) or floating point form picks the type, else the declared type does
+    std::string_view digits = token;
+    if (digits[0] == '-' || digits[0] == '+') digits.remove_prefix(1);
+    bool hex = starts_with(digits, "0x") || starts_with(digits, "0X");
+    char suffix = token.back();
+    bool is_float = !hex && (suffix == 'f' || suffix == 'F');
+    bool is_double = !hex && (suffix == 'd' || suffix == 'D');
+    std::string_view body = is_float || is_double ? digits.substr(0, digits.size() - 1) : digits;
+    if (is_float || is_double || (!hex && body.find_first_of(".eE") != std::string_view::npos) || body == "NaN" ||
+        body == "Infinity") {
+        std::string number = std::string(token.substr(0, token.size() - digits.size())) + std::string(body);
+        char* end = nullptr;
+        double value = std::strtod(number.c_str(), &end);
+        if (body.empty() || end != number.c_str() + number.size()) {
+            return fail(at, "Invalid number: " + std::string(token), error);
+        }
+        if (is_float || (!is_double && type == "F")) {
+            put_float(out, static_cast<float>(value));
+        } else {
+            put_double(out, value);
+        }
+        return true;
+    }
+
+    int64_t value;
+    if (!SmaliAssembler::parse_literal(token, value)) return fail(at, "Invalid value: " + std::string(token), error);
+    char kind = suffix == 't' || suffix == 'T' ? 'B'
+              : suffix == 's' || suffix == 'S' ? 'S'
+              : suffix == 'l' || suffix == 'L' ? 'J'
+              : type.size() == 1 ? type[0] : 'I';
+    switch (kind) {
+        case 'B': put_signed(out, 0x00, static_cast<int8_t>(value)); break;
+        case 'S': put_signed(out, 0x02, static_cast<int16_t>(value)); break;
+        case 'C': put_unsigned(out, 0x03, static_cast<uint16_t>(value)); break;
+        case 'J': put_signed(out, 0x06, value); break;
+        case 'F': put_float(out, static_cast<float>(value)); break;
+        case 'D': put_double(out, static_cast<double>(value)); break;
+        case 'Z': out.push_back(static_cast<uint8_t>(((value != 0) << 5) | 0x1f)); break;
+        default: put_signed(out, 0x04, static_cast<int32_t>(value)); break;
+    }
+    return true;
+}
+
+bool assemble_smali_classes(DexBuilder& builder, const std::vector<std::string>& sources, std::string& error) {
+    // Chunks keep per-thread pools small; their merge cost grows with the chunk count
+    size_t chunks = chunk_count(sources.size(), 32);
+    std::vector<DexBuilder> partials(chunks);
+    std::vector<std::string> errors(chunks);
+    std::vector<size_t> failed(chunks, sources.size());
+    parallel_chunks(sources.size(), chunks, [&](size_t chunk, size_t begin, size_t end) {
+        SmaliParser parser(partials[chunk]);
+        for (size_t i = begin; i < end; i++) {
+            if (!parser.parse(sources[i], errors[chunk])) {
+                failed[chunk] = i;
+                return;
+            }
+        }
+    });
+
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        if (failed[chunk] < sources.size()) {
+            error = "Source " + std::to_string(failed[chunk]) + ": " + errors[chunk];
+            return false;
+        }
+    }
+    return builder.merge(partials, error);
+}
+
+} // namespace dex
@@ -1,6 +1,7 @@
 #include "dex/smali_to_java.h"
 #include <regex>
 #include <algorithm>
+#include <cctype>
 
 namespace dex {
 
@@ -420,6 +421,71 @@ std::string SmaliToJava::convert_array(const std::string& line) {
     return "";
 }
 
+void SmaliToJava::record_debug_name(const std::string& directive) {
+    // .param v3, "count"    # I
+    // .local v0, "value":I
+    // .end local v0    # "value":I
+    // .restart local v0    # "value":I
+    std::regex start_re(R"re(^\.(param|local)\s+([vp]\d+),\s*"((?:[^"\\]|\\.)*)")re");
+    std::regex end_re(R"(^\.end local\s+([vp]\d+))");
+    std::regex restart_re(R"re(^\.restart local\s+([vp]\d+)\s*#\s*"((?:[^"\\]|\\.)*)")re");
+    std::smatch match;
+    
+    if (std::regex_search(directive, match, start_re)) {
+        Register& reg = registers_[match[2].str()];
+        reg.value = match[3].str();
+        reg.is_param = match[1].str() == "param";
+    } else if (std::regex_search(directive, match, restart_re)) {
+        registers_[match[1].str()].value = match[2].str();
+    } else if (std::regex_search(directive, match, end_re)) {
+        auto it = registers_.find(match[1].str());
+        if (it != registers_.end() && !it->second.is_param) registers_.erase(it);
+    }
+}
+
+std::string SmaliToJava::apply_names(const std::string& line) const {
+    if (registers_.empty()) return line;
+    
+    auto is_word = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$'; };
+    std::string result;
+    result.reserve(line.size());
+    bool in_string = false;
+    for (size_t i = 0; i < line.size();) {
+        char c = line[i];
+        if (in_string) {
+            result += c;
+            if (c == '\\' && i + 1 < line.size()) result += line[++i];
+            else if (c == '"') in_string = false;
+            i++;
+            continue;
+        }
+        if (c == '"') {
+            in_string = true;
+            result += c;
+            i++;
+            continue;
+        }
+        
+        // Register token: v/p followed by digits, not part of a longer identifier
+        if ((c == 'v' || c == 'p') && (i == 0 || !is_word(line[i - 1])) &&
+            i + 1 < line.size() && std::isdigit(static_cast<unsigned char>(line[i + 1]))) {
+            size_t end = i + 1;
+            while (end < line.size() && std::isdigit(static_cast<unsigned char>(line[end]))) end++;
+            if (end == line.size() || !is_word(line[end])) {
+                auto it = registers_.find(line.substr(i, end - i));
+                if (it != registers_.end() && !it->second.value.empty()) {
+                    result += it->second.value;
+                    i = end;
+                    continue;
+                }
+            }
+        }
+        result += c;
+        i++;
+    }
+    return result;
+}
+
 std::string SmaliToJava::convert_instruction(const std::string& line) {
     std::string trimmed = trim(line);
     if (trimmed.empty() || trimmed[0] == '#') return "";
@@ -447,6 +513,10 @@ std::string SmaliToJava::convert_instruction(const std::string& line) {
         if (trimmed.find(".registers") == 0 || trimmed.find(".locals") == 0) {
             return get_indent() + "{";
         }
+        if (trimmed.find(".param") == 0 || trimmed.find(".local") == 0 ||
+            trimmed.find(".end local") == 0 || trimmed.find(".restart local") == 0) {
+            record_debug_name(trimmed);
+        }
         return "";
     }
     
@@ -511,7 +581,7 @@ std::string SmaliToJava::convert_method(const std::string& method_smali) {
     while (std::getline(ss, line)) {
         std::string converted = convert_instruction(line);
         if (!converted.empty()) {
-            result << converted << "\n";
+            result << apply_names(converted) << "\n";
         }
     }
     
@@ -527,10 +597,19 @@ std::string SmaliToJava::convert(const std::string& smali_code) {
     std::stringstream result;
     
     bool in_method = false;
+    bool has_body = false;
+    bool in_annotation = false;
     
     while (std::getline(ss, line)) {
         std::string trimmed = trim(line);
         
+        // Annotation blocks carry no code
+        if (trimmed.find(".annotation") == 0) in_annotation = true;
+        if (in_annotation) {
+            if (trimmed.find(".end annotation") == 0) in_annotation = false;
+            continue;
+        }
+        
         if (trimmed.find(".class") == 0) {
             // Extract class name
             size_t last_space = trimmed.rfind(' ');
@@ -554,12 +633,18 @@ std::string SmaliToJava::convert(const std::string& smali_code) {
         
         if (trimmed.find(".method") == 0) {
             in_method = true;
+            has_body = false;
+            registers_.clear();
+        }
+        if (trimmed.find(".registers") == 0 || trimmed.find(".locals") == 0) {
+            has_body = true;
         }
         
-        if (in_method) {
+        // Abstract and native methods have no body to close
+        if (in_method && !(trimmed.find(".end method") == 0 && !has_body)) {
             std::string converted = convert_instruction(line);
             if (!converted.empty()) {
-                result << converted << "\n";
+                result << apply_names(converted) << "\n";
             }
         }
         
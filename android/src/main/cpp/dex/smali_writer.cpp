@@ -0,0 +1,59 @@
+#include "dex/smali_writer.h"
+#include <charconv>
+
+namespace dex {
+
+SmaliWriter& SmaliWriter::decimal(int64_t number) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), number);
+    out_.append(buf, res.ptr - buf);
+    return *this;
+}
+
+SmaliWriter& SmaliWriter::decimal(uint64_t number) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), number);
+    out_.append(buf, res.ptr - buf);
+    return *this;
+}
+
+SmaliWriter& SmaliWriter::hex(int64_t number, std::string_view suffix) {
+    uint64_t magnitude = number < 0 ? 0 - static_cast<uint64_t>(number) : static_cast<uint64_t>(number);
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), magnitude, 16);
+    if (number < 0) out_ += '-';
+    out_ += "0x";
+    out_.append(buf, res.ptr - buf);
+    return append(suffix);
+}
+
+SmaliWriter& SmaliWriter::string_literal(std::string_view str) {
+    static const char kHex[] = "0123456789abcdef";
+    out_ += '"';
+    size_t run = 0;  // start of the pending run of bytes that need no escape
+    for (size_t i = 0; i < str.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x20 && c != '"' && c != '\\' && c != '\'' && c != 0x7f) continue;
+
+        out_.append(str.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '\n': out_ += "\\n"; break;
+            case '\r': out_ += "\\r"; break;
+            case '\t': out_ += "\\t"; break;
+            case '"':  out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\'': out_ += "\\'"; break;
+            default: {
+                char esc[] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+                out_.append(esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+    out_.append(str.data() + run, str.size() - run);
+    out_ += '"';
+    return *this;
+}
+
+} // namespace dex
@@ -0,0 +1,162 @@
+#include "dex/string_table.h"
+#include "dex/dex_parser.h"
+#include <cstring>
+
+namespace dex {
+
+std::string decode_mutf8(const uint8_t* data, size_t size) {
+    std::string out;
+    out.reserve(size);
+
+    size_t i = 0;
+    while (i < size) {
+        uint8_t b = data[i];
+
+        // Embedded NUL is encoded as C0 80
+        if (b == 0xC0 && i + 1 < size && data[i + 1] == 0x80) {
+            out.push_back('\0');
+            i += 2;
+            continue;
+        }
+
+        // Supplementary characters are stored as a CESU-8 surrogate pair (ED Ax xx ED Bx xx)
+        if (b == 0xED && i + 5 < size &&
+            (data[i + 1] & 0xF0) == 0xA0 && data[i + 3] == 0xED && (data[i + 4] & 0xF0) == 0xB0) {
+            uint32_t high = 0xD000 | ((data[i + 1] & 0x3F) << 6) | (data[i + 2] & 0x3F);
+            uint32_t low = 0xD000 | ((data[i + 4] & 0x3F) << 6) | (data[i + 5] & 0x3F);
+            uint32_t cp = 0x10000 + ((high - 0xD800) << 10) + (low - 0xDC00);
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            i += 6;
+            continue;
+        }
+
+        out.push_back(static_cast<char>(b));
+        i++;
+    }
+
+    return out;
+}
+
+namespace {
+
+// UTF-16 code units of a UTF-8 or MUTF-8 string; stray bytes are taken as they are
+struct Utf16Units {
+    const unsigned char* p;
+    const unsigned char* end;
+    uint32_t low = 0;  // pending low surrogate of a 4-byte UTF-8 sequence
+
+    explicit Utf16Units(std::string_view s)
+        : p(reinterpret_cast<const unsigned char*>(s.data())), end(p + s.size()) {}
+
+    bool done() const { return p == end && low == 0; }
+
+    uint32_t next() {
+        if (low != 0) {
+            uint32_t unit = low;
+            low = 0;
+            return unit;
+        }
+        unsigned char c = *p++;
+        if ((c & 0xE0) == 0xC0 && p < end) return ((c & 0x1F) << 6) | (*p++ & 0x3F);  // C0 80 is NUL
+        if ((c & 0xF0) == 0xE0 && end - p >= 2) {
+            uint32_t unit = ((c & 0x0F) << 12) | ((p[0] & 0x3F) << 6) | (p[1] & 0x3F);
+            p += 2;
+            return unit;
+        }
+        if ((c & 0xF8) == 0xF0 && end - p >= 3) {
+            uint32_t cp = ((c & 0x07) << 18) | ((p[0] & 0x3F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+            p += 3;
+            cp -= 0x10000;
+            low = 0xDC00 | (cp & 0x3FF);
+            return 0xD800 | ((cp >> 10) & 0x3FF);
+        }
+        return c;
+    }
+};
+
+} // namespace
+
+int compare_utf16(std::string_view a, std::string_view b) {
+    Utf16Units ua(a), ub(b);
+    while (!ua.done() && !ub.done()) {
+        uint32_t x = ua.next();
+        uint32_t y = ub.next();
+        if (x != y) return x < y ? -1 : 1;
+    }
+    return ua.done() ? (ub.done() ? 0 : -1) : 1;
+}
+
+void StringTable::reset(const ByteView& data, uint32_t ids_off, uint32_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    data_ = data.data();
+    data_size_ = data.size();
+    ids_off_ = ids_off;
+    count_ = count;
+    cache_.clear();
+    cache_.resize(count);
+    ready_.reset(new std::atomic<bool>[count]);
+    for (uint32_t i = 0; i < count; i++) {
+        ready_[i].store(false, std::memory_order_relaxed);
+    }
+    all_ready_.store(false, std::memory_order_relaxed);
+}
+
+std::string_view StringTable::raw(uint32_t idx) const {
+    if (idx >= count_) return {};
+
+    size_t id_off = ids_off_ + static_cast<size_t>(idx) * 4;
+    if (id_off + 4 > data_size_) return {};
+    uint32_t off = data_[id_off] | (data_[id_off + 1] << 8) |
+                   (data_[id_off + 2] << 16) | (static_cast<uint32_t>(data_[id_off + 3]) << 24);
+
+    // Skip the utf16_size uleb128; the payload is NUL-terminated and contains no other zero bytes
+    size_t pos = off;
+    while (pos < data_size_ && (data_[pos] & 0x80)) pos++;
+    pos++;
+    if (pos >= data_size_) return {};
+
+    const void* end = std::memchr(data_ + pos, 0, data_size_ - pos);
+    size_t len = end ? static_cast<const uint8_t*>(end) - (data_ + pos) : data_size_ - pos;
+    return std::string_view(reinterpret_cast<const char*>(data_ + pos), len);
+}
+
+void StringTable::decode_locked(uint32_t idx) const {
+    if (ready_[idx].load(std::memory_order_relaxed)) return;
+    std::string_view bytes = raw(idx);
+    cache_[idx] = decode_mutf8(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+    ready_[idx].store(true, std::memory_order_release);
+}
+
+const std::string& StringTable::get(uint32_t idx) const {
+    static const std::string empty;
+    if (idx >= count_) return empty;
+
+    if (!ready_[idx].load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        decode_locked(idx);
+    }
+    return cache_[idx];
+}
+
+void StringTable::prefetch(uint32_t begin, uint32_t end) const {
+    if (end > count_) end = count_;
+    if (begin >= end) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t i = begin; i < end; i++) {
+        decode_locked(i);
+    }
+}
+
+const std::vector<std::string>& StringTable::all() const {
+    if (!all_ready_.load(std::memory_order_acquire)) {
+        prefetch(0, count_);
+        all_ready_.store(true, std::memory_order_release);
+    }
+    return cache_;
+}
+
+} // namespace dex
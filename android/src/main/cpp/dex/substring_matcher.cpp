@@ -0,0 +1,191 @@
+#include "dex/substring_matcher.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DEX_HAVE_AVX2_DISPATCH 1
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace dex {
+
+using Filter = SubstringMatcher::Filter;
+
+static uint8_t ascii_lower(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+static uint8_t ascii_upper(uint8_t c) {
+    return (c >= 'a' && c <= 'z') ? static_cast<uint8_t>(c - ('a' - 'A')) : c;
+}
+
+// Compare the needle bytes between the first and the last, which the filter already matched
+static bool verify(const Filter& f, const char* p) {
+    if (f.size <= 2) return true;
+    if (f.case_sensitive) return std::memcmp(p + 1, f.needle + 1, f.size - 2) == 0;
+    for (size_t j = 1; j + 1 < f.size; j++) {
+        if (ascii_lower(static_cast<uint8_t>(p[j])) != static_cast<uint8_t>(f.needle[j])) return false;
+    }
+    return true;
+}
+
+static bool filter_byte(uint8_t c, uint8_t lower, uint8_t upper) {
+    return c == lower || c == upper;
+}
+
+static bool scan_scalar(const Filter& f, const char* text, size_t pos, size_t last_start) {
+    const size_t tail = f.size - 1;
+    for (; pos <= last_start; pos++) {
+        if (filter_byte(static_cast<uint8_t>(text[pos]), f.first_lower, f.first_upper) &&
+            filter_byte(static_cast<uint8_t>(text[pos + tail]), f.last_lower, f.last_upper) &&
+            verify(f, text + pos)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Each vector scanner tests 16/32 start positions per step: a position is a candidate when both
+// its first and its last needle byte match the filter, and only candidates are verified.
+// Loads stay below `avail`; candidate bits past `last_start` are masked off.
+// On return `pos` is the first start position not yet examined.
+
+#if defined(__SSE2__)
+
+static bool scan_sse2(const Filter& f, const char* text, size_t last_start, size_t avail, size_t& pos) {
+    const size_t tail = f.size - 1;
+    const __m128i first_lo = _mm_set1_epi8(static_cast<char>(f.first_lower));
+    const __m128i first_up = _mm_set1_epi8(static_cast<char>(f.first_upper));
+    const __m128i last_lo = _mm_set1_epi8(static_cast<char>(f.last_lower));
+    const __m128i last_up = _mm_set1_epi8(static_cast<char>(f.last_upper));
+
+    for (; pos <= last_start && pos + tail + 16 <= avail; pos += 16) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+        __m128i end = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos + tail));
+        __m128i eq_first = _mm_or_si128(_mm_cmpeq_epi8(head, first_lo), _mm_cmpeq_epi8(head, first_up));
+        __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(end, last_lo), _mm_cmpeq_epi8(end, last_up));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(eq_first, eq_last)));
+        if (last_start - pos < 15) mask &= (2u << (last_start - pos)) - 1;
+        while (mask) {
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            if (verify(f, text + pos + bit)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return false;
+}
+
+#endif
+
+#if defined(DEX_HAVE_AVX2_DISPATCH)
+
+__attribute__((target("avx2")))
+static bool scan_avx2(const Filter& f, const char* text, size_t last_start, size_t avail, size_t& pos) {
+    const size_t tail = f.size - 1;
+    const __m256i first_lo = _mm256_set1_epi8(static_cast<char>(f.first_lower));
+    const __m256i first_up = _mm256_set1_epi8(static_cast<char>(f.first_upper));
+    const __m256i last_lo = _mm256_set1_epi8(static_cast<char>(f.last_lower));
+    const __m256i last_up = _mm256_set1_epi8(static_cast<char>(f.last_upper));
+
+    for (; pos <= last_start && pos + tail + 32 <= avail; pos += 32) {
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos));
+        __m256i end = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos + tail));
+        __m256i eq_first = _mm256_or_si256(_mm256_cmpeq_epi8(head, first_lo), _mm256_cmpeq_epi8(head, first_up));
+        __m256i eq_last = _mm256_or_si256(_mm256_cmpeq_epi8(end, last_lo), _mm256_cmpeq_epi8(end, last_up));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last)));
+        if (last_start - pos < 31) mask &= (2u << (last_start - pos)) - 1;
+        while (mask) {
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            if (verify(f, text + pos + bit)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return false;
+}
+
+static bool cpu_has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+
+static bool scan_neon(const Filter& f, const char* text, size_t last_start, size_t avail, size_t& pos) {
+    const size_t tail = f.size - 1;
+    const uint8x16_t first_lo = vdupq_n_u8(f.first_lower);
+    const uint8x16_t first_up = vdupq_n_u8(f.first_upper);
+    const uint8x16_t last_lo = vdupq_n_u8(f.last_lower);
+    const uint8x16_t last_up = vdupq_n_u8(f.last_upper);
+
+    for (; pos <= last_start && pos + tail + 16 <= avail; pos += 16) {
+        uint8x16_t head = vld1q_u8(reinterpret_cast<const uint8_t*>(text + pos));
+        uint8x16_t end = vld1q_u8(reinterpret_cast<const uint8_t*>(text + pos + tail));
+        uint8x16_t eq_first = vorrq_u8(vceqq_u8(head, first_lo), vceqq_u8(head, first_up));
+        uint8x16_t eq_last = vorrq_u8(vceqq_u8(end, last_lo), vceqq_u8(end, last_up));
+        // Narrow each 0x00/0xFF lane to a nibble: bit 4*k set <=> lane k matched
+        uint8x8_t packed = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(eq_first, eq_last)), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(packed), 0) & 0x1111111111111111ULL;
+        if (last_start - pos < 15) mask &= (1ULL << (4 * (last_start - pos + 1))) - 1;
+        while (mask) {
+            unsigned bit = static_cast<unsigned>(__builtin_ctzll(mask)) / 4;
+            if (verify(f, text + pos + bit)) return true;
+            mask &= mask - 1;
+        }
+    }
+    return false;
+}
+
+#endif
+
+SubstringMatcher::SubstringMatcher(std::string_view needle, bool case_sensitive)
+    : needle_(needle) {
+    if (!case_sensitive) {
+        for (char& c : needle_) c = static_cast<char>(ascii_lower(static_cast<uint8_t>(c)));
+    }
+
+    filter_.needle = needle_.data();
+    filter_.size = needle_.size();
+    filter_.case_sensitive = case_sensitive;
+    if (!needle_.empty()) {
+        uint8_t first = static_cast<uint8_t>(needle_.front());
+        uint8_t last = static_cast<uint8_t>(needle_.back());
+        filter_.first_lower = first;
+        filter_.last_lower = last;
+        filter_.first_upper = case_sensitive ? first : ascii_upper(first);
+        filter_.last_upper = case_sensitive ? last : ascii_upper(last);
+    } else {
+        filter_.first_lower = filter_.first_upper = 0;
+        filter_.last_lower = filter_.last_upper = 0;
+    }
+}
+
+bool SubstringMatcher::match(std::string_view text, const char* limit) const {
+    if (filter_.size == 0) return true;
+    if (text.size() < filter_.size) return false;
+
+    const char* data = text.data();
+    size_t last_start = text.size() - filter_.size;
+    size_t avail = (limit && limit > data + text.size()) ? static_cast<size_t>(limit - data) : text.size();
+    size_t pos = 0;
+
+#if defined(DEX_HAVE_AVX2_DISPATCH)
+    if (avail >= filter_.size + 31 && cpu_has_avx2()) {
+        if (scan_avx2(filter_, data, last_start, avail, pos)) return true;
+    }
+#endif
+#if defined(__SSE2__)
+    if (scan_sse2(filter_, data, last_start, avail, pos)) return true;
+#elif defined(__ARM_NEON)
+    if (scan_neon(filter_, data, last_start, avail, pos)) return true;
+#endif
+
+    return scan_scalar(filter_, data, pos, last_start);
+}
+
+} // namespace dex
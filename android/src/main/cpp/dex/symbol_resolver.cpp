@@ -0,0 +1,43 @@
+#include "dex/symbol_resolver.h"
+#include "dex/dex_parser.h"
+
+namespace dex {
+
+const std::string* DexSymbolResolver::signature(SymbolKind kind, uint32_t idx) const {
+    std::call_once(slots_once_, [this]() {
+        for (Signatures* table : {&methods_, &fields_}) {
+            uint32_t count = table == &methods_ ? parser_.header().method_ids_size : parser_.header().field_ids_size;
+            table->cache.resize(count);
+            table->ready.reset(new std::atomic<bool>[count]);
+            for (uint32_t i = 0; i < count; i++) table->ready[i].store(false, std::memory_order_relaxed);
+        }
+    });
+    Signatures& table = kind == SymbolKind::kMethod ? methods_ : fields_;
+    if (idx >= table.cache.size()) return nullptr;
+
+    if (!table.ready[idx].load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!table.ready[idx].load(std::memory_order_relaxed)) {
+            table.cache[idx] = kind == SymbolKind::kMethod ? parser_.get_full_method_signature(idx)
+                                                           : parser_.get_full_field_signature(idx);
+            table.ready[idx].store(true, std::memory_order_release);
+        }
+    }
+    return &table.cache[idx];
+}
+
+const std::string* DexSymbolResolver::get(SymbolKind kind, uint32_t idx) const {
+    // Strings and member signatures are resolved one at a time; types are decoded whole on first use
+    switch (kind) {
+        case SymbolKind::kString:
+            return idx < parser_.string_table().size() ? &parser_.get_string(idx) : nullptr;
+        case SymbolKind::kType:
+            return idx < parser_.types().size() ? &parser_.types()[idx] : nullptr;
+        case SymbolKind::kMethod:
+        case SymbolKind::kField:
+            return signature(kind, idx);
+    }
+    return nullptr;
+}
+
+} // namespace dex
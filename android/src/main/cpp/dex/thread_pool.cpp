@@ -0,0 +1,157 @@
+#include "dex/thread_pool.h"
+#include <algorithm>
+
+namespace dex {
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    // The thread calling parallel_for works too, so start one fewer worker
+    size_t workers = threads - 1;
+    for (size_t i = 0; i < std::max<size_t>(workers, 1); i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workers; i++) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+    size_t index = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        queued_.fetch_add(1, std::memory_order_release);
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::try_pop(size_t home, std::function<void()>& task) {
+    size_t n = queues_.size();
+    for (size_t i = 0; i < n; i++) {
+        Queue& queue = *queues_[(home + i) % n];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        // Own queue is LIFO for locality; victims are robbed from the opposite end
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    std::function<void()> task;
+    while (true) {
+        if (try_pop(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_.wait(lock, [this]() { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+        if (stop_) return;
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) return;
+    if (count == 1 || workers_.empty()) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    struct Group {
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto group = std::make_shared<Group>();
+    group->remaining.store(count, std::memory_order_relaxed);
+
+    for (size_t i = 0; i < count; i++) {
+        push([group, &fn, i]() {
+            fn(i);
+            if (group->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(group->mutex);
+                group->done.notify_all();
+            }
+        });
+    }
+
+    // Help out instead of blocking; this also makes nested parallel_for calls safe
+    std::function<void()> task;
+    size_t home = next_queue_.load(std::memory_order_relaxed) % queues_.size();
+    while (group->remaining.load(std::memory_order_acquire) > 0) {
+        if (try_pop(home, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(group->mutex);
+        group->done.wait(lock, [&group]() { return group->remaining.load(std::memory_order_acquire) == 0; });
+    }
+}
+
+static std::mutex shared_mutex;
+static std::shared_ptr<ThreadPool> shared_pool;
+
+std::shared_ptr<ThreadPool> ThreadPool::shared() {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    if (!shared_pool) {
+        shared_pool = std::make_shared<ThreadPool>();
+    }
+    return shared_pool;
+}
+
+void ThreadPool::set_shared_thread_count(size_t threads) {
+    auto pool = std::make_shared<ThreadPool>(threads);
+    std::shared_ptr<ThreadPool> old;
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        old = std::move(shared_pool);
+        shared_pool = std::move(pool);
+    }
+    // In-flight users keep the old pool alive until they finish
+}
+
+size_t chunk_count(size_t count, size_t min_chunk) {
+    if (count == 0) return 0;
+    size_t threads = ThreadPool::shared()->size();
+    // A few chunks per thread gives stealing something to balance
+    size_t chunks = std::min((count + min_chunk - 1) / min_chunk, threads * 4);
+    return std::max<size_t>(chunks, 1);
+}
+
+void parallel_chunks(size_t count, size_t chunks, const std::function<void(size_t, size_t, size_t)>& fn) {
+    if (count == 0 || chunks == 0) return;
+    size_t per_chunk = (count + chunks - 1) / chunks;
+    ThreadPool::shared()->parallel_for(chunks, [&](size_t chunk) {
+        size_t begin = chunk * per_chunk;
+        size_t end = std::min(count, begin + per_chunk);
+        if (begin < end) fn(chunk, begin, end);
+    });
+}
+
+} // namespace dex
@@ -0,0 +1,122 @@
+#include "dex/trigram_index.h"
+#include "dex/dex_parser.h"
+#include "dex/thread_pool.h"
+#include <algorithm>
+#include <iterator>
+
+namespace dex {
+
+static uint8_t ascii_lower(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+static uint32_t pack_trigram(const char* p) {
+    return (static_cast<uint32_t>(ascii_lower(static_cast<uint8_t>(p[0]))) << 16) |
+           (static_cast<uint32_t>(ascii_lower(static_cast<uint8_t>(p[1]))) << 8) |
+           static_cast<uint32_t>(ascii_lower(static_cast<uint8_t>(p[2])));
+}
+
+void TrigramIndex::build(const DexParser& parser, SearchTarget target) {
+    size_t count = search_pool_size(parser, target);
+
+    // Each chunk emits sorted (trigram << 32 | item) pairs, one per distinct trigram of an item
+    size_t chunks = chunk_count(count, 1024);
+    std::vector<std::vector<uint64_t>> partial(chunks);
+
+    parallel_chunks(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        std::vector<uint64_t>& pairs = partial[chunk];
+        std::vector<uint32_t> grams;
+        for (size_t i = begin; i < end; i++) {
+            std::string_view text = search_text(parser, target, i);
+            if (text.size() < kGram) continue;
+
+            grams.clear();
+            for (size_t pos = 0; pos + kGram <= text.size(); pos++) {
+                grams.push_back(pack_trigram(text.data() + pos));
+            }
+            std::sort(grams.begin(), grams.end());
+            grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+            for (uint32_t gram : grams) {
+                pairs.push_back((static_cast<uint64_t>(gram) << 32) | static_cast<uint32_t>(i));
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+    });
+
+    // Merge the sorted chunks pairwise until one run is left
+    while (partial.size() > 1) {
+        size_t merged_count = (partial.size() + 1) / 2;
+        std::vector<std::vector<uint64_t>> merged(merged_count);
+        parallel_chunks(merged_count, merged_count, [&](size_t chunk, size_t, size_t) {
+            size_t left = chunk * 2;
+            if (left + 1 == partial.size()) {
+                merged[chunk] = std::move(partial[left]);
+                return;
+            }
+            const auto& a = partial[left];
+            const auto& b = partial[left + 1];
+            merged[chunk].resize(a.size() + b.size());
+            std::merge(a.begin(), a.end(), b.begin(), b.end(), merged[chunk].begin());
+        });
+        partial = std::move(merged);
+    }
+
+    keys_.clear();
+    offsets_.clear();
+    postings_.clear();
+    if (partial.empty()) {
+        offsets_.push_back(0);
+        return;
+    }
+
+    const std::vector<uint64_t>& pairs = partial.front();
+    postings_.reserve(pairs.size());
+    for (uint64_t pair : pairs) {
+        uint32_t gram = static_cast<uint32_t>(pair >> 32);
+        if (keys_.empty() || keys_.back() != gram) {
+            keys_.push_back(gram);
+            offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+        }
+        postings_.push_back(static_cast<uint32_t>(pair));
+    }
+    offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+    keys_.shrink_to_fit();
+    offsets_.shrink_to_fit();
+}
+
+bool TrigramIndex::candidates(std::string_view query, std::vector<uint32_t>& out) const {
+    out.clear();
+    if (query.size() < kGram) return false;
+
+    std::vector<uint32_t> grams;
+    for (size_t pos = 0; pos + kGram <= query.size(); pos++) {
+        grams.push_back(pack_trigram(query.data() + pos));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+
+    // Intersect the posting lists from the shortest up
+    struct List { const uint32_t* first; const uint32_t* last; };
+    std::vector<List> lists;
+    for (uint32_t gram : grams) {
+        auto it = std::lower_bound(keys_.begin(), keys_.end(), gram);
+        if (it == keys_.end() || *it != gram) return true;  // some trigram never occurs
+        size_t k = it - keys_.begin();
+        lists.push_back({postings_.data() + offsets_[k], postings_.data() + offsets_[k + 1]});
+    }
+    std::sort(lists.begin(), lists.end(), [](const List& a, const List& b) {
+        return (a.last - a.first) < (b.last - b.first);
+    });
+
+    out.assign(lists.front().first, lists.front().last);
+    std::vector<uint32_t> scratch;
+    for (size_t i = 1; i < lists.size() && !out.empty(); i++) {
+        scratch.clear();
+        std::set_intersection(out.begin(), out.end(), lists[i].first, lists[i].last,
+                              std::back_inserter(scratch));
+        out.swap(scratch);
+    }
+    return true;
+}
+
+} // namespace dex
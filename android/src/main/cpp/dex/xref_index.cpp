@@ -0,0 +1,106 @@
+#include "dex/xref_index.h"
+#include "dex/dex_parser.h"
+#include "dex/insn_iterator.h"
+#include "dex/thread_pool.h"
+#include <array>
+
+namespace dex {
+
+template<typename T>
+static T read_le(const uint8_t* p) {
+    T val = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        val |= static_cast<T>(p[i]) << (i * 8);
+    }
+    return val;
+}
+
+// Map an opcode to the pool its index operand refers to; returns false for non-referencing opcodes
+static bool classify(uint8_t op, XrefKind& kind) {
+    if ((op >= 0x6e && op <= 0x72) || (op >= 0x74 && op <= 0x78) || op == 0xfa || op == 0xfb) {
+        kind = XrefKind::kMethod;
+    } else if (op >= 0x52 && op <= 0x6d) {
+        kind = XrefKind::kField;
+    } else if (op == 0x1a || op == 0x1b) {
+        kind = XrefKind::kString;
+    } else if (op == 0x1c || op == 0x1f || op == 0x20 || (op >= 0x22 && op <= 0x25)) {
+        kind = XrefKind::kType;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void XrefIndex::build(const DexParser& parser) {
+    const ByteView& data = parser.data();
+    const DexHeader& header = parser.header();
+    const uint32_t counts[4] = {
+        header.method_ids_size, header.field_ids_size, header.string_ids_size, header.type_ids_size
+    };
+
+    // Collect (target, site) pairs per kind in parallel class chunks, then bucket them by target
+    using RefList = std::vector<std::pair<uint32_t, XrefSite>>;
+    const auto& classes = parser.classes();
+    size_t chunks = chunk_count(classes.size(), 64);
+    std::vector<std::array<RefList, 4>> partial(chunks);
+
+    parallel_chunks(classes.size(), chunks, [&](size_t chunk, size_t begin, size_t end) {
+        std::array<RefList, 4>& refs = partial[chunk];
+
+        for (size_t c = begin; c < end; c++) {
+            for (const EncodedMethod& method : parser.class_data(static_cast<uint32_t>(c)).methods()) {
+                uint32_t method_idx = method.method_idx;
+                uint32_t code_off = method.code_off;
+                if (code_off == 0 || static_cast<size_t>(code_off) + 16 > data.size()) continue;
+
+                uint32_t insns_size = read_le<uint32_t>(&data[code_off + 12]);
+                size_t insns_off = static_cast<size_t>(code_off) + 16;
+                if (insns_off + static_cast<size_t>(insns_size) * 2 > data.size()) continue;
+
+                InsnIterator it(&data[insns_off], insns_size);
+                Insn insn;
+                while (it.next(insn)) {
+                    XrefKind kind;
+                    if (insn.payload != PayloadKind::kNone || !classify(insn.opcode, kind)) continue;
+
+                    uint32_t target = insn.ref_index();
+                    int k = static_cast<int>(kind);
+                    if (target < counts[k]) {
+                        refs[k].push_back({target, XrefSite{method_idx, insn.pc}});
+                    }
+                }
+            }
+        }
+    });
+
+    for (int k = 0; k < 4; k++) {
+        Table& table = tables_[k];
+        table.offsets.assign(counts[k] + 1, 0);
+        for (const auto& refs : partial) {
+            for (const auto& ref : refs[k]) {
+                table.offsets[ref.first + 1]++;
+            }
+        }
+        for (uint32_t i = 0; i < counts[k]; i++) {
+            table.offsets[i + 1] += table.offsets[i];
+        }
+
+        // Stable bucketing in chunk order keeps each target's sites in class_def order
+        table.sites.resize(table.offsets[counts[k]]);
+        std::vector<uint32_t> cursor(table.offsets.begin(), table.offsets.end() - 1);
+        for (const auto& refs : partial) {
+            for (const auto& ref : refs[k]) {
+                table.sites[cursor[ref.first]++] = ref.second;
+            }
+        }
+    }
+}
+
+XrefRange XrefIndex::sites(XrefKind kind, uint32_t idx) const {
+    const Table& table = tables_[static_cast<int>(kind)];
+    if (table.offsets.empty() || idx >= table.offsets.size() - 1) return {};
+    const XrefSite* base = table.sites.data();
+    return {base + table.offsets[idx], base + table.offsets[idx + 1]};
+}
+
+} // namespace dex
@@ -4,9 +4,13 @@
 #include <vector>
 #include <cstdint>
 #include <functional>
+#include <cstdio>
 
 namespace apk {
 
+// Adler-32 checksum, as used by DEX headers
+uint32_t adler32(const uint8_t* data, size_t size);
+
 struct ZipEntry {
     std::string name;
     uint32_t compressed_size;
@@ -54,4 +58,49 @@ private:
     std::vector<Entry> entries_;
 };
 
+// Writes entries to the file as they are added, keeping only the central directory in memory.
+// prepare() has no shared state, so entries can be compressed on several threads and written in order.
+class ZipStreamWriter {
+public:
+    struct Prepared {
+        std::string name;
+        std::vector<uint8_t> data;  // deflated or stored bytes
+        uint32_t uncompressed_size = 0;
+        uint32_t crc32 = 0;
+        uint16_t compression_method = 0;
+    };
+
+    static Prepared prepare(std::string name, const uint8_t* data, size_t size, bool compress = true);
+
+    ZipStreamWriter() = default;
+    ~ZipStreamWriter();
+    ZipStreamWriter(const ZipStreamWriter&) = delete;
+    ZipStreamWriter& operator=(const ZipStreamWriter&) = delete;
+
+    bool open(const std::string& path);
+    bool write(const Prepared& entry);
+    // Writes the central directory and closes the file
+    bool finish();
+    // Closes without finishing; the partial file is left for the caller to remove
+    void abort();
+
+private:
+    struct Record {
+        std::string name;
+        uint32_t crc32;
+        uint32_t compressed_size;
+        uint32_t uncompressed_size;
+        uint16_t compression_method;
+        uint32_t local_header_offset;
+    };
+
+    FILE* file_ = nullptr;
+    std::vector<char> buffer_;
+    std::vector<Record> records_;
+    uint64_t offset_ = 0;
+    bool failed_ = false;
+
+    void put(const void* data, size_t size);
+};
+
 } // namespace apk
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <initializer_list>
+#include <cstdint>
+#include <cstddef>
+
+namespace dex {
+
+// Compact result table returned to Java in a direct ByteBuffer instead of JSON.
+// Layout, little-endian (decoded by DexBinaryResult.java):
+//   u32 magic "DXR1"
+//   u32 string_count, then per string: u32 byte_length + MUTF-8 bytes (deduplicated)
+//   u32 meta_count, then per entry: u32 name (string ref) + i64 value
+//   u32 column_count, then per column: u32 name (string ref) + u8 type
+//   u32 row_count, then row_count * column_count u32 cells (string ref or integer)
+class BinaryResult {
+public:
+    static constexpr uint32_t kMagic = 0x31525844;  // "DXR1"
+
+    enum class Column : uint8_t {
+        kString = 0,
+        kInt = 1,
+    };
+
+    explicit BinaryResult(std::initializer_list<std::pair<const char*, Column>> columns);
+
+    // Index of `str` in the string table; the bytes must outlive this result (DEX data, literals)
+    uint32_t intern(std::string_view str);
+    // Same, for strings built on the fly
+    uint32_t intern_copy(std::string str);
+
+    void add_meta(const char* name, int64_t value);
+
+    // Append one cell; a row is complete after column_count cells
+    BinaryResult& cell(uint32_t value) {
+        cells_.push_back(value);
+        return *this;
+    }
+    BinaryResult& string_cell(std::string_view str) { return cell(intern(str)); }
+
+    size_t row_count() const { return columns_.empty() ? 0 : cells_.size() / columns_.size(); }
+
+    size_t serialized_size() const;
+    void serialize(uint8_t* out) const;
+
+private:
+    std::vector<std::string_view> strings_;
+    std::unordered_map<std::string_view, uint32_t> string_index_;
+    std::deque<std::string> owned_;
+    std::vector<std::pair<uint32_t, int64_t>> meta_;
+    std::vector<std::pair<uint32_t, Column>> columns_;
+    std::vector<uint32_t> cells_;
+};
+
+} // namespace dex
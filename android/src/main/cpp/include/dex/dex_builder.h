@@ -43,6 +43,22 @@ struct Prototype {
         : return_type(ret), param_types(params) {}
     
     std::string to_string() const;
+    // Parse "(params)return"; false if the descriptor has no parameter list
+    static bool parse(const std::string& descriptor, Prototype& proto);
+};
+
+// Annotation visibilities
+enum AnnotationVisibility : uint8_t {
+    VISIBILITY_BUILD = 0x00,
+    VISIBILITY_RUNTIME = 0x01,
+    VISIBILITY_SYSTEM = 0x02,
+};
+
+// Annotation for building; indexes inside `encoded` refer to the builder's pools
+struct AnnotationDef {
+    uint8_t visibility = VISIBILITY_RUNTIME;
+    uint32_t type_idx = 0;
+    std::vector<uint8_t> encoded;  // encoded_annotation, starting with type_idx
 };
 
 // Method definition for building
@@ -54,6 +70,19 @@ struct MethodDef {
     uint16_t ins_size;
     uint16_t outs_size;
     std::vector<uint8_t> code;  // bytecode
+    uint32_t code_off = 0;      // code_item in the base DEX, reused verbatim while code is empty
+    
+    // Only used with new code; handler types and debug names are builder indexes
+    std::vector<TryBlock> tries;
+    DebugInfo debug_info;       // no debug_info_item when it has no events and no parameter names
+    
+    std::vector<AnnotationDef> annotations;
+    std::vector<std::vector<AnnotationDef>> parameter_annotations;  // per parameter, may be shorter
+    
+    // 16-bit index operands whose pool index does not fit yet, as (byte offset in code, index). The
+    // operand holds 0 until build() has sorted the ids; a const-string then becomes const-string/jumbo
+    // if it still needs more than 16 bits.
+    std::vector<std::pair<uint32_t, uint32_t>> wide_refs;
 };
 
 // Field definition for building
@@ -61,6 +90,8 @@ struct FieldDef {
     std::string name;
     std::string type;
     uint32_t access_flags;
+    std::vector<uint8_t> initial_value = {};  // encoded_value of a static field, empty for the default
+    std::vector<AnnotationDef> annotations = {};
 };
 
 // Class definition for building
@@ -74,6 +105,9 @@ struct ClassBuilder {
     std::vector<MethodDef> direct_methods;   // static, private, constructor
     std::vector<MethodDef> virtual_methods;  // other methods
     
+    std::string source_file;  // empty for none
+    std::vector<AnnotationDef> annotations;
+    
     ClassBuilder(const std::string& name) 
         : class_name(name), super_class("Ljava/lang/Object;"), access_flags(ACC_PUBLIC) {}
     
@@ -90,6 +124,9 @@ struct ClassBuilder {
     MethodDef& create_method(const std::string& name, const Prototype& proto, uint32_t flags = ACC_PUBLIC);
 };
 
+// Old-to-new pool indexes
+struct PoolRemap;
+
 // DEX Builder - can build DEX from scratch or modify existing
 class DexBuilder {
 public:
@@ -98,14 +135,18 @@ public:
     
     // Load existing DEX as base (for modification)
     bool load(const std::vector<uint8_t>& data);
+    bool load(std::vector<uint8_t>&& data);
     bool load(const std::string& path);
     
     // Create new class
     ClassBuilder& make_class(const std::string& class_name);
     
-    // Modify existing class
+    // Modify existing class; classes of the base DEX are imported on first access
     ClassBuilder* get_class(const std::string& class_name);
     
+    // Remove a new or base DEX class; false if there is no such class
+    bool remove_class(const std::string& class_name);
+    
     // Add/modify method in existing class
     bool add_method(const std::string& class_name, const MethodDef& method);
     bool modify_method(const std::string& class_name, const std::string& method_name, 
@@ -118,7 +159,20 @@ public:
     uint32_t get_or_add_field(const std::string& class_name, const std::string& field_name, const std::string& type);
     uint32_t get_or_add_method(const std::string& class_name, const std::string& method_name, const Prototype& proto);
     
-    // Build final DEX
+    // Move the classes of `partials`, builders without a base DEX, into this one, in order. Their new
+    // pool entries are appended in first-use order, and the indexes in their code, debug info,
+    // annotations and static values are remapped in parallel on the shared pool. Instruction operands
+    // that no longer fit 16 bits wait in MethodDef::wide_refs for build(). With a base DEX loaded,
+    // build() sorts the appended entries into its id tables.
+    bool merge(std::vector<DexBuilder>& partials, std::string& error);
+    
+    // Build final DEX; empty on failure, with the reason in `error`. New ids are merged into the sorted
+    // id tables. With a base DEX loaded, untouched items are copied and only the edited classes are
+    // encoded, as long as no base id moves. Once a new id sorts before base ones, every code_item,
+    // debug_info, annotation and encoded_array of the base DEX is re-encoded with the shifted ids,
+    // which costs a pass over the whole file; a const-string whose index grows past 16 bits becomes
+    // const-string/jumbo and its method is laid out again. The edited classes are copied once for this.
+    std::vector<uint8_t> build(std::string& error);
     std::vector<uint8_t> build();
     bool save(const std::string& path);
     
@@ -140,6 +194,7 @@ private:
         uint32_t shorty_idx;
         uint32_t return_type_idx;
         std::vector<uint32_t> param_type_idxs;
+        uint32_t params_off = 0;  // type_list in the base DEX
     };
     std::vector<ProtoId> protos_;
     std::unordered_map<std::string, uint32_t> proto_map_;
@@ -169,6 +224,39 @@ private:
     // Original data (if loaded from existing DEX)
     std::vector<uint8_t> original_data_;
     bool has_original_ = false;
+    DexHeader original_header_;
+    std::vector<ClassDef> original_classes_;
+    std::unordered_map<std::string, uint32_t> original_class_map_;  // descriptor -> class_def index
+    std::vector<uint8_t> removed_classes_;  // per base class_def, 1 once it is deleted
+    
+    // Members of one class_data_item, each list sorted by index
+    struct ClassMembers {
+        std::vector<EncodedField> static_fields;
+        std::vector<EncodedField> instance_fields;
+        std::vector<EncodedMethod> direct_methods;
+        std::vector<EncodedMethod> virtual_methods;
+    };
+    bool read_class_data(uint32_t class_data_off, ClassMembers& members) const;
+    void write_class_data(std::vector<uint8_t>& out, const ClassMembers& members);
+    ClassBuilder* import_class(const std::string& class_name);
+    bool read_annotation_set(uint32_t set_off, std::vector<AnnotationDef>& annotations) const;
+    bool import_annotations(uint32_t directory_off, ClassBuilder& cls,
+                            const std::unordered_map<uint32_t, FieldDef*>& fields,
+                            const std::unordered_map<uint32_t, MethodDef*>& methods) const;
+    
+    // Rewrite the base DEX: untouched data is copied verbatim and offsets are relocated
+    std::vector<uint8_t> build_incremental(std::string& error);
+    // Same, with the pools already in output order; `map` takes base ids to their output index and
+    // `classes` hold output ids
+    std::vector<uint8_t> write_incremental(const PoolRemap& map, const std::vector<ClassBuilder>& classes,
+                                           std::string& error);
+    // Ids every class needs for its own definition
+    void add_class_ids();
+    // Output order of the pools: base entries keep their relative order and new ones are merged in at
+    // their sorted position, so a valid base DEX stays sorted. Fails if an id no longer fits 16 bits.
+    bool sort_pools(PoolRemap& map, std::string& error) const;
+    // Move every pool entry to its new index
+    void permute_pools(const PoolRemap& map);
     
     // Helper functions
     void write_uleb128(std::vector<uint8_t>& out, uint32_t value);
@@ -180,6 +268,7 @@ private:
     std::vector<uint8_t> build_type_list(const std::vector<uint32_t>& type_idxs);
     std::vector<uint8_t> build_class_data(const ClassBuilder& cls);
     std::vector<uint8_t> build_code_item(const MethodDef& method);
+    void write_debug_info(std::vector<uint8_t>& out, const DebugInfo& debug);
     
     // Checksum and signature
     uint32_t compute_checksum(const std::vector<uint8_t>& data);
@@ -5,9 +5,27 @@
 #include <cstdint>
 #include <unordered_map>
 #include <map>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include "mapped_file.h"
+#include "string_table.h"
 
 namespace dex {
 
+// Non-owning view over the bytes of a DEX image
+struct ByteView {
+    const uint8_t* ptr = nullptr;
+    size_t len = 0;
+
+    const uint8_t* data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const uint8_t* begin() const { return ptr; }
+    const uint8_t* end() const { return ptr + len; }
+    const uint8_t& operator[](size_t i) const { return ptr[i]; }
+};
+
 struct DexHeader {
     uint8_t magic[8];
     uint32_t checksum;
@@ -56,6 +74,49 @@ struct CodeItem {
     uint32_t code_off;    // offset of code_item in DEX file
 };
 
+// One clause of an encoded_catch_handler; addresses in 16-bit code units
+struct CatchHandler {
+    static constexpr uint32_t kCatchAll = 0xFFFFFFFF;
+    uint32_t type_idx;  // kCatchAll for the catch-all clause
+    uint32_t addr;
+};
+
+// try_item with its handler list resolved
+struct TryBlock {
+    uint32_t start_addr;
+    uint32_t end_addr;  // exclusive
+    std::vector<CatchHandler> handlers;
+};
+
+// One state-machine event of a debug_info_item; addresses in 16-bit code units
+struct DebugEvent {
+    enum class Kind : uint8_t { kLine, kStartLocal, kEndLocal, kRestartLocal, kPrologueEnd, kEpilogueBegin, kSetFile };
+    static constexpr uint32_t kNoIndex = 0xFFFFFFFF;
+
+    Kind kind;
+    uint32_t addr;
+    uint32_t line = 0;                  // kLine
+    uint32_t reg = 0;                   // local events
+    uint32_t name_idx = kNoIndex;       // local name, or the file name for kSetFile (string_idx)
+    uint32_t type_idx = kNoIndex;
+    uint32_t signature_idx = kNoIndex;  // generic signature (string_idx)
+};
+
+// Decoded debug_info_item; end/restart events carry the name and type of the local they refer to
+struct DebugInfo {
+    uint32_t line_start = 0;
+    std::vector<uint32_t> parameter_names;  // string_idx per declared parameter, or DebugEvent::kNoIndex
+    std::vector<DebugEvent> events;         // in address order
+};
+
+// annotations_directory_item; member entries pair a field/method index with an item offset
+struct AnnotationsDirectory {
+    uint32_t class_annotations_off = 0;                     // annotation_set_item, 0 for none
+    std::vector<std::pair<uint32_t, uint32_t>> fields;      // field_idx, annotation_set_item
+    std::vector<std::pair<uint32_t, uint32_t>> methods;     // method_idx, annotation_set_item
+    std::vector<std::pair<uint32_t, uint32_t>> parameters;  // method_idx, annotation_set_ref_list
+};
+
 struct MethodInfo {
     std::string class_name;
     std::string method_name;
@@ -71,26 +132,143 @@ struct FieldInfo {
     uint32_t access_flags;
 };
 
+// method_id_item / field_id_item, read in place
+struct MemberId {
+    uint32_t class_idx = 0;
+    uint32_t type_idx = 0;   // proto_idx for methods, field type_idx for fields
+    uint32_t name_idx = 0;
+};
+
+// proto_id_item with its parameter type_list, read in place
+struct ProtoId {
+    uint32_t return_type_idx = 0;
+    const uint8_t* params = nullptr;  // type_list entries, one uint16 type_idx each
+    uint32_t param_count = 0;
+
+    uint32_t param(uint32_t i) const { return params[i * 2] | (params[i * 2 + 1] << 8); }
+};
+
+// encoded_field of a class_data_item, with the index diff resolved
+struct EncodedField {
+    uint32_t field_idx;
+    uint32_t access_flags;
+};
+
+// encoded_method of a class_data_item, with the index diff resolved
+struct EncodedMethod {
+    uint32_t method_idx;
+    uint32_t access_flags;
+    uint32_t code_off;  // 0 for abstract and native methods
+};
+
+// Contiguous slice of decoded class_data entries
+template<typename T>
+struct MemberSpan {
+    const T* first = nullptr;
+    const T* last = nullptr;
+
+    const T* begin() const { return first; }
+    const T* end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+// Decoded class_data_item of one class_def; each class's entries are stored back to back
+struct ClassData {
+    MemberSpan<EncodedField> static_fields;
+    MemberSpan<EncodedField> instance_fields;
+    MemberSpan<EncodedMethod> direct_methods;
+    MemberSpan<EncodedMethod> virtual_methods;
+
+    MemberSpan<EncodedField> fields() const { return {static_fields.first, instance_fields.last}; }
+    MemberSpan<EncodedMethod> methods() const { return {direct_methods.first, virtual_methods.last}; }
+};
+
+// Contiguous slice of method_ids/field_ids indexes
+struct IdRange {
+    const uint32_t* first = nullptr;
+    const uint32_t* last = nullptr;
+
+    const uint32_t* begin() const { return first; }
+    const uint32_t* end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
 class DexParser {
 public:
     DexParser() = default;
     ~DexParser() = default;
 
+    DexParser(const DexParser&) = delete;
+    DexParser& operator=(const DexParser&) = delete;
+
     bool parse(const std::vector<uint8_t>& data);
+    bool parse(std::vector<uint8_t>&& data);
+    // Maps the file read-only instead of reading it into memory
     bool parse(const std::string& path);
+    // Parses in place; the buffer must stay valid and unchanged while the parser is in use
+    bool parse_view(const uint8_t* data, size_t size);
 
     const DexHeader& header() const { return header_; }
-    const std::vector<std::string>& strings() const { return strings_; }
-    const std::vector<std::string>& types() const { return types_; }
+    // Full string/type tables, decoded on first call; prefer string_table() for point lookups
+    const std::vector<std::string>& strings() const { return string_table_.all(); }
+    const std::vector<std::string>& types() const;
+    const StringTable& string_table() const { return string_table_; }
+    const std::string& get_string(uint32_t idx) const { return string_table_.get(idx); }
     const std::vector<ClassDef>& classes() const { return classes_; }
     std::vector<MethodInfo> get_methods() const;
     std::vector<FieldInfo> get_fields() const;
+    MethodInfo get_method(uint32_t method_idx) const;
+    FieldInfo get_field(uint32_t field_idx) const;
 
     std::string get_class_name(uint32_t idx) const;
+
+    // Id table entries without decoding, for callers that stream names straight out of the DEX
+    std::string_view type_descriptor(uint32_t type_idx) const;  // raw MUTF-8; empty if out of range
+    bool method_id(uint32_t method_idx, MemberId& out) const;
+    bool field_id(uint32_t field_idx, MemberId& out) const;
+    bool proto_id(uint32_t proto_idx, ProtoId& out) const;
     std::vector<std::string> get_class_methods(const std::string& class_name) const;
+
+    // Hash lookups, built on first use; all return -1 when not found
+    int find_type(const std::string& descriptor) const;
+    int find_class_def(const std::string& descriptor) const;  // index into classes()
+    int find_method(const std::string& class_name, const std::string& name,
+                    const std::string& proto = "") const;     // empty proto matches the first overload
+    int find_field(const std::string& class_name, const std::string& name) const;
+    int find_string(const std::string& value) const;
+    // Every overload named `name`, or only the one given as "name(proto)"
+    std::vector<uint32_t> find_methods(const std::string& class_name, const std::string& name) const;
+
+    // method_ids/field_ids whose owner is the given class
+    IdRange class_method_ids(const std::string& class_name) const;
+    IdRange class_field_ids(const std::string& class_name) const;
+
+    // class_data_item of classes()[class_def_idx]; every class is decoded in one pass on first use
+    const ClassData& class_data(uint32_t class_def_idx) const;
+    // Definition of a method/field in this DEX's class_data, or nullptr if it is only referenced
+    const EncodedMethod* encoded_method(uint32_t method_idx) const;
+    const EncodedField* encoded_field(uint32_t field_idx) const;
+
+    // Read the code_item at code_off, copying its instructions
+    bool read_code_item(uint32_t code_off, CodeItem& code) const;
+    // Decode the try_items and catch handlers that follow the instructions; false if malformed
+    bool read_tries(const CodeItem& code, std::vector<TryBlock>& tries) const;
+    // Run the debug_info_item state machine at debug_info_off; false if absent or malformed
+    bool read_debug_info(uint32_t debug_info_off, DebugInfo& info) const;
+    // annotations_directory_item at annotations_off; false if absent or malformed
+    bool read_annotations_directory(uint32_t annotations_off, AnnotationsDirectory& dir) const;
+    // Offsets listed by an annotation_set_item or annotation_set_ref_list; false if malformed
+    bool read_offset_list(uint32_t off, std::vector<uint32_t>& offsets) const;
     
-    // Get method code for disassembly
+    // Get method code for disassembly; by name alone the first defined overload wins
     bool get_method_code(const std::string& class_name, const std::string& method_name, CodeItem& code) const;
+    // Exact overload by proto ("(II)I"), resolved through the (class, name, proto) index
+    bool get_method_code(const std::string& class_name, const std::string& method_name,
+                         const std::string& proto, CodeItem& code) const;
+    // Method defined in this DEX; false for unknown, abstract and native methods
+    bool get_method_code(uint32_t method_idx, CodeItem& code) const;
     
     // Get all method codes at once (optimized batch operation)
     std::unordered_map<std::string, CodeItem> get_all_method_codes() const;
@@ -101,6 +279,8 @@ public:
     
     // Get full method signature with parameters and return type
     std::string get_full_method_signature(uint32_t method_idx) const;
+    // "Lfoo/Bar;->baz:I"; empty if out of range
+    std::string get_full_field_signature(uint32_t field_idx) const;
     std::string get_proto_string(uint32_t proto_idx) const;
     
     // Cross-reference analysis
@@ -109,29 +289,78 @@ public:
         std::string caller_method;
         uint32_t offset;
     };
+    // method_name as for find_methods
     std::vector<XRef> find_method_xrefs(const std::string& class_name, const std::string& method_name) const;
     std::vector<XRef> find_field_xrefs(const std::string& class_name, const std::string& field_name) const;
 
     std::string get_info() const;
     
-    const std::vector<uint8_t>& data() const { return data_; }
+    const ByteView& data() const { return data_; }
 
 private:
     DexHeader header_;
-    std::vector<uint8_t> data_;
-    std::vector<std::string> strings_;
-    std::vector<std::string> types_;
+    ByteView data_;
+    std::vector<uint8_t> owned_;          // backing store when parsing a copied buffer
+    std::unique_ptr<MappedFile> mapped_;  // backing store when parsing a file
+    StringTable string_table_;
     std::vector<ClassDef> classes_;
-    std::vector<uint32_t> string_ids_;
     std::vector<uint32_t> type_ids_;
 
+    mutable std::once_flag types_once_;
+    mutable std::vector<std::string> types_;
+
+    // Descriptor -> type_idx / class_def index
+    mutable std::once_flag class_index_once_;
+    mutable std::unordered_map<std::string_view, uint32_t> type_index_;
+    mutable std::vector<int32_t> class_def_by_type_;
+
+    // Per-type member lists (CSR) and (class, name, proto) -> method_idx
+    struct MethodKey {
+        uint32_t type_idx;
+        std::string_view name;
+        std::string_view proto;
+        bool operator==(const MethodKey& o) const {
+            return type_idx == o.type_idx && name == o.name && proto == o.proto;
+        }
+    };
+    struct MethodKeyHash {
+        size_t operator()(const MethodKey& k) const {
+            size_t h = std::hash<std::string_view>()(k.name);
+            h ^= std::hash<std::string_view>()(k.proto) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h ^ (k.type_idx * 0x9e3779b1u);
+        }
+    };
+    mutable std::once_flag member_index_once_;
+    mutable std::vector<uint32_t> method_offsets_;
+    mutable std::vector<uint32_t> method_ids_by_type_;
+    mutable std::vector<uint32_t> field_offsets_;
+    mutable std::vector<uint32_t> field_ids_by_type_;
+    mutable std::vector<std::string> protos_;
+    mutable std::unordered_map<MethodKey, uint32_t, MethodKeyHash> method_index_;
+
+    // Decoded class_data of all classes; ClassData spans point into encoded_fields_/encoded_methods_
+    static constexpr uint32_t kNotDefined = 0xFFFFFFFF;
+    mutable std::once_flag class_data_once_;
+    mutable std::vector<ClassData> class_data_;
+    mutable std::vector<EncodedField> encoded_fields_;
+    mutable std::vector<EncodedMethod> encoded_methods_;
+    mutable std::vector<uint32_t> field_defs_;   // field_idx -> encoded_fields_ index or kNotDefined
+    mutable std::vector<uint32_t> method_defs_;  // method_idx -> encoded_methods_ index or kNotDefined
+
+    void build_class_index() const;
+    void build_member_index() const;
+    void decode_class_data() const;
+
+    bool parse_all();
     bool parse_header();
     bool parse_strings();
     bool parse_types();
     bool parse_classes();
 
-    std::string read_string_at(uint32_t offset) const;
     uint32_t read_uleb128(size_t& offset) const;
+    int32_t read_sleb128(size_t& offset) const;
+
+    std::vector<XRef> scan_xrefs(bool (*matches)(uint8_t), const std::vector<uint32_t>& targets) const;
 };
 
 } // namespace dex
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace dex {
+
+// Linear-time regular expressions (Pike VM) over MUTF-8 text.
+// Supports literals, ., [classes], \d\w\s and their negations, ^ $ \b \B, groups, | and
+// the * + ? {m,n} quantifiers (lazy forms accepted). Backreferences, lookaround,
+// possessive quantifiers and inline flags are rejected at compile time.
+// Case-insensitive mode folds ASCII letters only, like java.util.regex by default.
+class Regex {
+public:
+    static constexpr size_t kMaxPatternSize = 4096;
+    static constexpr size_t kMaxProgramSize = 20000;
+    static constexpr int kMaxRepeat = 1000;
+
+    bool compile(std::string_view pattern, bool case_sensitive, std::string& error);
+
+    // True if the pattern matches anywhere in `text`
+    bool search(std::string_view text) const;
+
+    // A literal every match must contain (MUTF-8, lowercased when case-insensitive); may be empty
+    const std::string& required_literal() const { return required_literal_; }
+
+    // The pattern is exactly required_literal(), so a substring hit is already a match
+    bool is_literal() const { return is_literal_; }
+
+    bool case_sensitive() const { return case_sensitive_; }
+
+private:
+    enum class Op : uint8_t {
+        kChar,          // code point == arg
+        kAny,           // any code point except line terminators
+        kClass,         // code point in classes_[arg]
+        kSplit,         // fork to x and y
+        kJmp,           // continue at x
+        kBol,           // start of text
+        kEol,           // end of text
+        kWordBoundary,
+        kNotWordBoundary,
+        kMatch,
+    };
+
+    struct Inst {
+        Op op;
+        uint32_t arg = 0;
+        uint32_t x = 0;
+        uint32_t y = 0;
+    };
+
+    struct CharClass {
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;  // inclusive
+        bool negated = false;
+
+        bool contains(uint32_t cp) const;
+    };
+
+    struct Node;
+    class Parser;
+
+    std::vector<Inst> program_;
+    std::vector<CharClass> classes_;
+    std::string required_literal_;
+    bool is_literal_ = false;
+    bool case_sensitive_ = true;
+    bool anchored_start_ = false;  // program begins with ^, so only position 0 can start a match
+
+    static bool exact_literal(const Node& node, std::string& out);
+    static std::string required_literal(const Node& node);
+
+    bool emit(const Node& node, std::string& error);
+    bool step(const Inst& inst, uint32_t cp) const;
+};
+
+} // namespace dex
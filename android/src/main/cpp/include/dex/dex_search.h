@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace dex {
+
+class DexParser;
+class TrigramIndex;
+
+enum class SearchTarget {
+    kString,  // string pool entries
+    kClass,   // class_def descriptors
+    kMethod,  // method_ids names
+    kField,   // field_ids names
+};
+
+struct SearchOptions {
+    std::string query;  // MUTF-8, as delivered by GetStringUTFChars
+    SearchTarget target = SearchTarget::kString;
+    bool case_sensitive = false;
+    bool regex = false;  // treat query as a pattern for dex::Regex
+    size_t max_results = 1000;  // 0 finds nothing; the JNI entry points pass 0 for maxResults <= 0
+};
+
+// Substring or regex search over one DEX pool, scanned in parallel chunks.
+// Fills `results` with matching indexes (string_idx, class_def index, method_idx or field_idx) in
+// pool order, so results are identical for any thread count.
+// With an index built for the same target, queries it can serve skip the scan.
+// Returns false with `error` set if the regex does not compile.
+bool search_dex(const DexParser& parser, const SearchOptions& options, std::vector<uint32_t>& results,
+                std::string& error, const TrigramIndex* index = nullptr);
+
+// Number of items in a pool and the raw MUTF-8 text searched for item i
+size_t search_pool_size(const DexParser& parser, SearchTarget target);
+std::string_view search_text(const DexParser& parser, SearchTarget target, size_t i);
+
+// Parse "string" / "class" / "method" / "field"; returns false for anything else
+bool parse_search_target(const std::string& name, SearchTarget& target);
+
+} // namespace dex
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "dex_parser.h"
+#include "smali_disasm.h"
+#include "symbol_resolver.h"
+#include "xref_index.h"
+#include "dex_search.h"
+#include "trigram_index.h"
+#include "package_tree.h"
+
+namespace dex {
+
+// A parsed DEX kept alive across JNI calls, so each DEX is parsed once per session
+class DexSession {
+public:
+    DexSession();
+    ~DexSession() = default;
+
+    DexSession(const DexSession&) = delete;
+    DexSession& operator=(const DexSession&) = delete;
+
+    bool open(std::vector<uint8_t>&& data);
+    bool open_file(const std::string& path);
+    // Parse in place over memory owned by `keepalive`, which is released together with the session
+    bool open_view(const uint8_t* data, size_t size, std::shared_ptr<const void> keepalive = nullptr);
+
+    const DexParser& parser() const { return parser_; }
+
+    // Disassembler resolving references through this DEX's pools, each resolved on first use
+    const SmaliDisassembler& disassembler() const { return disasm_; }
+
+    // Code references of the whole DEX, indexed on first use
+    const XrefIndex& xref_index() const;
+
+    // Callers of a method/field/string/type, resolved to class and method names
+    std::vector<DexParser::XRef> xrefs(XrefKind kind, int idx) const;
+
+    // Search one pool; with the search index enabled, queries of 3+ bytes use trigram posting lists.
+    // Returns false with `error` set for an invalid regex.
+    bool search(const SearchOptions& options, std::vector<uint32_t>& results, std::string& error) const;
+
+    // The per-pool trigram indexes are built on the first search that uses them
+    void set_search_index_enabled(bool enabled) { search_index_enabled_ = enabled; }
+    bool search_index_enabled() const { return search_index_enabled_; }
+
+    // Package hierarchy of the defined classes, built on first use
+    const PackageTree& package_tree() const;
+
+    // debug_info_item at debug_info_off, decoded on first request and cached; nullptr if absent or malformed
+    std::shared_ptr<const DebugInfo> debug_info(uint32_t debug_info_off) const;
+
+    // Append a method body from .registers on; with_debug adds .param/.line/.local directives.
+    // `annotations` (annotation_set_item) and `parameters` (annotation_set_ref_list) are rendered
+    // ahead of the code when non-zero.
+    void code_smali(SmaliWriter& out, uint32_t method_idx, uint32_t access_flags, const CodeItem& code,
+                    bool with_debug, uint32_t annotations = 0, uint32_t parameters = 0) const;
+
+    // Render a whole class as Smali into `out`, replacing its contents but keeping its capacity;
+    // returns false if the class is not defined here
+    bool class_smali(const std::string& class_name, std::string& out, bool with_debug = false) const;
+    bool class_smali(uint32_t class_def_idx, std::string& out, bool with_debug = false) const;
+
+private:
+    std::shared_ptr<const void> keepalive_;  // must outlive parser_
+    DexParser parser_;
+
+    std::shared_ptr<const DexSymbolResolver> symbols_;
+    SmaliDisassembler disasm_;
+
+    mutable std::once_flag xref_once_;
+    mutable XrefIndex xref_index_;
+
+    std::atomic<bool> search_index_enabled_{false};
+    mutable std::once_flag search_index_once_[4];
+    mutable TrigramIndex search_index_[4];  // indexed by SearchTarget
+
+    mutable std::once_flag package_tree_once_;
+    mutable PackageTree package_tree_;
+
+    mutable std::mutex debug_info_mutex_;
+    mutable std::unordered_map<uint32_t, std::shared_ptr<const DebugInfo>> debug_info_;  // by debug_info_off
+
+    // .param directives and method annotations; `code` is null for abstract and native methods
+    void method_header_smali(SmaliWriter& out, uint32_t method_idx, uint32_t access_flags, const CodeItem* code,
+                             const DebugInfo* debug, uint32_t annotations, uint32_t parameters) const;
+};
+
+// Process-wide table of open sessions, addressed by opaque handles
+class SessionRegistry {
+public:
+    static SessionRegistry& instance();
+
+    int64_t add(std::shared_ptr<DexSession> session);
+    std::shared_ptr<DexSession> get(int64_t handle) const;
+    bool remove(int64_t handle);
+    size_t size() const;
+
+private:
+    SessionRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<int64_t, std::shared_ptr<DexSession>> sessions_;
+    int64_t next_handle_ = 1;
+};
+
+} // namespace dex
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "smali_disasm.h"
+
+namespace dex {
+
+// Pseudo-opcodes for the data payloads embedded in the instruction stream (ident in the first code unit)
+enum class PayloadKind : uint8_t {
+    kNone = 0,
+    kPackedSwitch = 1,
+    kSparseSwitch = 2,
+    kFillArrayData = 3,
+};
+
+// One decoded instruction or payload
+struct Insn {
+    const uint8_t* code;   // first byte of the instruction
+    uint32_t pc;           // offset in 16-bit code units from the start of insns
+    uint32_t size;         // width in code units, including payload data
+    uint8_t opcode;
+    PayloadKind payload;
+
+    const OpcodeInfo& info() const { return SmaliDisassembler::get_opcode_info(opcode); }
+
+    // Index operand of 21c/22c/35c/3rc/45cc/4rcc (BBBB/CCCC) and 31c (BBBBBBBB) instructions
+    uint32_t ref_index() const;
+};
+
+// Walks a code_item's insns array one instruction at a time, using the opcode table for widths
+// and stepping over switch/array payloads as single units. Stops on a truncated instruction.
+class InsnIterator {
+public:
+    InsnIterator(const uint8_t* insns, uint32_t insns_size)
+        : insns_(insns), units_(insns_size) {}
+
+    bool next(Insn& insn);
+
+private:
+    const uint8_t* insns_;
+    uint32_t units_;    // total size in code units
+    uint32_t pc_ = 0;
+};
+
+} // namespace dex
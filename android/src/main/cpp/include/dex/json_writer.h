@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace dex {
+
+// Streaming JSON writer that appends straight into a caller-owned buffer, without a DOM.
+// String bytes are escaped but not re-encoded, so MUTF-8 taken from the DEX stays MUTF-8
+// (which is what NewStringUTF expects).
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+
+    // Object key; `name` is written as-is and must not need escaping
+    JsonWriter& key(std::string_view name);
+
+    JsonWriter& value(std::string_view str);
+    JsonWriter& value(const char* str) { return value(std::string_view(str)); }
+    JsonWriter& value(const std::string& str) { return value(std::string_view(str)); }
+    JsonWriter& value(int64_t number);
+    JsonWriter& value(uint64_t number);
+    JsonWriter& value(int number) { return value(static_cast<int64_t>(number)); }
+    JsonWriter& value(uint32_t number) { return value(static_cast<uint64_t>(number)); }
+    JsonWriter& value(bool flag);
+
+    // A string value assembled from several pieces
+    JsonWriter& begin_string();
+    JsonWriter& append(std::string_view piece);
+    JsonWriter& end_string();
+
+private:
+    static constexpr int kMaxDepth = 64;
+
+    std::string& out_;
+    bool has_items_[kMaxDepth] = {};
+    int depth_ = 0;
+    bool after_key_ = false;
+
+    void separate();
+    void open(char bracket);
+    void close(char bracket);
+    void escape(std::string_view str);
+};
+
+} // namespace dex
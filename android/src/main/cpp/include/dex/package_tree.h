@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+namespace dex {
+
+class DexParser;
+
+// Package hierarchy of the classes defined in a DEX, for browsing one level at a time.
+// Nodes are stored flat in breadth-first order, so each node's subpackages (sorted by name)
+// and direct classes (sorted by descriptor) are contiguous slices. Names point into the DEX.
+class PackageTree {
+public:
+    struct Node {
+        std::string_view name;       // last path segment; empty for the root
+        uint32_t first_child = 0;
+        uint32_t child_count = 0;
+        uint32_t first_class = 0;
+        uint32_t class_count = 0;    // classes directly in this package
+        uint32_t total_classes = 0;  // classes in this package and all subpackages
+    };
+
+    void build(const DexParser& parser);
+
+    const Node& root() const { return nodes_.front(); }
+
+    // Package by path ("com/example", "com.example" or "" for the root); nullptr if absent
+    const Node* find(std::string_view path) const;
+
+    const Node* children_begin(const Node& node) const { return nodes_.data() + node.first_child; }
+    const Node* children_end(const Node& node) const { return children_begin(node) + node.child_count; }
+
+    // class_def indices of the classes directly in `node`
+    const uint32_t* classes_begin(const Node& node) const { return classes_.data() + node.first_class; }
+    const uint32_t* classes_end(const Node& node) const { return classes_begin(node) + node.class_count; }
+
+private:
+    std::vector<Node> nodes_{Node{}};
+    std::vector<uint32_t> classes_;
+};
+
+} // namespace dex
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "dex_session.h"
+
+namespace dex {
+
+enum class CursorTarget : uint8_t {
+    kClass,
+    kString,
+};
+
+bool parse_cursor_target(const std::string& name, CursorTarget& target);
+
+// A filtered class/string listing over one or more sessions, computed once and then read page by page.
+// Entries are ordered by their MUTF-8 bytes (UTF-16 order), ties by source, so pages stay stable.
+class ResultCursor {
+public:
+    struct Entry {
+        uint32_t source;  // position in sessions()
+        uint32_t idx;     // class_def index or string index
+    };
+
+    // Case-sensitive substring filter; an empty filter lists everything
+    static std::shared_ptr<ResultCursor> open(std::vector<std::shared_ptr<const DexSession>> sessions,
+                                              CursorTarget target, const std::string& filter);
+
+    CursorTarget target() const { return target_; }
+    size_t size() const { return entries_.size(); }
+    const std::vector<std::shared_ptr<const DexSession>>& sessions() const { return sessions_; }
+
+    // Entries [offset, offset + limit), clamped to the result set
+    const Entry* page(size_t offset, size_t limit, size_t& count) const;
+
+    // Class descriptor or string value of an entry
+    std::string_view text(const Entry& entry) const;
+
+private:
+    // Sessions are kept alive so entries stay valid until the cursor is closed
+    std::vector<std::shared_ptr<const DexSession>> sessions_;
+    CursorTarget target_ = CursorTarget::kClass;
+    std::vector<Entry> entries_;
+};
+
+// Process-wide table of open cursors, addressed by opaque handles
+class CursorRegistry {
+public:
+    static CursorRegistry& instance();
+
+    int64_t add(std::shared_ptr<const ResultCursor> cursor);
+    std::shared_ptr<const ResultCursor> get(int64_t handle) const;
+    bool remove(int64_t handle);
+
+private:
+    CursorRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<int64_t, std::shared_ptr<const ResultCursor>> cursors_;
+    int64_t next_handle_ = 1;
+};
+
+} // namespace dex
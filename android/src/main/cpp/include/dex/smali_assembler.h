@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "dex_builder.h"
+
+namespace dex {
+
+// One line of Smali source with its 1-based line number, for error messages
+struct SmaliLine {
+    std::string_view text;
+    uint32_t number;
+};
+
+// Smali Assembler - converts Smali method bodies to bytecode
+class SmaliAssembler {
+public:
+    // References resolve through the pools of `builder`, which adds those it does not have yet
+    explicit SmaliAssembler(DexBuilder& builder) : builder_(builder) {}
+    ~SmaliAssembler() = default;
+
+    // Assemble Smali text to bytecode; labels, payload directives and .registers are understood
+    bool assemble(const std::string& smali_code, std::vector<uint8_t>& bytecode, std::string& error);
+
+    // Assemble a single instruction; branch targets are relative offsets in code units
+    bool assemble_insn(const std::string& line, std::vector<uint8_t>& bytecode, std::string& error);
+
+    // Assemble the lines between .method and .end method into `method`, whose name, prototype and
+    // access flags must be set. Fills in code, register counts, tries and debug_info from the
+    // instructions, labels, payloads, .catch/.catchall and .line/.local/.param directives.
+    // Errors are reported as "Line N: ...".
+    bool assemble_method(const std::vector<SmaliLine>& lines, MethodDef& method, std::string& error);
+
+    // Smali lexical helpers shared with the class parser
+    // Text before a '#' or '//' comment, trimmed; "#int"/"#long" literal prefixes are kept
+    static std::string_view strip_comment(std::string_view line);
+    // Decode a quoted string literal with Smali escapes; `end` receives the position after the quote
+    static bool parse_string_literal(std::string_view text, std::string& value, size_t* end = nullptr);
+    // Integer literal: decimal or 0x hex, optional sign, "#int"/"#long" prefix and t/s/L suffix
+    static bool parse_literal(std::string_view text, int64_t& value);
+    // Declared parameter held by p-register p, or -1 if p is `this` or past the parameters
+    static int parameter_index(const MethodDef& method, uint32_t p);
+    // Number of parameter registers, including `this` for instance methods
+    static uint32_t ins_size(const MethodDef& method);
+
+private:
+    DexBuilder& builder_;
+
+    struct MethodState;
+    enum class RefKind { kString, kType, kField, kMethod, kProto, kCallSite, kMethodHandle };
+
+    // Pool index of a reference operand, or of an explicit "kind@N"
+    bool resolve(RefKind kind, std::string_view token, uint32_t& idx, std::string& error);
+
+    bool parse_register(std::string_view token, const MethodState* state, uint32_t limit, uint32_t& num,
+                        std::string& error) const;
+    // Encode one instruction at `pc` into `insn`, sized from the opcode table. Pool indexes too wide for a
+    // 16-bit operand go to `wide_refs` (see MethodDef::wide_refs); without it they are an error.
+    bool encode_insn(std::string_view line, const MethodState* state, uint32_t pc, std::vector<uint8_t>& insn,
+                     uint32_t& outs, std::vector<std::pair<uint32_t, uint32_t>>* wide_refs, std::string& error);
+    bool assemble_lines(const std::vector<SmaliLine>& lines, MethodDef& method, bool with_prototype,
+                        std::string& error);
+};
+
+} // namespace dex
@@ -4,9 +4,18 @@
 #include <vector>
 #include <cstdint>
 #include <map>
+#include <memory>
+#include "smali_writer.h"
+#include "symbol_resolver.h"
 
 namespace dex {
 
+struct TryBlock;
+struct DebugInfo;
+struct DebugEvent;
+struct ProtoId;
+class DexParser;
+
 // Dalvik opcode formats
 enum class OpcodeFormat {
     k10x,  // op
@@ -33,6 +42,8 @@ enum class OpcodeFormat {
     k35c,  // op {vC, vD, vE, vF, vG}, meth@BBBB / type@BBBB
     k3rc,  // op {vCCCC .. vNNNN}, meth@BBBB / type@BBBB
     k51l,  // op vAA, #+BBBBBBBBBBBBBBBB
+    k45cc, // op {vC, vD, vE, vF, vG}, meth@BBBB, proto@HHHH
+    k4rcc, // op {vCCCC .. vNNNN}, meth@BBBB, proto@HHHH
     kPackedSwitch,
     kSparseSwitch,
     kFillArrayData,
@@ -56,72 +67,73 @@ struct DisassembledInsn {
 class SmaliDisassembler {
 public:
     SmaliDisassembler() = default;
+    // Context for resolving references; shared, not copied. Without one, references render as kind@idx.
+    explicit SmaliDisassembler(std::shared_ptr<const SymbolResolver> symbols) : symbols_(std::move(symbols)) {}
     ~SmaliDisassembler() = default;
 
-    // Set context for resolving references
-    void set_strings(const std::vector<std::string>& strings) { strings_ = strings; }
-    void set_types(const std::vector<std::string>& types) { types_ = types; }
-    void set_methods(const std::vector<std::string>& methods) { methods_ = methods; }
-    void set_fields(const std::vector<std::string>& fields) { fields_ = fields; }
-
     // Disassemble a single instruction
-    DisassembledInsn disassemble_insn(const uint8_t* code, size_t code_size, uint32_t offset);
+    DisassembledInsn disassemble_insn(const uint8_t* code, size_t code_size, uint32_t offset) const;
 
     // Disassemble entire method code
-    std::vector<DisassembledInsn> disassemble_method(const uint8_t* code, size_t code_size);
+    std::vector<DisassembledInsn> disassemble_method(const uint8_t* code, size_t code_size) const;
 
     // Convert disassembled instructions to Smali text
-    std::string to_smali(const std::vector<DisassembledInsn>& insns);
+    std::string to_smali(const std::vector<DisassembledInsn>& insns) const;
+
+    // Two-pass disassembly to Smali text: branch targets become labels (:cond_0, :goto_0, ...),
+    // try blocks become :try_start/:try_end with .catch directives, and payloads render as
+    // .packed-switch/.sparse-switch/.array-data blocks. With `debug`, .line/.local/.prologue
+    // directives are interleaved at their addresses.
+    std::string disassemble_method_smali(const uint8_t* code, size_t code_size,
+                                         const std::vector<TryBlock>& tries,
+                                         const DebugInfo* debug = nullptr) const;
+    // Same, appended straight into `out` without per-instruction strings
+    void write_method_smali(SmaliWriter& out, const uint8_t* code, size_t code_size,
+                            const std::vector<TryBlock>& tries, const DebugInfo* debug = nullptr) const;
+
+    // .param directives for the named or annotated parameters; registers follow the Dalvik calling
+    // convention, or are p-registers when there is no code. `parameter_sets` holds an annotation_set_item
+    // offset in `dex` per parameter, 0 for none.
+    void write_parameters_smali(SmaliWriter& out, const DebugInfo* debug, const ProtoId& proto,
+                                uint16_t registers_size, uint16_t ins_size, bool is_static,
+                                const DexParser* dex = nullptr,
+                                const std::vector<uint32_t>* parameter_sets = nullptr) const;
+
+    // annotation_set_item at set_off as .annotation blocks, indented by `indent` spaces
+    void write_annotation_set(SmaliWriter& out, const DexParser& dex, uint32_t set_off, int indent) const;
+    // One encoded_value as Smali; arrays and sub-annotations continue on lines indented by `indent`.
+    // Returns false if it is malformed.
+    bool write_encoded_value(SmaliWriter& out, const uint8_t*& p, const uint8_t* end, int indent) const;
+
+    // Access flags as Smali keywords ("public static final"); bits 0x40/0x80 depend on the kind
+    enum class AccessKind { kClass, kField, kMethod };
+    static std::string access_flags_string(uint32_t flags, AccessKind kind);
+    // Bit of one access flag keyword; false if it is not a keyword
+    static bool access_flag_by_name(std::string_view name, uint32_t& flag);
 
     // Get opcode info
     static const OpcodeInfo& get_opcode_info(uint8_t opcode);
-    static int get_opcode_by_name(const std::string& name);
+    static int get_opcode_by_name(std::string_view name);
 
 private:
-    std::vector<std::string> strings_;
-    std::vector<std::string> types_;
-    std::vector<std::string> methods_;
-    std::vector<std::string> fields_;
-
-    std::string resolve_string(uint32_t idx) const;
-    std::string resolve_type(uint32_t idx) const;
-    std::string resolve_method(uint32_t idx) const;
-    std::string resolve_field(uint32_t idx) const;
+    std::shared_ptr<const SymbolResolver> symbols_;
+
+    const std::string* symbol(SymbolKind kind, uint32_t idx) const {
+        return symbols_ ? symbols_->get(kind, idx) : nullptr;
+    }
+    // Append a reference operand resolved through the symbols
+    void write_string(uint32_t idx, SmaliWriter& out) const;
+    void write_type(uint32_t idx, SmaliWriter& out) const;
+    void write_method(uint32_t idx, SmaliWriter& out) const;
+    void write_field(uint32_t idx, SmaliWriter& out) const;
+
+    // Operands of one instruction; for branches everything before the target, which the caller appends
+    void write_operands(const uint8_t* code, SmaliWriter& out) const;
+    void write_debug_event(const DebugEvent& event, SmaliWriter& out) const;
+    // name = value lines of an encoded_annotation after its type_idx
+    bool write_annotation_elements(SmaliWriter& out, const uint8_t*& p, const uint8_t* end, int indent) const;
 
     static const OpcodeInfo opcodes_[256];
 };
 
-// Smali Assembler - converts Smali text to bytecode
-class SmaliAssembler {
-public:
-    SmaliAssembler() = default;
-    ~SmaliAssembler() = default;
-
-    // Set context for reference lookup
-    void set_strings(const std::vector<std::string>& strings) { strings_ = strings; }
-    void set_types(const std::vector<std::string>& types) { types_ = types; }
-    void set_methods(const std::vector<std::string>& methods) { methods_ = methods; }
-    void set_fields(const std::vector<std::string>& fields) { fields_ = fields; }
-
-    // Assemble Smali text to bytecode
-    bool assemble(const std::string& smali_code, std::vector<uint8_t>& bytecode, std::string& error);
-
-    // Assemble a single instruction
-    bool assemble_insn(const std::string& line, std::vector<uint8_t>& bytecode, std::string& error);
-
-private:
-    std::vector<std::string> strings_;
-    std::vector<std::string> types_;
-    std::vector<std::string> methods_;
-    std::vector<std::string> fields_;
-
-    int find_string(const std::string& str) const;
-    int find_type(const std::string& type) const;
-    int find_method(const std::string& method) const;
-    int find_field(const std::string& field) const;
-
-    bool parse_register(const std::string& reg, int& num);
-    bool parse_int(const std::string& str, int64_t& val);
-};
-
 } // namespace dex
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstddef>
+
+namespace dex {
+
+class DexSession;
+
+// Receives (classes done, total) between batches; returning false cancels the export
+using ExportProgress = std::function<bool(size_t, size_t)>;
+
+struct ExportStats {
+    size_t classes = 0;  // .smali files written
+    size_t skipped = 0;  // classes whose descriptor does not map to a safe relative path
+    size_t bytes = 0;    // Smali text produced, before compression
+    bool cancelled = false;
+};
+
+// Disassemble every class of `session` into `output`: a directory tree of .smali files, or a ZIP
+// file when `zip` is set. Classes are rendered (and compressed) in parallel batches on the shared
+// pool; ZIP entries are written in class_def order. A cancelled ZIP export removes the partial file.
+bool export_smali(const DexSession& session, const std::string& output, bool zip,
+                  const ExportProgress& progress, ExportStats& stats, std::string& error);
+
+} // namespace dex
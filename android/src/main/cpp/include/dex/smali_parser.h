@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "dex_builder.h"
+#include "smali_assembler.h"
+
+namespace dex {
+
+// Smali class parser - defines one class in a DexBuilder from its .smali source
+class SmaliParser {
+public:
+    explicit SmaliParser(DexBuilder& builder) : builder_(builder), assembler_(builder) {}
+
+    // Parse .class/.super/.source/.implements, fields with their values, methods and annotations.
+    // The class replaces any class of the same name in the builder; references missing from the
+    // builder's pools are added. Errors are reported as "Line N: ...".
+    bool parse(std::string_view smali, std::string& error);
+
+    // Descriptor from the .class directive of the last parse
+    const std::string& class_name() const { return class_name_; }
+
+private:
+    DexBuilder& builder_;
+    SmaliAssembler assembler_;
+    std::string class_name_;
+
+    std::string_view source_;
+    std::vector<SmaliLine> lines_;
+
+    struct Cursor;
+    uint32_t line_number(const char* at) const;
+    bool fail(const char* at, const std::string& message, std::string& error) const;
+
+    bool parse_field(size_t& line, ClassBuilder& cls, std::string& error);
+    bool parse_method(size_t& line, ClassBuilder& cls, std::string& error);
+
+    // `.annotation` block starting at `line`; `line` is left on its .end annotation
+    bool parse_annotation(size_t& line, AnnotationDef& annotation, std::string& error);
+    bool parse_annotation_elements(Cursor& cursor, std::string_view end_directive, std::vector<uint8_t>& out,
+                                   std::string& error);
+    // One encoded_value; `type` is the declared type it initializes, or empty when unknown
+    bool parse_value(Cursor& cursor, std::string_view type, std::vector<uint8_t>& out, std::string& error);
+};
+
+// Assemble many classes into `builder`. Chunks of `sources` are parsed in parallel on the shared
+// pool, each into its own partial builder, whose pools are then merged in source order, so the
+// result does not depend on the thread count. New ids land in sorted position when the builder
+// is built, also on top of a loaded base DEX. On failure `error` names the first failing source.
+bool assemble_smali_classes(DexBuilder& builder, const std::vector<std::string>& sources, std::string& error);
+
+} // namespace dex
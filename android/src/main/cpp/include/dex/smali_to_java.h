@@ -40,6 +40,11 @@ private:
     std::string convert_cast(const std::string& line);
     std::string convert_arithmetic(const std::string& line);
     
+    // Track source names from .param/.local/.end local/.restart local directives
+    void record_debug_name(const std::string& directive);
+    // Replace register tokens outside string literals with their source names
+    std::string apply_names(const std::string& line) const;
+    
     std::string type_to_java(const std::string& smali_type);
     std::string method_to_java(const std::string& method_ref);
     std::string get_indent();
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+namespace dex {
+
+// Append-only Smali text writer over a caller-owned buffer. Numbers are formatted with
+// std::to_chars, so rendering into a reused buffer only allocates when it has to grow.
+class SmaliWriter {
+public:
+    explicit SmaliWriter(std::string& out) : out_(out) {}
+
+    SmaliWriter& append(std::string_view text) { out_.append(text.data(), text.size()); return *this; }
+    SmaliWriter& append(char c) { out_ += c; return *this; }
+
+    SmaliWriter& decimal(int64_t number);
+    SmaliWriter& decimal(uint64_t number);
+    SmaliWriter& decimal(int number) { return decimal(static_cast<int64_t>(number)); }
+    SmaliWriter& decimal(uint32_t number) { return decimal(static_cast<uint64_t>(number)); }
+
+    // Signed hex literal as baksmali prints it ("0x1f", "-0x1"), followed by `suffix` ("t", "s", "L")
+    SmaliWriter& hex(int64_t number, std::string_view suffix = {});
+
+    // Register operand "vN"
+    SmaliWriter& reg(uint32_t number) { out_ += 'v'; return decimal(static_cast<uint64_t>(number)); }
+
+    // Quoted string literal with Smali escapes; other bytes are copied as-is
+    SmaliWriter& string_literal(std::string_view str);
+
+    std::string& buffer() { return out_; }
+
+private:
+    std::string& out_;
+};
+
+} // namespace dex
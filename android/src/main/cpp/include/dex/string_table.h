@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace dex {
+
+struct ByteView;
+
+// Decode Modified UTF-8 (as stored in string_data_item) into standard UTF-8
+std::string decode_mutf8(const uint8_t* data, size_t size);
+
+// Order of string_ids: by UTF-16 code units. Either side may be UTF-8 or Modified UTF-8;
+// returns <0, 0 or >0 like std::string::compare.
+int compare_utf16(std::string_view a, std::string_view b);
+
+// String pool that reads string_ids lazily and decodes each entry on first access
+class StringTable {
+public:
+    StringTable() = default;
+
+    StringTable(const StringTable&) = delete;
+    StringTable& operator=(const StringTable&) = delete;
+
+    void reset(const ByteView& data, uint32_t ids_off, uint32_t count);
+
+    uint32_t size() const { return count_; }
+
+    // Raw MUTF-8 bytes of an entry, without allocating; empty if out of range
+    std::string_view raw(uint32_t idx) const;
+
+    // Entry decoded to UTF-8; cached, safe to call from multiple threads
+    const std::string& get(uint32_t idx) const;
+
+    // Decode entries [begin, end) in one batch so later lookups are cache hits
+    void prefetch(uint32_t begin, uint32_t end) const;
+
+    // Every entry, decoded on first call
+    const std::vector<std::string>& all() const;
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t data_size_ = 0;
+    uint32_t ids_off_ = 0;
+    uint32_t count_ = 0;
+
+    mutable std::vector<std::string> cache_;
+    mutable std::unique_ptr<std::atomic<bool>[]> ready_;
+    mutable std::mutex mutex_;
+    mutable std::atomic<bool> all_ready_{false};
+
+    void decode_locked(uint32_t idx) const;
+};
+
+} // namespace dex
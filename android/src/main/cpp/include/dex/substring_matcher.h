@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+namespace dex {
+
+// Substring matcher over raw MUTF-8 bytes, vectorized with SSE2/AVX2 or NEON where available.
+// Case-insensitive mode folds ASCII letters only; every other byte must match exactly.
+class SubstringMatcher {
+public:
+    SubstringMatcher(std::string_view needle, bool case_sensitive);
+
+    // filter_ points into needle_
+    SubstringMatcher(const SubstringMatcher&) = delete;
+    SubstringMatcher& operator=(const SubstringMatcher&) = delete;
+
+    // `limit`, if given, marks the end of memory that is safe to read past `text`
+    // (e.g. the end of the DEX image), so short candidates can still use full-width loads
+    bool match(std::string_view text, const char* limit = nullptr) const;
+
+    const std::string& needle() const { return needle_; }
+
+    // Precomputed needle data shared with the per-ISA scanners
+    struct Filter {
+        const char* needle;
+        size_t size;
+        bool case_sensitive;
+        // First/last needle byte in both ASCII cases (equal for non-letters)
+        uint8_t first_lower, first_upper;
+        uint8_t last_lower, last_upper;
+    };
+
+private:
+    std::string needle_;  // lowercased when case-insensitive
+    Filter filter_;
+};
+
+} // namespace dex
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace dex {
+
+class DexParser;
+
+enum class SymbolKind {
+    kString,
+    kType,    // "Lfoo/Bar;"
+    kMethod,  // "Lfoo/Bar;->baz(I)V"
+    kField,   // "Lfoo/Bar;->baz:I"
+};
+
+// Immutable reference pools shared by disassemblers; safe to use from multiple threads
+class SymbolResolver {
+public:
+    virtual ~SymbolResolver() = default;
+
+    // Smali text of an entry, or nullptr if idx is out of range
+    virtual const std::string* get(SymbolKind kind, uint32_t idx) const = 0;
+};
+
+// Pools of a parsed DEX; each entry is resolved on first use and cached, like StringTable.
+// The parser must outlive the resolver and be parsed before the first lookup.
+class DexSymbolResolver : public SymbolResolver {
+public:
+    explicit DexSymbolResolver(const DexParser& parser) : parser_(parser) {}
+
+    const std::string* get(SymbolKind kind, uint32_t idx) const override;
+
+private:
+    // Method or field signatures, built one slot at a time
+    struct Signatures {
+        std::vector<std::string> cache;
+        std::unique_ptr<std::atomic<bool>[]> ready;
+    };
+
+    const DexParser& parser_;
+
+    mutable std::once_flag slots_once_;
+    mutable Signatures methods_;
+    mutable Signatures fields_;
+    mutable std::mutex mutex_;
+
+    const std::string* signature(SymbolKind kind, uint32_t idx) const;
+};
+
+} // namespace dex
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+namespace dex {
+
+// Fixed-size pool with one task deque per worker; idle workers steal from the others' queues
+class ThreadPool {
+public:
+    // threads == 0 uses std::thread::hardware_concurrency()
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size() + 1; }  // workers plus the calling thread
+
+    // Run fn(i) for every i in [0, count) and wait; the calling thread helps execute tasks
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+    // Process-wide pool used by the parsers and scanners
+    static std::shared_ptr<ThreadPool> shared();
+    static void set_shared_thread_count(size_t threads);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> next_queue_{0};
+    bool stop_ = false;
+
+    void push(std::function<void()> task);
+    bool try_pop(size_t home, std::function<void()>& task);
+    void worker_loop(size_t index);
+};
+
+// Number of chunks to split `count` items into for the shared pool (at least min_chunk items each)
+size_t chunk_count(size_t count, size_t min_chunk);
+
+// Run fn(chunk, begin, end) for `chunks` even slices of [0, count) on the shared pool.
+// Merge per-chunk results in chunk order so output does not depend on the thread count.
+void parallel_chunks(size_t count, size_t chunks, const std::function<void(size_t, size_t, size_t)>& fn);
+
+} // namespace dex
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "dex_search.h"
+
+namespace dex {
+
+class DexParser;
+
+// Posting lists of ASCII-lowercased byte trigrams over one search pool.
+// Serves both case-sensitive and case-insensitive substring queries; hits still need verifying.
+class TrigramIndex {
+public:
+    static constexpr size_t kGram = 3;
+
+    void build(const DexParser& parser, SearchTarget target);
+
+    // Ascending item indexes containing every trigram of `query`.
+    // Returns false when the query is too short for the index to narrow anything.
+    bool candidates(std::string_view query, std::vector<uint32_t>& out) const;
+
+private:
+    std::vector<uint32_t> keys_;      // sorted packed trigrams
+    std::vector<uint32_t> offsets_;   // size = keys_.size() + 1
+    std::vector<uint32_t> postings_;  // item indexes, ascending within each key
+};
+
+} // namespace dex
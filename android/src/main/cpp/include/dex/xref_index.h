@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace dex {
+
+class DexParser;
+
+// One referencing instruction: the calling method and the instruction's pc in code units
+struct XrefSite {
+    uint32_t method_idx;
+    uint32_t pc;
+};
+
+struct XrefRange {
+    const XrefSite* first = nullptr;
+    const XrefSite* last = nullptr;
+
+    const XrefSite* begin() const { return first; }
+    const XrefSite* end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+enum class XrefKind {
+    kMethod,  // invoke-*
+    kField,   // iget/iput/sget/sput
+    kString,  // const-string(/jumbo)
+    kType,    // const-class, check-cast, instance-of, new-instance, new-array, filled-new-array
+};
+
+// Every code reference in a DEX, built in one pass over all code items.
+// Sites for each target are stored contiguously (CSR) in class_def order.
+class XrefIndex {
+public:
+    void build(const DexParser& parser);
+
+    XrefRange sites(XrefKind kind, uint32_t idx) const;
+
+private:
+    struct Table {
+        std::vector<uint32_t> offsets;  // size = target count + 1
+        std::vector<XrefSite> sites;
+    };
+
+    Table tables_[4];
+};
+
+} // namespace dex
@@ -1,11 +1,25 @@
 #include <jni.h>
 #include <string>
 #include <vector>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdlib>
 #include <android/log.h>
 
 #include "dex/dex_parser.h"
 #include "dex/dex_builder.h"
+#include "dex/dex_session.h"
+#include "dex/dex_search.h"
+#include "dex/thread_pool.h"
+#include "dex/substring_matcher.h"
+#include "dex/json_writer.h"
+#include "dex/binary_result.h"
+#include "dex/result_cursor.h"
+#include "dex/smali_export.h"
 #include "dex/smali_disasm.h"
+#include "dex/smali_parser.h"
 #include "dex/smali_to_java.h"
 #include "xml/axml_parser.h"
 #include "arsc/arsc_parser.h"
@@ -52,21 +66,56 @@ static jstring string_to_jstring(JNIEnv* env, const std::string& str) {
     return env->NewStringUTF(str.c_str());
 }
 
-extern "C" {
+static std::string error_json(const std::string& message) {
+    json error = {{"error", message}};
+    return error.dump();
+}
 
-// ==================== DEX 解析操作 ====================
+// Helper: Per-thread output buffer for streamed responses; keeps its capacity between calls
+static std::string& response_buffer() {
+    static constexpr size_t kMaxRetained = 16 * 1024 * 1024;
+    thread_local std::string buffer;
+    if (buffer.capacity() > kMaxRetained) {
+        std::string().swap(buffer);
+    }
+    buffer.clear();
+    return buffer;
+}
 
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_getDexInfo(JNIEnv* env, jclass, jbyteArray dexBytes) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
+// Helper: Run a query against a one-shot session parsed in place over the Java array's elements.
+// Parsing and the query can take long, so the array is not held in a critical region, which would
+// stall the GC; GetByteArrayElements may copy instead. Streamed queries return response_buffer()
+// itself, which makes the assignment below a no-op.
+template <typename Query>
+static jstring query_dex_bytes(JNIEnv* env, jbyteArray dexBytes, Query&& query) {
+    if (!dexBytes) return string_to_jstring(env, error_json("Failed to parse DEX"));
+    
+    jsize len = env->GetArrayLength(dexBytes);
+    jbyte* bytes = env->GetByteArrayElements(dexBytes, nullptr);
+    if (!bytes) return string_to_jstring(env, error_json("Failed to access DEX bytes"));
+    
+    std::string& result = response_buffer();
+    {
+        dex::DexSession session;
+        if (session.open_view(reinterpret_cast<const uint8_t*>(bytes), static_cast<size_t>(len))) {
+            result = query(session);
+        } else {
+            result = error_json("Failed to parse DEX");
+        }
     }
+    env->ReleaseByteArrayElements(dexBytes, bytes, JNI_ABORT);
     
-    const auto& header = parser.header();
+    return string_to_jstring(env, result);
+}
+
+static jlong register_session(std::shared_ptr<dex::DexSession> session) {
+    return static_cast<jlong>(dex::SessionRegistry::instance().add(std::move(session)));
+}
+
+// ==================== DEX 查询实现（字节数组与会话句柄共用） ====================
+
+static std::string dex_info_json(const dex::DexSession& session) {
+    const auto& header = session.parser().header();
     json result = {
         {"version", std::string(reinterpret_cast<const char*>(header.magic + 4), 3)},
         {"file_size", header.file_size},
@@ -77,415 +126,254 @@ Java_com_aetherlink_dexeditor_CppDex_getDexInfo(JNIEnv* env, jclass, jbyteArray
         {"methods_count", header.method_ids_size},
         {"classes_count", header.class_defs_size}
     };
-    
-    return string_to_jstring(env, result.dump());
+    return result.dump();
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_listClasses(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                  jstring packageFilter, jint offset, jint limit) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string filter = jstring_to_string(env, packageFilter);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
-    
-    json class_list = json::array();
-    const auto& classes = parser.classes();
+static const std::string& list_classes_json(const dex::DexSession& session, const std::string& filter,
+                                            int offset, int limit) {
+    const auto& parser = session.parser();
+    dex::SubstringMatcher matcher(filter, true);
+    const char* dex_end = reinterpret_cast<const char*>(parser.data().end());
     int count = 0;
     int matched = 0;
     
-    for (const auto& cls : classes) {
-        std::string class_name = parser.get_class_name(cls.class_idx);
+    std::string& out = response_buffer();
+    dex::JsonWriter writer(out);
+    writer.begin_object().key("classes").begin_array();
+    for (const auto& cls : parser.classes()) {
+        std::string_view class_name = parser.type_descriptor(cls.class_idx);
         
-        if (!filter.empty() && class_name.find(filter) == std::string::npos) {
+        if (!matcher.match(class_name, dex_end)) {
             continue;
         }
         
         matched++;
         if (matched > offset && count < limit) {
-            class_list.push_back(class_name);
+            writer.value(class_name);
             count++;
         }
     }
-    
-    json result = {
-        {"classes", class_list},
-        {"shown", class_list.size()},
-        {"total", matched}
-    };
-    
-    return string_to_jstring(env, result.dump());
+    writer.end_array();
+    writer.key("shown").value(count);
+    writer.key("total").value(matched);
+    writer.end_object();
+    return out;
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_searchInDex(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                  jstring query, jstring searchType,
-                                                  jboolean caseSensitive, jint maxResults) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string q = jstring_to_string(env, query);
-    std::string type = jstring_to_string(env, searchType);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
+// One level of the package tree: direct subpackages with class counts, then direct classes
+static const std::string& package_level_json(const dex::DexSession& session, const std::string& path) {
+    const auto& parser = session.parser();
+    const dex::PackageTree& tree = session.package_tree();
+    const dex::PackageTree::Node* node = tree.find(path);
+    
+    std::string& out = response_buffer();
+    if (!node) {
+        out = error_json("Package not found: " + path);
+        return out;
     }
     
-    json results = json::array();
-    int count = 0;
-    
-    // 转换为小写用于不区分大小写搜索
-    std::string q_lower = q;
-    if (!caseSensitive) {
-        std::transform(q_lower.begin(), q_lower.end(), q_lower.begin(), ::tolower);
+    dex::JsonWriter writer(out);
+    writer.begin_object();
+    writer.key("package").value(path);
+    writer.key("packages").begin_array();
+    for (const auto* child = tree.children_begin(*node); child != tree.children_end(*node); ++child) {
+        writer.begin_object();
+        writer.key("name").value(child->name);
+        writer.key("classCount").value(child->total_classes);
+        writer.key("packageCount").value(child->child_count);
+        writer.end_object();
     }
-    
-    if (type == "string") {
-        for (const auto& s : parser.strings()) {
-            if (count >= maxResults) break;
-            
-            std::string s_check = caseSensitive ? s : s;
-            if (!caseSensitive) {
-                s_check.resize(s.size());
-                std::transform(s.begin(), s.end(), s_check.begin(), ::tolower);
-            }
-            
-            if (s_check.find(q_lower) != std::string::npos) {
-                results.push_back({{"type", "string"}, {"value", s}});
-                count++;
-            }
-        }
-    } else if (type == "class") {
-        for (const auto& cls : parser.classes()) {
-            if (count >= maxResults) break;
-            std::string class_name = parser.get_class_name(cls.class_idx);
-            
-            std::string check = caseSensitive ? class_name : class_name;
-            if (!caseSensitive) {
-                check.resize(class_name.size());
-                std::transform(class_name.begin(), class_name.end(), check.begin(), ::tolower);
-            }
-            
-            if (check.find(q_lower) != std::string::npos) {
-                results.push_back({{"type", "class"}, {"name", class_name}});
-                count++;
-            }
-        }
-    } else if (type == "method") {
-        auto methods = parser.get_methods();
-        for (const auto& m : methods) {
-            if (count >= maxResults) break;
-            
-            std::string check = caseSensitive ? m.method_name : m.method_name;
-            if (!caseSensitive) {
-                check.resize(m.method_name.size());
-                std::transform(m.method_name.begin(), m.method_name.end(), check.begin(), ::tolower);
-            }
-            
-            if (check.find(q_lower) != std::string::npos) {
-                results.push_back({
-                    {"type", "method"},
-                    {"class", m.class_name},
-                    {"name", m.method_name},
-                    {"prototype", m.prototype}
-                });
-                count++;
-            }
-        }
-    } else if (type == "field") {
-        auto fields = parser.get_fields();
-        for (const auto& f : fields) {
-            if (count >= maxResults) break;
-            
-            std::string check = caseSensitive ? f.field_name : f.field_name;
-            if (!caseSensitive) {
-                check.resize(f.field_name.size());
-                std::transform(f.field_name.begin(), f.field_name.end(), check.begin(), ::tolower);
-            }
-            
-            if (check.find(q_lower) != std::string::npos) {
-                results.push_back({
-                    {"type", "field"},
-                    {"class", f.class_name},
-                    {"name", f.field_name},
-                    {"fieldType", f.type_name}
-                });
-                count++;
-            }
+    writer.end_array();
+    writer.key("classes").begin_array();
+    for (const uint32_t* idx = tree.classes_begin(*node); idx != tree.classes_end(*node); ++idx) {
+        writer.value(parser.type_descriptor(parser.classes()[*idx].class_idx));
+    }
+    writer.end_array();
+    writer.key("totalClasses").value(node->total_classes);
+    writer.end_object();
+    return out;
+}
+
+// Helper: Write a proto as "(params)return" without building it in a temporary string
+static void write_proto(dex::JsonWriter& writer, const dex::DexParser& parser, uint32_t proto_idx) {
+    dex::ProtoId proto;
+    writer.begin_string();
+    if (parser.proto_id(proto_idx, proto)) {
+        writer.append("(");
+        for (uint32_t i = 0; i < proto.param_count; i++) {
+            writer.append(parser.type_descriptor(proto.param(i)));
         }
+        writer.append(")");
+        writer.append(parser.type_descriptor(proto.return_type_idx));
+    } else {
+        writer.append("()V");
     }
-    
-    json result = {
-        {"query", q},
-        {"searchType", type},
-        {"results", results},
-        {"count", results.size()}
-    };
-    
-    return string_to_jstring(env, result.dump());
+    writer.end_string();
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_getClassSmali(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                    jstring className) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
+static const std::string& search_json(const dex::DexSession& session, const std::string& q,
+                                      const std::string& type, bool caseSensitive, int maxResults,
+                                      bool regex = false) {
+    const auto& parser = session.parser();
+    const auto& strings = parser.string_table();
+    std::string& out = response_buffer();
+    
+    dex::SearchOptions options;
+    options.query = q;
+    options.case_sensitive = caseSensitive;
+    options.regex = regex;
+    // 与原实现一致：maxResults <= 0 时不返回结果，而不是不限数量
+    options.max_results = maxResults > 0 ? static_cast<size_t>(maxResults) : 0;
+    
+    std::vector<uint32_t> hits;
+    if (dex::parse_search_target(type, options.target)) {
+        std::string error;
+        if (!session.search(options, hits, error)) {
+            out = error_json("Invalid regex: " + error);
+            return out;
+        }
     }
     
-    // 设置反汇编器上下文
-    dex::SmaliDisassembler disasm;
-    disasm.set_strings(parser.strings());
-    disasm.set_types(parser.types());
-    disasm.set_methods(parser.get_method_signatures());
-    disasm.set_fields(parser.get_field_signatures());
-    
-    // 查找类并反汇编所有方法
-    std::stringstream smali;
-    bool found = false;
-    
-    for (const auto& cls : parser.classes()) {
-        if (parser.get_class_name(cls.class_idx) == class_name) {
-            found = true;
-            
-            // 输出类声明
-            smali << ".class public " << class_name << "\n";
-            smali << ".super Ljava/lang/Object;\n\n";
-            
-            // 获取该类的所有方法
-            auto methods = parser.get_methods();
-            for (const auto& m : methods) {
-                if (m.class_name == class_name) {
-                    dex::CodeItem code;
-                    if (parser.get_method_code(class_name, m.method_name, code)) {
-                        auto insns = disasm.disassemble_method(code.insns.data(), code.insns.size());
-                        
-                        smali << ".method public " << m.method_name << m.prototype << "\n";
-                        smali << "    .registers " << code.registers_size << "\n";
-                        smali << disasm.to_smali(insns);
-                        smali << ".end method\n\n";
-                    }
-                }
-            }
-            break;
+    dex::JsonWriter writer(out);
+    writer.begin_object();
+    writer.key("count").value(hits.size());
+    writer.key("query").value(q);
+    writer.key("regex").value(regex);
+    writer.key("results").begin_array();
+    for (uint32_t idx : hits) {
+        dex::MemberId id;
+        writer.begin_object();
+        switch (options.target) {
+            case dex::SearchTarget::kString:
+                writer.key("type").value("string");
+                writer.key("value").value(strings.raw(idx));
+                break;
+            case dex::SearchTarget::kClass:
+                writer.key("type").value("class");
+                writer.key("name").value(parser.type_descriptor(parser.classes()[idx].class_idx));
+                break;
+            case dex::SearchTarget::kMethod:
+                parser.method_id(idx, id);
+                writer.key("type").value("method");
+                writer.key("class").value(parser.type_descriptor(id.class_idx));
+                writer.key("name").value(strings.raw(id.name_idx));
+                writer.key("prototype");
+                write_proto(writer, parser, id.type_idx);
+                break;
+            case dex::SearchTarget::kField:
+                parser.field_id(idx, id);
+                writer.key("type").value("field");
+                writer.key("class").value(parser.type_descriptor(id.class_idx));
+                writer.key("name").value(strings.raw(id.name_idx));
+                writer.key("fieldType").value(parser.type_descriptor(id.type_idx));
+                break;
         }
+        writer.end_object();
     }
-    
-    if (!found) {
-        json error = {{"error", "Class not found: " + class_name}};
-        return string_to_jstring(env, error.dump());
+    writer.end_array();
+    writer.key("searchType").value(type);
+    writer.end_object();
+    return out;
+}
+
+static std::string class_smali_json(const dex::DexSession& session, const std::string& class_name) {
+    std::string smali;
+    if (!session.class_smali(class_name, smali, true)) {
+        return error_json("Class not found: " + class_name);
     }
     
     json result = {
         {"className", class_name},
-        {"smali", smali.str()}
+        {"smali", smali}
     };
-    
-    return string_to_jstring(env, result.dump());
+    return result.dump();
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_getMethodSmali(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                     jstring className, jstring methodName,
-                                                     jstring methodSignature) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    std::string method_name = jstring_to_string(env, methodName);
-    std::string method_sig = jstring_to_string(env, methodSignature);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
-    
+static std::string method_smali_json(const dex::DexSession& session, uint32_t method_idx) {
+    const auto& parser = session.parser();
     dex::CodeItem code;
-    if (!parser.get_method_code(class_name, method_name, code)) {
-        json error = {{"error", "Method not found or has no code"}};
-        return string_to_jstring(env, error.dump());
+    if (!parser.get_method_code(method_idx, code)) {
+        return error_json("Method not found or has no code");
     }
     
-    dex::SmaliDisassembler disasm;
-    disasm.set_strings(parser.strings());
-    disasm.set_types(parser.types());
-    disasm.set_methods(parser.get_method_signatures());
-    disasm.set_fields(parser.get_field_signatures());
-    
-    auto insns = disasm.disassemble_method(code.insns.data(), code.insns.size());
-    std::string smali_code = disasm.to_smali(insns);
-    
+    dex::MethodInfo m = parser.get_method(method_idx);
+    std::string smali_code;
+    dex::SmaliWriter writer(smali_code);
+    session.code_smali(writer, method_idx, m.access_flags, code, true);
     json result = {
-        {"className", class_name},
-        {"methodName", method_name},
+        {"className", m.class_name},
+        {"methodName", m.method_name},
+        {"prototype", m.prototype},
+        {"methodIdx", method_idx},
+        {"accessFlags", m.access_flags},
         {"registers", code.registers_size},
         {"smali", smali_code}
     };
-    
-    return string_to_jstring(env, result.dump());
+    return result.dump();
 }
 
-// ==================== Smali 转 Java ====================
-
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_smaliToJava(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                  jstring className) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
-    
-    // 先获取类的 Smali 代码
-    dex::SmaliDisassembler disasm;
-    disasm.set_strings(parser.strings());
-    disasm.set_types(parser.types());
-    disasm.set_methods(parser.get_method_signatures());
-    disasm.set_fields(parser.get_field_signatures());
-    
-    std::stringstream smali;
-    bool found = false;
-    
-    for (const auto& cls : parser.classes()) {
-        if (parser.get_class_name(cls.class_idx) == class_name) {
-            found = true;
-            smali << ".class public " << class_name << "\n";
-            smali << ".super Ljava/lang/Object;\n\n";
-            
-            auto methods = parser.get_methods();
-            for (const auto& m : methods) {
-                if (m.class_name == class_name) {
-                    dex::CodeItem code;
-                    if (parser.get_method_code(class_name, m.method_name, code)) {
-                        auto insns = disasm.disassemble_method(code.insns.data(), code.insns.size());
-                        smali << ".method public " << m.method_name << m.prototype << "\n";
-                        smali << "    .registers " << code.registers_size << "\n";
-                        smali << disasm.to_smali(insns);
-                        smali << ".end method\n\n";
-                    }
+// method_sig may be a bare proto "(I)V" or carry the name "foo(I)V"; empty picks the first overload
+static std::string method_smali_json(const dex::DexSession& session, const std::string& class_name,
+                                     const std::string& method_name, const std::string& method_sig) {
+    const auto& parser = session.parser();
+    size_t paren = method_sig.find('(');
+    std::string proto = paren != std::string::npos ? method_sig.substr(paren) : std::string();
+    
+    int method_idx = -1;
+    if (!proto.empty()) {
+        method_idx = parser.find_method(class_name, method_name, proto);
+    } else {
+        int class_def_idx = parser.find_class_def(class_name);
+        if (class_def_idx >= 0) {
+            for (const dex::EncodedMethod& method : parser.class_data(class_def_idx).methods()) {
+                dex::MemberId id;
+                if (parser.method_id(method.method_idx, id) && parser.get_string(id.name_idx) == method_name) {
+                    method_idx = static_cast<int>(method.method_idx);
+                    break;
                 }
             }
-            break;
         }
     }
-    
-    if (!found) {
-        json error = {{"error", "Class not found: " + class_name}};
-        return string_to_jstring(env, error.dump());
+    if (method_idx < 0) {
+        return error_json("Method not found or has no code");
+    }
+    return method_smali_json(session, static_cast<uint32_t>(method_idx));
+}
+
+static std::string smali_to_java_json(const dex::DexSession& session, const std::string& class_name) {
+    // 先获取类的 Smali 代码（带调试信息，参数和局部变量使用源码中的名称）
+    std::string smali;
+    if (!session.class_smali(class_name, smali, true)) {
+        return error_json("Class not found: " + class_name);
     }
     
     // 转换为 Java 伪代码
     dex::SmaliToJava converter;
-    std::string java_code = converter.convert(smali.str());
+    std::string java_code = converter.convert(smali);
     
     if (java_code.empty()) {
-        json error = {{"error", "Failed to convert class: " + class_name}};
-        return string_to_jstring(env, error.dump());
+        return error_json("Failed to convert class: " + class_name);
     }
     
     json result = {
         {"className", class_name},
         {"java", java_code}
     };
-    
-    return string_to_jstring(env, result.dump());
-}
-
-// ==================== DEX 修改操作 ====================
-
-JNIEXPORT jbyteArray JNICALL
-Java_com_aetherlink_dexeditor_CppDex_modifyClass(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                  jstring className, jstring newSmali) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    std::string smali_code = jstring_to_string(env, newSmali);
-    
-    dex::DexBuilder builder;
-    if (!builder.load(data)) {
-        LOGE("Failed to load DEX for modification");
-        return nullptr;
-    }
-    
-    // TODO: 实现类修改逻辑
-    // 这需要解析 smali_code 并修改 builder
-    
-    auto result = builder.build();
-    if (result.empty()) {
-        LOGE("Failed to build modified DEX");
-        return nullptr;
-    }
-    
-    return vector_to_jbyteArray(env, result);
-}
-
-JNIEXPORT jbyteArray JNICALL
-Java_com_aetherlink_dexeditor_CppDex_addClass(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                               jstring newSmali) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string smali_code = jstring_to_string(env, newSmali);
-    
-    dex::DexBuilder builder;
-    if (!builder.load(data)) {
-        LOGE("Failed to load DEX");
-        return nullptr;
-    }
-    
-    // TODO: 解析 smali_code 并添加类
-    
-    auto result = builder.build();
-    if (result.empty()) {
-        return nullptr;
-    }
-    
-    return vector_to_jbyteArray(env, result);
-}
-
-JNIEXPORT jbyteArray JNICALL
-Java_com_aetherlink_dexeditor_CppDex_deleteClass(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                  jstring className) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    
-    // TODO: 实现删除类逻辑
-    
-    return nullptr;
+    return result.dump();
 }
 
-// ==================== 方法级操作 ====================
-
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_listMethods(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                  jstring className) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
-    
+static std::string list_methods_json(const dex::DexSession& session, const std::string& class_name) {
+    const auto& parser = session.parser();
     json method_list = json::array();
-    auto methods = parser.get_methods();
-    
-    for (const auto& m : methods) {
-        if (m.class_name == class_name) {
-            method_list.push_back({
-                {"name", m.method_name},
-                {"prototype", m.prototype},
-                {"accessFlags", m.access_flags}
-            });
-        }
+    
+    for (uint32_t method_idx : parser.class_method_ids(class_name)) {
+        dex::MethodInfo m = parser.get_method(method_idx);
+        method_list.push_back({
+            {"name", m.method_name},
+            {"prototype", m.prototype},
+            {"accessFlags", m.access_flags},
+            {"methodIdx", method_idx}
+        });
     }
     
     json result = {
@@ -493,33 +381,20 @@ Java_com_aetherlink_dexeditor_CppDex_listMethods(JNIEnv* env, jclass, jbyteArray
         {"methods", method_list},
         {"count", method_list.size()}
     };
-    
-    return string_to_jstring(env, result.dump());
+    return result.dump();
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_listFields(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                 jstring className) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
-    
+static std::string list_fields_json(const dex::DexSession& session, const std::string& class_name) {
+    const auto& parser = session.parser();
     json field_list = json::array();
-    auto fields = parser.get_fields();
-    
-    for (const auto& f : fields) {
-        if (f.class_name == class_name) {
-            field_list.push_back({
-                {"name", f.field_name},
-                {"type", f.type_name},
-                {"accessFlags", f.access_flags}
-            });
-        }
+    
+    for (uint32_t field_idx : parser.class_field_ids(class_name)) {
+        dex::FieldInfo f = parser.get_field(field_idx);
+        field_list.push_back({
+            {"name", f.field_name},
+            {"type", f.type_name},
+            {"accessFlags", f.access_flags}
+        });
     }
     
     json result = {
@@ -527,67 +402,40 @@ Java_com_aetherlink_dexeditor_CppDex_listFields(JNIEnv* env, jclass, jbyteArray
         {"fields", field_list},
         {"count", field_list.size()}
     };
-    
-    return string_to_jstring(env, result.dump());
+    return result.dump();
 }
 
-// ==================== 字符串操作 ====================
-
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_listStrings(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                  jstring filter, jint limit) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string filter_str = jstring_to_string(env, filter);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
-    
-    json string_list = json::array();
-    const auto& strings = parser.strings();
+static const std::string& list_strings_json(const dex::DexSession& session, const std::string& filter,
+                                            int limit) {
+    const auto& strings = session.parser().string_table();
+    dex::SubstringMatcher matcher(filter, true);
+    const char* dex_end = reinterpret_cast<const char*>(session.parser().data().end());
     int count = 0;
     int matched = 0;
     
-    for (const auto& s : strings) {
-        if (!filter_str.empty() && s.find(filter_str) == std::string::npos) {
+    std::string& out = response_buffer();
+    dex::JsonWriter writer(out);
+    writer.begin_object().key("strings").begin_array();
+    for (uint32_t i = 0; i < strings.size(); i++) {
+        std::string_view s = strings.raw(i);
+        if (!matcher.match(s, dex_end)) {
             continue;
         }
         matched++;
         if (count < limit) {
-            string_list.push_back(s);
+            writer.value(s);
             count++;
         }
     }
-    
-    json result = {
-        {"strings", string_list},
-        {"shown", string_list.size()},
-        {"matched", matched},
-        {"total", strings.size()}
-    };
-    
-    return string_to_jstring(env, result.dump());
+    writer.end_array();
+    writer.key("matched").value(matched);
+    writer.key("shown").value(count);
+    writer.key("total").value(strings.size());
+    writer.end_object();
+    return out;
 }
 
-// ==================== 交叉引用分析 ====================
-
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_findMethodXrefs(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                      jstring className, jstring methodName) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    std::string method_name = jstring_to_string(env, methodName);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
-    
-    auto xrefs = parser.find_method_xrefs(class_name, method_name);
-    
+static json xrefs_to_json(const std::vector<dex::DexParser::XRef>& xrefs) {
     json xref_list = json::array();
     for (const auto& xref : xrefs) {
         xref_list.push_back({
@@ -596,6 +444,18 @@ Java_com_aetherlink_dexeditor_CppDex_findMethodXrefs(JNIEnv* env, jclass, jbyteA
             {"offset", xref.offset}
         });
     }
+    return xref_list;
+}
+
+// method_name 可带原型 "foo(I)V" 只查该重载，否则合并所有同名重载的引用
+static std::string method_xrefs_json(const dex::DexSession& session, const std::string& class_name,
+                                     const std::string& method_name) {
+    std::vector<dex::DexParser::XRef> xrefs;
+    for (uint32_t method_idx : session.parser().find_methods(class_name, method_name)) {
+        auto sites = session.xrefs(dex::XrefKind::kMethod, static_cast<int>(method_idx));
+        xrefs.insert(xrefs.end(), std::make_move_iterator(sites.begin()), std::make_move_iterator(sites.end()));
+    }
+    json xref_list = xrefs_to_json(xrefs);
     
     json result = {
         {"className", class_name},
@@ -603,42 +463,573 @@ Java_com_aetherlink_dexeditor_CppDex_findMethodXrefs(JNIEnv* env, jclass, jbyteA
         {"xrefs", xref_list},
         {"count", xref_list.size()}
     };
-    
-    return string_to_jstring(env, result.dump());
+    return result.dump();
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_aetherlink_dexeditor_CppDex_findFieldXrefs(JNIEnv* env, jclass, jbyteArray dexBytes,
-                                                     jstring className, jstring fieldName) {
-    auto data = jbyteArray_to_vector(env, dexBytes);
-    std::string class_name = jstring_to_string(env, className);
-    std::string field_name = jstring_to_string(env, fieldName);
-    
-    dex::DexParser parser;
-    if (!parser.parse(data)) {
-        json error = {{"error", "Failed to parse DEX"}};
-        return string_to_jstring(env, error.dump());
-    }
+static std::string field_xrefs_json(const dex::DexSession& session, const std::string& class_name,
+                                    const std::string& field_name) {
+    int field_idx = session.parser().find_field(class_name, field_name);
+    json xref_list = xrefs_to_json(session.xrefs(dex::XrefKind::kField, field_idx));
     
-    auto xrefs = parser.find_field_xrefs(class_name, field_name);
+    json result = {
+        {"className", class_name},
+        {"fieldName", field_name},
+        {"xrefs", xref_list},
+        {"count", xref_list.size()}
+    };
+    return result.dump();
+}
+
+static std::string string_xrefs_json(const dex::DexSession& session, const std::string& value) {
+    int string_idx = session.parser().find_string(value);
+    json xref_list = xrefs_to_json(session.xrefs(dex::XrefKind::kString, string_idx));
     
-    json xref_list = json::array();
-    for (const auto& xref : xrefs) {
-        xref_list.push_back({
-            {"callerClass", xref.caller_class},
-            {"callerMethod", xref.caller_method},
-            {"offset", xref.offset}
-        });
-    }
+    json result = {
+        {"string", value},
+        {"xrefs", xref_list},
+        {"count", xref_list.size()}
+    };
+    return result.dump();
+}
+
+static std::string type_xrefs_json(const dex::DexSession& session, const std::string& class_name) {
+    int type_idx = session.parser().find_type(class_name);
+    json xref_list = xrefs_to_json(session.xrefs(dex::XrefKind::kType, type_idx));
     
     json result = {
         {"className", class_name},
-        {"fieldName", field_name},
         {"xrefs", xref_list},
         {"count", xref_list.size()}
     };
+    return result.dump();
+}
+
+// ==================== 二进制结果（DexBinaryResult 解码） ====================
+
+// Helper: Hand a binary result to Java as a direct ByteBuffer; Java releases it with freeBinaryResult
+static jobject binary_to_buffer(JNIEnv* env, const dex::BinaryResult& result) {
+    size_t size = result.serialized_size();
+    void* data = std::malloc(size);
+    if (!data) return nullptr;
+    result.serialize(static_cast<uint8_t*>(data));
+    jobject buffer = env->NewDirectByteBuffer(data, static_cast<jlong>(size));
+    if (!buffer) std::free(data);
+    return buffer;
+}
+
+// Helper: Intern a proto as "(params)return", building each distinct proto once
+static uint32_t intern_proto(dex::BinaryResult& result, const dex::DexParser& parser, uint32_t proto_idx,
+                             std::unordered_map<uint32_t, uint32_t>& cache) {
+    auto it = cache.find(proto_idx);
+    if (it != cache.end()) return it->second;
+    
+    std::string text = "(";
+    dex::ProtoId proto;
+    if (parser.proto_id(proto_idx, proto)) {
+        for (uint32_t i = 0; i < proto.param_count; i++) {
+            text += parser.type_descriptor(proto.param(i));
+        }
+        text += ")";
+        text += parser.type_descriptor(proto.return_type_idx);
+    } else {
+        text = "()V";
+    }
+    uint32_t ref = result.intern_copy(std::move(text));
+    cache.emplace(proto_idx, ref);
+    return ref;
+}
+
+static dex::BinaryResult list_classes_binary(const dex::DexSession& session, const std::string& filter,
+                                             int offset, int limit) {
+    const auto& parser = session.parser();
+    dex::SubstringMatcher matcher(filter, true);
+    const char* dex_end = reinterpret_cast<const char*>(parser.data().end());
+    dex::BinaryResult result({{"name", dex::BinaryResult::Column::kString}});
+    int count = 0;
+    int matched = 0;
     
-    return string_to_jstring(env, result.dump());
+    for (const auto& cls : parser.classes()) {
+        std::string_view class_name = parser.type_descriptor(cls.class_idx);
+        if (!matcher.match(class_name, dex_end)) continue;
+        
+        matched++;
+        if (matched > offset && count < limit) {
+            result.string_cell(class_name);
+            count++;
+        }
+    }
+    result.add_meta("total", matched);
+    return result;
+}
+
+static dex::BinaryResult list_methods_binary(const dex::DexSession& session, const std::string& class_name) {
+    const auto& parser = session.parser();
+    dex::BinaryResult result({
+        {"name", dex::BinaryResult::Column::kString},
+        {"prototype", dex::BinaryResult::Column::kString},
+        {"accessFlags", dex::BinaryResult::Column::kInt},
+        {"methodIdx", dex::BinaryResult::Column::kInt}
+    });
+    std::unordered_map<uint32_t, uint32_t> protos;
+    
+    for (uint32_t method_idx : parser.class_method_ids(class_name)) {
+        dex::MemberId id;
+        if (!parser.method_id(method_idx, id)) continue;
+        dex::MethodInfo m = parser.get_method(method_idx);
+        result.string_cell(parser.string_table().raw(id.name_idx));
+        result.cell(intern_proto(result, parser, id.type_idx, protos));
+        result.cell(m.access_flags);
+        result.cell(method_idx);
+    }
+    return result;
+}
+
+static dex::BinaryResult list_fields_binary(const dex::DexSession& session, const std::string& class_name) {
+    const auto& parser = session.parser();
+    dex::BinaryResult result({
+        {"name", dex::BinaryResult::Column::kString},
+        {"type", dex::BinaryResult::Column::kString},
+        {"accessFlags", dex::BinaryResult::Column::kInt}
+    });
+    
+    for (uint32_t field_idx : parser.class_field_ids(class_name)) {
+        dex::MemberId id;
+        if (!parser.field_id(field_idx, id)) continue;
+        dex::FieldInfo f = parser.get_field(field_idx);
+        result.string_cell(parser.string_table().raw(id.name_idx));
+        result.string_cell(parser.type_descriptor(id.type_idx));
+        result.cell(f.access_flags);
+    }
+    return result;
+}
+
+static dex::BinaryResult list_strings_binary(const dex::DexSession& session, const std::string& filter,
+                                             int limit) {
+    const auto& strings = session.parser().string_table();
+    dex::SubstringMatcher matcher(filter, true);
+    const char* dex_end = reinterpret_cast<const char*>(session.parser().data().end());
+    dex::BinaryResult result({{"value", dex::BinaryResult::Column::kString}});
+    int count = 0;
+    int matched = 0;
+    
+    for (uint32_t i = 0; i < strings.size(); i++) {
+        std::string_view s = strings.raw(i);
+        if (!matcher.match(s, dex_end)) continue;
+        matched++;
+        if (count < limit) {
+            result.string_cell(s);
+            count++;
+        }
+    }
+    result.add_meta("matched", matched);
+    result.add_meta("total", strings.size());
+    return result;
+}
+
+static dex::BinaryResult search_columns(dex::SearchTarget target) {
+    using Column = dex::BinaryResult::Column;
+    switch (target) {
+        case dex::SearchTarget::kString:
+            return dex::BinaryResult({{"value", Column::kString}});
+        case dex::SearchTarget::kClass:
+            return dex::BinaryResult({{"name", Column::kString}});
+        case dex::SearchTarget::kMethod:
+            return dex::BinaryResult({{"class", Column::kString}, {"name", Column::kString},
+                                      {"prototype", Column::kString}});
+        case dex::SearchTarget::kField:
+            return dex::BinaryResult({{"class", Column::kString}, {"name", Column::kString},
+                                      {"fieldType", Column::kString}});
+    }
+    return dex::BinaryResult({});
+}
+
+// Returns false with the reason in `error` for an unknown search type or an invalid regex
+static bool search_binary(const dex::DexSession& session, const std::string& q, const std::string& type,
+                          bool caseSensitive, bool regex, int maxResults, dex::BinaryResult& result,
+                          std::string& error) {
+    const auto& parser = session.parser();
+    const auto& strings = parser.string_table();
+    
+    dex::SearchOptions options;
+    options.query = q;
+    options.case_sensitive = caseSensitive;
+    options.regex = regex;
+    options.max_results = maxResults > 0 ? static_cast<size_t>(maxResults) : 0;
+    if (!dex::parse_search_target(type, options.target)) {
+        error = "Unknown search type: " + type;
+        return false;
+    }
+    
+    std::vector<uint32_t> hits;
+    if (!session.search(options, hits, error)) {
+        error = "Invalid regex: " + error;
+        return false;
+    }
+    
+    result = search_columns(options.target);
+    std::unordered_map<uint32_t, uint32_t> protos;
+    for (uint32_t idx : hits) {
+        dex::MemberId id;
+        switch (options.target) {
+            case dex::SearchTarget::kString:
+                result.string_cell(strings.raw(idx));
+                break;
+            case dex::SearchTarget::kClass:
+                result.string_cell(parser.type_descriptor(parser.classes()[idx].class_idx));
+                break;
+            case dex::SearchTarget::kMethod:
+                parser.method_id(idx, id);
+                result.string_cell(parser.type_descriptor(id.class_idx));
+                result.string_cell(strings.raw(id.name_idx));
+                result.cell(intern_proto(result, parser, id.type_idx, protos));
+                break;
+            case dex::SearchTarget::kField:
+                parser.field_id(idx, id);
+                result.string_cell(parser.type_descriptor(id.class_idx));
+                result.string_cell(strings.raw(id.name_idx));
+                result.string_cell(parser.type_descriptor(id.type_idx));
+                break;
+        }
+    }
+    return true;
+}
+
+static dex::BinaryResult xrefs_binary(const dex::DexSession& session, dex::XrefKind kind,
+                                      const std::vector<uint32_t>& targets) {
+    const auto& parser = session.parser();
+    dex::BinaryResult result({
+        {"callerClass", dex::BinaryResult::Column::kString},
+        {"callerMethod", dex::BinaryResult::Column::kString},
+        {"offset", dex::BinaryResult::Column::kInt}
+    });
+    
+    for (uint32_t idx : targets) {
+        for (const dex::XrefSite& site : session.xref_index().sites(kind, idx)) {
+            dex::MemberId caller;
+            if (!parser.method_id(site.method_idx, caller)) continue;
+            result.string_cell(parser.type_descriptor(caller.class_idx));
+            result.string_cell(parser.string_table().raw(caller.name_idx));
+            result.cell(site.pc);
+        }
+    }
+    return result;
+}
+
+static dex::BinaryResult xrefs_binary(const dex::DexSession& session, dex::XrefKind kind, int idx) {
+    std::vector<uint32_t> targets;
+    if (idx >= 0) targets.push_back(static_cast<uint32_t>(idx));
+    return xrefs_binary(session, kind, targets);
+}
+
+static dex::BinaryResult cursor_page_binary(const dex::ResultCursor& cursor, int offset, int limit) {
+    dex::BinaryResult result({
+        {"value", dex::BinaryResult::Column::kString},
+        {"source", dex::BinaryResult::Column::kInt}
+    });
+    size_t count = 0;
+    const dex::ResultCursor::Entry* entries =
+        cursor.page(static_cast<size_t>(std::max(offset, 0)), static_cast<size_t>(std::max(limit, 0)), count);
+    for (size_t i = 0; i < count; i++) {
+        result.string_cell(cursor.text(entries[i]));
+        result.cell(entries[i].source);
+    }
+    size_t next = static_cast<size_t>(std::max(offset, 0)) + count;
+    result.add_meta("total", static_cast<int64_t>(cursor.size()));
+    result.add_meta("next", next < cursor.size() ? static_cast<int64_t>(next) : -1);
+    return result;
+}
+
+extern "C" {
+
+// ==================== DEX 会话句柄 ====================
+
+JNIEXPORT jlong JNICALL
+Java_com_aetherlink_dexeditor_CppDex_openDex(JNIEnv* env, jclass, jbyteArray dexBytes) {
+    // Java 堆上的数组可能被 GC 移动，只能复制一次后交给会话持有
+    auto session = std::make_shared<dex::DexSession>();
+    if (!session->open(jbyteArray_to_vector(env, dexBytes))) {
+        LOGE("Failed to parse DEX for session");
+        return 0;
+    }
+    return register_session(std::move(session));
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_aetherlink_dexeditor_CppDex_openDexFile(JNIEnv* env, jclass, jstring path) {
+    std::string file_path = jstring_to_string(env, path);
+    auto session = std::make_shared<dex::DexSession>();
+    if (!session->open_file(file_path)) {
+        LOGE("Failed to map DEX file: %s", file_path.c_str());
+        return 0;
+    }
+    return register_session(std::move(session));
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_aetherlink_dexeditor_CppDex_openDexBuffer(JNIEnv* env, jclass, jobject buffer) {
+    void* address = buffer ? env->GetDirectBufferAddress(buffer) : nullptr;
+    jlong capacity = buffer ? env->GetDirectBufferCapacity(buffer) : -1;
+    if (!address || capacity <= 0) {
+        LOGE("openDexBuffer requires a direct ByteBuffer");
+        return 0;
+    }
+    
+    // 持有 ByteBuffer 的全局引用，会话关闭时释放；最后一个引用可能在未附加到 JVM 的工作线程上
+    // 释放，此时临时附加线程删除全局引用后再分离，避免泄漏
+    JavaVM* vm = nullptr;
+    env->GetJavaVM(&vm);
+    jobject buffer_ref = env->NewGlobalRef(buffer);
+    std::shared_ptr<const void> keepalive(buffer_ref, [vm](const void* ref) {
+        if (!vm) return;
+        JNIEnv* ref_env = nullptr;
+        jint status = vm->GetEnv(reinterpret_cast<void**>(&ref_env), JNI_VERSION_1_6);
+        bool attached = false;
+        if (status == JNI_EDETACHED) {
+            if (vm->AttachCurrentThread(&ref_env, nullptr) != JNI_OK) {
+                LOGE("Failed to attach thread to release DEX buffer");
+                return;
+            }
+            attached = true;
+        } else if (status != JNI_OK) {
+            return;
+        }
+        ref_env->DeleteGlobalRef(static_cast<jobject>(const_cast<void*>(ref)));
+        if (attached) vm->DetachCurrentThread();
+    });
+    
+    auto session = std::make_shared<dex::DexSession>();
+    if (!session->open_view(static_cast<const uint8_t*>(address), static_cast<size_t>(capacity),
+                            std::move(keepalive))) {
+        LOGE("Failed to parse DEX from direct buffer");
+        return 0;
+    }
+    return register_session(std::move(session));
+}
+
+JNIEXPORT void JNICALL
+Java_com_aetherlink_dexeditor_CppDex_closeDex(JNIEnv*, jclass, jlong handle) {
+    dex::SessionRegistry::instance().remove(handle);
+}
+
+// ==================== 并行设置 ====================
+
+JNIEXPORT void JNICALL
+Java_com_aetherlink_dexeditor_CppDex_setThreadCount(JNIEnv*, jclass, jint threads) {
+    dex::ThreadPool::set_shared_thread_count(threads > 0 ? static_cast<size_t>(threads) : 0);
+    LOGI("Native thread pool size: %zu", dex::ThreadPool::shared()->size());
+}
+
+JNIEXPORT jint JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getThreadCount(JNIEnv*, jclass) {
+    return static_cast<jint>(dex::ThreadPool::shared()->size());
+}
+
+// ==================== DEX 解析操作 ====================
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getDexInfo(JNIEnv* env, jclass, jbyteArray dexBytes) {
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return dex_info_json(session);
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listClasses(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                  jstring packageFilter, jint offset, jint limit) {
+    std::string filter = jstring_to_string(env, packageFilter);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) -> const std::string& {
+        return list_classes_json(session, filter, offset, limit);
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_searchInDex(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                  jstring query, jstring searchType,
+                                                  jboolean caseSensitive, jint maxResults) {
+    std::string q = jstring_to_string(env, query);
+    std::string type = jstring_to_string(env, searchType);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) -> const std::string& {
+        return search_json(session, q, type, caseSensitive, maxResults);
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_regexSearchInDex(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                       jstring pattern, jstring searchType,
+                                                       jboolean caseSensitive, jint maxResults) {
+    std::string p = jstring_to_string(env, pattern);
+    std::string type = jstring_to_string(env, searchType);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) -> const std::string& {
+        return search_json(session, p, type, caseSensitive, maxResults, true);
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getClassSmali(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                    jstring className) {
+    std::string class_name = jstring_to_string(env, className);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return class_smali_json(session, class_name);
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getMethodSmali(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                     jstring className, jstring methodName,
+                                                     jstring methodSignature) {
+    std::string class_name = jstring_to_string(env, className);
+    std::string method_name = jstring_to_string(env, methodName);
+    std::string method_sig = jstring_to_string(env, methodSignature);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return method_smali_json(session, class_name, method_name, method_sig);
+    });
+}
+
+// ==================== Smali 转 Java ====================
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_smaliToJava(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                  jstring className) {
+    std::string class_name = jstring_to_string(env, className);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return smali_to_java_json(session, class_name);
+    });
+}
+
+// ==================== DEX 修改操作 ====================
+
+// 重建 DEX；失败时抛出带具体原因的 IllegalStateException，而不是静默返回 null
+static jbyteArray build_dex(JNIEnv* env, dex::DexBuilder& builder) {
+    std::string error;
+    auto result = builder.build(error);
+    if (result.empty()) {
+        LOGE("Failed to build DEX: %s", error.c_str());
+        jclass cls = env->FindClass("java/lang/IllegalStateException");
+        if (cls) env->ThrowNew(cls, ("Failed to build DEX: " + error).c_str());
+        return nullptr;
+    }
+    return vector_to_jbyteArray(env, result);
+}
+
+// 把一个类的 Smali 源码汇编进 builder 并重建 DEX；expected_class 非空时要求 .class 与之一致
+static jbyteArray build_with_class(JNIEnv* env, dex::DexBuilder& builder, const std::string& smali_code,
+                                   const std::string& expected_class) {
+    dex::SmaliParser parser(builder);
+    std::string error;
+    if (!parser.parse(smali_code, error)) {
+        LOGE("Failed to assemble Smali: %s", error.c_str());
+        return nullptr;
+    }
+    if (!expected_class.empty() && parser.class_name() != expected_class) {
+        LOGE("Smali defines %s instead of %s", parser.class_name().c_str(), expected_class.c_str());
+        return nullptr;
+    }
+
+    return build_dex(env, builder);
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_com_aetherlink_dexeditor_CppDex_modifyClass(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                  jstring className, jstring newSmali) {
+    auto data = jbyteArray_to_vector(env, dexBytes);
+    std::string class_name = jstring_to_string(env, className);
+    std::string smali_code = jstring_to_string(env, newSmali);
+    
+    dex::DexBuilder builder;
+    if (!builder.load(std::move(data))) {
+        LOGE("Failed to load DEX for modification");
+        return nullptr;
+    }
+    
+    // 新类替换同名的原类，其余类原样拷贝
+    return build_with_class(env, builder, smali_code, class_name);
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_com_aetherlink_dexeditor_CppDex_addClass(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                               jstring newSmali) {
+    auto data = jbyteArray_to_vector(env, dexBytes);
+    std::string smali_code = jstring_to_string(env, newSmali);
+    
+    dex::DexBuilder builder;
+    if (!builder.load(std::move(data))) {
+        LOGE("Failed to load DEX");
+        return nullptr;
+    }
+    
+    return build_with_class(env, builder, smali_code, "");
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_com_aetherlink_dexeditor_CppDex_deleteClass(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                  jstring className) {
+    auto data = jbyteArray_to_vector(env, dexBytes);
+    std::string class_name = jstring_to_string(env, className);
+    
+    dex::DexBuilder builder;
+    if (!builder.load(std::move(data))) {
+        LOGE("Failed to load DEX");
+        return nullptr;
+    }
+    if (!builder.remove_class(class_name)) {
+        LOGE("Class not found: %s", class_name.c_str());
+        return nullptr;
+    }
+    
+    return build_dex(env, builder);
+}
+
+// ==================== 方法级操作 ====================
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listMethods(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                  jstring className) {
+    std::string class_name = jstring_to_string(env, className);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return list_methods_json(session, class_name);
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listFields(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                 jstring className) {
+    std::string class_name = jstring_to_string(env, className);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return list_fields_json(session, class_name);
+    });
+}
+
+// ==================== 字符串操作 ====================
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listStrings(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                  jstring filter, jint limit) {
+    std::string filter_str = jstring_to_string(env, filter);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) -> const std::string& {
+        return list_strings_json(session, filter_str, limit);
+    });
+}
+
+// ==================== 交叉引用分析 ====================
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_findMethodXrefs(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                      jstring className, jstring methodName) {
+    std::string class_name = jstring_to_string(env, className);
+    std::string method_name = jstring_to_string(env, methodName);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return method_xrefs_json(session, class_name, method_name);
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_findFieldXrefs(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                     jstring className, jstring fieldName) {
+    std::string class_name = jstring_to_string(env, className);
+    std::string field_name = jstring_to_string(env, fieldName);
+    return query_dex_bytes(env, dexBytes, [&](const dex::DexSession& session) {
+        return field_xrefs_json(session, class_name, field_name);
+    });
 }
 
 // ==================== Smali 编译 ====================
@@ -647,19 +1038,345 @@ JNIEXPORT jbyteArray JNICALL
 Java_com_aetherlink_dexeditor_CppDex_smaliToDex(JNIEnv* env, jclass, jstring smaliCode) {
     std::string smali = jstring_to_string(env, smaliCode);
     
-    // 使用 DexBuilder 创建 DEX
+    // 未加载原 DEX 时 build() 从空 DEX 开始写出
     dex::DexBuilder builder;
+    return build_with_class(env, builder, smali, "");
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_com_aetherlink_dexeditor_CppDex_assembleSmaliClasses(JNIEnv* env, jclass, jbyteArray dexBytes,
+                                                           jobjectArray smaliCodes) {
+    dex::DexBuilder builder;
+    if (dexBytes && !builder.load(jbyteArray_to_vector(env, dexBytes))) {
+        LOGE("Failed to load DEX");
+        return nullptr;
+    }
     
-    // TODO: 解析 smali 代码并构建 DEX
-    // 这需要完整的 Smali 解析器实现
+    std::vector<std::string> sources;
+    jsize count = smaliCodes ? env->GetArrayLength(smaliCodes) : 0;
+    sources.reserve(count);
+    for (jsize i = 0; i < count; i++) {
+        auto code = static_cast<jstring>(env->GetObjectArrayElement(smaliCodes, i));
+        sources.push_back(jstring_to_string(env, code));
+        env->DeleteLocalRef(code);
+    }
     
-    auto result = builder.build();
-    if (result.empty()) {
-        LOGE("Failed to build DEX from Smali");
+    // 多线程分块汇编后按源顺序合并常量池，输出与线程数无关
+    std::string error;
+    if (!dex::assemble_smali_classes(builder, sources, error)) {
+        LOGE("Failed to assemble Smali: %s", error.c_str());
         return nullptr;
     }
     
-    return vector_to_jbyteArray(env, result);
+    // 有原 DEX 时新常量按序插入其索引表，原索引随之重映射
+    return build_dex(env, builder);
+}
+
+
+// ==================== 会话句柄查询 ====================
+
+#define WITH_SESSION(handle)                                                        \
+    auto session = dex::SessionRegistry::instance().get(handle);                    \
+    if (!session) return string_to_jstring(env, error_json("Invalid DEX handle"))
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getDexInfoByHandle(JNIEnv* env, jclass, jlong handle) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, dex_info_json(*session));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listClassesByHandle(JNIEnv* env, jclass, jlong handle,
+                                                          jstring packageFilter, jint offset, jint limit) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, list_classes_json(*session, jstring_to_string(env, packageFilter),
+                                                    offset, limit));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getPackageLevelByHandle(JNIEnv* env, jclass, jlong handle,
+                                                              jstring packagePath) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, package_level_json(*session, jstring_to_string(env, packagePath)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_regexSearchInDexByHandle(JNIEnv* env, jclass, jlong handle,
+                                                               jstring pattern, jstring searchType,
+                                                               jboolean caseSensitive, jint maxResults) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, search_json(*session, jstring_to_string(env, pattern),
+                                              jstring_to_string(env, searchType),
+                                              caseSensitive, maxResults, true));
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_aetherlink_dexeditor_CppDex_setSearchIndexEnabled(JNIEnv*, jclass, jlong handle, jboolean enabled) {
+    auto session = dex::SessionRegistry::instance().get(handle);
+    if (!session) return JNI_FALSE;
+    session->set_search_index_enabled(enabled == JNI_TRUE);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_searchInDexByHandle(JNIEnv* env, jclass, jlong handle,
+                                                          jstring query, jstring searchType,
+                                                          jboolean caseSensitive, jint maxResults) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, search_json(*session, jstring_to_string(env, query),
+                                              jstring_to_string(env, searchType),
+                                              caseSensitive, maxResults));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getClassSmaliByHandle(JNIEnv* env, jclass, jlong handle,
+                                                            jstring className) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, class_smali_json(*session, jstring_to_string(env, className)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getMethodSmaliByHandle(JNIEnv* env, jclass, jlong handle,
+                                                             jstring className, jstring methodName,
+                                                             jstring methodSignature) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, method_smali_json(*session, jstring_to_string(env, className),
+                                                    jstring_to_string(env, methodName),
+                                                    jstring_to_string(env, methodSignature)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getMethodSmaliByIndex(JNIEnv* env, jclass, jlong handle, jint methodIdx) {
+    WITH_SESSION(handle);
+    if (methodIdx < 0) return string_to_jstring(env, error_json("Method not found or has no code"));
+    return string_to_jstring(env, method_smali_json(*session, static_cast<uint32_t>(methodIdx)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_smaliToJavaByHandle(JNIEnv* env, jclass, jlong handle,
+                                                          jstring className) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, smali_to_java_json(*session, jstring_to_string(env, className)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listMethodsByHandle(JNIEnv* env, jclass, jlong handle,
+                                                          jstring className) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, list_methods_json(*session, jstring_to_string(env, className)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listFieldsByHandle(JNIEnv* env, jclass, jlong handle,
+                                                         jstring className) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, list_fields_json(*session, jstring_to_string(env, className)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listStringsByHandle(JNIEnv* env, jclass, jlong handle,
+                                                          jstring filter, jint limit) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, list_strings_json(*session, jstring_to_string(env, filter), limit));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_findMethodXrefsByHandle(JNIEnv* env, jclass, jlong handle,
+                                                              jstring className, jstring methodName) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, method_xrefs_json(*session, jstring_to_string(env, className),
+                                                    jstring_to_string(env, methodName)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_findFieldXrefsByHandle(JNIEnv* env, jclass, jlong handle,
+                                                             jstring className, jstring fieldName) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, field_xrefs_json(*session, jstring_to_string(env, className),
+                                                   jstring_to_string(env, fieldName)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_findStringXrefsByHandle(JNIEnv* env, jclass, jlong handle,
+                                                              jstring value) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, string_xrefs_json(*session, jstring_to_string(env, value)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_findTypeXrefsByHandle(JNIEnv* env, jclass, jlong handle,
+                                                            jstring className) {
+    WITH_SESSION(handle);
+    return string_to_jstring(env, type_xrefs_json(*session, jstring_to_string(env, className)));
+}
+
+#undef WITH_SESSION
+
+// ==================== 二进制结果查询 ====================
+
+// 返回的 DirectByteBuffer 由 native 分配，必须调用 freeBinaryResult 释放
+
+#define WITH_SESSION_OR_NULL(handle)                                                \
+    auto session = dex::SessionRegistry::instance().get(handle);                    \
+    if (!session) return nullptr
+
+JNIEXPORT jobject JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listClassesBinary(JNIEnv* env, jclass, jlong handle,
+                                                        jstring packageFilter, jint offset, jint limit) {
+    WITH_SESSION_OR_NULL(handle);
+    return binary_to_buffer(env, list_classes_binary(*session, jstring_to_string(env, packageFilter),
+                                                     offset, limit));
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listMethodsBinary(JNIEnv* env, jclass, jlong handle,
+                                                        jstring className) {
+    WITH_SESSION_OR_NULL(handle);
+    return binary_to_buffer(env, list_methods_binary(*session, jstring_to_string(env, className)));
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listFieldsBinary(JNIEnv* env, jclass, jlong handle,
+                                                       jstring className) {
+    WITH_SESSION_OR_NULL(handle);
+    return binary_to_buffer(env, list_fields_binary(*session, jstring_to_string(env, className)));
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_aetherlink_dexeditor_CppDex_listStringsBinary(JNIEnv* env, jclass, jlong handle,
+                                                        jstring filter, jint limit) {
+    WITH_SESSION_OR_NULL(handle);
+    return binary_to_buffer(env, list_strings_binary(*session, jstring_to_string(env, filter), limit));
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_aetherlink_dexeditor_CppDex_searchBinary(JNIEnv* env, jclass, jlong handle,
+                                                   jstring query, jstring searchType,
+                                                   jboolean caseSensitive, jboolean regex, jint maxResults) {
+    WITH_SESSION_OR_NULL(handle);
+    dex::BinaryResult result({});
+    std::string error;
+    if (!search_binary(*session, jstring_to_string(env, query), jstring_to_string(env, searchType),
+                       caseSensitive, regex, maxResults, result, error)) {
+        // 与 JSON 接口的 error 字段对应，避免与“会话无效”的 null 混淆
+        jclass cls = env->FindClass("java/lang/IllegalArgumentException");
+        if (cls) env->ThrowNew(cls, error.c_str());
+        return nullptr;
+    }
+    return binary_to_buffer(env, result);
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_aetherlink_dexeditor_CppDex_findXrefsBinary(JNIEnv* env, jclass, jlong handle, jstring kind,
+                                                      jstring target, jstring member) {
+    WITH_SESSION_OR_NULL(handle);
+    const auto& parser = session->parser();
+    std::string kind_str = jstring_to_string(env, kind);
+    std::string target_str = jstring_to_string(env, target);
+    
+    if (kind_str == "method") {
+        auto targets = parser.find_methods(target_str, jstring_to_string(env, member));
+        return binary_to_buffer(env, xrefs_binary(*session, dex::XrefKind::kMethod, targets));
+    } else if (kind_str == "field") {
+        int idx = parser.find_field(target_str, jstring_to_string(env, member));
+        return binary_to_buffer(env, xrefs_binary(*session, dex::XrefKind::kField, idx));
+    } else if (kind_str == "string") {
+        return binary_to_buffer(env, xrefs_binary(*session, dex::XrefKind::kString, parser.find_string(target_str)));
+    } else if (kind_str == "type") {
+        return binary_to_buffer(env, xrefs_binary(*session, dex::XrefKind::kType, parser.find_type(target_str)));
+    }
+    return nullptr;
+}
+
+#undef WITH_SESSION_OR_NULL
+
+// ==================== 批量导出 ====================
+
+JNIEXPORT jstring JNICALL
+Java_com_aetherlink_dexeditor_CppDex_exportSmaliByHandle(JNIEnv* env, jclass, jlong handle,
+                                                          jstring outputPath, jboolean zip, jobject listener) {
+    auto session = dex::SessionRegistry::instance().get(handle);
+    if (!session) return string_to_jstring(env, error_json("Invalid DEX handle"));
+    
+    // 进度回调在调用线程上执行（批次之间），返回 false 或抛出异常即取消
+    jmethodID on_progress = nullptr;
+    if (listener) {
+        jclass listener_class = env->GetObjectClass(listener);
+        on_progress = env->GetMethodID(listener_class, "onProgress", "(II)Z");
+        env->DeleteLocalRef(listener_class);
+        if (!on_progress) {
+            env->ExceptionClear();
+            return string_to_jstring(env, error_json("Invalid progress listener"));
+        }
+    }
+    dex::ExportProgress progress;
+    if (on_progress) {
+        progress = [env, listener, on_progress](size_t done, size_t total) {
+            jboolean keep_going = env->CallBooleanMethod(listener, on_progress,
+                                                         static_cast<jint>(done), static_cast<jint>(total));
+            if (env->ExceptionCheck()) {
+                env->ExceptionClear();
+                return false;
+            }
+            return keep_going == JNI_TRUE;
+        };
+    }
+    
+    dex::ExportStats stats;
+    std::string error;
+    if (!dex::export_smali(*session, jstring_to_string(env, outputPath), zip == JNI_TRUE, progress, stats, error)) {
+        return string_to_jstring(env, error_json(error));
+    }
+    
+    json result = {
+        {"success", true},
+        {"classes", stats.classes},
+        {"skipped", stats.skipped},
+        {"bytes", stats.bytes},
+        {"cancelled", stats.cancelled}
+    };
+    return string_to_jstring(env, result.dump());
+}
+
+// ==================== 分页游标 ====================
+
+JNIEXPORT jlong JNICALL
+Java_com_aetherlink_dexeditor_CppDex_openCursor(JNIEnv* env, jclass, jlongArray handles,
+                                                 jstring target, jstring filter) {
+    dex::CursorTarget cursor_target;
+    if (!handles || !dex::parse_cursor_target(jstring_to_string(env, target), cursor_target)) return 0;
+    
+    jsize count = env->GetArrayLength(handles);
+    std::vector<jlong> ids(count);
+    env->GetLongArrayRegion(handles, 0, count, ids.data());
+    
+    std::vector<std::shared_ptr<const dex::DexSession>> sessions;
+    for (jlong id : ids) {
+        auto session = dex::SessionRegistry::instance().get(id);
+        if (!session) return 0;
+        sessions.push_back(std::move(session));
+    }
+    
+    auto cursor = dex::ResultCursor::open(std::move(sessions), cursor_target, jstring_to_string(env, filter));
+    return static_cast<jlong>(dex::CursorRegistry::instance().add(std::move(cursor)));
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_aetherlink_dexeditor_CppDex_getCursorPageBinary(JNIEnv* env, jclass, jlong cursor,
+                                                          jint offset, jint limit) {
+    auto result_cursor = dex::CursorRegistry::instance().get(cursor);
+    if (!result_cursor) return nullptr;
+    return binary_to_buffer(env, cursor_page_binary(*result_cursor, offset, limit));
+}
+
+JNIEXPORT void JNICALL
+Java_com_aetherlink_dexeditor_CppDex_closeCursor(JNIEnv*, jclass, jlong cursor) {
+    dex::CursorRegistry::instance().remove(cursor);
+}
+
+JNIEXPORT void JNICALL
+Java_com_aetherlink_dexeditor_CppDex_freeBinaryResult(JNIEnv* env, jclass, jobject buffer) {
+    if (buffer) std::free(env->GetDirectBufferAddress(buffer));
 }
 
 // ==================== AXML 解析 ====================
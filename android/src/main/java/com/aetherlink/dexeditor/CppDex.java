@@ -28,6 +28,50 @@ public class CppDex {
         return libraryLoaded;
     }
 
+    // ==================== DEX 会话句柄 ====================
+
+    /**
+     * 解析 DEX 并创建原生会话，后续查询复用同一份解析结果
+     * @param dexBytes DEX 文件字节数组
+     * @return 会话句柄，解析失败返回 0
+     */
+    public static native long openDex(byte[] dexBytes);
+
+    /**
+     * 以只读内存映射方式打开 DEX 文件，不复制到原生堆
+     * 会话存续期间文件不能被截断或覆盖
+     * @param path DEX 文件路径
+     * @return 会话句柄，失败返回 0
+     */
+    public static native long openDexFile(String path);
+
+    /**
+     * 直接在 DirectByteBuffer 上解析 DEX，不复制数据
+     * 会话持有该缓冲区的引用，关闭前不能修改其内容
+     * @param buffer 包含 DEX 数据的 DirectByteBuffer
+     * @return 会话句柄，失败返回 0
+     */
+    public static native long openDexBuffer(java.nio.ByteBuffer buffer);
+
+    /**
+     * 关闭原生会话并释放解析结果
+     * @param handle openDex 返回的会话句柄
+     */
+    public static native void closeDex(long handle);
+
+    // ==================== 并行设置 ====================
+
+    /**
+     * 设置原生扫描（交叉引用、搜索）使用的线程数
+     * @param threads 线程数，0 表示按 CPU 核心数自动选择
+     */
+    public static native void setThreadCount(int threads);
+
+    /**
+     * 获取原生扫描当前使用的线程数
+     */
+    public static native int getThreadCount();
+
     // ==================== DEX 解析操作 ====================
 
     /**
@@ -58,7 +102,7 @@ public class CppDex {
      * @param query 搜索查询
      * @param searchType 搜索类型: class, method, field, string
      * @param caseSensitive 是否区分大小写
-     * @param maxResults 最大结果数
+     * @param maxResults 最大结果数，小于等于 0 时不返回结果
      * @return JSON 格式的搜索结果
      */
     public static native String searchInDex(
@@ -69,6 +113,23 @@ public class CppDex {
         int maxResults
     );
 
+    /**
+     * 在 DEX 中按正则表达式搜索（线性时间引擎，不支持反向引用和环视）
+     * @param dexBytes DEX 文件字节数组
+     * @param pattern 正则表达式
+     * @param searchType 搜索类型: class, method, field, string
+     * @param caseSensitive 是否区分大小写
+     * @param maxResults 最大结果数，小于等于 0 时不返回结果
+     * @return JSON 格式的搜索结果，表达式无效或不支持时返回 error
+     */
+    public static native String regexSearchInDex(
+        byte[] dexBytes,
+        String pattern,
+        String searchType,
+        boolean caseSensitive,
+        int maxResults
+    );
+
     /**
      * 获取类的 Smali 代码
      * @param dexBytes DEX 文件字节数组
@@ -115,7 +176,8 @@ public class CppDex {
      * @param dexBytes DEX 文件字节数组
      * @param className 类名
      * @param newSmali 新的 Smali 代码
-     * @return 修改后的 DEX 字节数组，失败返回 null
+     * @return 修改后的 DEX 字节数组，加载或汇编失败返回 null
+     * @throws IllegalStateException 重建 DEX 失败时抛出，消息为具体原因（如超出 16 位的索引）
      */
     public static native byte[] modifyClass(
         byte[] dexBytes,
@@ -127,7 +189,8 @@ public class CppDex {
      * 添加新类到 DEX
      * @param dexBytes DEX 文件字节数组
      * @param newSmali 新类的 Smali 代码
-     * @return 修改后的 DEX 字节数组，失败返回 null
+     * @return 修改后的 DEX 字节数组，加载或汇编失败返回 null
+     * @throws IllegalStateException 重建 DEX 失败时抛出，消息为具体原因（如超出 16 位的索引）
      */
     public static native byte[] addClass(
         byte[] dexBytes,
@@ -138,7 +201,8 @@ public class CppDex {
      * 从 DEX 中删除类
      * @param dexBytes DEX 文件字节数组
      * @param className 要删除的类名
-     * @return 修改后的 DEX 字节数组，失败返回 null
+     * @return 修改后的 DEX 字节数组，加载失败或类不存在返回 null
+     * @throws IllegalStateException 重建 DEX 失败时抛出，消息为具体原因（如超出 16 位的索引）
      */
     public static native byte[] deleteClass(
         byte[] dexBytes,
@@ -190,7 +254,7 @@ public class CppDex {
      * 查找方法的交叉引用
      * @param dexBytes DEX 文件字节数组
      * @param className 类名
-     * @param methodName 方法名
+     * @param methodName 方法名，匹配所有同名重载；带原型（如 add(II)I）时只匹配该重载
      * @return JSON 格式的交叉引用列表
      */
     public static native String findMethodXrefs(
@@ -217,10 +281,340 @@ public class CppDex {
     /**
      * 将 Smali 代码编译为 DEX
      * @param smaliCode Smali 代码
-     * @return 编译后的 DEX 字节数组，失败返回 null
+     * @return 编译后的 DEX 字节数组，汇编失败返回 null
+     * @throws IllegalStateException 重建 DEX 失败时抛出，消息为具体原因（如超出 16 位的索引）
      */
     public static native byte[] smaliToDex(String smaliCode);
 
+    /**
+     * 批量编译多个 Smali 类，多线程并行汇编，结果与线程数无关
+     * @param dexBytes 原 DEX 字节数组，为 null 时生成新 DEX
+     * @param smaliCodes 每个元素为一个类的 Smali 代码，同名类替换原类
+     * @return 编译后的 DEX 字节数组，加载或汇编失败返回 null
+     * @throws IllegalStateException 重建 DEX 失败时抛出，消息为具体原因（如超出 16 位的索引）
+     */
+    public static native byte[] assembleSmaliClasses(byte[] dexBytes, String[] smaliCodes);
+
+    // ==================== 会话句柄查询 ====================
+    // 以下方法与同名字节数组版本返回相同 JSON，但复用 openDex 创建的会话，不再重复解析
+
+    /**
+     * 获取 DEX 文件信息
+     * @param handle 会话句柄
+     * @return JSON 格式的 DEX 信息
+     */
+    public static native String getDexInfoByHandle(long handle);
+
+    /**
+     * 列出 DEX 中的类
+     * @param handle 会话句柄
+     * @param packageFilter 包名过滤器
+     * @param offset 偏移量
+     * @param limit 限制数量
+     * @return JSON 格式的类列表
+     */
+    public static native String listClassesByHandle(
+        long handle,
+        String packageFilter,
+        int offset,
+        int limit
+    );
+
+    /**
+     * 获取包树的一层：直接子包（含类数量）和直接包含的类
+     * @param handle 会话句柄
+     * @param packagePath 包路径，如 "com/example" 或 "com.example"，空字符串表示根
+     * @return JSON 格式的包层级，包不存在时返回 error
+     */
+    public static native String getPackageLevelByHandle(long handle, String packagePath);
+
+    /**
+     * 在 DEX 中搜索
+     * @param handle 会话句柄
+     * @param query 搜索查询
+     * @param searchType 搜索类型: class, method, field, string
+     * @param caseSensitive 是否区分大小写
+     * @param maxResults 最大结果数，小于等于 0 时不返回结果
+     * @return JSON 格式的搜索结果
+     */
+    public static native String searchInDexByHandle(
+        long handle,
+        String query,
+        String searchType,
+        boolean caseSensitive,
+        int maxResults
+    );
+
+    /**
+     * 按正则表达式搜索（线性时间引擎，不支持反向引用和环视）
+     * @param handle 会话句柄
+     * @param pattern 正则表达式
+     * @param searchType 搜索类型: class, method, field, string
+     * @param caseSensitive 是否区分大小写
+     * @param maxResults 最大结果数，小于等于 0 时不返回结果
+     * @return JSON 格式的搜索结果，表达式无效或不支持时返回 error
+     */
+    public static native String regexSearchInDexByHandle(
+        long handle,
+        String pattern,
+        String searchType,
+        boolean caseSensitive,
+        int maxResults
+    );
+
+    /**
+     * 启用或关闭会话的三元组搜索索引
+     * 启用后 3 个字符以上的查询走倒排索引，适合逐字输入的增量搜索；索引在首次搜索时构建
+     * @param handle 会话句柄
+     * @param enabled 是否启用
+     * @return 句柄无效时返回 false
+     */
+    public static native boolean setSearchIndexEnabled(long handle, boolean enabled);
+
+    /**
+     * 获取类的 Smali 代码
+     * @param handle 会话句柄
+     * @param className 类名
+     * @return JSON 格式的 Smali 代码
+     */
+    public static native String getClassSmaliByHandle(
+        long handle,
+        String className
+    );
+
+    /**
+     * 获取单个方法的 Smali 代码
+     * @param handle 会话句柄
+     * @param className 类名
+     * @param methodName 方法名
+     * @param methodSignature 方法签名，如 "(I)V" 或 "foo(I)V"，用于区分重载；为空时取第一个同名方法
+     * @return JSON 格式的方法 Smali 代码
+     */
+    public static native String getMethodSmaliByHandle(
+        long handle,
+        String className,
+        String methodName,
+        String methodSignature
+    );
+
+    /**
+     * 按 method_idx 获取方法的 Smali 代码（method_idx 来自 listMethodsByHandle 的 methodIdx 字段）
+     * @param handle 会话句柄
+     * @param methodIdx 方法索引
+     * @return JSON 格式的方法 Smali 代码
+     */
+    public static native String getMethodSmaliByIndex(long handle, int methodIdx);
+
+    /**
+     * 将 Smali 代码转换为 Java 伪代码
+     * @param handle 会话句柄
+     * @param className 类名
+     * @return JSON 格式的 Java 伪代码
+     */
+    public static native String smaliToJavaByHandle(
+        long handle,
+        String className
+    );
+
+    /**
+     * 列出类中的所有方法
+     * @param handle 会话句柄
+     * @param className 类名
+     * @return JSON 格式的方法列表
+     */
+    public static native String listMethodsByHandle(
+        long handle,
+        String className
+    );
+
+    /**
+     * 列出类中的所有字段
+     * @param handle 会话句柄
+     * @param className 类名
+     * @return JSON 格式的字段列表
+     */
+    public static native String listFieldsByHandle(
+        long handle,
+        String className
+    );
+
+    /**
+     * 列出 DEX 中的字符串
+     * @param handle 会话句柄
+     * @param filter 过滤器
+     * @param limit 限制数量
+     * @return JSON 格式的字符串列表
+     */
+    public static native String listStringsByHandle(
+        long handle,
+        String filter,
+        int limit
+    );
+
+    /**
+     * 查找方法的交叉引用
+     * @param handle 会话句柄
+     * @param className 类名
+     * @param methodName 方法名，匹配所有同名重载；带原型（如 add(II)I）时只匹配该重载
+     * @return JSON 格式的交叉引用列表
+     */
+    public static native String findMethodXrefsByHandle(
+        long handle,
+        String className,
+        String methodName
+    );
+
+    /**
+     * 查找字段的交叉引用
+     * @param handle 会话句柄
+     * @param className 类名
+     * @param fieldName 字段名
+     * @return JSON 格式的交叉引用列表
+     */
+    public static native String findFieldXrefsByHandle(
+        long handle,
+        String className,
+        String fieldName
+    );
+
+    /**
+     * 查找字符串的交叉引用（const-string）
+     * @param handle 会话句柄
+     * @param value 字符串内容
+     * @return JSON 格式的交叉引用列表
+     */
+    public static native String findStringXrefsByHandle(
+        long handle,
+        String value
+    );
+
+    /**
+     * 查找类型的交叉引用（new-instance、check-cast、const-class 等）
+     * @param handle 会话句柄
+     * @param className 类名
+     * @return JSON 格式的交叉引用列表
+     */
+    public static native String findTypeXrefsByHandle(
+        long handle,
+        String className
+    );
+
+    // ==================== 二进制结果查询 ====================
+    // 与 *ByHandle 方法查询相同的数据，但以紧凑二进制表（字符串去重）返回，避免 JSON 序列化与解析。
+    // 返回的 DirectByteBuffer 由 native 分配，使用 DexBinaryResult.decodeAndFree 解码并释放；
+    // 会话句柄无效或参数错误时返回 null
+
+    /**
+     * 列出 DEX 中的类（列: name；元数据: total）
+     */
+    public static native java.nio.ByteBuffer listClassesBinary(
+        long handle,
+        String packageFilter,
+        int offset,
+        int limit
+    );
+
+    /**
+     * 列出类的方法（列: name, prototype, accessFlags）
+     */
+    public static native java.nio.ByteBuffer listMethodsBinary(long handle, String className);
+
+    /**
+     * 列出类的字段（列: name, type, accessFlags）
+     */
+    public static native java.nio.ByteBuffer listFieldsBinary(long handle, String className);
+
+    /**
+     * 列出字符串（列: value；元数据: matched, total）
+     */
+    public static native java.nio.ByteBuffer listStringsBinary(long handle, String filter, int limit);
+
+    /**
+     * 在 DEX 中搜索，列与 searchInDexByHandle 的结果字段一致
+     * @param regex 是否按正则表达式匹配
+     * @param maxResults 最大结果数，小于等于 0 时不返回结果
+     * @return 二进制结果；会话句柄无效时返回 null
+     * @throws IllegalArgumentException 搜索类型未知或正则表达式无效时抛出，消息为具体原因
+     */
+    public static native java.nio.ByteBuffer searchBinary(
+        long handle,
+        String query,
+        String searchType,
+        boolean caseSensitive,
+        boolean regex,
+        int maxResults
+    );
+
+    /**
+     * 查找交叉引用（列: callerClass, callerMethod, offset）
+     * @param kind 引用类型: method, field, string, type
+     * @param target 类名（method/field）、字符串值或类型描述符
+     * @param member 方法名或字段名，其他类型忽略；方法名可带原型（如 add(II)I）只匹配该重载
+     */
+    public static native java.nio.ByteBuffer findXrefsBinary(
+        long handle,
+        String kind,
+        String target,
+        String member
+    );
+
+    /**
+     * 释放二进制查询返回的缓冲区，释放后不可再访问
+     */
+    public static native void freeBinaryResult(java.nio.ByteBuffer buffer);
+
+    // ==================== 分页游标 ====================
+    // 过滤结果只在打开游标时计算一次（按 MUTF-8 字节序稳定排序），之后每页开销只与页大小相关
+
+    /**
+     * 打开类或字符串的分页游标
+     * @param handles 参与列举的会话句柄，结果中的 source 列为其在数组中的下标
+     * @param target 列举对象: class, string
+     * @param filter 区分大小写的子串过滤，空字符串表示全部
+     * @return 游标句柄，句柄无效或参数错误时返回 0
+     */
+    public static native long openCursor(long[] handles, String target, String filter);
+
+    /**
+     * 读取游标的一页（列: value, source；元数据: total, next，next 为 -1 表示已到末尾）
+     * @return 二进制结果，使用 DexBinaryResult.decodeAndFree 解码；游标无效时返回 null
+     */
+    public static native java.nio.ByteBuffer getCursorPageBinary(long cursor, int offset, int limit);
+
+    /**
+     * 关闭游标并释放结果集
+     */
+    public static native void closeCursor(long cursor);
+
+    // ==================== 批量导出 ====================
+
+    /**
+     * 批量导出进度监听器，在调用 exportSmaliByHandle 的线程上回调
+     */
+    public interface ExportProgressListener {
+        /**
+         * @param done 已处理的类数量
+         * @param total 类总数
+         * @return false 取消导出
+         */
+        boolean onProgress(int done, int total);
+    }
+
+    /**
+     * 并行反汇编整个 DEX，每个类输出一个 .smali 文件（按包路径分目录）
+     * @param handle 会话句柄
+     * @param outputPath 输出目录，或 zip 为 true 时的 ZIP 文件路径
+     * @param zip 是否直接写入 ZIP（按 class_def 顺序，取消或失败时删除未完成的文件）
+     * @param listener 进度监听器，可为 null
+     * @return JSON 格式的统计 {classes, skipped, bytes, cancelled}
+     */
+    public static native String exportSmaliByHandle(
+        long handle,
+        String outputPath,
+        boolean zip,
+        ExportProgressListener listener
+    );
+
     // ==================== XML/资源解析 ====================
 
     /**
@@ -0,0 +1,135 @@
+package com.aetherlink.dexeditor;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.HashMap;
+import java.util.Map;
+
+/**
+ * CppDex 二进制查询结果的解码器
+ * 布局（小端）: magic "DXR1" | 字符串表（MUTF-8，去重）| 元数据 | 列定义 | 行数据
+ * 字符串单元格存放字符串表下标，整数单元格直接存值
+ */
+public class DexBinaryResult {
+
+    private static final int MAGIC = 0x31525844;  // "DXR1"
+
+    public static final int COLUMN_STRING = 0;
+    public static final int COLUMN_INT = 1;
+
+    private final String[] strings;
+    private final Map<String, Long> meta = new HashMap<>();
+    private final String[] columnNames;
+    private final int[] columnTypes;
+    private final int rowCount;
+    private final int[] cells;
+
+    private DexBinaryResult(ByteBuffer buffer) {
+        ByteBuffer in = buffer.duplicate().order(ByteOrder.LITTLE_ENDIAN);
+        in.position(0);
+        if (in.getInt() != MAGIC) {
+            throw new IllegalArgumentException("Invalid binary result");
+        }
+
+        int stringCount = in.getInt();
+        strings = new String[stringCount];
+        for (int i = 0; i < stringCount; i++) {
+            int length = in.getInt();
+            strings[i] = decodeMutf8(in, length);
+        }
+
+        int metaCount = in.getInt();
+        for (int i = 0; i < metaCount; i++) {
+            String name = strings[in.getInt()];
+            meta.put(name, in.getLong());
+        }
+
+        int columnCount = in.getInt();
+        columnNames = new String[columnCount];
+        columnTypes = new int[columnCount];
+        for (int i = 0; i < columnCount; i++) {
+            columnNames[i] = strings[in.getInt()];
+            columnTypes[i] = in.get() & 0xFF;
+        }
+
+        rowCount = in.getInt();
+        cells = new int[rowCount * columnCount];
+        in.asIntBuffer().get(cells);
+    }
+
+    /**
+     * 解码 native 返回的缓冲区（不释放）
+     */
+    public static DexBinaryResult decode(ByteBuffer buffer) {
+        return new DexBinaryResult(buffer);
+    }
+
+    /**
+     * 解码并通过 CppDex.freeBinaryResult 释放缓冲区；buffer 为 null 时返回 null
+     */
+    public static DexBinaryResult decodeAndFree(ByteBuffer buffer) {
+        if (buffer == null) return null;
+        try {
+            return new DexBinaryResult(buffer);
+        } finally {
+            CppDex.freeBinaryResult(buffer);
+        }
+    }
+
+    public int getRowCount() {
+        return rowCount;
+    }
+
+    public int getColumnCount() {
+        return columnNames.length;
+    }
+
+    /**
+     * 按列名查找列下标，不存在时返回 -1
+     */
+    public int columnIndex(String name) {
+        for (int i = 0; i < columnNames.length; i++) {
+            if (columnNames[i].equals(name)) return i;
+        }
+        return -1;
+    }
+
+    public String getString(int row, int column) {
+        int value = cells[row * columnNames.length + column];
+        return columnTypes[column] == COLUMN_STRING ? strings[value] : Integer.toString(value);
+    }
+
+    public int getInt(int row, int column) {
+        return cells[row * columnNames.length + column];
+    }
+
+    public long getMeta(String name, long defaultValue) {
+        Long value = meta.get(name);
+        return value != null ? value : defaultValue;
+    }
+
+    /**
+     * 解码 DEX 使用的 Modified UTF-8（补充平面字符以代理对形式编码）
+     */
+    private static String decodeMutf8(ByteBuffer in, int length) {
+        char[] chars = new char[length];
+        int count = 0;
+        int end = in.position() + length;
+        while (in.position() < end) {
+            int a = in.get() & 0xFF;
+            if (a < 0x80) {
+                chars[count++] = (char) a;
+            } else if ((a & 0xE0) == 0xC0 && in.position() < end) {
+                int b = in.get() & 0x3F;
+                chars[count++] = (char) (((a & 0x1F) << 6) | b);
+            } else if ((a & 0xF0) == 0xE0 && in.position() + 1 < end) {
+                int b = in.get() & 0x3F;
+                int c = in.get() & 0x3F;
+                chars[count++] = (char) (((a & 0x0F) << 12) | (b << 6) | c);
+            } else {
+                chars[count++] = '\uFFFD';
+            }
+        }
+        return new String(chars, 0, count);
+    }
+}
@@ -324,6 +324,20 @@ public class DexEditorPluginPlugin extends Plugin {
                 ));
                 break;
 
+            case "findStringXrefs":
+                result.put("data", dexManager.findStringXrefs(
+                    params.getString("sessionId"),
+                    params.getString("value")
+                ));
+                break;
+
+            case "findTypeXrefs":
+                result.put("data", dexManager.findTypeXrefs(
+                    params.getString("sessionId"),
+                    params.getString("className")
+                ));
+                break;
+
             // ============ Smali 转 Java（C++ 实现）============
             case "smaliToJava":
                 result.put("data", dexManager.smaliToJava(
@@ -527,6 +541,26 @@ public class DexEditorPluginPlugin extends Plugin {
                 ));
                 break;
 
+            case "getPackageLevel":
+                result.put("data", dexManager.getPackageLevelFromMultiSession(
+                    params.getString("sessionId"),
+                    params.optString("packagePath", "")
+                ));
+                break;
+
+            case "exportSmali":
+                result.put("data", dexManager.exportSmaliFromMultiSession(
+                    params.getString("sessionId"),
+                    params.optString("dexName", ""),
+                    params.getString("outputPath"),
+                    params.optBoolean("zip", false)
+                ));
+                break;
+
+            case "cancelExportSmali":
+                dexManager.cancelExportSmali();
+                break;
+
             case "searchInDexSession":
                 result.put("data", dexManager.searchInMultiSession(
                     params.getString("sessionId"),
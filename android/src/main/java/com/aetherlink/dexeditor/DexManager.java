@@ -131,6 +131,7 @@ public class DexManager {
         String filePath;
         DexBackedDexFile originalDexFile;
         byte[] dexBytes;  // DEX 字节数据，用于 C++ 解析
+        long nativeHandle;  // C++ 会话句柄，0 表示尚未打开
         List<ClassDef> modifiedClasses;
         Set<String> removedClasses;
         boolean modified = false;
@@ -143,6 +144,30 @@ public class DexManager {
             this.modifiedClasses = new ArrayList<>();
             this.removedClasses = new HashSet<>();
         }
+
+        /**
+         * 获取 C++ 会话句柄，首次调用时解析 DEX（优先内存映射原文件）
+         */
+        synchronized long nativeHandle() {
+            if (nativeHandle == 0 && dexBytes != null && CppDex.isAvailable()) {
+                nativeHandle = CppDex.openDexFile(filePath);
+                if (nativeHandle == 0) {
+                    nativeHandle = CppDex.openDex(dexBytes);
+                }
+                if (nativeHandle != 0) {
+                    // 编辑器内搜索是逐字触发的，用索引代替每次全量扫描
+                    CppDex.setSearchIndexEnabled(nativeHandle, true);
+                }
+            }
+            return nativeHandle;
+        }
+
+        synchronized void closeNative() {
+            if (nativeHandle != 0) {
+                CppDex.closeDex(nativeHandle);
+                nativeHandle = 0;
+            }
+        }
     }
 
     /**
@@ -153,14 +178,19 @@ public class DexManager {
         String apkPath;
         Map<String, DexBackedDexFile> dexFiles;
         Map<String, byte[]> dexBytes;  // DEX 字节数据，用于 Rust 搜索
+        Map<String, Long> nativeHandles;  // 每个 DEX 的 C++ 会话句柄
         Map<String, ClassDef> modifiedClasses;
         boolean modified = false;
+        long classCursor;  // 类列表分页游标，过滤条件或 DEX 变化时重建
+        String classCursorFilter;
+        List<String> classCursorDexNames;  // 游标 source 下标对应的 DEX 名称
 
         MultiDexSession(String sessionId, String apkPath) {
             this.sessionId = sessionId;
             this.apkPath = apkPath;
             this.dexFiles = new HashMap<>();
             this.dexBytes = new HashMap<>();
+            this.nativeHandles = new HashMap<>();
             this.modifiedClasses = new HashMap<>();
         }
 
@@ -170,6 +200,67 @@ public class DexManager {
                 this.dexBytes.put(dexName, bytes);
             }
         }
+
+        /**
+         * 获取指定 DEX 的 C++ 会话句柄，首次调用时解析
+         */
+        synchronized long nativeHandle(String dexName) {
+            Long handle = nativeHandles.get(dexName);
+            if (handle == null) {
+                byte[] bytes = dexBytes.get(dexName);
+                handle = bytes != null ? CppDex.openDex(bytes) : 0L;
+                nativeHandles.put(dexName, handle);
+            }
+            return handle;
+        }
+
+        /**
+         * 替换 DEX 字节数据，旧句柄失效
+         */
+        synchronized void updateDex(String dexName, byte[] bytes) {
+            dexBytes.put(dexName, bytes);
+            closeClassCursor();
+            Long handle = nativeHandles.remove(dexName);
+            if (handle != null && handle != 0) {
+                CppDex.closeDex(handle);
+            }
+        }
+
+        /**
+         * 获取指定过滤条件的类列表游标，条件不变时复用已有结果集
+         */
+        synchronized long classCursor(String filter) {
+            if (classCursor != 0 && filter.equals(classCursorFilter)) {
+                return classCursor;
+            }
+            closeClassCursor();
+            List<String> dexNames = new ArrayList<>(dexBytes.keySet());
+            long[] handles = new long[dexNames.size()];
+            for (int i = 0; i < handles.length; i++) {
+                handles[i] = nativeHandle(dexNames.get(i));
+            }
+            classCursor = CppDex.openCursor(handles, "class", filter);
+            classCursorFilter = filter;
+            classCursorDexNames = dexNames;
+            return classCursor;
+        }
+
+        synchronized void closeClassCursor() {
+            if (classCursor != 0) {
+                CppDex.closeCursor(classCursor);
+                classCursor = 0;
+            }
+        }
+
+        synchronized void closeNative() {
+            closeClassCursor();
+            for (Long handle : nativeHandles.values()) {
+                if (handle != 0) {
+                    CppDex.closeDex(handle);
+                }
+            }
+            nativeHandles.clear();
+        }
     }
 
     // ==================== DEX 文件操作 ====================
@@ -237,6 +328,10 @@ public class DexManager {
 
         // 写入文件 (使用官方推荐方式)
         File outputFile = new File(outputPath);
+        if (outputFile.getAbsoluteFile().equals(new File(session.filePath).getAbsoluteFile())) {
+            // 原文件被 C++ 会话映射，覆盖前先释放
+            session.closeNative();
+        }
         if (outputFile.getParentFile() != null) {
             outputFile.getParentFile().mkdirs();
         }
@@ -262,7 +357,10 @@ public class DexManager {
      * 关闭 DEX 会话
      */
     public void closeDex(String sessionId) {
-        sessions.remove(sessionId);
+        DexSession session = sessions.remove(sessionId);
+        if (session != null) {
+            session.closeNative();
+        }
         Log.d(TAG, "Closed session: " + sessionId);
     }
 
@@ -275,7 +373,7 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.getDexInfo(session.dexBytes);
+                String jsonResult = CppDex.getDexInfoByHandle(session.nativeHandle());
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     JSObject info = new JSObject();
@@ -327,22 +425,19 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.listClasses(session.dexBytes, "", 0, 100000);
-                if (jsonResult != null && !jsonResult.contains("\"error\"")) {
-                    org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
-                    org.json.JSONArray cppClasses = cppResult.optJSONArray("classes");
-                    if (cppClasses != null) {
-                        JSArray classes = new JSArray();
-                        for (int i = 0; i < cppClasses.length(); i++) {
-                            String className = cppClasses.getString(i);
-                            if (!session.removedClasses.contains(className)) {
-                                JSObject classInfo = new JSObject();
-                                classInfo.put("type", className);
-                                classes.put(classInfo);
-                            }
+                DexBinaryResult cppResult = DexBinaryResult.decodeAndFree(
+                    CppDex.listClassesBinary(session.nativeHandle(), "", 0, Integer.MAX_VALUE));
+                if (cppResult != null) {
+                    JSArray classes = new JSArray();
+                    for (int i = 0; i < cppResult.getRowCount(); i++) {
+                        String className = cppResult.getString(i, 0);
+                        if (!session.removedClasses.contains(className)) {
+                            JSObject classInfo = new JSObject();
+                            classInfo.put("type", className);
+                            classes.put(classInfo);
                         }
-                        return classes;
                     }
+                    return classes;
                 }
             } catch (Exception e) {
                 Log.w(TAG, "C++ getClasses failed, fallback to Java", e);
@@ -469,7 +564,7 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.listMethods(session.dexBytes, className);
+                String jsonResult = CppDex.listMethodsByHandle(session.nativeHandle(), className);
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     org.json.JSONArray cppMethods = cppResult.optJSONArray("methods");
@@ -571,7 +666,7 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.getMethodSmali(session.dexBytes, className, methodName, methodSignature);
+                String jsonResult = CppDex.getMethodSmaliByHandle(session.nativeHandle(), className, methodName, methodSignature);
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     String smali = cppResult.optString("smali", "");
@@ -689,7 +784,7 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.listFields(session.dexBytes, className);
+                String jsonResult = CppDex.listFieldsByHandle(session.nativeHandle(), className);
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     org.json.JSONArray cppFields = cppResult.optJSONArray("fields");
@@ -811,7 +906,7 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.getClassSmali(session.dexBytes, className);
+                String jsonResult = CppDex.getClassSmaliByHandle(session.nativeHandle(), className);
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     String smali = cppResult.optString("smali", "");
@@ -893,6 +988,107 @@ public class DexManager {
         Log.d(TAG, "Disassembled to: " + outputDir);
     }
 
+    // 批量导出取消标志，由 cancelExportSmali 设置
+    private volatile boolean exportSmaliCancelled = false;
+
+    /**
+     * 使用 C++ 并行导出多 DEX 会话的 Smali
+     * 指定 dexName 时直接导出到 outputPath；否则每个 DEX 按 apktool 布局导出到
+     * outputPath/smali、outputPath/smali_classes2 ...（zip 为 true 时为同名 .zip 文件）
+     */
+    public JSObject exportSmaliFromMultiSession(String sessionId, String dexName, String outputPath, boolean zip)
+            throws Exception {
+        MultiDexSession session = multiDexSessions.get(sessionId);
+        if (session == null) {
+            throw new IllegalArgumentException("Session not found: " + sessionId);
+        }
+        if (!CppDex.isAvailable() || session.dexBytes.isEmpty()) {
+            throw new RuntimeException("C++ DEX library not available");
+        }
+        
+        List<String> dexNames = new ArrayList<>();
+        if (dexName != null && !dexName.isEmpty()) {
+            if (!session.dexBytes.containsKey(dexName)) {
+                throw new IllegalArgumentException("DEX not found: " + dexName);
+            }
+            dexNames.add(dexName);
+        } else {
+            dexNames.addAll(session.dexBytes.keySet());
+            java.util.Collections.sort(dexNames, (a, b) -> Integer.compare(dexIndex(a), dexIndex(b)));
+        }
+        
+        exportSmaliCancelled = false;
+        JSArray exported = new JSArray();
+        int totalClasses = 0;
+        boolean cancelled = false;
+        
+        for (String name : dexNames) {
+            String target = outputPath;
+            if (dexName == null || dexName.isEmpty()) {
+                target = new File(outputPath, smaliDirName(name) + (zip ? ".zip" : "")).getPath();
+            }
+            reportTitle("导出 Smali: " + name);
+            
+            String jsonResult = CppDex.exportSmaliByHandle(session.nativeHandle(name), target, zip,
+                (done, total) -> {
+                    reportProgress(done, total);
+                    return !exportSmaliCancelled;
+                });
+            org.json.JSONObject stats = new org.json.JSONObject(jsonResult);
+            if (stats.has("error")) {
+                throw new RuntimeException(name + ": " + stats.getString("error"));
+            }
+            
+            JSObject item = new JSObject();
+            item.put("dexFile", name);
+            item.put("path", target);
+            item.put("classes", stats.optInt("classes", 0));
+            item.put("skipped", stats.optInt("skipped", 0));
+            exported.put(item);
+            totalClasses += stats.optInt("classes", 0);
+            
+            if (stats.optBoolean("cancelled", false)) {
+                cancelled = true;
+                break;
+            }
+        }
+        
+        JSObject result = new JSObject();
+        result.put("dexFiles", exported);
+        result.put("totalClasses", totalClasses);
+        result.put("cancelled", cancelled);
+        return result;
+    }
+
+    /**
+     * 取消正在进行的 Smali 批量导出（当前批次完成后停止）
+     */
+    public void cancelExportSmali() {
+        exportSmaliCancelled = true;
+    }
+
+    // classes.dex -> smali, classes2.dex -> smali_classes2, 其他 -> smali_<名称>
+    private static String smaliDirName(String dexName) {
+        int index = dexIndex(dexName);
+        if (index == 1) return "smali";
+        String base = new File(dexName).getName();
+        if (base.endsWith(".dex")) base = base.substring(0, base.length() - 4);
+        return "smali_" + base;
+    }
+
+    // classes.dex -> 1, classes2.dex -> 2；无法识别的名称排在最后
+    private static int dexIndex(String dexName) {
+        String base = new File(dexName).getName();
+        if (base.equals("classes.dex")) return 1;
+        if (base.startsWith("classes") && base.endsWith(".dex")) {
+            try {
+                return Integer.parseInt(base.substring(7, base.length() - 4));
+            } catch (NumberFormatException ignored) {
+            }
+        }
+        return Integer.MAX_VALUE;
+    }
+
     /**
      * 汇编 Smali 目录为 DEX
      */
@@ -932,10 +1128,12 @@ public class DexManager {
                                 boolean regex, boolean caseSensitive) throws Exception {
         DexSession session = getSession(sessionId);
         
-        // 优先使用 C++ 实现
-        if (CppDex.isAvailable() && session.dexBytes != null && !regex) {
+        // 优先使用 C++ 实现（正则表达式不受支持时返回 error，回退到 Java）
+        if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.searchInDex(session.dexBytes, query, "string", caseSensitive, 1000);
+                String jsonResult = regex
+                    ? CppDex.regexSearchInDexByHandle(session.nativeHandle(), query, "string", caseSensitive, 1000)
+                    : CppDex.searchInDexByHandle(session.nativeHandle(), query, "string", caseSensitive, 1000);
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     org.json.JSONArray cppResults = cppResult.optJSONArray("results");
@@ -1013,7 +1211,7 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.searchInDex(session.dexBytes, query, "method", false, 1000);
+                String jsonResult = CppDex.searchInDexByHandle(session.nativeHandle(), query, "method", false, 1000);
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     org.json.JSONArray cppResults = cppResult.optJSONArray("results");
@@ -1062,7 +1260,7 @@ public class DexManager {
         // 优先使用 C++ 实现
         if (CppDex.isAvailable() && session.dexBytes != null) {
             try {
-                String jsonResult = CppDex.searchInDex(session.dexBytes, query, "field", false, 1000);
+                String jsonResult = CppDex.searchInDexByHandle(session.nativeHandle(), query, "field", false, 1000);
                 if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                     org.json.JSONObject cppResult = new org.json.JSONObject(jsonResult);
                     org.json.JSONArray cppResults = cppResult.optJSONArray("results");
@@ -1114,7 +1312,7 @@ public class DexManager {
             throw new UnsupportedOperationException("C++ library not available for xref analysis");
         }
         
-        String jsonResult = CppDex.findMethodXrefs(session.dexBytes, className, methodName);
+        String jsonResult = CppDex.findMethodXrefsByHandle(session.nativeHandle(), className, methodName);
         if (jsonResult == null || jsonResult.contains("\"error\"")) {
             throw new Exception("Failed to find method xrefs");
         }
@@ -1151,7 +1349,7 @@ public class DexManager {
             throw new UnsupportedOperationException("C++ library not available for xref analysis");
         }
         
-        String jsonResult = CppDex.findFieldXrefs(session.dexBytes, className, fieldName);
+        String jsonResult = CppDex.findFieldXrefsByHandle(session.nativeHandle(), className, fieldName);
         if (jsonResult == null || jsonResult.contains("\"error\"")) {
             throw new Exception("Failed to find field xrefs");
         }
@@ -1178,6 +1376,65 @@ public class DexManager {
         return result;
     }
 
+    /**
+     * 查找字符串的交叉引用（使用 C++ 实现）
+     */
+    public JSObject findStringXrefs(String sessionId, String value) throws Exception {
+        DexSession session = getSession(sessionId);
+        
+        if (!CppDex.isAvailable() || session.dexBytes == null) {
+            throw new UnsupportedOperationException("C++ library not available for xref analysis");
+        }
+        
+        String jsonResult = CppDex.findStringXrefsByHandle(session.nativeHandle(), value);
+        if (jsonResult == null || jsonResult.contains("\"error\"")) {
+            throw new Exception("Failed to find string xrefs");
+        }
+        
+        JSObject result = xrefsToJS(new org.json.JSONObject(jsonResult));
+        result.put("string", value);
+        return result;
+    }
+
+    /**
+     * 查找类型的交叉引用（使用 C++ 实现）
+     */
+    public JSObject findTypeXrefs(String sessionId, String className) throws Exception {
+        DexSession session = getSession(sessionId);
+        
+        if (!CppDex.isAvailable() || session.dexBytes == null) {
+            throw new UnsupportedOperationException("C++ library not available for xref analysis");
+        }
+        
+        String jsonResult = CppDex.findTypeXrefsByHandle(session.nativeHandle(), className);
+        if (jsonResult == null || jsonResult.contains("\"error\"")) {
+            throw new Exception("Failed to find type xrefs");
+        }
+        
+        JSObject result = xrefsToJS(new org.json.JSONObject(jsonResult));
+        result.put("className", className);
+        return result;
+    }
+
+    private JSObject xrefsToJS(org.json.JSONObject cppResult) throws Exception {
+        JSObject result = new JSObject();
+        org.json.JSONArray xrefs = cppResult.optJSONArray("xrefs");
+        JSArray xrefArray = new JSArray();
+        if (xrefs != null) {
+            for (int i = 0; i < xrefs.length(); i++) {
+                org.json.JSONObject x = xrefs.getJSONObject(i);
+                JSObject xref = new JSObject();
+                xref.put("callerClass", x.optString("callerClass"));
+                xref.put("callerMethod", x.optString("callerMethod"));
+                xref.put("offset", x.optInt("offset"));
+                xrefArray.put(xref);
+            }
+        }
+        result.put("xrefs", xrefArray);
+        result.put("count", xrefArray.length());
+        return result;
+    }
+
     // ==================== Smali 转 Java（C++ 实现）====================
 
     /**
@@ -1190,7 +1447,7 @@ public class DexManager {
             throw new UnsupportedOperationException("C++ library not available for smali to java conversion");
         }
         
-        String jsonResult = CppDex.smaliToJava(session.dexBytes, className);
+        String jsonResult = CppDex.smaliToJavaByHandle(session.nativeHandle(), className);
         if (jsonResult == null || jsonResult.contains("\"error\"")) {
             throw new Exception("Failed to convert smali to java");
         }
@@ -1464,7 +1721,11 @@ public class DexManager {
             if (end == -1) break;
             
             String methodBlock = classSmali.substring(start, end + methodEnd.length());
-            if (methodBlock.contains(methodName)) {
+            // 按方法头匹配名称和签名，避免重载方法取到第一个同名方法
+            int lineEnd = methodBlock.indexOf('\n');
+            String header = lineEnd >= 0 ? methodBlock.substring(0, lineEnd) : methodBlock;
+            String expected = signature != null && signature.startsWith("(") ? methodName + signature : methodName;
+            if (header.contains(" " + expected)) {
                 return methodBlock;
             }
             
@@ -2015,7 +2276,10 @@ public class DexManager {
      * 关闭多 DEX 会话
      */
     public void closeMultiDexSession(String sessionId) {
-        multiDexSessions.remove(sessionId);
+        MultiDexSession session = multiDexSessions.remove(sessionId);
+        if (session != null) {
+            session.closeNative();
+        }
         Log.d(TAG, "Closed multi-dex session: " + sessionId);
     }
 
@@ -2034,51 +2298,106 @@ public class DexManager {
         
         JSObject result = new JSObject();
         JSArray classes = new JSArray();
-        List<String> allClasses = new ArrayList<>();
         String filter = packageFilter != null ? packageFilter : "";
         
-        // 使用 Rust 获取每个 DEX 的类列表
-        for (Map.Entry<String, byte[]> entry : session.dexBytes.entrySet()) {
-            String dexName = entry.getKey();
-            byte[] dexData = entry.getValue();
-            
-            String jsonResult = CppDex.listClasses(dexData, filter, 0, 100000);
-            if (jsonResult != null && !jsonResult.contains("\"error\"")) {
-                org.json.JSONObject rustResult = new org.json.JSONObject(jsonResult);
-                org.json.JSONArray rustClasses = rustResult.optJSONArray("classes");
-                if (rustClasses != null) {
-                    for (int i = 0; i < rustClasses.length(); i++) {
-                        allClasses.add(rustClasses.getString(i) + "|" + dexName);
-                    }
-                }
+        // 过滤和排序只在游标创建时执行一次，翻页只读取当前页
+        List<String> dexNames;
+        DexBinaryResult page;
+        synchronized (session) {
+            long cursor = session.classCursor(filter);
+            if (cursor == 0) {
+                throw new RuntimeException("Failed to open class cursor");
             }
+            dexNames = session.classCursorDexNames;
+            page = DexBinaryResult.decodeAndFree(CppDex.getCursorPageBinary(cursor, offset, limit));
+        }
+        if (page == null) {
+            throw new RuntimeException("Failed to read class cursor");
         }
         
-        // 排序
-        java.util.Collections.sort(allClasses);
-        
-        // 分页
-        int total = allClasses.size();
-        int end = Math.min(offset + limit, total);
-        
-        for (int i = offset; i < end; i++) {
-            String[] parts = allClasses.get(i).split("\\|");
+        for (int i = 0; i < page.getRowCount(); i++) {
             JSObject classInfo = new JSObject();
-            classInfo.put("className", parts[0]);
-            classInfo.put("dexFile", parts[1]);
+            classInfo.put("className", page.getString(i, 0));
+            classInfo.put("dexFile", dexNames.get(page.getInt(i, 1)));
             classes.put(classInfo);
         }
         
-        result.put("total", total);
+        result.put("total", page.getMeta("total", 0));
         result.put("offset", offset);
         result.put("limit", limit);
         result.put("classes", classes);
-        result.put("hasMore", end < total);
+        result.put("hasMore", page.getMeta("next", -1) >= 0);
         result.put("engine", "rust");
         
         return result;
     }
 
+    /**
+     * 获取多 DEX 会话中包树的一层，各 DEX 的同名子包合并计数
+     */
+    public JSObject getPackageLevelFromMultiSession(String sessionId, String packagePath) throws Exception {
+        MultiDexSession session = multiDexSessions.get(sessionId);
+        if (session == null) {
+            throw new IllegalArgumentException("Session not found: " + sessionId);
+        }
+        
+        if (!CppDex.isAvailable() || session.dexBytes.isEmpty()) {
+            throw new RuntimeException("C++ DEX library not available");
+        }
+        
+        String path = packagePath != null ? packagePath : "";
+        Map<String, int[]> packageCounts = new java.util.TreeMap<>();  // name -> {classCount, packageCount}
+        JSArray classes = new JSArray();
+        int totalClasses = 0;
+        
+        for (String dexName : new ArrayList<>(session.dexBytes.keySet())) {
+            String jsonResult = CppDex.getPackageLevelByHandle(session.nativeHandle(dexName), path);
+            if (jsonResult == null || jsonResult.contains("\"error\"")) continue;
+            
+            org.json.JSONObject level = new org.json.JSONObject(jsonResult);
+            org.json.JSONArray packages = level.optJSONArray("packages");
+            if (packages != null) {
+                for (int i = 0; i < packages.length(); i++) {
+                    org.json.JSONObject pkg = packages.getJSONObject(i);
+                    int[] counts = packageCounts.get(pkg.getString("name"));
+                    if (counts == null) {
+                        counts = new int[2];
+                        packageCounts.put(pkg.getString("name"), counts);
+                    }
+                    counts[0] += pkg.optInt("classCount", 0);
+                    // 同名子包在不同 DEX 中的下级包可能重叠，这里取最大值作为近似
+                    counts[1] = Math.max(counts[1], pkg.optInt("packageCount", 0));
+                }
+            }
+            org.json.JSONArray levelClasses = level.optJSONArray("classes");
+            if (levelClasses != null) {
+                for (int i = 0; i < levelClasses.length(); i++) {
+                    JSObject classInfo = new JSObject();
+                    classInfo.put("className", levelClasses.getString(i));
+                    classInfo.put("dexFile", dexName);
+                    classes.put(classInfo);
+                }
+            }
+            totalClasses += level.optInt("totalClasses", 0);
+        }
+        
+        JSArray packages = new JSArray();
+        for (Map.Entry<String, int[]> entry : packageCounts.entrySet()) {
+            JSObject pkg = new JSObject();
+            pkg.put("name", entry.getKey());
+            pkg.put("classCount", entry.getValue()[0]);
+            pkg.put("packageCount", entry.getValue()[1]);
+            packages.put(pkg);
+        }
+        
+        JSObject result = new JSObject();
+        result.put("package", path);
+        result.put("packages", packages);
+        result.put("classes", classes);
+        result.put("totalClasses", totalClasses);
+        return result;
+    }
+
     /**
      * 在多 DEX 会话中搜索（Rust 实现）
      */
@@ -2102,9 +2421,8 @@ public class DexManager {
         
         for (Map.Entry<String, byte[]> entry : session.dexBytes.entrySet()) {
             String dexName = entry.getKey();
-            byte[] dexData = entry.getValue();
             
-            String jsonResult = CppDex.searchInDex(dexData, query, searchType, caseSensitive, maxResults);
+            String jsonResult = CppDex.searchInDexByHandle(session.nativeHandle(dexName), query, searchType, caseSensitive, maxResults);
             
             if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                 org.json.JSONObject rustResult = new org.json.JSONObject(jsonResult);
@@ -2174,9 +2492,8 @@ public class DexManager {
         // 使用 Rust 获取 Smali
         for (Map.Entry<String, byte[]> entry : session.dexBytes.entrySet()) {
             String dexName = entry.getKey();
-            byte[] dexData = entry.getValue();
             
-            String jsonResult = CppDex.getClassSmali(dexData, className);
+            String jsonResult = CppDex.getClassSmaliByHandle(session.nativeHandle(dexName), className);
             if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                 org.json.JSONObject rustResult = new org.json.JSONObject(jsonResult);
                 JSObject result = new JSObject();
@@ -2207,7 +2524,7 @@ public class DexManager {
         // 找到类所在的 DEX
         String targetDex = null;
         for (Map.Entry<String, byte[]> entry : session.dexBytes.entrySet()) {
-            String jsonResult = CppDex.getClassSmali(entry.getValue(), className);
+            String jsonResult = CppDex.getClassSmaliByHandle(session.nativeHandle(entry.getKey()), className);
             if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                 targetDex = entry.getKey();
                 break;
@@ -2227,7 +2544,7 @@ public class DexManager {
         }
         
         // 更新 DEX 字节数据
-        session.dexBytes.put(targetDex, modifiedDex);
+        session.updateDex(targetDex, modifiedDex);
         session.modified = true;
         
         Log.d(TAG, "Modified class in session (Rust): " + className);
@@ -2261,7 +2578,7 @@ public class DexManager {
         }
         
         // 更新 DEX 字节数据
-        session.dexBytes.put(targetDex, modifiedDex);
+        session.updateDex(targetDex, modifiedDex);
         session.modified = true;
         
         Log.d(TAG, "Added class to session (Rust): " + className);
@@ -2283,7 +2600,7 @@ public class DexManager {
         // 找到类所在的 DEX
         String targetDex = null;
         for (Map.Entry<String, byte[]> entry : session.dexBytes.entrySet()) {
-            String jsonResult = CppDex.getClassSmali(entry.getValue(), className);
+            String jsonResult = CppDex.getClassSmaliByHandle(session.nativeHandle(entry.getKey()), className);
             if (jsonResult != null && !jsonResult.contains("\"error\"")) {
                 targetDex = entry.getKey();
                 break;
@@ -2303,7 +2620,7 @@ public class DexManager {
         }
         
         // 更新 DEX 字节数据
-        session.dexBytes.put(targetDex, modifiedDex);
+        session.updateDex(targetDex, modifiedDex);
         session.modified = true;
         
         Log.d(TAG, "Deleted class from session (Rust): " + className);
@@ -0,0 +1,370 @@
+// Host-side round trip of the DEX editor: Smali -> DEX -> Smali, through both a DEX built from scratch
+// and edits on top of a loaded one. Exits non-zero if any check fails.
+
+#include "dex/dex_builder.h"
+#include "dex/dex_session.h"
+#include "dex/smali_parser.h"
+#include "dex/string_table.h"
+#include "apk/zip_utils.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (condition) return;
+    std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+    failures++;
+}
+
+// Covers annotations, static values, debug info, switch and array payloads, try/catch, wide and
+// range invokes, and a non-ASCII string with a supplementary character
+const char* const kFoo = R"(.class public Lcom/example/Foo;
+.super Ljava/lang/Object;
+.source "Foo.java"
+
+.annotation runtime Ljava/lang/Deprecated;
+.end annotation
+
+.field public static COUNT:I = 0x2a
+    .annotation runtime Ljava/lang/Deprecated;
+    .end annotation
+.end field
+.field private name:Ljava/lang/String;
+
+.method public constructor <init>()V
+    .registers 1
+    .prologue
+    .line 10
+    invoke-direct {v0}, Ljava/lang/Object;-><init>()V
+    return-void
+.end method
+
+.method public static add(II)I
+    .registers 3
+    .param v1, "a"    # I
+        .annotation runtime Ljava/lang/Deprecated;
+        .end annotation
+    .end param
+    .param v2, "b"    # I
+    .line 20
+    add-int v0, v1, v2
+    .line 21
+    return v0
+.end method
+
+.method public static add(JJ)J
+    .registers 6
+    add-long v0, v2, v4
+    return-wide v0
+.end method
+
+.method public run(I)V
+    .registers 8
+    .prologue
+    packed-switch v5, :pswitch_data_0
+    .line 35
+    sparse-switch v5, :sswitch_data_0
+    :pswitch_0
+    :sswitch_0
+    const/4 v0, #int 3
+    new-array v0, v0, [I
+    fill-array-data v0, :array_0
+    const-string v1, "h\u00e9llo \ud83d\ude00 world"
+    iput-object v1, v4, Lcom/example/Foo;->name:Ljava/lang/String;
+    sget v2, Lcom/example/Foo;->COUNT:I
+    :try_start_0
+    invoke-virtual {v4}, Lcom/example/Bar;->hello()V
+    invoke-static {v2, v2}, Lcom/example/Foo;->add(II)I
+    :try_end_0
+    .catch Ljava/lang/Exception; {:try_start_0 .. :try_end_0} :catch_0
+    if-eqz v2, :cond_0
+    goto :goto_0
+    :catch_0
+    move-exception v3
+    new-instance v3, Lcom/example/Foo;
+    invoke-direct {v3}, Lcom/example/Foo;-><init>()V
+    :cond_0
+    :goto_0
+    :pswitch_1
+    :sswitch_1
+    return-void
+    nop
+    :pswitch_data_0
+    .packed-switch 0x0
+        :pswitch_1
+        :pswitch_0
+    .end packed-switch
+    :sswitch_data_0
+    .sparse-switch
+        0x5 -> :sswitch_1
+        0x64 -> :sswitch_0
+    .end sparse-switch
+    :array_0
+    .array-data 4
+        0x1
+        0x2
+        0x3
+    .end array-data
+.end method
+)";
+
+const char* const kBar = R"(.class public Lcom/example/Bar;
+.super Ljava/lang/Object;
+
+.method public constructor <init>()V
+    .registers 1
+    invoke-direct {v0}, Ljava/lang/Object;-><init>()V
+    return-void
+.end method
+
+.method public hello()V
+    .registers 4
+    const-string v0, "tag"
+    invoke-static {v1, v1}, Lcom/example/Foo;->add(II)I
+    move-result v0
+    sput v0, Lcom/example/Foo;->COUNT:I
+    invoke-static/range {v0 .. v3}, Lcom/example/Foo;->add(JJ)J
+    return-void
+.end method
+)";
+
+const char* const kBaz = R"(.class public Lcom/example/sub/Baz;
+.super Lcom/example/Bar;
+
+.implements Ljava/lang/Runnable;
+
+.method public constructor <init>()V
+    .registers 1
+    invoke-direct {v0}, Lcom/example/Bar;-><init>()V
+    return-void
+.end method
+
+.method public run()V
+    .registers 1
+    return-void
+.end method
+)";
+
+// Its ids sort ahead of every id of the classes above, so adding it shifts all of them
+const char* const kAdded = R"(.class public La/Added;
+.super Lcom/example/Bar;
+.source "Added.java"
+
+.field public static FIRST:La/Added;
+
+.method public static aaa(La/Added;)V
+    .registers 2
+    .line 1
+    const-string v0, "Aardvark \u00e9"
+    sget-object v0, La/Added;->FIRST:La/Added;
+    invoke-static {v0, v0}, Lcom/example/Foo;->add(II)I
+    return-void
+.end method
+)";
+
+bool assemble(dex::DexBuilder& builder, const char* smali) {
+    dex::SmaliParser parser(builder);
+    std::string error;
+    bool ok = parser.parse(smali, error);
+    check(ok, "assemble: " + error);
+    return ok;
+}
+
+std::string disassemble(const std::vector<uint8_t>& dex, const std::string& class_name) {
+    dex::DexSession session;
+    std::string smali;
+    if (!session.open(std::vector<uint8_t>(dex)) || !session.class_smali(class_name, smali, true)) return "";
+    return smali;
+}
+
+// string_ids, type_ids, proto_ids, field_ids and method_ids in the order the format requires,
+// and a checksum matching the contents
+void check_ids_sorted(const std::vector<uint8_t>& dex, const std::string& label) {
+    dex::DexParser parser;
+    if (!parser.parse(dex)) {
+        check(false, label + ": parse");
+        return;
+    }
+    const dex::DexHeader& header = parser.header();
+    check(header.checksum == apk::adler32(dex.data() + 12, dex.size() - 12), label + ": checksum");
+
+    for (uint32_t i = 1; i < header.string_ids_size; i++) {
+        if (dex::compare_utf16(parser.string_table().raw(i - 1), parser.string_table().raw(i)) >= 0) {
+            check(false, label + ": string_ids unsorted at " + std::to_string(i));
+            break;
+        }
+    }
+    for (uint32_t i = 1; i < header.type_ids_size; i++) {
+        if (dex::compare_utf16(parser.type_descriptor(i - 1), parser.type_descriptor(i)) >= 0) {
+            check(false, label + ": type_ids unsorted at " + std::to_string(i));
+            break;
+        }
+    }
+    auto proto_key = [&](uint32_t idx) {
+        dex::ProtoId proto;
+        std::vector<uint32_t> key;
+        if (!parser.proto_id(idx, proto)) return key;
+        key.push_back(proto.return_type_idx);
+        for (uint32_t i = 0; i < proto.param_count; i++) key.push_back(proto.param(i));
+        return key;
+    };
+    for (uint32_t i = 1; i < header.proto_ids_size; i++) {
+        if (!(proto_key(i - 1) < proto_key(i))) {
+            check(false, label + ": proto_ids unsorted at " + std::to_string(i));
+            break;
+        }
+    }
+    auto member_key = [&](bool method, uint32_t idx) {
+        dex::MemberId id;
+        if (!(method ? parser.method_id(idx, id) : parser.field_id(idx, id))) return std::vector<uint32_t>();
+        return std::vector<uint32_t>{id.class_idx, id.name_idx, id.type_idx};
+    };
+    for (bool method : {false, true}) {
+        uint32_t count = method ? header.method_ids_size : header.field_ids_size;
+        for (uint32_t i = 1; i < count; i++) {
+            if (!(member_key(method, i - 1) < member_key(method, i))) {
+                check(false, label + (method ? ": method_ids" : ": field_ids") + " unsorted at " + std::to_string(i));
+                break;
+            }
+        }
+    }
+}
+
+const char* const kBaseClasses[] = {"Lcom/example/Foo;", "Lcom/example/Bar;", "Lcom/example/sub/Baz;"};
+
+std::vector<uint8_t> build_base() {
+    dex::DexBuilder builder;
+    for (const char* smali : {kFoo, kBar, kBaz}) assemble(builder, smali);
+    std::vector<uint8_t> dex = builder.build();
+    check(!dex.empty(), "build from scratch");
+    check_ids_sorted(dex, "from scratch");
+    return dex;
+}
+
+// Every class disassembled, reassembled into the loaded DEX and disassembled again is unchanged
+void test_round_trip(const std::vector<uint8_t>& base) {
+    dex::DexBuilder builder;
+    check(builder.load(base), "load base");
+    std::vector<std::string> before;
+    for (const char* name : kBaseClasses) {
+        before.push_back(disassemble(base, name));
+        check(!before.back().empty(), std::string("disassemble ") + name);
+        assemble(builder, before.back().c_str());
+    }
+    std::vector<uint8_t> rebuilt = builder.build();
+    check(!rebuilt.empty(), "rebuild");
+    check_ids_sorted(rebuilt, "round trip");
+    for (size_t i = 0; i < before.size(); i++) {
+        check(disassemble(rebuilt, kBaseClasses[i]) == before[i], std::string("round trip of ") + kBaseClasses[i]);
+    }
+}
+
+// A class with new ids lands in sorted position; base classes keep their meaning
+void test_add_class(const std::vector<uint8_t>& base) {
+    dex::DexBuilder builder;
+    check(builder.load(base), "load base");
+    assemble(builder, kAdded);
+    std::vector<uint8_t> out = builder.build();
+    check(!out.empty(), "build with added class");
+    check_ids_sorted(out, "add class");
+    for (const char* name : kBaseClasses) {
+        check(disassemble(out, name) == disassemble(base, name), std::string("base class after add: ") + name);
+    }
+
+    std::string added = disassemble(out, "La/Added;");
+    check(added.find("const-string v0, \"Aardvark \xc3\xa9\"") != std::string::npos, "added string");
+    check(added.find("invoke-static {v0, v0}, Lcom/example/Foo;->add(II)I") != std::string::npos, "added invoke");
+
+    // The builder still holds the base ids, so building again gives the same DEX
+    check(builder.build() == out, "second build");
+}
+
+// const-string/jumbo and padding nops only appear when string ids pass 16 bits
+std::string without_widening(const std::string& smali) {
+    std::string out;
+    size_t pos = 0;
+    while (pos < smali.size()) {
+        size_t end = smali.find('\n', pos);
+        if (end == std::string::npos) end = smali.size();
+        std::string line = smali.substr(pos, end - pos);
+        pos = end + 1;
+        if (line == "    nop") continue;
+        size_t jumbo = line.find("const-string/jumbo");
+        if (jumbo != std::string::npos) line.replace(jumbo, 18, "const-string");
+        out += line + "\n";
+    }
+    return out;
+}
+
+// Filler strings push the method's strings to the 16-bit boundary; adding a class whose strings
+// sort first shifts them past it, so const-string widens and branches, the switch, try range and
+// line table move with it
+void test_jumbo_strings() {
+    std::string smali = ".class public Lt/Big;\n.super Ljava/lang/Object;\n\n"
+                        ".method public static run(I)Ljava/lang/String;\n    .registers 3\n"
+                        "    packed-switch v2, :pswitch_data_0\n    :try_start_0\n";
+    for (int i = 65500; i < 65540; i++) {
+        char line[96];
+        std::snprintf(line, sizeof(line), "    .line %d\n    const-string v0, \"f%05d\"\n    if-eqz v2, :cond_0\n",
+                      i - 65499, i);
+        smali += line;
+    }
+    smali += "    :try_end_0\n    .catch Ljava/lang/Exception; {:try_start_0 .. :try_end_0} :catch_0\n"
+             "    :cond_0\n    :pswitch_0\n    return-object v0\n"
+             "    :catch_0\n    move-exception v1\n    goto :cond_0\n"
+             "    :pswitch_data_0\n    .packed-switch 0x0\n        :pswitch_0\n        :cond_0\n    .end packed-switch\n"
+             ".end method\n";
+
+    dex::DexBuilder builder;
+    for (int i = 0; i < 65540; i++) {
+        char filler[8];
+        std::snprintf(filler, sizeof(filler), "f%05d", i);
+        builder.get_or_add_string(filler);
+    }
+    assemble(builder, smali.c_str());
+    std::string error;
+    std::vector<uint8_t> base = builder.build(error);
+    check(!base.empty(), "build with 64K strings: " + error);
+    std::string before = without_widening(disassemble(base, "Lt/Big;"));
+    check(!before.empty(), "disassemble Lt/Big;");
+
+    dex::DexBuilder loaded;
+    check(loaded.load(base), "load 64K strings");
+    assemble(loaded, kAdded);
+    std::vector<uint8_t> out = loaded.build(error);
+    check(!out.empty(), "add class to 64K strings: " + error);
+    check_ids_sorted(out, "jumbo");
+    std::string after = disassemble(out, "Lt/Big;");
+    check(after.find("const-string/jumbo") != std::string::npos, "const-string widened");
+    check(without_widening(after) == before, "Lt/Big; after widening");
+
+    // Reassembled from Smali, where each index is provisional until build() sorts the pools
+    dex::DexBuilder edited;
+    check(edited.load(base), "load 64K strings");
+    assemble(edited, before.c_str());
+    assemble(edited, kAdded);
+    std::vector<uint8_t> modified = edited.build(error);
+    check(!modified.empty(), "modify class in 64K strings: " + error);
+    check(disassemble(modified, "Lt/Big;") == after, "Lt/Big; after modify");
+}
+
+} // namespace
+
+int main() {
+    std::vector<uint8_t> base = build_base();
+    if (failures == 0) {
+        test_round_trip(base);
+        test_add_class(base);
+        test_jumbo_strings();
+    }
+    if (failures != 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("dex_round_trip_test passed\n");
+    return 0;
+}